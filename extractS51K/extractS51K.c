@@ -1,302 +1,435 @@
 /*
-   This program extracts files from S51K filesystem (big-endian).
+   This program extracts files from S51K filesystem.
    Written by Alexander V. Lukyanov using parts of linux kernel (Dec 1999).
    This code is covered by GNU GPL.
+
+   The image is read through the s51k library (s51k.c). With -i the
+   index of the image is kept in a file, built on first use; listing
+   (-l), extracting a single file to stdout (-c) and checking (--check)
+   then need no walk of the image.
+
+   Regular files are extracted by a pool of worker threads (-j N). Each
+   gets the file's block extents and writes them with pwritev(), one
+   call per run of logically consecutive blocks. Holes are left as
+   holes. --stats reports the throughput at the end.
+
+   Build: cc -O2 -o extractS51K extractS51K.c s51k.c -lpthread
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
-#include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <sys/types.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <utime.h>
+#include "s51k.h"
 
-typedef int s32;
-typedef unsigned u32;
-typedef unsigned short u16;
-typedef short s16;
-typedef u16 sysv_ino_t;
-
-#ifdef __GNUC__
-#define __packed2__  __attribute__ ((packed, aligned(2)))
-#else
-#error I want gcc!
-#endif
-
-/* Among the inodes ... */
-/* 0 is non-existent */
-#define SYSV_BADBL_INO  1       /* inode of bad blocks file */
-#define SYSV_ROOT_INO   2       /* inode of root directory */
-        
-#define SYSV_NICINOD    100     /* number of inode cache entries */
-#define SYSV_NICFREE    50      /* number of free block list chunk entries */
-
-/* SystemV2 super-block data on disk */
-struct sysv2_super_block {
-        u16     s_isize;                /* index of first data zone */
-        u32     s_fsize __packed2__;    /* total number of zones of this fs */
-        /* the start of the free block list: */
-        u16     s_nfree;                /* number of free blocks in s_free, <= SYSV_NICFREE */
-        u32     s_free[SYSV_NICFREE];   /* first free block list chunk */
-        /* the cache of free inodes: */
-        u16     s_ninode;               /* number of free inodes in s_inode, <= SYSV_NICINOD */
-        sysv_ino_t     s_inode[SYSV_NICINOD]; /* some free inodes */
-        /* locks, not used by Linux: */
-        char    s_flock;                /* lock during free block list manipulation */
-        char    s_ilock;                /* lock during inode cache manipulation */
-        char    s_fmod;                 /* super-block modified flag */
-        char    s_ronly;                /* flag whether fs is mounted read-only */
-        u32     s_time __packed2__;     /* time of last super block update */
-        s16     s_dinfo[4];             /* device information ?? */
-        u32     s_tfree __packed2__;    /* total number of free zones */
-        u16     s_tinode;               /* total number of free inodes */
-        char    s_fname[6];             /* file system volume name */
-        char    s_fpack[6];             /* file system pack name */
-        s32     s_fill[14];
-        s32     s_state;                /* file system state: 0xcb096f43 means clean */
-        s32     s_magic;                /* version of file system */
-        s32     s_type;                 /* type of file system: 1 for 512 byte blocks
-                                                                2 for 1024 byte blocks */
-};
-
-/* SystemV/Coherent inode data on disk */
-
-struct sysv_inode {
-        u16 i_mode;
-        u16 i_nlink;
-        u16 i_uid;
-        u16 i_gid;
-        u32 i_size;
-        union { /* directories, regular files, ... */
-                unsigned char i_addb[3*(10+1+1+1)+1]; /* zone numbers: max. 10 data blocks,
-                                              * then 1 indirection block,
-                                              * then 1 double indirection block,
-                                              * then 1 triple indirection block.
-                                              * Then maybe a "file generation number" ??
-                                              */
-                /* devices */
-                u16 i_rdev;
-                /* named pipes on Coherent */
-                struct {
-                        char p_addp[30];
-                        s16 p_pnc;
-                        s16 p_prx;
-                        s16 p_pwx;
-                } i_p;
-        } i_a;
-        u32 i_atime;    /* time of last access */  
-        u32 i_mtime;    /* time of last modification */
-        u32 i_ctime;    /* time of creation */
-};
-
-/* SystemV/Coherent directory entry on disk */
+#define		MAXIOV	64	/* iovecs per pwritev() */
 
-#define SYSV_NAMELEN    14      /* max size of name in struct sysv_dir_entry */
+struct s51k *fs;
 
-struct sysv_dir_entry {
-        sysv_ino_t inode;
-        char name[SYSV_NAMELEN]; /* up to 14 characters, the rest are zeroes */
+/* Regular files waiting for a worker */
+struct job
+{
+	int ino;
+	char *path;
+	struct job *next;
 };
 
+struct worker
+{
+	pthread_t thread;
+	long files;
+	long long bytes;
+};
 
-#define		BSIZE	1024
-#define		INOPB	(BSIZE/sizeof(struct sysv_inode))
+struct job *job_head,*job_tail;
+int walk_done;
+pthread_mutex_t job_lock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t job_cond=PTHREAD_COND_INITIALIZER;
 
-char *used_inodes[65536];
+int nthreads=1;
+struct worker *workers;
+mode_t cmask;
 
-void create_inode(struct sysv_inode *i,const char *path);
-void process_directory(struct sysv_inode *i,const char *path);
-struct sysv_inode *get_inode(int n);
-u16 fs2host16(u16);
-u32 fs2host32(u32);
+int extract_fn(void *arg,int what,const char *path,int ino,const char *first);
+int list_fn(void *arg,const char *path,int ino);
+int list_walk_fn(void *arg,int what,const char *path,int ino,const char *first);
+int cat_file(const char *path);
+void *worker_main(void *arg);
 
-char *map;
-int offset;
+void usage(const char *prog)
+{
+	printf("Usage: %s [-j threads] [--stats] [-i index] file [offset]\n"
+	       "       %s [-i index] -l file [offset]\n"
+	       "       %s [-i index] -c path file [offset]\n"
+	       "       %s [-i index] --check file [offset]\n",
+		prog,prog,prog,prog);
+}
 
 int main(int argc,char **argv)
 {
 	char *file;
-	int hd;
-	struct stat st;
-	struct sysv_inode *root_ino;
-	struct sysv2_super_block *sb;
+	char *index=0,*cat=0;
+	int list=0,check=0,stats=0;
+	int a,n,res=0;
+	struct timeval t0,t1;
 
-	if(argc<2)
+	for(a=1; a<argc && argv[a][0]=='-'; a++)
 	{
-		printf("Usage: %s file [offset]\n",argv[0]);
-		return 1;
+		if(!strcmp(argv[a],"--stats"))
+			stats=1;
+		else if(!strcmp(argv[a],"--check"))
+			check=1;
+		else if(!strcmp(argv[a],"-l"))
+			list=1;
+		else if(!strcmp(argv[a],"-j") && a+1<argc)
+			nthreads=atoi(argv[++a]);
+		else if(!strcmp(argv[a],"-i") && a+1<argc)
+			index=argv[++a];
+		else if(!strcmp(argv[a],"-c") && a+1<argc)
+			cat=argv[++a];
+		else
+			break;
 	}
-	
-	file=argv[1];
-	hd=open(file,O_RDONLY);
-	if(hd==-1)
+	if(argc-a<1 || nthreads<1 || list+check+(cat!=0)>1)
 	{
-		perror(file);
+		usage(argv[0]);
 		return 1;
 	}
 
-	if(argc>=3)
-		offset=strtol(argv[2],0,0);
+	file=argv[a];
+	cmask=umask(0);
+	umask(cmask);
+	gettimeofday(&t0,0);
+	fs=s51k_open(file,argc-a>=2 ? strtol(argv[a+1],0,0) : 0);
+	if(!fs)
+		return 1;
 
-	printf("Using offset 0x%08x\n",offset);
-	
-	fstat(hd,&st);
-	map=mmap(0,st.st_size,PROT_READ,MAP_SHARED,hd,0);
-	if(map==MAP_FAILED)
+	if(index && s51k_index_load(fs,index))
 	{
-		perror("mmap");
-		return 1;
+		fprintf(stderr,"%s: building the index\n",index);
+		if(s51k_index_build(fs) || s51k_index_save(fs,index))
+		{
+			fprintf(stderr,"%s: cannot build the index\n",index);
+			return 1;
+		}
 	}
-	
-	sb=(struct sysv2_super_block*)(map+offset+512);
-	if(fs2host32(sb->s_magic)!=0xFD187E20
-	|| fs2host32(sb->s_type) !=2)
+
+	if(list)
 	{
-		fprintf(stderr,"No S51K filesystem found (magic=0x%08X)\n",
-			fs2host32(sb->s_magic));
-		return 1;
+		if(index)
+			res=s51k_index_paths(fs,list_fn,0);
+		else
+			res=s51k_walk(fs,"",list_walk_fn,0);
+	}
+	else if(cat)
+		res=cat_file(cat);
+	else if(check)
+	{
+		res=s51k_check(fs,1);
+		if(res==0)
+			fprintf(stderr,"%s: no problems found\n",file);
+	}
+	else
+	{
+		printf("Using offset 0x%08lx\n",fs->offset);
+
+		workers=calloc(nthreads,sizeof(*workers));
+		if(nthreads>1)
+		{
+			for(n=0; n<nthreads; n++)
+				if(pthread_create(&workers[n].thread,0,worker_main,&workers[n]))
+				{
+					fprintf(stderr,"cannot create worker thread\n");
+					return 1;
+				}
+		}
+
+		res=s51k_walk(fs,"root",extract_fn,0);
+
+		if(nthreads>1)
+		{
+			pthread_mutex_lock(&job_lock);
+			walk_done=1;
+			pthread_cond_broadcast(&job_cond);
+			pthread_mutex_unlock(&job_lock);
+			for(n=0; n<nthreads; n++)
+				pthread_join(workers[n].thread,0);
+		}
 	}
+	gettimeofday(&t1,0);
 
-	root_ino=get_inode(SYSV_ROOT_INO);
-	used_inodes[SYSV_ROOT_INO]=strdup("root");
-	create_inode(root_ino,"root");
+	if(stats)
+	{
+		long files=0;
+		long long bytes=0;
+		double secs=(t1.tv_sec-t0.tv_sec)+(t1.tv_usec-t0.tv_usec)/1e6;
 
-	return 0;
+		for(n=0; workers && n<nthreads; n++)
+		{
+			files+=workers[n].files;
+			bytes+=workers[n].bytes;
+		}
+		if(secs<=0)
+			secs=1e-6;
+		if(workers)
+			fprintf(stderr,"%ld files, %.1f MB in %.2f s: %.2f MB/s, %.1f files/s\n",
+				files,bytes/1048576.0,secs,bytes/1048576.0/secs,files/secs);
+		else
+			fprintf(stderr,"%.3f s\n",secs);
+	}
+
+	s51k_close(fs);
+	return res!=0;
 }
 
-struct sysv_inode *get_inode(int n)
+void print_entry(const char *path,int ino)
 {
-	return (struct sysv_inode*)
-		(map+offset+BSIZE*2+sizeof(struct sysv_inode)*(n-1));
+	struct sysv_inode *i=s51k_inode(fs,ino);
+	printf("%06o %5d %10lu %s\n",s51k_16(fs,i->i_mode),ino,
+		(unsigned long)s51k_32(fs,i->i_size),path[0] ? path : "/");
 }
 
-int read3bytes(unsigned char *a,int n)
+int list_fn(void *arg,const char *path,int ino)
 {
-	return ((((a[n*3]<<8)+a[n*3+1])<<8)+a[n*3+2]);
+	print_entry(path,ino);
+	return 0;
 }
 
-int read4bytes(unsigned char *a,int n)
+int list_walk_fn(void *arg,int what,const char *path,int ino,const char *first)
 {
-	return ((((((a[n*4]<<8)+a[n*4+1])<<8)+a[n*4+2])<<8)+a[n*4+3]);
+	if(what!=S51K_DIREND)
+		print_entry(path,ino);
+	return 0;
 }
 
-char *abs_block(int n)
+int cat_file(const char *path)
 {
-	return map+offset+n*BSIZE;
+	static char buf[65536];
+	struct sysv_inode *i;
+	long pos=0,n;
+	int ino=s51k_namei(fs,path);
+
+	i=s51k_inode(fs,ino);
+	if(!i)
+	{
+		fprintf(stderr,"%s: not found\n",path);
+		return -1;
+	}
+	if((s51k_16(fs,i->i_mode)&S_IFMT)==S_IFDIR)
+	{
+		fprintf(stderr,"%s: is a directory\n",path);
+		return -1;
+	}
+	while((n=s51k_pread(fs,ino,buf,sizeof(buf),pos))>0)
+	{
+		if(fwrite(buf,1,n,stdout)!=(size_t)n)
+		{
+			perror("stdout");
+			return -1;
+		}
+		pos+=n;
+	}
+	return 0;
 }
 
-char *inode_block(struct sysv_inode *i, int n)
+int pwritev_all(int fd,struct iovec *iov,int cnt,off_t pos)
 {
-	if(n<10)
-		return abs_block(read3bytes(i->i_a.i_addb,n));
-
-	if(n<10+BSIZE/4)
-		return abs_block(read4bytes(
-			abs_block(read3bytes(i->i_a.i_addb,10)),n-10));
-			
-	if(n<10+BSIZE/4+BSIZE/4*BSIZE/4)
-		return abs_block(read4bytes(
-			abs_block(read4bytes(
-			 abs_block(read3bytes(i->i_a.i_addb,11)),
-					(n-10-BSIZE/4)/(BSIZE/4))),
-					(n-10-BSIZE/4)%(BSIZE/4)));
-					
-	/* triple indirect blocks... */
-	abort();
+	while(cnt>0)
+	{
+		ssize_t res=pwritev(fd,iov,cnt,pos);
+		if(res==-1)
+		{
+			if(errno==EINTR)
+				continue;
+			return -1;
+		}
+		pos+=res;
+		while(cnt>0 && (size_t)res>=iov->iov_len)
+		{
+			res-=iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if(cnt>0)
+		{
+			iov->iov_base=(char*)iov->iov_base+res;
+			iov->iov_len-=res;
+		}
+	}
+	return 0;
 }
 
-void create_inode(struct sysv_inode *i,const char *path)
+void set_attrs(int ino,const char *path)
 {
+	struct sysv_inode *i=s51k_inode(fs,ino);
 	struct utimbuf ut;
-	int mode=fs2host16(i->i_mode);
-	long size=fs2host32(i->i_size);
-	puts(path);
-	fflush(stdout);
-	if(S_ISDIR(mode))
+
+	chown(path,s51k_16(fs,i->i_uid),s51k_16(fs,i->i_gid));
+	ut.actime =s51k_32(fs,i->i_atime);
+	ut.modtime=s51k_32(fs,i->i_mtime);
+	utime(path,&ut);
+}
+
+/* Write out a regular file created by extract_fn() */
+void extract_file(int ino,const char *path,struct worker *w)
+{
+	long size=s51k_32(fs,s51k_inode(fs,ino)->i_size);
+	int mode=s51k_16(fs,s51k_inode(fs,ino)->i_mode);
+	struct iovec iov[MAXIOV];
+	struct s51k_extent *ext;
+	int fd,n,cnt,next;
+	u32 bad;
+	off_t pos;
+
+	fd=open(path,O_WRONLY);
+	if(fd==-1)
 	{
-		mkdir(path,mode);
-		process_directory(i,path);
+		perror(path);
+		return;
 	}
-	else if(((mode&S_IFMT)==0) || ((mode&S_IFMT)==S_IFREG))
+	next=s51k_extents(fs,ino,&ext,&bad);
+	if(next<0)
 	{
-		int nblk=(size+BSIZE-1)/BSIZE;
-		int n;
-		int last=size%BSIZE;
-		
-		int fd=open(path,O_WRONLY|O_CREAT,mode);
-		if(fd==-1)
+		perror(path);
+		close(fd);
+		return;
+	}
+	if(bad)
+		fprintf(stderr,"%s: %u bad block numbers, extracted as zeroes\n",
+			path,(unsigned)bad);
+
+	for(n=0; n<next; )
+	{
+		/* extents adjacent in the file go into one pwritev() */
+		pos=(off_t)ext[n].lblk*BSIZE;
+		cnt=0;
+		do
 		{
-			perror(path);
-			return;
+			long len=(long)ext[n].count*BSIZE;
+			if(len>size-(long)ext[n].lblk*BSIZE)
+				len=size-(long)ext[n].lblk*BSIZE;
+			iov[cnt].iov_base=s51k_block(fs,ext[n].pblk);
+			iov[cnt].iov_len=len;
+			cnt++;
+			n++;
 		}
-		
-		for(n=0; n<nblk; n++)
+		while(n<next && cnt<MAXIOV
+		&& ext[n].lblk==ext[n-1].lblk+ext[n-1].count);
+		if(pwritev_all(fd,iov,cnt,pos)==-1)
 		{
-			char *e=inode_block(i,n);
-			int limit=BSIZE;
-			if(n==nblk-1)
-				limit=last;
-			write(fd,e,limit);
+			perror(path);
+			break;
 		}
-		close(fd);
 	}
-	chown(path,fs2host16(i->i_uid),fs2host16(i->i_gid));
-	ut.actime =fs2host32(i->i_atime);
-	ut.modtime=fs2host32(i->i_mtime);
-	utime(path,&ut);
+	/* trailing holes */
+	if(ftruncate(fd,size)==-1)
+		perror(path);
+	/* extract_fn() let the owner write it */
+	if(!(mode&S_IWUSR) && fchmod(fd,mode&07777&~cmask)==-1)
+		perror(path);
+	close(fd);
+	free(ext);
+
+	set_attrs(ino,path);
+	w->files++;
+	w->bytes+=size;
 }
 
-void process_directory(struct sysv_inode *i,const char *path)
+void *worker_main(void *arg)
 {
-	long size=fs2host32(i->i_size);
-	int nblk=(size+BSIZE-1)/BSIZE;
-	int n,j;
-	char *path1=alloca(strlen(path)+1+SYSV_NAMELEN+1);
-	char *add;
-	char *slash;
-	int last=size%BSIZE;
-	
-	for(n=0; n<nblk; n++)
+	struct worker *w=arg;
+	struct job *j;
+
+	for(;;)
 	{
-		struct sysv_dir_entry *e=
-				(struct sysv_dir_entry*)inode_block(i,n);
-		int limit=BSIZE/sizeof(*e);
-		if(n==nblk-1)
-			limit=last/sizeof(*e);
-		for(j=0; j<limit; j++,e++)
+		pthread_mutex_lock(&job_lock);
+		while(!job_head && !walk_done)
+			pthread_cond_wait(&job_cond,&job_lock);
+		j=job_head;
+		if(j)
 		{
-			int inode=fs2host16(e->inode);
-			if(inode!=0 && e->name[0])
-			{
-				strcpy(path1,path);
-				strcat(path1,"/");
-				add=path1+strlen(path1);
-				strncpy(add,e->name,SYSV_NAMELEN);
-				add[SYSV_NAMELEN]=0;
-				while((slash=strchr(add,'/')))
-					*slash='_';
-				if(used_inodes[inode])
-					link(used_inodes[inode],path1);
-				else {
-				  used_inodes[inode]=strdup(path1);
-				  create_inode(get_inode(inode),path1);
-				}
-			}
+			job_head=j->next;
+			if(!job_head)
+				job_tail=0;
 		}
+		pthread_mutex_unlock(&job_lock);
+		if(!j)
+			return 0;
+
+		extract_file(j->ino,j->path,w);
+		free(j->path);
+		free(j);
 	}
 }
 
-u16 fs2host16(u16 a)
+void queue_file(int ino,const char *path)
 {
-	unsigned char *u=(unsigned char*)&a;
-	return (u[0]*256+u[1]);
+	struct job *j;
+
+	if(nthreads<=1)
+	{
+		extract_file(ino,path,&workers[0]);
+		return;
+	}
+	j=malloc(sizeof(*j));
+	j->ino=ino;
+	j->path=strdup(path);
+	j->next=0;
+	pthread_mutex_lock(&job_lock);
+	if(job_tail)
+		job_tail->next=j;
+	else
+		job_head=j;
+	job_tail=j;
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&job_lock);
 }
-u32 fs2host32(u32 a)
+
+int extract_fn(void *arg,int what,const char *path,int ino,const char *first)
 {
-	unsigned char *u=(unsigned char*)&a;
-	return (((u[0]*256+u[1])*256+u[2])*256+u[3]);
+	int mode=s51k_16(fs,s51k_inode(fs,ino)->i_mode);
+
+	switch(what)
+	{
+	case S51K_LINK:
+		link(first,path);
+		return 0;
+	case S51K_DIR:
+		puts(path);
+		fflush(stdout);
+		mkdir(path,mode);
+		return 0;
+	case S51K_DIREND:
+		set_attrs(ino,path);
+		return 0;
+	}
+
+	puts(path);
+	fflush(stdout);
+	if(((mode&S_IFMT)==0) || ((mode&S_IFMT)==S_IFREG))
+	{
+		/* create it now, so that links to it can be made;
+		   the data and attributes come from extract_file(), which
+		   has to be able to open it for writing again */
+		int fd=open(path,O_WRONLY|O_CREAT,mode|S_IWUSR);
+		if(fd==-1)
+		{
+			perror(path);
+			return 0;
+		}
+		close(fd);
+		queue_file(ino,path);
+		return 0;
+	}
+	set_attrs(ino,path);
+	return 0;
 }
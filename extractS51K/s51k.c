@@ -0,0 +1,1001 @@
+/*
+   s51k.c - read-only access to S51K (SysV, 1K blocks) filesystem images.
+   Based on extractS51K by Alexander V. Lukyanov.
+   This code is covered by GNU GPL.
+
+   The image is mmap()ed; inodes and blocks are used in place. Both byte
+   orders are handled, the one of the superblock magic is used.
+
+   An index can be built by walking the tree once, and saved to a file:
+   for every inode reached its block extents, and every path name with
+   its inode, sorted. Listing, lookups and s51k_check() then work from
+   the index alone. The index remembers the image size, the offset and a
+   checksum of the superblock and is refused if any of them changed.
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "s51k.h"
+
+#define S51K_MAGIC	0xFD187E20
+#define IDX_MAGIC	"S51KIDX2"
+#define IDX_ENDIAN	0x01020304
+#define NOEXT		0xFFFFFFFF	/* inode not in the index */
+
+/* Index file layout: the header, then ninodes+1 struct idx_ino indexed
+   by inode number, nextents extents, npaths struct idx_path sorted by
+   name and the name strings. All in host byte order. */
+struct idx_head
+{
+	char magic[8];
+	u32 endian;
+	u32 sbsum;
+	unsigned long long imagesize;
+	u32 offset;
+	u32 ninodes;
+	u32 nextents;
+	u32 npaths;
+	u32 strsize;
+	u32 pad;
+};
+
+struct idx_ino
+{
+	u32 first;		/* extent, NOEXT if not indexed */
+	u32 count;
+	u32 bad;		/* block numbers outside the filesystem */
+};
+
+struct idx_path
+{
+	u32 name;		/* offset in the string table */
+	u32 ino;
+};
+
+struct s51k_index
+{
+	char *base;
+	size_t len;
+	int mapped;
+	struct idx_head *head;
+	struct idx_ino *ino;
+	struct s51k_extent *ext;
+	struct idx_path *path;
+	char *str;
+};
+
+u16 s51k_16(struct s51k *fs,u16 a)
+{
+	unsigned char *u=(unsigned char*)&a;
+	if(fs->bigendian)
+		return (u[0]<<8)|u[1];
+	return u[0]|(u[1]<<8);
+}
+
+u32 s51k_32(struct s51k *fs,u32 a)
+{
+	unsigned char *u=(unsigned char*)&a;
+	if(fs->bigendian)
+		return ((u32)u[0]<<24)|(u[1]<<16)|(u[2]<<8)|u[3];
+	return u[0]|(u[1]<<8)|(u[2]<<16)|((u32)u[3]<<24);
+}
+
+static u32 read3bytes(struct s51k *fs,const unsigned char *a,int n)
+{
+	a+=n*3;
+	if(fs->bigendian)
+		return (a[0]<<16)|(a[1]<<8)|a[2];
+	return a[0]|(a[1]<<8)|(a[2]<<16);
+}
+
+static u32 sb_sum(const unsigned char *p)
+{
+	u32 sum=2166136261u;
+	int n;
+	for(n=0; n<512; n++)
+		sum=(sum^p[n])*16777619u;
+	return sum;
+}
+
+struct s51k *s51k_open(const char *file,long offset)
+{
+	struct s51k *fs;
+	struct sysv2_super_block *sb;
+	struct stat st;
+	int hd;
+
+	hd=open(file,O_RDONLY);
+	if(hd==-1)
+	{
+		perror(file);
+		return 0;
+	}
+	fstat(hd,&st);
+	if(offset<0 || offset+1024>st.st_size)
+	{
+		fprintf(stderr,"%s: too small for a filesystem at offset 0x%lx\n",file,offset);
+		close(hd);
+		return 0;
+	}
+	fs=calloc(1,sizeof(*fs));
+	fs->size=st.st_size;
+	fs->offset=offset;
+	fs->map=mmap(0,st.st_size,PROT_READ,MAP_SHARED,hd,0);
+	close(hd);
+	if(fs->map==MAP_FAILED)
+	{
+		perror("mmap");
+		free(fs);
+		return 0;
+	}
+
+	sb=(struct sysv2_super_block*)(fs->map+offset+512);
+	fs->bigendian=1;
+	if(s51k_32(fs,sb->s_magic)!=S51K_MAGIC)
+		fs->bigendian=0;
+	if(s51k_32(fs,sb->s_magic)!=S51K_MAGIC
+	|| s51k_32(fs,sb->s_type)!=2)
+	{
+		fprintf(stderr,"No S51K filesystem found (magic=0x%08X)\n",
+			s51k_32(fs,sb->s_magic));
+		s51k_close(fs);
+		return 0;
+	}
+	fs->isize=s51k_16(fs,sb->s_isize);
+	fs->fsize=s51k_32(fs,sb->s_fsize);
+	fs->ninodes=fs->isize>2 ? (fs->isize-2)*INOPB : 0;
+	if(fs->ninodes>65535)
+		fs->ninodes=65535;
+	return fs;
+}
+
+static void index_free(struct s51k_index *idx)
+{
+	if(!idx)
+		return;
+	if(idx->mapped)
+		munmap(idx->base,idx->len);
+	else
+		free(idx->base);
+	free(idx);
+}
+
+void s51k_close(struct s51k *fs)
+{
+	index_free(fs->index);
+	munmap(fs->map,fs->size);
+	free(fs);
+}
+
+struct sysv_inode *s51k_inode(struct s51k *fs,int ino)
+{
+	long long pos=fs->offset+BSIZE*2+sizeof(struct sysv_inode)*(long long)(ino-1);
+	if(ino<1 || ino>fs->ninodes || pos+sizeof(struct sysv_inode)>fs->size)
+		return 0;
+	return (struct sysv_inode*)(fs->map+pos);
+}
+
+/* 0 for block 0 (a hole) and for blocks outside the filesystem */
+char *s51k_block(struct s51k *fs,u32 blk)
+{
+	if(blk==0 || (fs->fsize && blk>=fs->fsize)
+	|| fs->offset+(long long)(blk+1)*BSIZE>fs->size)
+		return 0;
+	return fs->map+fs->offset+(long long)blk*BSIZE;
+}
+
+static u32 ind_entry(struct s51k *fs,u32 ind,u32 n)
+{
+	u32 *p=(u32*)s51k_block(fs,ind);
+	return p ? s51k_32(fs,p[n]) : 0;
+}
+
+/* The image block of file block n, 0 for a hole */
+u32 s51k_bmap(struct s51k *fs,struct sysv_inode *i,u32 n)
+{
+	const u32 per=BSIZE/4;
+
+	if(n<10)
+		return read3bytes(fs,i->i_a.i_addb,n);
+	n-=10;
+	if(n<per)
+		return ind_entry(fs,read3bytes(fs,i->i_a.i_addb,10),n);
+	n-=per;
+	if(n<per*per)
+		return ind_entry(fs,ind_entry(fs,read3bytes(fs,i->i_a.i_addb,11),
+					      n/per),n%per);
+	n-=per*per;
+	return ind_entry(fs,ind_entry(fs,ind_entry(fs,
+			read3bytes(fs,i->i_a.i_addb,12),n/(per*per)),
+			(n/per)%per),n%per);
+}
+
+static int grow(void *pp,int *alloc,int need,size_t size)
+{
+	void *p;
+	int n=*alloc;
+
+	if(need<=n)
+		return 0;
+	while(n<need)
+		n=n ? n*2 : 64;
+	p=realloc(*(void**)pp,n*size);
+	if(!p)
+		return -1;
+	*(void**)pp=p;
+	*alloc=n;
+	return 0;
+}
+
+/* The block map of an inode: the image block of every file block with
+   the indirect blocks it went through and the block numbers, data or
+   indirect, pointing outside the filesystem */
+struct badblk
+{
+	u32 lblk;		/* file block, the first one mapped if indirect */
+	u32 pblk;
+	int ind;
+};
+
+struct blkmap
+{
+	u32 *blk;		/* 0 for a hole or a bad block number */
+	int nblk;
+	u32 *ind;
+	int nind,aind;
+	struct badblk *bad;
+	int nbad,abad;
+};
+
+static int map_bad(struct blkmap *m,u32 lblk,u32 pblk,int ind)
+{
+	if(grow(&m->bad,&m->abad,m->nbad+1,sizeof(*m->bad)))
+		return -1;
+	m->bad[m->nbad].lblk=lblk;
+	m->bad[m->nbad].pblk=pblk;
+	m->bad[m->nbad].ind=ind;
+	m->nbad++;
+	return 0;
+}
+
+/* Fill m->blk[] from file block n on with the blocks mapped by the
+   indirect block ind of the given depth (1 single, 2 double, 3 triple).
+   A missing indirect block maps a hole. Returns the next file block,
+   -1 if out of memory. */
+static int ind_blocks(struct s51k *fs,struct blkmap *m,u32 ind,int depth,int n)
+{
+	int span=BSIZE/4,k,j,end;
+	u32 *p;
+
+	for(k=1; k<depth; k++)
+		span*=BSIZE/4;
+	end=n+span<m->nblk ? n+span : m->nblk;
+	p=(u32*)s51k_block(fs,ind);
+	if(!p)
+	{
+		if(ind && map_bad(m,n,ind,1))
+			return -1;
+		for(; n<end; n++)
+			m->blk[n]=0;
+		return n;
+	}
+	if(grow(&m->ind,&m->aind,m->nind+1,sizeof(*m->ind)))
+		return -1;
+	m->ind[m->nind++]=ind;
+	for(j=0; j<BSIZE/4 && n<end; j++)
+	{
+		u32 b=s51k_32(fs,p[j]);
+		if(depth==1)
+			m->blk[n++]=b;
+		else if((n=ind_blocks(fs,m,b,depth-1,n))<0)
+			return -1;
+	}
+	return n;
+}
+
+static void map_free(struct blkmap *m)
+{
+	free(m->blk);
+	free(m->ind);
+	free(m->bad);
+}
+
+/* Read the block map of an inode up to its size; 0 or -1 */
+static int map_blocks(struct s51k *fs,struct sysv_inode *i,struct blkmap *m)
+{
+	int n,k;
+
+	memset(m,0,sizeof(*m));
+	m->nblk=(s51k_32(fs,i->i_size)+BSIZE-1)/BSIZE;
+	m->blk=malloc((m->nblk+1)*sizeof(*m->blk));
+	if(!m->blk)
+		return -1;
+	for(n=0; n<m->nblk && n<10; n++)
+		m->blk[n]=read3bytes(fs,i->i_a.i_addb,n);
+	for(k=1; k<=3 && n<m->nblk && n>=0; k++)
+		n=ind_blocks(fs,m,read3bytes(fs,i->i_a.i_addb,9+k),k,n);
+	for(k=0; k<m->nblk && n>=0; k++)
+	{
+		if(!m->blk[k] || s51k_block(fs,m->blk[k]))
+			continue;
+		if(map_bad(m,k,m->blk[k],0))
+			n=-1;
+		m->blk[k]=0;
+	}
+	if(n<0)
+	{
+		map_free(m);
+		return -1;
+	}
+	return 0;
+}
+
+/* Extents of an inode from its block map, holes and bad block numbers
+   left out; the number of the bad ones goes to *bad */
+static int map_extents(struct s51k *fs,struct sysv_inode *i,struct s51k_extent **ext,
+		       u32 *bad)
+{
+	struct blkmap m;
+	struct s51k_extent *e;
+	int n,cnt=0;
+
+	if(map_blocks(fs,i,&m))
+		return -1;
+	e=malloc((m.nblk+1)*sizeof(*e));
+	if(!e)
+	{
+		map_free(&m);
+		return -1;
+	}
+	for(n=0; n<m.nblk; n++)
+	{
+		if(!m.blk[n])
+			continue;
+		if(cnt>0 && e[cnt-1].lblk+e[cnt-1].count==n
+		&& e[cnt-1].pblk+e[cnt-1].count==m.blk[n])
+		{
+			e[cnt-1].count++;
+			continue;
+		}
+		e[cnt].lblk=n;
+		e[cnt].pblk=m.blk[n];
+		e[cnt].count=1;
+		cnt++;
+	}
+	if(bad)
+		*bad=m.nbad;
+	map_free(&m);
+	*ext=e;
+	return cnt;
+}
+
+/* The extents of inode ino in a malloc()ed array, their number or -1.
+   Block numbers outside the filesystem read as holes; how many there
+   were goes to *bad if bad is not 0. */
+int s51k_extents(struct s51k *fs,int ino,struct s51k_extent **ext,u32 *bad)
+{
+	struct s51k_index *idx=fs->index;
+	struct sysv_inode *i=s51k_inode(fs,ino);
+
+	if(!i)
+		return -1;
+	if(idx && ino<=idx->head->ninodes && idx->ino[ino].first!=NOEXT)
+	{
+		struct idx_ino *x=&idx->ino[ino];
+		*ext=malloc((x->count+1)*sizeof(**ext));
+		if(!*ext)
+			return -1;
+		memcpy(*ext,idx->ext+x->first,x->count*sizeof(**ext));
+		if(bad)
+			*bad=x->bad;
+		return x->count;
+	}
+	return map_extents(fs,i,ext,bad);
+}
+
+long s51k_pread(struct s51k *fs,int ino,char *buf,long len,long pos)
+{
+	struct sysv_inode *i=s51k_inode(fs,ino);
+	long size,done=0;
+
+	if(!i)
+		return -1;
+	size=s51k_32(fs,i->i_size);
+	if(pos>=size)
+		return 0;
+	if(len>size-pos)
+		len=size-pos;
+	while(done<len)
+	{
+		int off=(pos+done)%BSIZE;
+		int n=BSIZE-off;
+		char *b=s51k_block(fs,s51k_bmap(fs,i,(pos+done)/BSIZE));
+		if(n>len-done)
+			n=len-done;
+		if(b)
+			memcpy(buf+done,b+off,n);
+		else
+			memset(buf+done,0,n);
+		done+=n;
+	}
+	return done;
+}
+
+/* Call fn for each entry of directory ino but "." and "..", with the
+   name NUL-terminated. Stops early when fn returns nonzero. */
+int s51k_readdir(struct s51k *fs,int ino,s51k_dir_fn fn,void *arg)
+{
+	struct sysv_inode *i=s51k_inode(fs,ino);
+	long size;
+	u32 n,nblk;
+	int j,res;
+
+	if(!i || (s51k_16(fs,i->i_mode)&S_IFMT)!=S_IFDIR)
+		return -1;
+	size=s51k_32(fs,i->i_size);
+	nblk=(size+BSIZE-1)/BSIZE;
+	for(n=0; n<nblk; n++)
+	{
+		struct sysv_dir_entry *e=
+			(struct sysv_dir_entry*)s51k_block(fs,s51k_bmap(fs,i,n));
+		int limit=BSIZE/sizeof(*e);
+		if(!e)
+			continue;
+		if(n==nblk-1 && size%BSIZE)
+			limit=(size%BSIZE)/sizeof(*e);
+		for(j=0; j<limit; j++,e++)
+		{
+			char name[SYSV_NAMELEN+1];
+			int eino=s51k_16(fs,e->inode);
+			if(eino==0 || !e->name[0])
+				continue;
+			strncpy(name,e->name,SYSV_NAMELEN);
+			name[SYSV_NAMELEN]=0;
+			if(!strcmp(name,".") || !strcmp(name,".."))
+				continue;
+			res=fn(arg,name,eino);
+			if(res)
+				return res;
+		}
+	}
+	return 0;
+}
+
+struct lookup
+{
+	const char *name;
+	int len;
+	int ino;
+};
+
+static int lookup_fn(void *arg,const char *name,int ino)
+{
+	struct lookup *l=arg;
+	if((int)strlen(name)!=l->len || strncmp(name,l->name,l->len))
+		return 0;
+	l->ino=ino;
+	return 1;
+}
+
+static int path_cmp(const void *key,const void *elt)
+{
+	struct s51k_index *idx=*(struct s51k_index**)key;
+	const char *name=((char**)key)[1];
+	return strcmp(name,idx->str+((const struct idx_path*)elt)->name);
+}
+
+/* The inode of an absolute or root-relative path, -1 if none */
+int s51k_namei(struct s51k *fs,const char *path)
+{
+	struct s51k_index *idx=fs->index;
+	struct lookup l;
+	int ino=SYSV_ROOT_INO;
+
+	if(idx)
+	{
+		char *norm=malloc(strlen(path)+3);
+		void *key[2];
+		struct idx_path *p;
+		int n;
+
+		sprintf(norm,"%s%s",path[0]=='/' ? "" : "/",path);
+		for(n=strlen(norm); n>1 && norm[n-1]=='/'; n--)
+			norm[n-1]=0;
+		key[0]=idx;
+		key[1]=norm;
+		p=bsearch(key,idx->path,idx->head->npaths,sizeof(*p),path_cmp);
+		free(norm);
+		return p ? (int)p->ino : -1;
+	}
+
+	while(*path)
+	{
+		while(*path=='/')
+			path++;
+		if(!*path)
+			break;
+		l.name=path;
+		l.len=strcspn(path,"/");
+		l.ino=-1;
+		path+=l.len;
+		if(s51k_readdir(fs,ino,lookup_fn,&l)<=0)
+			return -1;
+		ino=l.ino;
+	}
+	return ino;
+}
+
+struct walk
+{
+	struct s51k *fs;
+	s51k_walk_fn fn;
+	void *arg;
+	char **seen;		/* first path of each inode */
+	char *path;
+};
+
+static int walk_dir(struct walk *w,int ino);
+
+static int walk_fn(void *arg,const char *name,int ino)
+{
+	struct walk *w=arg;
+	struct sysv_inode *i=s51k_inode(w->fs,ino);
+	char *path=w->path;
+	char *path1,*slash;
+	int res;
+
+	if(!i)
+	{
+		fprintf(stderr,"%s/%s: bad inode number %d\n",path,name,ino);
+		return 0;
+	}
+	path1=malloc(strlen(path)+1+SYSV_NAMELEN+1);
+	sprintf(path1,"%s/%s",path,name);
+	slash=path1+strlen(path)+1;
+	while((slash=strchr(slash,'/')))
+		*slash='_';
+
+	if(w->seen[ino])
+	{
+		res=w->fn(w->arg,S51K_LINK,path1,ino,w->seen[ino]);
+		free(path1);
+		return res;
+	}
+	w->seen[ino]=path1;
+	if((s51k_16(w->fs,i->i_mode)&S_IFMT)!=S_IFDIR)
+		return w->fn(w->arg,S51K_FILE,path1,ino,0);
+
+	res=w->fn(w->arg,S51K_DIR,path1,ino,0);
+	if(!res)
+	{
+		w->path=path1;
+		res=walk_dir(w,ino);
+		w->path=path;
+	}
+	if(!res)
+		res=w->fn(w->arg,S51K_DIREND,path1,ino,0);
+	return res;
+}
+
+static int walk_dir(struct walk *w,int ino)
+{
+	return s51k_readdir(w->fs,ino,walk_fn,w);
+}
+
+/* Walk the whole tree calling fn for every name; the root directory is
+   called root, the other paths are made from it. Slashes in names are
+   replaced with '_'. */
+int s51k_walk(struct s51k *fs,const char *root,s51k_walk_fn fn,void *arg)
+{
+	struct walk w;
+	int res,n;
+
+	w.fs=fs;
+	w.fn=fn;
+	w.arg=arg;
+	w.seen=calloc(fs->ninodes+1,sizeof(*w.seen));
+	w.path=(char*)root;
+	if(!w.seen || !s51k_inode(fs,SYSV_ROOT_INO))
+	{
+		free(w.seen);
+		return -1;
+	}
+	w.seen[SYSV_ROOT_INO]=strdup(root);
+	res=fn(arg,S51K_DIR,root,SYSV_ROOT_INO,0);
+	if(!res)
+		res=walk_dir(&w,SYSV_ROOT_INO);
+	if(!res)
+		res=fn(arg,S51K_DIREND,root,SYSV_ROOT_INO,0);
+	for(n=0; n<=fs->ninodes; n++)
+		free(w.seen[n]);
+	free(w.seen);
+	return res;
+}
+
+/* index building */
+
+struct build
+{
+	struct s51k *fs;
+	struct idx_ino *ino;
+	struct s51k_extent *ext;
+	int next,aext;
+	struct idx_path *path;
+	int npath,apath;
+	char *str;
+	int nstr,astr;
+};
+
+static int build_fn(void *arg,int what,const char *path,int ino,const char *first)
+{
+	struct build *b=arg;
+	struct sysv_inode *i;
+	struct s51k_extent *e;
+	int n,len,fmt;
+	u32 bad;
+
+	if(what==S51K_DIREND)
+		return 0;
+	if(!path[0])
+		path="/";
+	len=strlen(path)+1;
+	if(grow(&b->path,&b->apath,b->npath+1,sizeof(*b->path))
+	|| grow(&b->str,&b->astr,b->nstr+len,1))
+		return -1;
+	b->path[b->npath].name=b->nstr;
+	b->path[b->npath].ino=ino;
+	b->npath++;
+	memcpy(b->str+b->nstr,path,len);
+	b->nstr+=len;
+
+	if(what==S51K_LINK)
+		return 0;
+	/* devices keep no block numbers in i_addb */
+	i=s51k_inode(b->fs,ino);
+	fmt=s51k_16(b->fs,i->i_mode)&S_IFMT;
+	if(fmt!=0 && fmt!=S_IFREG && fmt!=S_IFDIR)
+	{
+		b->ino[ino].first=b->next;
+		b->ino[ino].count=0;
+		b->ino[ino].bad=0;
+		return 0;
+	}
+	n=map_extents(b->fs,i,&e,&bad);
+	if(n<0 || grow(&b->ext,&b->aext,b->next+n,sizeof(*b->ext)))
+		return -1;
+	memcpy(b->ext+b->next,e,n*sizeof(*e));
+	free(e);
+	b->ino[ino].first=b->next;
+	b->ino[ino].count=n;
+	b->ino[ino].bad=bad;
+	b->next+=n;
+	return 0;
+}
+
+static char *sort_str;
+
+static int sort_cmp(const void *a,const void *b)
+{
+	return strcmp(sort_str+((const struct idx_path*)a)->name,
+		      sort_str+((const struct idx_path*)b)->name);
+}
+
+static void index_setup(struct s51k_index *idx)
+{
+	struct idx_head *h=(struct idx_head*)idx->base;
+	idx->head=h;
+	idx->ino=(struct idx_ino*)(h+1);
+	idx->ext=(struct s51k_extent*)(idx->ino+h->ninodes+1);
+	idx->path=(struct idx_path*)(idx->ext+h->nextents);
+	idx->str=(char*)(idx->path+h->npaths);
+}
+
+/* Walk the tree and make the index of the image in memory */
+int s51k_index_build(struct s51k *fs)
+{
+	struct build b;
+	struct s51k_index *idx;
+	struct idx_head h;
+	int n,res;
+
+	memset(&b,0,sizeof(b));
+	b.fs=fs;
+	b.ino=malloc((fs->ninodes+1)*sizeof(*b.ino));
+	if(!b.ino)
+		return -1;
+	for(n=0; n<=fs->ninodes; n++)
+	{
+		b.ino[n].first=NOEXT;
+		b.ino[n].count=0;
+		b.ino[n].bad=0;
+	}
+	res=s51k_walk(fs,"",build_fn,&b);
+	if(res==0)
+	{
+		sort_str=b.str;
+		qsort(b.path,b.npath,sizeof(*b.path),sort_cmp);
+
+		memset(&h,0,sizeof(h));
+		memcpy(h.magic,IDX_MAGIC,8);
+		h.endian=IDX_ENDIAN;
+		h.sbsum=sb_sum((unsigned char*)fs->map+fs->offset+512);
+		h.imagesize=fs->size;
+		h.offset=fs->offset;
+		h.ninodes=fs->ninodes;
+		h.nextents=b.next;
+		h.npaths=b.npath;
+		h.strsize=b.nstr;
+
+		idx=calloc(1,sizeof(*idx));
+		idx->len=sizeof(h)+(h.ninodes+1)*sizeof(*b.ino)
+			+h.nextents*sizeof(*b.ext)+h.npaths*sizeof(*b.path)+h.strsize;
+		idx->base=malloc(idx->len);
+		if(!idx->base)
+		{
+			free(idx);
+			res=-1;
+		}
+		else
+		{
+			memcpy(idx->base,&h,sizeof(h));
+			index_setup(idx);
+			memcpy(idx->ino,b.ino,(h.ninodes+1)*sizeof(*b.ino));
+			memcpy(idx->ext,b.ext,h.nextents*sizeof(*b.ext));
+			memcpy(idx->path,b.path,h.npaths*sizeof(*b.path));
+			memcpy(idx->str,b.str,h.strsize);
+			index_free(fs->index);
+			fs->index=idx;
+		}
+	}
+	free(b.ino);
+	free(b.ext);
+	free(b.path);
+	free(b.str);
+	return res ? -1 : 0;
+}
+
+/* Use a saved index; -1 if it is missing, damaged or out of date */
+int s51k_index_load(struct s51k *fs,const char *file)
+{
+	struct s51k_index *idx;
+	struct idx_head *h;
+	struct stat st;
+	unsigned long long need;
+	int hd;
+	char *base;
+
+	hd=open(file,O_RDONLY);
+	if(hd==-1)
+		return -1;
+	if(fstat(hd,&st)==-1 || st.st_size<(off_t)sizeof(*h))
+	{
+		close(hd);
+		return -1;
+	}
+	base=mmap(0,st.st_size,PROT_READ,MAP_SHARED,hd,0);
+	close(hd);
+	if(base==MAP_FAILED)
+		return -1;
+
+	h=(struct idx_head*)base;
+	need=sizeof(*h)+(h->ninodes+1ULL)*sizeof(struct idx_ino)
+		+(unsigned long long)h->nextents*sizeof(struct s51k_extent)
+		+(unsigned long long)h->npaths*sizeof(struct idx_path)+h->strsize;
+	if(memcmp(h->magic,IDX_MAGIC,8) || h->endian!=IDX_ENDIAN
+	|| need!=(unsigned long long)st.st_size
+	|| h->imagesize!=(unsigned long long)fs->size || h->offset!=fs->offset
+	|| h->ninodes!=(u32)fs->ninodes
+	|| h->sbsum!=sb_sum((unsigned char*)fs->map+fs->offset+512))
+	{
+		munmap(base,st.st_size);
+		return -1;
+	}
+	idx=calloc(1,sizeof(*idx));
+	idx->base=base;
+	idx->len=st.st_size;
+	idx->mapped=1;
+	index_setup(idx);
+	index_free(fs->index);
+	fs->index=idx;
+	return 0;
+}
+
+int s51k_index_save(struct s51k *fs,const char *file)
+{
+	struct s51k_index *idx=fs->index;
+	char *tmp;
+	size_t done=0;
+	int fd,res=0;
+
+	if(!idx)
+		return -1;
+	tmp=malloc(strlen(file)+5);
+	sprintf(tmp,"%s.new",file);
+	fd=open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if(fd==-1)
+	{
+		perror(tmp);
+		free(tmp);
+		return -1;
+	}
+	while(done<idx->len)
+	{
+		ssize_t n=write(fd,idx->base+done,idx->len-done);
+		if(n==-1)
+		{
+			if(errno==EINTR)
+				continue;
+			res=-1;
+			break;
+		}
+		done+=n;
+	}
+	if(close(fd)==-1)
+		res=-1;
+	if(res==0 && rename(tmp,file)==-1)
+		res=-1;
+	if(res)
+	{
+		perror(file);
+		unlink(tmp);
+	}
+	free(tmp);
+	return res;
+}
+
+/* Call fn for every indexed path in sorted order */
+int s51k_index_paths(struct s51k *fs,int (*fn)(void *arg,const char *path,int ino),
+		     void *arg)
+{
+	struct s51k_index *idx=fs->index;
+	u32 n;
+	int res;
+
+	if(!idx)
+		return -1;
+	for(n=0; n<idx->head->npaths; n++)
+	{
+		res=fn(arg,idx->str+idx->path[n].name,idx->path[n].ino);
+		if(res)
+			return res;
+	}
+	return 0;
+}
+
+struct owned
+{
+	u32 pblk;
+	u32 count;
+	u32 ino;
+	int ind;
+};
+
+static int owned_cmp(const void *a,const void *b)
+{
+	const struct owned *x=a,*y=b;
+	return x->pblk<y->pblk ? -1 : x->pblk>y->pblk;
+}
+
+static int own(struct owned **o,int *cnt,int *alloc,u32 pblk,u32 count,u32 ino,int ind)
+{
+	if(grow(o,alloc,*cnt+1,sizeof(**o)))
+		return -1;
+	(*o)[*cnt].pblk=pblk;
+	(*o)[*cnt].count=count;
+	(*o)[*cnt].ino=ino;
+	(*o)[*cnt].ind=ind;
+	(*cnt)++;
+	return 0;
+}
+
+/* Check the indexed inodes: block numbers inside the filesystem, blocks
+   inside the data area, within the file size, and no block used twice,
+   whether for data or as an indirect block. Builds the index if there
+   is none. Returns the number of problems found. */
+int s51k_check(struct s51k *fs,int verbose)
+{
+	struct s51k_index *idx;
+	struct owned *o=0;
+	struct blkmap m;
+	u32 ino,end;
+	int n,k,cnt=0,alloc=0,bad=0;
+
+	if(!fs->index && s51k_index_build(fs))
+		return -1;
+	idx=fs->index;
+
+	for(ino=1; ino<=idx->head->ninodes; ino++)
+	{
+		struct idx_ino *x=&idx->ino[ino];
+		struct sysv_inode *i;
+		u32 nblk;
+		int fmt;
+
+		if(x->first==NOEXT)
+			continue;
+		i=s51k_inode(fs,ino);
+		nblk=(s51k_32(fs,i->i_size)+BSIZE-1)/BSIZE;
+		for(k=0; k<(int)x->count; k++)
+		{
+			struct s51k_extent *e=&idx->ext[x->first+k];
+			if(e->pblk<fs->isize)
+			{
+				bad++;
+				if(verbose)
+					fprintf(stderr,"inode %u: block %u is in the inode area\n",
+						ino,e->pblk);
+			}
+			if(e->lblk+e->count>nblk)
+			{
+				bad++;
+				if(verbose)
+					fprintf(stderr,"inode %u: block %u beyond the end of file\n",
+						ino,e->lblk+e->count-1);
+			}
+			if(own(&o,&cnt,&alloc,e->pblk,e->count,ino,0))
+				goto nomem;
+		}
+
+		/* the index keeps data extents only, the indirect blocks
+		   and the bad numbers come from the inode itself */
+		fmt=s51k_16(fs,i->i_mode)&S_IFMT;
+		if(fmt!=0 && fmt!=S_IFREG && fmt!=S_IFDIR)
+			continue;
+		if(map_blocks(fs,i,&m))
+			goto nomem;
+		for(k=0; k<m.nbad; k++)
+		{
+			bad++;
+			if(verbose)
+				fprintf(stderr,"inode %u: %sblock number %u for file block %u is outside the filesystem\n",
+					ino,m.bad[k].ind ? "indirect " : "",
+					m.bad[k].pblk,m.bad[k].lblk);
+		}
+		for(k=0; k<m.nind; k++)
+		{
+			if(m.ind[k]<fs->isize)
+			{
+				bad++;
+				if(verbose)
+					fprintf(stderr,"inode %u: indirect block %u is in the inode area\n",
+						ino,m.ind[k]);
+			}
+			if(own(&o,&cnt,&alloc,m.ind[k],1,ino,1))
+			{
+				map_free(&m);
+				goto nomem;
+			}
+		}
+		map_free(&m);
+	}
+	qsort(o,cnt,sizeof(*o),owned_cmp);
+	for(n=1,k=0,end=cnt ? o[0].pblk+o[0].count : 0; n<cnt; n++)
+	{
+		if(o[n].pblk<end)
+		{
+			bad++;
+			if(verbose)
+				fprintf(stderr,"block %u is used by inode %u%s and inode %u%s\n",
+					o[n].pblk,o[k].ino,o[k].ind ? " as an indirect block" : "",
+					o[n].ino,o[n].ind ? " as an indirect block" : "");
+		}
+		if(o[n].pblk+o[n].count>end)
+		{
+			end=o[n].pblk+o[n].count;
+			k=n;
+		}
+	}
+	free(o);
+	return bad;
+
+nomem:
+	free(o);
+	return -1;
+}
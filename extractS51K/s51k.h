@@ -0,0 +1,159 @@
+/*
+   s51k.h - read-only access to S51K (SysV, 1K blocks) filesystem images.
+   Based on extractS51K by Alexander V. Lukyanov.
+   This code is covered by GNU GPL.
+*/
+
+#ifndef S51K_H
+#define S51K_H
+
+#include <sys/types.h>
+
+typedef int s32;
+typedef unsigned u32;
+typedef unsigned short u16;
+typedef short s16;
+typedef u16 sysv_ino_t;
+
+#ifdef __GNUC__
+#define __packed2__  __attribute__ ((packed, aligned(2)))
+#else
+#error I want gcc!
+#endif
+
+/* Among the inodes ... */
+/* 0 is non-existent */
+#define SYSV_BADBL_INO  1       /* inode of bad blocks file */
+#define SYSV_ROOT_INO   2       /* inode of root directory */
+
+#define SYSV_NICINOD    100     /* number of inode cache entries */
+#define SYSV_NICFREE    50      /* number of free block list chunk entries */
+
+/* SystemV2 super-block data on disk */
+struct sysv2_super_block {
+        u16     s_isize;                /* index of first data zone */
+        u32     s_fsize __packed2__;    /* total number of zones of this fs */
+        /* the start of the free block list: */
+        u16     s_nfree;                /* number of free blocks in s_free, <= SYSV_NICFREE */
+        u32     s_free[SYSV_NICFREE];   /* first free block list chunk */
+        /* the cache of free inodes: */
+        u16     s_ninode;               /* number of free inodes in s_inode, <= SYSV_NICINOD */
+        sysv_ino_t     s_inode[SYSV_NICINOD]; /* some free inodes */
+        /* locks, not used by Linux: */
+        char    s_flock;                /* lock during free block list manipulation */
+        char    s_ilock;                /* lock during inode cache manipulation */
+        char    s_fmod;                 /* super-block modified flag */
+        char    s_ronly;                /* flag whether fs is mounted read-only */
+        u32     s_time __packed2__;     /* time of last super block update */
+        s16     s_dinfo[4];             /* device information ?? */
+        u32     s_tfree __packed2__;    /* total number of free zones */
+        u16     s_tinode;               /* total number of free inodes */
+        char    s_fname[6];             /* file system volume name */
+        char    s_fpack[6];             /* file system pack name */
+        s32     s_fill[14];
+        s32     s_state;                /* file system state: 0xcb096f43 means clean */
+        s32     s_magic;                /* version of file system */
+        s32     s_type;                 /* type of file system: 1 for 512 byte blocks
+                                                                2 for 1024 byte blocks */
+};
+
+/* SystemV/Coherent inode data on disk */
+
+struct sysv_inode {
+        u16 i_mode;
+        u16 i_nlink;
+        u16 i_uid;
+        u16 i_gid;
+        u32 i_size;
+        union { /* directories, regular files, ... */
+                unsigned char i_addb[3*(10+1+1+1)+1]; /* zone numbers: max. 10 data blocks,
+                                              * then 1 indirection block,
+                                              * then 1 double indirection block,
+                                              * then 1 triple indirection block.
+                                              * Then maybe a "file generation number" ??
+                                              */
+                /* devices */
+                u16 i_rdev;
+                /* named pipes on Coherent */
+                struct {
+                        char p_addp[30];
+                        s16 p_pnc;
+                        s16 p_prx;
+                        s16 p_pwx;
+                } i_p;
+        } i_a;
+        u32 i_atime;    /* time of last access */
+        u32 i_mtime;    /* time of last modification */
+        u32 i_ctime;    /* time of creation */
+};
+
+/* SystemV/Coherent directory entry on disk */
+
+#define SYSV_NAMELEN    14      /* max size of name in struct sysv_dir_entry */
+
+struct sysv_dir_entry {
+        sysv_ino_t inode;
+        char name[SYSV_NAMELEN]; /* up to 14 characters, the rest are zeroes */
+};
+
+
+#define		BSIZE	1024
+#define		INOPB	(BSIZE/sizeof(struct sysv_inode))
+
+/* A run of blocks of a file, adjacent both in the file and in the image */
+struct s51k_extent
+{
+	u32 lblk;	/* first block in the file */
+	u32 pblk;	/* first block in the image */
+	u32 count;
+};
+
+struct s51k_index;
+
+struct s51k
+{
+	char *map;
+	long long size;		/* of the image file */
+	long offset;		/* of the filesystem in it */
+	int bigendian;
+	u32 isize;		/* first data zone */
+	u32 fsize;		/* zones in the filesystem */
+	int ninodes;
+	struct s51k_index *index;
+};
+
+/* what s51k_walk() reports */
+#define S51K_FILE	0	/* anything but a directory, first name */
+#define S51K_LINK	1	/* another name of an inode already seen */
+#define S51K_DIR	2	/* directory, before its entries */
+#define S51K_DIREND	3	/* directory, after its entries */
+
+typedef int (*s51k_walk_fn)(void *arg,int what,const char *path,int ino,
+			    const char *first);
+typedef int (*s51k_dir_fn)(void *arg,const char *name,int ino);
+
+struct s51k *s51k_open(const char *file,long offset);
+void s51k_close(struct s51k *fs);
+
+u16 s51k_16(struct s51k *fs,u16 a);
+u32 s51k_32(struct s51k *fs,u32 a);
+
+struct sysv_inode *s51k_inode(struct s51k *fs,int ino);
+char *s51k_block(struct s51k *fs,u32 blk);
+u32 s51k_bmap(struct s51k *fs,struct sysv_inode *i,u32 n);
+int s51k_extents(struct s51k *fs,int ino,struct s51k_extent **ext,u32 *bad);
+long s51k_pread(struct s51k *fs,int ino,char *buf,long len,long pos);
+
+int s51k_readdir(struct s51k *fs,int ino,s51k_dir_fn fn,void *arg);
+int s51k_namei(struct s51k *fs,const char *path);
+int s51k_walk(struct s51k *fs,const char *root,s51k_walk_fn fn,void *arg);
+
+int s51k_index_build(struct s51k *fs);
+int s51k_index_load(struct s51k *fs,const char *file);
+int s51k_index_save(struct s51k *fs,const char *file);
+int s51k_index_paths(struct s51k *fs,int (*fn)(void *arg,const char *path,int ino),
+		     void *arg);
+
+int s51k_check(struct s51k *fs,int verbose);
+
+#endif /* S51K_H */
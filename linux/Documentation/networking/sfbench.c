@@ -0,0 +1,197 @@
+/*
+ *	sfbench.c	Compare sendfile() with read()+write() for
+ *			streaming a file down a TCP connection.
+ *
+ *	sfbench -l port				sink: accept and discard
+ *	sfbench [-r] [-b bufsize] host port file [count]
+ *
+ *	-r uses read()+write() through a user buffer instead of
+ *	sendfile(). The file is sent count times (default 1) on one
+ *	connection; the rate and the CPU time used are printed.
+ *
+ *	Build with: gcc -O2 -o sfbench sfbench.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/unistd.h>
+
+#if defined(__NR_sendfile) && defined(_syscall4)
+static inline _syscall4(int, sendfile, int, out_fd, int, in_fd,
+			off_t *, offset, int, count)
+#endif
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: sfbench -l port\n"
+		"       sfbench [-r] [-b bufsize] host port file [count]\n");
+	exit(1);
+}
+
+static int sink(int port)
+{
+	struct sockaddr_in sin;
+	static char buf[65536];
+	int s, c, one = 1;
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if (bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0 ||
+	    listen(s, 5) < 0) {
+		perror("bind");
+		return 1;
+	}
+	for (;;) {
+		long total = 0;
+		int n;
+
+		c = accept(s, NULL, NULL);
+		if (c < 0) {
+			perror("accept");
+			continue;
+		}
+		while ((n = read(c, buf, sizeof(buf))) > 0)
+			total += n;
+		printf("received %ld bytes\n", total);
+		close(c);
+	}
+}
+
+static int send_read_write(int s, int fd, long size, char *buf, int bufsize)
+{
+	long left = size;
+
+	lseek(fd, 0, SEEK_SET);
+	while (left > 0) {
+		int n = read(fd, buf, left < bufsize ? left : bufsize);
+		char *p = buf;
+
+		if (n <= 0)
+			return -1;
+		left -= n;
+		while (n > 0) {
+			int w = write(s, p, n);
+			if (w < 0)
+				return -1;
+			p += w;
+			n -= w;
+		}
+	}
+	return 0;
+}
+
+static int send_sendfile(int s, int fd, long size)
+{
+#if defined(__NR_sendfile) && defined(_syscall4)
+	off_t off = 0;
+
+	while (off < size) {
+		int n = sendfile(s, fd, &off, size - off);
+		if (n <= 0)
+			return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin;
+	struct hostent *hp;
+	struct stat st;
+	struct timeval t0, t1;
+	struct tms c0, c1;
+	int rw = 0, bufsize = 8192, count = 1;
+	int opt, s, fd, i;
+	char *buf = NULL;
+	double secs, bytes;
+	long hz = sysconf(_SC_CLK_TCK);
+
+	while ((opt = getopt(argc, argv, "l:rb:")) != -1) {
+		switch (opt) {
+		case 'l':
+			return sink(atoi(optarg));
+		case 'r':
+			rw = 1;
+			break;
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind < 3 || bufsize <= 0)
+		usage();
+	if (argc - optind > 3)
+		count = atoi(argv[optind + 3]);
+
+	fd = open(argv[optind + 2], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[optind + 2]);
+		return 1;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(atoi(argv[optind + 1]));
+	if ((hp = gethostbyname(argv[optind])) != NULL)
+		memcpy(&sin.sin_addr, hp->h_addr, sizeof(sin.sin_addr));
+	else
+		sin.sin_addr.s_addr = inet_addr(argv[optind]);
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0 || connect(s, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		perror("connect");
+		return 1;
+	}
+	if (rw && (buf = malloc(bufsize)) == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	gettimeofday(&t0, NULL);
+	times(&c0);
+	for (i = 0; i < count; i++) {
+		int err = rw ? send_read_write(s, fd, st.st_size, buf, bufsize)
+			     : send_sendfile(s, fd, st.st_size);
+		if (err < 0) {
+			perror(rw ? "read/write" : "sendfile");
+			return 1;
+		}
+	}
+	close(s);
+	gettimeofday(&t1, NULL);
+	times(&c1);
+
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+	bytes = (double) st.st_size * count;
+	printf("%s: %.0f bytes in %.2f s, %.1f KB/s, cpu user %.2f s sys %.2f s\n",
+	       rw ? "read+write" : "sendfile", bytes, secs,
+	       secs > 0 ? bytes / secs / 1024 : 0.0,
+	       (double) (c1.tms_utime - c0.tms_utime) / hz,
+	       (double) (c1.tms_stime - c0.tms_stime) / hz);
+	return 0;
+}
@@ -24,6 +24,7 @@
 #include <linux/linkage.h>
 #include <linux/kernel_stat.h>
 #include <linux/fcntl.h>
+#include <linux/proc_fs.h>
 
 #include <asm/system.h>
 #include <asm/pgtable.h>
@@ -165,28 +166,134 @@ struct select_buffer {
 
 extern int old_select (void *);
 
+/*  Data written to an endpoint waits in a chain of page sized chunks,
+   allocated as the writer needs them and freed as the reader drains
+   them, up to SOCKM_BUFMAX bytes per endpoint. The reader wakes a
+   blocked writer only when half of that room is free again, so bulk
+   transfers are no longer clocked page by page.
+*/
+#define SOCKM_BUFMAX    (16 * PAGE_SIZE)
+
+struct sockm_chunk {
+	struct sockm_chunk *next;
+	int head;               /*  first unread byte   */
+	int tail;               /*  first free byte   */
+};
+
+#define SOCKM_CHUNK_DATA        (PAGE_SIZE - sizeof (struct sockm_chunk))
+#define sockm_chunk_data(c)     ((char *) ((c) + 1))
+
 struct sockm {
 	int state;
 	int num;
 	int peer;
 	int reqmax;
 	int reqcnt;
-	int head;
-	int tail;
-	int cnt;
-	char *data;
+	int cnt;                /*  bytes queued to be read here   */
+	struct sockm_chunk *first;
+	struct sockm_chunk *last;
+	struct sockm_chunk *spare;
+	int wwait;              /*  somebody waits for room at the peer  */
 	struct wait_queue *wait;
 	struct sockm *connq;
 	char name[64];
+
+	/*  per channel throughput counters   */
+	unsigned long rbytes;
+	unsigned long wbytes;
+	unsigned long rsleeps;
+	unsigned long wsleeps;
+	int maxcnt;
 };
 
 struct sockm *sockm_base[256] = { NULL, };
 
+static struct sockm_chunk *sockm_chunk_get (struct sockm *sp) {
+	struct sockm_chunk *c = sp->spare;
+
+	if (c)  sp->spare = NULL;
+	else {
+	    c = (struct sockm_chunk *) __get_free_page (GFP_KERNEL);
+	    if (!c)  return NULL;
+	}
+
+	c->next = NULL;
+	c->head = 0;
+	c->tail = 0;
+
+	return c;
+}
+
+static void sockm_chunk_put (struct sockm *sp, struct sockm_chunk *c) {
+
+	if (!sp->spare)  sp->spare = c;
+	else  free_page ((unsigned long) c);
+}
+
+static void sockm_free_data (struct sockm *sp) {
+	struct sockm_chunk *c;
+
+	while ((c = sp->first) != NULL) {
+	    sp->first = c->next;
+	    free_page ((unsigned long) c);
+	}
+	sp->last = NULL;
+	sp->cnt = 0;
+
+	if (sp->spare)  free_page ((unsigned long) sp->spare);
+	sp->spare = NULL;
+}
+
+#ifdef CONFIG_PROC_FS
+static int sockm_get_info (char *buffer, char **start, off_t offset,
+						    int length, int dummy) {
+	int len, i;
+	off_t pos = 0, begin = 0;
+
+	len = sprintf (buffer, "num state peer queued maxq "
+				"rbytes wbytes rsleeps wsleeps name\n");
+
+	for (i = 0; i < 255; i++) {
+	    struct sockm *sp = sockm_base[i];
+
+	    if (!sp)  continue;
+
+	    len += sprintf (buffer + len, "%3d %5d %4d %6d %6d "
+			    "%lu %lu %lu %lu %.64s\n",
+			    sp->num, sp->state, sp->peer, sp->cnt, sp->maxcnt,
+			    sp->rbytes, sp->wbytes, sp->rsleeps, sp->wsleeps,
+			    sp->name);
+
+	    pos = begin + len;
+	    if (pos < offset) {
+		len = 0;
+		begin = pos;
+	    }
+	    if (pos > offset + length)  break;
+	}
+
+	*start = buffer + (offset - begin);
+	len -= (offset - begin);
+	if (len > length)  len = length;
+
+	return len;
+}
+#endif
+
 void sockm_init (const char *name, int major) {
 
 	if (register_chrdev (major, name, &sockm_fops))
 	    printk ("Unable to get major %d\n", major);
 
+#ifdef CONFIG_PROC_FS
+	proc_register_dynamic (&proc_root, &(struct proc_dir_entry) {
+		0, 5, "sockm",
+		S_IFREG | S_IRUGO, 1, 0, 0,
+		0, NULL,
+		&sockm_get_info,
+	});
+#endif
+
 	return;
 }
 
@@ -242,7 +349,7 @@ static void sockm_release (struct inode *inode, struct file *filp) {
 		    sockm_base[req->peer]->peer = 0;
 		}
 
-		if (req->data)  free_page ((unsigned long) req->data);
+		sockm_free_data (req);
 
 		if (req->state == SOCKM_REQUEST ||
 		    req->state == SOCKM_PREALLOC
@@ -251,13 +358,8 @@ static void sockm_release (struct inode *inode, struct file *filp) {
 		    sockm_base[req->num] = NULL;
 		    kfree (req);
 
-		} else {
-
-		    req->cnt = 0;
-		    req->head = 0;
-		    req->tail = 0;
+		} else
 		    req->state = SOCKM_DISCONN;
-		}
 	    }
 	}
 
@@ -279,7 +381,7 @@ static void sockm_release (struct inode *inode, struct file *filp) {
 	    sockm_base[sp->peer]->peer = 0;
 	}
 
-	if (sp->data)  free_page ((unsigned long) sp->data);
+	sockm_free_data (sp);
 
 	sockm_base[sp->num] = NULL;
 	kfree (sp);
@@ -309,24 +411,36 @@ restart:
 	)  return -EPIPE;   /*  svr3 behavior  */
 
 	while (count && sp->cnt) {
-	    int n = sp->head + sp->cnt > PAGE_SIZE ? PAGE_SIZE - sp->head
-						   : sp->cnt;
+	    struct sockm_chunk *c = sp->first;
+	    int n = c->tail - c->head;
 
 	    if (n > count)  n = count;
 
-	    memcpy_tofs (buf, &sp->data[sp->head], n);
+	    memcpy_tofs (buf, sockm_chunk_data (c) + c->head, n);
 
 	    count -= n;
 	    buf += n;
 	    total += n;
 	    sp->cnt -= n;
-	    sp->head += n;
-	    sp->head &= (PAGE_SIZE - 1);
+	    c->head += n;
+
+	    /*  The last chunk is left alone, the writer may be filling it  */
+	    if (c->head == c->tail && c != sp->last) {
+		sp->first = c->next;
+		sockm_chunk_put (sp, c);
+	    }
 	}
 
 	if (total) {
-	    if (sp->state == SOCKM_CONN || sp->state == SOCKM_REQUEST)
+	    sp->rbytes += total;
+
+	    if ((sp->state == SOCKM_CONN || sp->state == SOCKM_REQUEST) &&
+		sockm_base[sp->peer]->wwait &&
+		sp->cnt <= SOCKM_BUFMAX / 2
+	    ) {
+		sockm_base[sp->peer]->wwait = 0;
 		wake_up_interruptible (&sockm_base[sp->peer]->wait);
+	    }
 	    inode->i_atime = CURRENT_TIME;
 	    return total;
 	}
@@ -338,7 +452,10 @@ restart:
 	save_flags (flags);
 	cli();
 
-	interruptible_sleep_on (&sp->wait);
+	if (sp->cnt == 0 && sp->state != SOCKM_DISCONN) {
+	    sp->rsleeps++;
+	    interruptible_sleep_on (&sp->wait);
+	}
 
 	restore_flags (flags);
 
@@ -363,57 +480,79 @@ static int sockm_write (struct inode *inode, struct file *filp,
 	if (err)  return err;
 
 	while (count) {
-	    int n = PAGE_SIZE - peer->cnt;  /*  free area   */
-
+	    int n = SOCKM_BUFMAX - peer->cnt;  /*  free area   */
+	    struct sockm_chunk *c;
 
 	    if (sp->state != SOCKM_CONN &&
 		sp->state != SOCKM_REQUEST
-	    )  return -EPIPE;   /*  svr3 behavior  */
+	    )  return total ? total : -EPIPE;   /*  svr3 behavior  */
 
-	    if (peer->cnt == PAGE_SIZE) {
+	    if (n <= 0) {
 
-		if (filp->f_flags & O_NONBLOCK) {
-		    if (total) {
-			inode->i_mtime = CURRENT_TIME;
-			return total;
-		    } else
-			return -EDEADLK;   /*  svr3 behavior  */
-		}
+		if (filp->f_flags & O_NONBLOCK)  break;
+
+		/*  Let the reader drain what we have queued so far   */
+		if (total)  wake_up_interruptible (&peer->wait);
 
 		save_flags (flags);
 		cli();
 
-		interruptible_sleep_on (&sp->wait);
+		if (peer->cnt >= SOCKM_BUFMAX &&
+		    (sp->state == SOCKM_CONN || sp->state == SOCKM_REQUEST)
+		) {
+		    sp->wwait = 1;
+		    sp->wsleeps++;
+		    interruptible_sleep_on (&sp->wait);
+		}
 
 		restore_flags (flags);
 
-		if (current->signal & ~current->blocked)  return -ERESTARTSYS;
+		if (current->signal & ~current->blocked) {
+		    if (total)  break;
+		    return -ERESTARTSYS;
+		}
 
 		continue;
 	    }
 
-	    if (peer->tail + n > PAGE_SIZE)  n = PAGE_SIZE - peer->tail;
-	    if (n > count)  n = count;
+	    c = peer->last;
+	    if (c && c->head == c->tail) {
+		c->head = 0;        /*  drained, start over   */
+		c->tail = 0;
+	    }
+
+	    if (!c || c->tail == SOCKM_CHUNK_DATA) {
 
-	    if (!peer->data) {
-		peer->data = (char *) get_free_page (GFP_KERNEL);
-		if (!peer->data)  return -ENOMEM;
+		c = sockm_chunk_get (peer);
+		if (!c) {
+		    if (total)  break;
+		    return -ENOMEM;
+		}
+
+		if (peer->last)  peer->last->next = c;
+		else  peer->first = c;
+		peer->last = c;
 	    }
 
-	    memcpy_fromfs (&peer->data[peer->tail], buf, n);
+	    if (n > SOCKM_CHUNK_DATA - c->tail)  n = SOCKM_CHUNK_DATA - c->tail;
+	    if (n > count)  n = count;
+
+	    memcpy_fromfs (sockm_chunk_data (c) + c->tail, buf, n);
 
 	    count -= n;
 	    buf += n;
 	    total += n;
-	    peer->tail += n;
-	    peer->tail &= (PAGE_SIZE - 1);
+	    c->tail += n;
 	    peer->cnt += n;
+	    if (peer->cnt > peer->maxcnt)  peer->maxcnt = peer->cnt;
 	}
 
 	if (total) {
+	    sp->wbytes += total;
 	    wake_up_interruptible (&peer->wait);
 	    inode->i_mtime = CURRENT_TIME;
-	}
+	} else if (count)       /*  O_NONBLOCK and no room at all   */
+	    return -EDEADLK;   /*  svr3 behavior  */
 
 	return total;
 }
@@ -665,12 +804,9 @@ static int sockm_ioctl (struct inode *inode, struct file *filp,
 							    sizeof (int));
 		    if (err)  return err;
 
-		    if (sp->state == SOCKM_CONN || sp->state == SOCKM_LISTEN) {
-			int n = sp->tail - sp->head;
-
-			if (n < 0)  n += PAGE_SIZE;
-			put_fs_long (n, (int *) arg);
-		    } else
+		    if (sp->state == SOCKM_CONN || sp->state == SOCKM_LISTEN)
+			put_fs_long (sp->cnt, (int *) arg);
+		    else
 			put_fs_long (0, (int *) arg);
 
 		    break;
@@ -705,8 +841,9 @@ static int sockm_select (struct inode *inode, struct file *filp,
 	    if (sp->state == SOCKM_LISTEN)  return 0;   /* ???  */
 
 	    if (sp->state == SOCKM_CONN &&
-		sockm_base[sp->peer]->cnt == PAGE_SIZE
+		sockm_base[sp->peer]->cnt >= SOCKM_BUFMAX
 	    ) {
+		sp->wwait = 1;
 		select_wait (&sp->wait, wait);
 		return 0;
 	    }
@@ -29,6 +29,8 @@
 #include <linux/socket.h>
 #include <linux/net.h>
 #include <linux/in.h>
+#include <linux/fcntl.h>
+#include <linux/file.h>
 
 #include <asm/system.h>
 #include <asm/page.h>
@@ -93,11 +95,7 @@ extern int sys_socket (int, int, int),
 	   sys_write (int, void *, int),
 	   sys_shutdown (int, int),
 	   sys_getsockname (int, void *, void *),
-	   sys_getpeername (int, void *, void *),
-	   sys_send (int, void *, int, int),
-	   sys_sendto (int, void *, int, int, void *, int),
-	   sys_recv (int, void *, int, int),
-	   sys_recvfrom (int, void *, int, int, void *, void *);
+	   sys_getpeername (int, void *, void *);
 
 
 static int sockmod_open (struct stream_info *stream_info, struct file *file,
@@ -883,6 +881,96 @@ static int sockmod_ioctl (struct stream_info *stream_info, int cmd,
 }
 
 
+/*  Message data goes straight between the caller`s buffer and the
+   socket: an iovec over the user buffer is handed to the protocol`s
+   sendmsg/recvmsg, which copy (and checksum) it exactly once. Only
+   the address is in kernel space, as the socket layer expects it.
+*/
+static struct socket *sockmod_sock_get (struct sockmod_info *sockmod_info,
+							struct file **filp) {
+	struct file *file;
+	struct inode *inode;
+
+	file = fget (sockmod_info->sfd);
+	if (!file)  return NULL;
+
+	inode = file->f_inode;
+	if (!inode || !inode->i_sock) {
+	    fput (file, inode);
+	    return NULL;
+	}
+
+	*filp = file;
+	return &inode->u.socket_i;
+}
+
+static int sockmod_sendmsg (struct sockmod_info *sockmod_info,
+				void *buf, int len, int flags,
+				void *addr, int addr_len) {
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov;
+	int err;
+
+	err = verify_area (VERIFY_READ, buf, len);
+	if (err)  return err;
+
+	sock = sockmod_sock_get (sockmod_info, &file);
+	if (!sock)  return -ENOTSOCK;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = addr ? addr_len : 0;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+
+	err = sock->ops->sendmsg (sock, &msg, len,
+					file->f_flags & O_NONBLOCK, flags);
+
+	fput (file, file->f_inode);
+
+	return err;
+}
+
+static int sockmod_recvmsg (struct sockmod_info *sockmod_info,
+				void *buf, int len, int flags,
+				void *addr, int *addr_len) {
+	struct socket *sock;
+	struct file *file;
+	struct msghdr msg;
+	struct iovec iov;
+	int err, alen = 0;
+
+	if (len == 0)  return 0;
+
+	err = verify_area (VERIFY_WRITE, buf, len);
+	if (err)  return err;
+
+	sock = sockmod_sock_get (sockmod_info, &file);
+	if (!sock)  return -ENOTSOCK;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_name = addr;
+	msg.msg_namelen = addr ? *addr_len : 0;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = NULL;
+
+	err = sock->ops->recvmsg (sock, &msg, len,
+				    file->f_flags & O_NONBLOCK, flags, &alen);
+
+	fput (file, file->f_inode);
+
+	if (err >= 0 && addr)  *addr_len = alen;
+
+	return err;
+}
+
+
 static int sockmod_putmsg (struct stream_info *stream_info,
 				void *buf_ctl, int len_ctl, void *buf_data,
 				int len_data, int nonblocks, int flags) {
@@ -894,7 +982,6 @@ static int sockmod_putmsg (struct stream_info *stream_info,
 	struct file *new_file;
 	int new_sfd, err;
 	struct sockmod_info *new_sock;
-	char *tmp_buf;
 
 	if (len_ctl >= 0) {     /*  there is a ctl message...   */
 
@@ -981,17 +1068,8 @@ static int sockmod_putmsg (struct stream_info *stream_info,
 
 		    if (len_data <= 0)  return 0;
 
-		    tmp_buf = (char *) kmalloc (len_data, GFP_KERNEL);
-		    if (!tmp_buf)  return -ENOMEM;
-
-		    memcpy_fromfs (tmp_buf, buf_data, len_data);
-
-		    set_fs (KERNEL_DS);
-		    err = sys_send (sockmod_info->sfd,
-					tmp_buf, len_data, MSG_OOB);
-		    set_fs (USER_DS);
-
-		    kfree (tmp_buf);
+		    err = sockmod_sendmsg (sockmod_info, buf_data, len_data,
+							    MSG_OOB, NULL, 0);
 
 		    if (err < 0)  return err;
 		    else  return 0;
@@ -1017,17 +1095,8 @@ static int sockmod_putmsg (struct stream_info *stream_info,
 			sin = &inet_addr;
 		    }
 
-		    tmp_buf = (char *) kmalloc (len_data, GFP_KERNEL);
-		    if (!tmp_buf)  return -ENOMEM;
-
-		    memcpy_fromfs (tmp_buf, buf_data, len_data);
-
-		    set_fs (KERNEL_DS);
-		    err = sys_sendto (sockmod_info->sfd, tmp_buf, len_data, 0,
+		    err = sockmod_sendmsg (sockmod_info, buf_data, len_data, 0,
 							    sin, sizeof (*sin));
-		    set_fs (USER_DS);
-
-		    kfree (tmp_buf);
 
 		    if (err < 0)  return err;
 		    else  return 0;
@@ -1057,7 +1126,6 @@ static int sockmod_getmsg (struct stream_info *stream_info,
 	struct sysv_bind_ux *bux;
 	long *lp;
 	int err;
-	char *tmp_buf;
 
 	if (*len_ctl >= 0) {
 
@@ -1151,19 +1219,14 @@ static int sockmod_getmsg (struct stream_info *stream_info,
 		*len_data >= 0
 	    ) {     /*  assume it want recvmsg...   */
 
-		tmp_buf = (char *) kmalloc (*len_data, GFP_KERNEL);
-		if (!tmp_buf)  return -ENOMEM;
-
 		if (sockmod_info->type != SOCK_DGRAM) {
 
-		    set_fs (KERNEL_DS);
-		    err = sys_recv (sockmod_info->sfd, tmp_buf, *len_data, 0);
-		    set_fs (USER_DS);
-		    if (err < 0)  { kfree (tmp_buf);  return err; }
+		    err = sockmod_recvmsg (sockmod_info, buf_data, *len_data,
+							    0, NULL, NULL);
+		    if (err < 0)  return err;
 
 		    *len_ctl = -1;      /*  is it correct ???  */
 		    *len_data = err;
-		    memcpy_tofs (buf_data, tmp_buf, *len_data);
 
 		} else {
 		    lp = (long *) data;
@@ -1173,14 +1236,11 @@ static int sockmod_getmsg (struct stream_info *stream_info,
 		    lp[2] = 20;
 		    lp[3] = lp[4] = 0;
 
-		    set_fs (KERNEL_DS);
-		    err = sys_recvfrom (sockmod_info->sfd, tmp_buf, *len_data,
-				    0, (struct sockaddr_in *) &lp[5], &lp[1]);
-		    set_fs (USER_DS);
-		    if (err < 0)  { kfree (tmp_buf);  return err; }
+		    err = sockmod_recvmsg (sockmod_info, buf_data, *len_data,
+						0, &lp[5], (int *) &lp[1]);
+		    if (err < 0)  return err;
 
 		    *len_data = err;
-		    memcpy_tofs (buf_data, tmp_buf, *len_data);
 
 		    if (sockmod_info->domain == AF_UNIX) {
 			/*  convert from loopback   */
@@ -1201,8 +1261,6 @@ static int sockmod_getmsg (struct stream_info *stream_info,
 		    memcpy_tofs (buf_ctl, data, *len_ctl);
 		}
 
-		kfree (tmp_buf);
-
 		return 0;
 	    }
 
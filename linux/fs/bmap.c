@@ -0,0 +1,124 @@
+/*
+ *  linux/fs/bmap.c
+ *
+ *  Mapping ranges of file blocks to runs of device blocks
+ *
+ *  minix and xiafs keep their block pointers in the same kind of tree: a
+ *  few direct pointers in the inode, followed by the roots of a single,
+ *  a double and (minix V2) a triple indirect block. bmap() looks up one
+ *  block and reads every indirect block on the way for it. bmap_runs()
+ *  maps a whole range in one walk. It holds on to the indirect block it
+ *  used last at each level, and returns the range as runs of blocks that
+ *  follow each other on the device, so that the callers can hand each
+ *  run to ll_rw_block() in one go.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+
+static inline int bmap_ptr(const void * p, int size, int nr)
+{
+	if (size == 2)
+		return ((const __u16 *) p)[nr];
+	return ((const __u32 *) p)[nr];
+}
+
+/*
+ * Map count blocks of a file, starting at block, into at most nrun runs.
+ * direct points to the t->bt_direct direct pointers in the inode, roots
+ * to the t->bt_depth roots of the indirect trees, which need not follow
+ * them in memory (nor have their size). A run with br_block 0 is a hole,
+ * as is anything an indirect block that cannot be read would map.
+ * Returns the number of runs; they may cover fewer than count blocks if
+ * nrun is too small or the range goes past the largest possible file.
+ */
+int bmap_runs(struct inode * inode, const struct bmap_tree * t,
+	      const void * direct, const unsigned long * roots,
+	      int block, int count, struct bmap_run * run, int nrun)
+{
+	struct buffer_head * bh[BMAP_MAX_DEPTH];
+	unsigned long off, span;
+	int i, n, level, nr;
+
+	for (i = 0; i < BMAP_MAX_DEPTH; i++)
+		bh[i] = NULL;
+	n = 0;
+	for ( ; count > 0; block++, count--) {
+		if (block < t->bt_direct)
+			nr = bmap_ptr(direct, t->bt_ptrsize, block);
+		else {
+			/* find the tree and the offset within it */
+			off = block - t->bt_direct;
+			for (level = 1; level <= t->bt_depth; level++) {
+				span = 1UL << (level * t->bt_bits);
+				if (off < span)
+					break;
+				off -= span;
+			}
+			if (level > t->bt_depth)
+				break;
+			nr = roots[level - 1];
+			for (i = 0; nr && i < level; i++) {
+				if (!bh[i] || bh[i]->b_blocknr != nr) {
+					brelse(bh[i]);
+					bh[i] = bread(inode->i_dev, nr, t->bt_size);
+					if (!bh[i]) {
+						nr = 0;
+						break;
+					}
+				}
+				nr = bmap_ptr(bh[i]->b_data, t->bt_ptrsize,
+					(off >> ((level - 1 - i) * t->bt_bits)) &
+					((1 << t->bt_bits) - 1));
+			}
+		}
+		if (n && (run[n-1].br_block ?
+			  nr == run[n-1].br_block + run[n-1].br_count : !nr))
+			run[n-1].br_count++;
+		else if (n == nrun)
+			break;
+		else {
+			run[n].br_block = nr;
+			run[n].br_count = 1;
+			n++;
+		}
+	}
+	for (i = 0; i < BMAP_MAX_DEPTH; i++)
+		brelse(bh[i]);
+	return n;
+}
+
+/*
+ * generic_readpage() for file systems with a bmap_tree: the blocks of
+ * the page are mapped in one walk instead of a bmap() call each.
+ */
+int bmap_readpage(struct inode * inode, struct page * page,
+		  const struct bmap_tree * t, const void * direct,
+		  const unsigned long * roots)
+{
+	struct bmap_run run[PAGE_SIZE/512];
+	int *p, nr[PAGE_SIZE/512];
+	int i, j, n, blocks;
+
+	page->count++;
+	set_bit(PG_locked, &page->flags);
+	set_bit(PG_free_after, &page->flags);
+
+	blocks = PAGE_SIZE >> inode->i_sb->s_blocksize_bits;
+	n = bmap_runs(inode, t, direct, roots,
+		      page->offset >> inode->i_sb->s_blocksize_bits,
+		      blocks, run, blocks);
+	p = nr;
+	for (i = 0; i < n; i++)
+		for (j = 0; j < run[i].br_count; j++)
+			*p++ = run[i].br_block ? run[i].br_block + j : 0;
+	while (p < nr + blocks)
+		*p++ = 0;
+
+	/* IO start */
+	brw_page(READ, page, inode->i_dev, nr, inode->i_sb->s_blocksize, 1);
+	return 0;
+}
@@ -45,6 +45,8 @@ static char buffersize_index[17] =
 #define HASH_PAGES         4  /* number of pages to use for the hash table */
 #define NR_HASH (HASH_PAGES*PAGE_SIZE/sizeof(struct buffer_head *))
 #define HASH_MASK (NR_HASH-1)
+#define NR_FSYNC_BUFS	32	/* buffers fsync_inode_buffers() queues at once */
+#define NR_FSYNC_HIST	14	/* latency buckets: < 1ms, < 2ms, ... >= 4096ms */
 
 static int grow_buffers(int pri, int size);
 
@@ -252,40 +254,263 @@ asmlinkage int sys_sync(void)
 	return 0;
 }
 
+/*
+ * The fsync() of file systems that do not keep their dirty buffers on
+ * per-inode lists: all that can be done is flush the whole device.
+ */
+static unsigned long fsync_whole_dev = 0;
+
 int file_fsync (struct inode *inode, struct file *filp)
 {
+	fsync_whole_dev++;
 	return fsync_dev(inode->i_dev);
 }
 
-asmlinkage int sys_fsync(unsigned int fd)
+/*
+ * Per-inode dirty buffer lists.  A file system that dirties a buffer
+ * on behalf of an inode - a data block, an indirect block, a directory
+ * block - says so with mark_buffer_dirty_inode(), which puts the buffer
+ * on the inode's circular i_dirty_buffers list.  Its fsync() can then
+ * use fsync_inode_buffers() to write just those, instead of walking
+ * the whole file or the whole device.  Buffers that have been written
+ * meanwhile are taken off lazily by fsync_inode_buffers(); a buffer
+ * that is reused or freed, and an inode that is cleared, leave their
+ * lists at once.
+ */
+static inline void remove_from_inode_queue(struct buffer_head * bh)
 {
-	struct file * file;
-	struct inode * inode;
+	struct inode * inode = bh->b_inode;
 
-	if (fd>=NR_OPEN || !(file=current->files->fd[fd]) || !(inode=file->f_inode))
-		return -EBADF;
-	if (!file->f_op || !file->f_op->fsync)
-		return -EINVAL;
-	if (file->f_op->fsync(inode,file))
-		return -EIO;
+	if (!inode)
+		return;
+	if (bh->b_inode_next == bh)
+		inode->i_dirty_buffers = NULL;
+	else {
+		bh->b_inode_next->b_inode_prev = bh->b_inode_prev;
+		bh->b_inode_prev->b_inode_next = bh->b_inode_next;
+		if (inode->i_dirty_buffers == bh)
+			inode->i_dirty_buffers = bh->b_inode_next;
+	}
+	bh->b_inode = NULL;
+	bh->b_inode_next = bh->b_inode_prev = NULL;
+}
+
+void buffer_insert_inode(struct buffer_head * bh, struct inode * inode)
+{
+	struct buffer_head * head;
+
+	remove_from_inode_queue(bh);
+	bh->b_inode = inode;
+	head = inode->i_dirty_buffers;
+	if (!head) {
+		inode->i_dirty_buffers = bh->b_inode_next = bh->b_inode_prev = bh;
+		return;
+	}
+	bh->b_inode_next = head;
+	bh->b_inode_prev = head->b_inode_prev;
+	head->b_inode_prev->b_inode_next = bh;
+	head->b_inode_prev = bh;
+}
+
+/*
+ * Take all buffers off an inode's list, without writing them.
+ */
+void forget_inode_buffers(struct inode * inode)
+{
+	while (inode->i_dirty_buffers)
+		remove_from_inode_queue(inode->i_dirty_buffers);
+}
+
+/*
+ * Does the inode have buffers that still need writing?  Buffers written
+ * meanwhile (by bdflush, say) are taken off the list on the way, those
+ * whose write failed are left for fsync_inode_buffers() to report.
+ */
+int inode_has_dirty_buffers(struct inode * inode)
+{
+	struct buffer_head * bh, * next;
+
+	while ((bh = inode->i_dirty_buffers) != NULL) {
+		do {
+			next = bh->b_inode_next;
+			if (buffer_dirty(bh) || buffer_locked(bh) ||
+			    !buffer_uptodate(bh))
+				return 1;
+			remove_from_inode_queue(bh);
+			bh = next;
+		} while (inode->i_dirty_buffers && bh != inode->i_dirty_buffers);
+	}
 	return 0;
 }
 
-asmlinkage int sys_fdatasync(unsigned int fd)
+static void fsync_write_bufs(int n, struct buffer_head ** bhs)
+{
+	int i;
+
+	if (n) {
+		ll_rw_block(WRITE, n, bhs);
+		for (i = 0; i < n; i++)
+			bhs[i]->b_count--;
+	}
+}
+
+/*
+ * Write out the buffers on an inode's list and wait for them, the way
+ * sync_buffers() does for a device: pass 0 starts writing what is dirty
+ * and unlocked, pass 1 waits for the locked ones and writes those that
+ * were dirtied while locked, pass 2 just waits.  Clean buffers leave the
+ * list.  Each pass only goes as far as the buffer that was last on the
+ * list when it started, so that buffers appended meanwhile cannot keep
+ * it going; the next buffer is held while we sleep so that the walk can
+ * carry on from it.  Returns -EIO if a buffer could not be written.
+ */
+int fsync_inode_buffers(struct inode * inode)
+{
+	struct buffer_head * bh, * next, * stop, * bhs[NR_FSYNC_BUFS];
+	int n, done, waited, pass, err = 0;
+
+	for (pass = 0; pass < 3; pass++) {
+		if (!(bh = inode->i_dirty_buffers))
+			break;
+		stop = bh->b_inode_prev;
+		stop->b_count++;
+		n = 0;
+		waited = 0;
+		for (;;) {
+			done = (bh == stop);
+			next = bh->b_inode_next;
+			if (buffer_locked(bh)) {
+				if (pass && !waited) {
+					/* write what we have, then wait */
+					next = bh;
+					next->b_count++;
+					fsync_write_bufs(n, bhs);
+					n = 0;
+					wait_on_buffer(bh);
+					next->b_count--;
+					waited = 1;
+					goto sleep;
+				}
+			} else if (buffer_dirty(bh)) {
+				if (pass < 2) {
+					bh->b_count++;
+					bhs[n++] = bh;
+					if (n == NR_FSYNC_BUFS && !done) {
+						next->b_count++;
+						fsync_write_bufs(n, bhs);
+						n = 0;
+						next->b_count--;
+						goto sleep;
+					}
+				}
+			} else {
+				if (buffer_req(bh) && !buffer_uptodate(bh))
+					err = -EIO;
+				remove_from_inode_queue(bh);
+			}
+			waited = 0;
+			if (done || !inode->i_dirty_buffers)
+				break;
+			bh = next;
+			continue;
+sleep:
+			if (!inode->i_dirty_buffers)
+				break;
+			/* bforget() may have taken stop or next off the list */
+			if (stop->b_inode != inode) {
+				stop->b_count--;
+				stop = inode->i_dirty_buffers->b_inode_prev;
+				stop->b_count++;
+			}
+			bh = (next->b_inode == inode) ? next : inode->i_dirty_buffers;
+		}
+		fsync_write_bufs(n, bhs);
+		stop->b_count--;
+	}
+	return err;
+}
+
+/*
+ * fsync() and fdatasync() latency, for /proc/fsync: [0] counts calls
+ * that took under 1ms, [i] those under 2^i ms, the last one the rest.
+ */
+static unsigned long fsync_hist[2][NR_FSYNC_HIST];
+static unsigned long fsync_ms[2], fsync_max[2];
+
+static void fsync_account(int datasync, struct timeval * start)
+{
+	struct timeval now;
+	unsigned long ms;
+	int i;
+
+	do_gettimeofday(&now);
+	ms = (now.tv_sec - start->tv_sec) * 1000 +
+	     (now.tv_usec - start->tv_usec) / 1000;
+	if ((long) ms < 0)
+		ms = 0;
+	for (i = 0; i < NR_FSYNC_HIST - 1 && ms >= (1UL << i); i++)
+		;
+	fsync_hist[datasync][i]++;
+	fsync_ms[datasync] += ms;
+	if (ms > fsync_max[datasync])
+		fsync_max[datasync] = ms;
+}
+
+int get_fsync_stats(char * buffer)
+{
+	unsigned long calls[2];
+	int i, len;
+
+	len = sprintf(buffer, "%-10s %10s %10s\n", "ms", "fsync", "fdatasync");
+	calls[0] = calls[1] = 0;
+	for (i = 0; i < NR_FSYNC_HIST; i++) {
+		calls[0] += fsync_hist[0][i];
+		calls[1] += fsync_hist[1][i];
+		len += sprintf(buffer + len, "%2s%-8lu %10lu %10lu\n",
+			       i < NR_FSYNC_HIST - 1 ? "<" : ">=",
+			       i < NR_FSYNC_HIST - 1 ? 1UL << i : 1UL << (i - 1),
+			       fsync_hist[0][i], fsync_hist[1][i]);
+	}
+	len += sprintf(buffer + len, "%-10s %10lu %10lu\n",
+		       "calls", calls[0], calls[1]);
+	len += sprintf(buffer + len, "%-10s %10lu %10lu\n",
+		       "total_ms", fsync_ms[0], fsync_ms[1]);
+	len += sprintf(buffer + len, "%-10s %10lu %10lu\n",
+		       "max_ms", fsync_max[0], fsync_max[1]);
+	len += sprintf(buffer + len, "whole device: %lu\n", fsync_whole_dev);
+	return len;
+}
+
+static int do_fsync(unsigned int fd, int datasync)
 {
 	struct file * file;
 	struct inode * inode;
+	struct timeval start;
+	int err;
 
 	if (fd>=NR_OPEN || !(file=current->files->fd[fd]) || !(inode=file->f_inode))
 		return -EBADF;
 	if (!file->f_op || !file->f_op->fsync)
 		return -EINVAL;
-	/* this needs further work, at the moment it is identical to fsync() */
-	if (file->f_op->fsync(inode,file))
+	do_gettimeofday(&start);
+	err = file->f_op->fsync(inode,file);
+	fsync_account(datasync, &start);
+	if (err)
 		return -EIO;
 	return 0;
 }
 
+asmlinkage int sys_fsync(unsigned int fd)
+{
+	return do_fsync(fd, 0);
+}
+
+asmlinkage int sys_fdatasync(unsigned int fd)
+{
+	/* this needs further work, at the moment it is identical to fsync() */
+	return do_fsync(fd, 1);
+}
+
 void invalidate_buffers(kdev_t dev)
 {
 	int i;
@@ -702,6 +927,7 @@ repeat:
 			candidate[i] = bh->b_next_free;
 			if(candidate[i] == bh) candidate[i] = NULL;  /* Got last one */
 			remove_from_queues(bh);
+			remove_from_inode_queue(bh);
 			bh->b_dev = B_FREE;
 			put_last_free(bh);
 			needed -= bh->b_size;
@@ -845,7 +1071,13 @@ void refile_buffer(struct buffer_head * buf)
 		dispose = BUF_LOCKED;
 	else
 		dispose = BUF_CLEAN;
-	if(dispose == BUF_CLEAN) buf->b_lru_time = jiffies;
+	if(dispose == BUF_CLEAN) {
+		buf->b_lru_time = jiffies;
+		/* written: no fsync() needs it any more, unless one is
+		   holding it as the place to carry on from */
+		if (buf->b_inode && !buf->b_count && buffer_uptodate(buf))
+			remove_from_inode_queue(buf);
+	}
 	if(dispose != buf->b_list)  {
 		if(dispose == BUF_DIRTY)
 			 buf->b_lru_time = jiffies;
@@ -900,6 +1132,7 @@ void __bforget(struct buffer_head * buf)
 	clear_bit(BH_Protected, &buf->b_state);
 	buf->b_count--;
 	remove_from_hash_queue(buf);
+	remove_from_inode_queue(buf);
 	buf->b_dev = NODEV;
 	refile_buffer(buf);
 }
@@ -1459,6 +1692,7 @@ int try_to_free_buffer(struct buffer_head * bh, struct buffer_head ** bhp,
 		      *bhp = NULL;
 		  }
 		remove_from_queues(p);
+		remove_from_inode_queue(p);
 		put_unused_buffer_head(p);
 	} while (tmp != bh);
 	buffermem -= PAGE_SIZE;
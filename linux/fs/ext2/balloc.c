@@ -22,6 +22,13 @@
  * super block.  Each descriptor contains the number of the bitmap block and
  * the free blocks count in the block.  The descriptors are loaded in memory
  * when a file system is mounted (see ext2_read_super).
+ *
+ * For each group an upper bound on its longest run of free blocks is kept
+ * in s_max_free_run.  It starts as the free blocks count, is made exact
+ * whenever the bitmap is read or searched in vain, only shrinks when
+ * blocks are allocated and grows by the merged run when they are freed.
+ * The allocator uses it to pass over fragmented groups without reading
+ * their bitmaps.
  */
 
 #include <linux/fs.h>
@@ -30,11 +37,16 @@
 #include <linux/sched.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
+#include <linux/malloc.h>
 
 #include <asm/bitops.h>
 
 #define in_range(b, first, len)		((b) >= (first) && (b) <= (first) + (len) - 1)
 
+/* a group is worth a bitmap read if it may hold a whole free byte */
+#define WANT_FREE_RUN	8
+
 static struct ext2_group_desc * get_group_desc (struct super_block * sb,
 						unsigned int block_group,
 						struct buffer_head ** bh)
@@ -67,6 +79,55 @@ static struct ext2_group_desc * get_group_desc (struct super_block * sb,
 	return gdp + desc;
 }
 
+/*
+ * Number of blocks in a group: the last one may be short.
+ */
+static inline unsigned long group_blocks (struct super_block * sb,
+					  unsigned int block_group)
+{
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+	unsigned long first = block_group * EXT2_BLOCKS_PER_GROUP(sb) +
+			      e_swab (bs, sb->u.ext2_sb.s_es->s_first_data_block);
+	unsigned long count = e_swab (bs, sb->u.ext2_sb.s_es->s_blocks_count);
+
+	if (count - first < EXT2_BLOCKS_PER_GROUP(sb))
+		return count - first;
+	return EXT2_BLOCKS_PER_GROUP(sb);
+}
+
+/*
+ * Length of the longest run of clear bits in the first nbits of map.
+ */
+static unsigned long max_free_run (const char * map, unsigned long nbits)
+{
+	unsigned long i = 0, run = 0, max = 0;
+
+	while (i < nbits) {
+		if (!(i & 7) && i + 8 <= nbits) {
+			if (!map[i >> 3]) {
+				run += 8;
+				i += 8;
+				continue;
+			}
+			if ((unsigned char) map[i >> 3] == 0xff) {
+				if (run > max)
+					max = run;
+				run = 0;
+				i += 8;
+				continue;
+			}
+		}
+		if (ext2_test_bit (i, map)) {
+			if (run > max)
+				max = run;
+			run = 0;
+		} else
+			run++;
+		i++;
+	}
+	return run > max ? run : max;
+}
+
 /*
  * Read the bitmap for a given block_group, reading into the specified 
  * slot in the superblock's bitmap cache.
@@ -100,6 +161,9 @@ static int read_block_bitmap (struct super_block * sb,
 	 */
 	sb->u.ext2_sb.s_block_bitmap_number[bitmap_nr] = block_group;
 	sb->u.ext2_sb.s_block_bitmap[bitmap_nr] = bh;
+	if (bh)
+		sb->u.ext2_sb.s_max_free_run[block_group] =
+			max_free_run (bh->b_data, group_blocks (sb, block_group));
 	return retval;
 }
 
@@ -111,8 +175,9 @@ static int read_block_bitmap (struct super_block * sb,
  *
  * Notes:
  * 1/ There is one cache per mounted file system.
- * 2/ If the file system contains less than EXT2_MAX_GROUP_LOADED groups,
- *    this function reads the bitmap without maintaining a LRU cache.
+ * 2/ If the file system contains no more groups than the cache has slots
+ *    (s_block_bitmap_slots), this function reads the bitmap without
+ *    maintaining a LRU cache.
  *
  * Return the slot used to store the bitmap, or a -ve error code.
  */
@@ -129,7 +194,7 @@ static int load__block_bitmap (struct super_block * sb,
 			    "block_group = %d, groups_count = %lu",
 			    block_group, sb->u.ext2_sb.s_groups_count);
 
-	if (sb->u.ext2_sb.s_groups_count <= EXT2_MAX_GROUP_LOADED) {
+	if (sb->u.ext2_sb.s_groups_count <= sb->u.ext2_sb.s_block_bitmap_slots) {
 		if (sb->u.ext2_sb.s_block_bitmap[block_group]) {
 			if (sb->u.ext2_sb.s_block_bitmap_number[block_group] !=
 			    block_group)
@@ -169,10 +234,11 @@ static int load__block_bitmap (struct super_block * sb,
 		if (!block_bitmap)
 			retval = read_block_bitmap (sb, block_group, 0);
 	} else {
-		if (sb->u.ext2_sb.s_loaded_block_bitmaps < EXT2_MAX_GROUP_LOADED)
+		if (sb->u.ext2_sb.s_loaded_block_bitmaps <
+		    sb->u.ext2_sb.s_block_bitmap_slots)
 			sb->u.ext2_sb.s_loaded_block_bitmaps++;
 		else
-			brelse (sb->u.ext2_sb.s_block_bitmap[EXT2_MAX_GROUP_LOADED - 1]);
+			brelse (sb->u.ext2_sb.s_block_bitmap[sb->u.ext2_sb.s_block_bitmap_slots - 1]);
 		for (j = sb->u.ext2_sb.s_loaded_block_bitmaps - 1; j > 0;  j--) {
 			sb->u.ext2_sb.s_block_bitmap_number[j] =
 				sb->u.ext2_sb.s_block_bitmap_number[j - 1];
@@ -193,7 +259,7 @@ static int load__block_bitmap (struct super_block * sb,
  * success, or a -ve error code.
  *
  * There is still one inconsistancy here --- if the number of groups in this
- * filesystems is <= EXT2_MAX_GROUP_LOADED, then we have no way of 
+ * filesystems is <= s_block_bitmap_slots, then we have no way of 
  * differentiating between a group for which we have never performed a bitmap
  * IO request, and a group for which the last bitmap read request failed.
  */
@@ -215,7 +281,7 @@ static inline int load_block_bitmap (struct super_block * sb,
 	 * Or can we do a fast lookup based on a loaded group on a filesystem
 	 * small enough to be mapped directly into the superblock?
 	 */
-	else if (sb->u.ext2_sb.s_groups_count <= EXT2_MAX_GROUP_LOADED && 
+	else if (sb->u.ext2_sb.s_groups_count <= sb->u.ext2_sb.s_block_bitmap_slots &&
 		 sb->u.ext2_sb.s_block_bitmap_number[block_group] == block_group &&
 		 sb->u.ext2_sb.s_block_bitmap[block_group]) {
 		slot = block_group;
@@ -328,6 +394,22 @@ void ext2_free_blocks (const struct inode * inode, unsigned long block,
 				    e_swab (bs, es->s_free_blocks_count) + 1);
 		}
 	}
+
+	/*
+	 * The freed blocks may have joined two free runs.
+	 */
+	if (sb->u.ext2_sb.s_max_free_run[block_group] <
+	    e_swab (bs, gdp->bg_free_blocks_count)) {
+		unsigned long run = count;
+		unsigned long end = group_blocks (sb, block_group);
+
+		for (i = bit; i > 0 && !ext2_test_bit (i - 1, bh->b_data); i--)
+			run++;
+		for (i = bit + count; i < end && !ext2_test_bit (i, bh->b_data); i++)
+			run++;
+		if (run > sb->u.ext2_sb.s_max_free_run[block_group])
+			sb->u.ext2_sb.s_max_free_run[block_group] = run;
+	}
 	
 	mark_buffer_dirty(bh2, 1);
 	mark_buffer_dirty(sb->u.ext2_sb.s_sbh, 1);
@@ -453,6 +535,8 @@ repeat:
 			j = k;
 			goto search_back;
 		}
+		sb->u.ext2_sb.s_max_free_run[i] =
+			max_free_run (bh->b_data, group_blocks (sb, i));
 		k = ext2_find_next_zero_bit ((unsigned long *) bh->b_data, 
 					EXT2_BLOCKS_PER_GROUP(sb),
 					j);
@@ -467,15 +551,29 @@ repeat:
 	/*
 	 * Now search the rest of the groups.  We assume that 
 	 * i and gdp correctly point to the last group visited.
+	 * Groups known to have no free run of WANT_FREE_RUN blocks are
+	 * passed over first; only if nothing else is left do we settle
+	 * for any free block.
 	 */
 	for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
 		i++;
 		if (i >= sb->u.ext2_sb.s_groups_count)
 			i = 0;
 		gdp = get_group_desc (sb, i, &bh2);
-		if (e_swab (bs, gdp->bg_free_blocks_count) > 0)
+		if (e_swab (bs, gdp->bg_free_blocks_count) > 0 &&
+		    sb->u.ext2_sb.s_max_free_run[i] >= WANT_FREE_RUN)
 			break;
 	}
+	if (k >= sb->u.ext2_sb.s_groups_count) {
+		for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
+			i++;
+			if (i >= sb->u.ext2_sb.s_groups_count)
+				i = 0;
+			gdp = get_group_desc (sb, i, &bh2);
+			if (e_swab (bs, gdp->bg_free_blocks_count) > 0)
+				break;
+		}
+	}
 	if (k >= sb->u.ext2_sb.s_groups_count) {
 		unlock_super (sb);
 		return 0;
@@ -493,8 +591,9 @@ repeat:
 	j = (r - bh->b_data) << 3;
 	if (j < EXT2_BLOCKS_PER_GROUP(sb))
 		goto search_back;
-	else
-		j = ext2_find_first_zero_bit ((unsigned long *) bh->b_data,
+	sb->u.ext2_sb.s_max_free_run[i] =
+		max_free_run (bh->b_data, group_blocks (sb, i));
+	j = ext2_find_first_zero_bit ((unsigned long *) bh->b_data,
 					 EXT2_BLOCKS_PER_GROUP(sb));
 	if (j >= EXT2_BLOCKS_PER_GROUP(sb)) {
 		ext2_error (sb, "ext2_new_block",
@@ -600,7 +699,7 @@ got_block:
 	}
 	memset(bh->b_data, 0, sb->s_blocksize);
 	mark_buffer_uptodate(bh, 1);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, (struct inode *) inode);
 	brelse (bh);
 
 	ext2_debug ("allocating block %d. "
@@ -608,6 +707,9 @@ got_block:
 
 	e_set_swab (bs, gdp->bg_free_blocks_count,
 		    e_swab (bs, gdp->bg_free_blocks_count) - 1);
+	if (sb->u.ext2_sb.s_max_free_run[i] > e_swab (bs, gdp->bg_free_blocks_count))
+		sb->u.ext2_sb.s_max_free_run[i] =
+			e_swab (bs, gdp->bg_free_blocks_count);
 	mark_buffer_dirty(bh2, 1);
 	e_set_swab (bs, es->s_free_blocks_count,
 		    e_swab (bs, es->s_free_blocks_count) - 1);
@@ -618,6 +720,70 @@ got_block:
 	return j;
 }
 
+/*
+ * Set up the block bitmap cache with the given number of slots, 0 meaning
+ * one per megabyte of memory, and the free run bounds of the groups.
+ */
+int ext2_setup_block_bitmaps (struct super_block * sb, unsigned long slots)
+{
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+	unsigned long groups = sb->u.ext2_sb.s_groups_count;
+	unsigned long i;
+
+	if (!slots) {
+		slots = high_memory >> 20;
+		if (slots < EXT2_MAX_GROUP_LOADED)
+			slots = EXT2_MAX_GROUP_LOADED;
+	}
+	if (slots > EXT2_MAX_BITMAPS_LOADED)
+		slots = EXT2_MAX_BITMAPS_LOADED;
+	if (slots > groups)
+		slots = groups;
+
+	sb->u.ext2_sb.s_block_bitmap_number =
+		kmalloc (slots * sizeof (unsigned long), GFP_KERNEL);
+	sb->u.ext2_sb.s_block_bitmap =
+		kmalloc (slots * sizeof (struct buffer_head *), GFP_KERNEL);
+	sb->u.ext2_sb.s_max_free_run =
+		kmalloc (groups * sizeof (unsigned long), GFP_KERNEL);
+	if (!sb->u.ext2_sb.s_block_bitmap_number ||
+	    !sb->u.ext2_sb.s_block_bitmap ||
+	    !sb->u.ext2_sb.s_max_free_run) {
+		sb->u.ext2_sb.s_block_bitmap_slots = 0;
+		ext2_release_block_bitmaps (sb);
+		return -ENOMEM;
+	}
+	for (i = 0; i < slots; i++) {
+		sb->u.ext2_sb.s_block_bitmap_number[i] = 0;
+		sb->u.ext2_sb.s_block_bitmap[i] = NULL;
+	}
+	for (i = 0; i < groups; i++)
+		sb->u.ext2_sb.s_max_free_run[i] =
+			e_swab (bs, get_group_desc (sb, i, NULL)->bg_free_blocks_count);
+	sb->u.ext2_sb.s_block_bitmap_slots = slots;
+	sb->u.ext2_sb.s_loaded_block_bitmaps = 0;
+	return 0;
+}
+
+void ext2_release_block_bitmaps (struct super_block * sb)
+{
+	unsigned long i;
+
+	for (i = 0; i < sb->u.ext2_sb.s_block_bitmap_slots; i++)
+		if (sb->u.ext2_sb.s_block_bitmap[i])
+			brelse (sb->u.ext2_sb.s_block_bitmap[i]);
+	if (sb->u.ext2_sb.s_block_bitmap_number)
+		kfree (sb->u.ext2_sb.s_block_bitmap_number);
+	if (sb->u.ext2_sb.s_block_bitmap)
+		kfree (sb->u.ext2_sb.s_block_bitmap);
+	if (sb->u.ext2_sb.s_max_free_run)
+		kfree (sb->u.ext2_sb.s_max_free_run);
+	sb->u.ext2_sb.s_block_bitmap_number = NULL;
+	sb->u.ext2_sb.s_block_bitmap = NULL;
+	sb->u.ext2_sb.s_max_free_run = NULL;
+	sb->u.ext2_sb.s_block_bitmap_slots = 0;
+}
+
 unsigned long ext2_count_free_blocks (struct super_block * sb)
 {
 #ifdef EXT2FS_DEBUG
@@ -0,0 +1,547 @@
+/*
+ *  linux/fs/ext2/dirindex.c
+ *
+ *  In-memory hash index of large directories
+ *
+ *  A directory of EXT2_DIR_INDEX_BLOCKS blocks or more is indexed the
+ *  first time it is searched: every name is hashed to its offset in the
+ *  directory, and the largest record that still fits in each block is
+ *  remembered.  Lookups then read only the block holding the name (or
+ *  none at all for a name which is not there), and ext2_add_entry()
+ *  goes straight to a block with room.  The disk format is unchanged.
+ *
+ *  The indexes are kept per super block, EXT2_MAX_DIR_INDEXES of them
+ *  in LRU order, keyed by inode number, so they survive the directory
+ *  inode being released between two lookups.  They are kept up to date
+ *  by ext2_add_entry() and ext2_delete_entry(); anything unexpected
+ *  (an entry not where the index says, a size change the index did not
+ *  see, no memory) simply drops the index and the caller falls back to
+ *  the linear scan.  Enabled with the "dirindex" mount option.
+ */
+
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/ext2_fs.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/locks.h>
+#include <linux/malloc.h>
+#include <linux/mm.h>
+
+#define DINDEX_RA_BLOCKS	8	/* blocks read at once while building */
+
+struct dindex_ent {
+	__u32 de_hash;
+	__u32 de_offset;		/* of the entry in the directory */
+	int de_next;			/* next on the chain, or -1 */
+};
+
+struct ext2_dir_index {
+	struct ext2_dir_index * di_next;	/* LRU list, most recent first */
+	unsigned long di_ino;
+	unsigned long di_stamp;		/* changes when arrays are replaced */
+	unsigned long di_blocks;	/* directory blocks covered */
+	unsigned long di_room_size;	/* allocated entries of di_room */
+	unsigned short * di_room;	/* per block, largest record that fits */
+	int di_size;			/* allocated entries of di_ent */
+	int di_used;			/* entries ever handed out */
+	int di_free;			/* first released entry, or -1 */
+	int * di_bucket;		/* di_size / 2 chain heads */
+	struct dindex_ent * di_ent;
+};
+
+static inline __u32 dindex_hash (const char * name, int len)
+{
+	__u32 hash = 5381;
+
+	while (len--)
+		hash = (hash << 5) + hash + (unsigned char) *name++;
+	return hash;
+}
+
+static void * dindex_alloc (unsigned long size)
+{
+	if (size <= PAGE_SIZE / 4)
+		return kmalloc (size, GFP_KERNEL);
+	return vmalloc (size);
+}
+
+static void dindex_free (void * p, unsigned long size)
+{
+	if (!p)
+		return;
+	if (size <= PAGE_SIZE / 4)
+		kfree_s (p, size);
+	else
+		vfree (p);
+}
+
+static void dindex_destroy (struct ext2_dir_index * di)
+{
+	dindex_free (di->di_room, di->di_room_size * sizeof (unsigned short));
+	dindex_free (di->di_bucket, di->di_size / 2 * sizeof (int));
+	dindex_free (di->di_ent, di->di_size * sizeof (struct dindex_ent));
+	kfree_s (di, sizeof (*di));
+}
+
+/*
+ * Find the index of a directory and move it to the head of the list
+ */
+static struct ext2_dir_index * dindex_get (struct inode * dir)
+{
+	struct ext2_dir_index ** p, * di;
+
+	for (p = &dir->i_sb->u.ext2_sb.s_dir_index; (di = *p); p = &di->di_next)
+		if (di->di_ino == dir->i_ino) {
+			*p = di->di_next;
+			di->di_next = dir->i_sb->u.ext2_sb.s_dir_index;
+			dir->i_sb->u.ext2_sb.s_dir_index = di;
+			return di;
+		}
+	return NULL;
+}
+
+static void dindex_install (struct super_block * sb, struct ext2_dir_index * di)
+{
+	struct ext2_dir_index ** p;
+
+	if (sb->u.ext2_sb.s_dir_indexes >= EXT2_MAX_DIR_INDEXES) {
+		for (p = &sb->u.ext2_sb.s_dir_index; (*p)->di_next;
+		     p = &(*p)->di_next)
+			;
+		dindex_destroy (*p);
+		*p = NULL;
+		sb->u.ext2_sb.s_dir_indexes--;
+	}
+	di->di_next = sb->u.ext2_sb.s_dir_index;
+	sb->u.ext2_sb.s_dir_index = di;
+	sb->u.ext2_sb.s_dir_indexes++;
+}
+
+/*
+ * Take the index of a directory off the list, either to free it or to
+ * work on it while asleep
+ */
+static struct ext2_dir_index * dindex_unlink (struct inode * dir)
+{
+	struct ext2_dir_index ** p, * di;
+
+	for (p = &dir->i_sb->u.ext2_sb.s_dir_index; (di = *p); p = &di->di_next)
+		if (di->di_ino == dir->i_ino) {
+			*p = di->di_next;
+			dir->i_sb->u.ext2_sb.s_dir_indexes--;
+			return di;
+		}
+	return NULL;
+}
+
+void ext2_dindex_drop (struct inode * dir)
+{
+	struct ext2_dir_index * di = dindex_unlink (dir);
+
+	if (di)
+		dindex_destroy (di);
+}
+
+void ext2_dindex_release (struct super_block * sb)
+{
+	struct ext2_dir_index * di;
+
+	while ((di = sb->u.ext2_sb.s_dir_index)) {
+		sb->u.ext2_sb.s_dir_index = di->di_next;
+		dindex_destroy (di);
+	}
+	sb->u.ext2_sb.s_dir_indexes = 0;
+}
+
+/*
+ * Largest record which can still be placed in a directory block
+ */
+static unsigned short dindex_room (struct buffer_head * bh, int bs)
+{
+	struct ext2_dir_entry * de = (struct ext2_dir_entry *) bh->b_data;
+	char * dlimit = bh->b_data + bh->b_size;
+	unsigned short room = 0, rec_len, n;
+
+	while ((char *) de < dlimit) {
+		rec_len = e_swab (bs, de->rec_len);
+		if (rec_len < EXT2_DIR_REC_LEN(1))
+			break;
+		n = de->inode ? rec_len -
+			EXT2_DIR_REC_LEN(e_swab (bs, de->name_len)) : rec_len;
+		if (n > room)
+			room = n;
+		de = (struct ext2_dir_entry *) ((char *) de + rec_len);
+	}
+	return room;
+}
+
+/*
+ * Allocate the arrays for "size" names and "blocks" blocks and move
+ * the contents of the old ones over.  The allocation may sleep, so the
+ * index must not be on the list meanwhile.
+ */
+static int dindex_resize (struct ext2_dir_index * di, int size,
+			  unsigned long blocks)
+{
+	struct dindex_ent * ent = di->di_ent;
+	int * bucket = di->di_bucket;
+	unsigned short * room = di->di_room;
+	int i, j, k;
+
+	if (size > di->di_size) {
+		ent = dindex_alloc (size * sizeof (struct dindex_ent));
+		bucket = dindex_alloc (size / 2 * sizeof (int));
+		if (!ent || !bucket) {
+			dindex_free (ent, size * sizeof (struct dindex_ent));
+			dindex_free (bucket, size / 2 * sizeof (int));
+			return -ENOMEM;
+		}
+		for (i = 0; i < size / 2; i++)
+			bucket[i] = -1;
+		for (i = 0; i < di->di_size / 2; i++)
+			for (j = di->di_bucket[i]; j >= 0; j = di->di_ent[j].de_next) {
+				ent[j] = di->di_ent[j];
+				k = ent[j].de_hash & (size / 2 - 1);
+				ent[j].de_next = bucket[k];
+				bucket[k] = j;
+			}
+	}
+	if (blocks > di->di_room_size) {
+		room = dindex_alloc (blocks * sizeof (unsigned short));
+		if (!room) {
+			if (ent != di->di_ent) {
+				dindex_free (ent, size * sizeof (struct dindex_ent));
+				dindex_free (bucket, size / 2 * sizeof (int));
+			}
+			return -ENOMEM;
+		}
+		if (di->di_room)
+			memcpy (room, di->di_room,
+				di->di_blocks * sizeof (unsigned short));
+	}
+	if (ent != di->di_ent) {
+		/* released entries are only linked on the free list */
+		for (i = di->di_free; i >= 0; i = j) {
+			j = di->di_ent[i].de_next;
+			ent[i].de_hash = 0;
+			ent[i].de_next = j;
+		}
+		dindex_free (di->di_bucket, di->di_size / 2 * sizeof (int));
+		dindex_free (di->di_ent, di->di_size * sizeof (struct dindex_ent));
+		di->di_ent = ent;
+		di->di_bucket = bucket;
+		di->di_size = size;
+	}
+	if (room != di->di_room) {
+		dindex_free (di->di_room,
+			     di->di_room_size * sizeof (unsigned short));
+		di->di_room = room;
+		di->di_room_size = blocks;
+	}
+	di->di_stamp = ++event;
+	return 0;
+}
+
+/*
+ * Enter a name at the given directory offset.  The caller has made
+ * sure there is a free entry.
+ */
+static void dindex_insert (struct ext2_dir_index * di, __u32 hash,
+			   unsigned long offset)
+{
+	int i, k;
+
+	if (di->di_free >= 0) {
+		i = di->di_free;
+		di->di_free = di->di_ent[i].de_next;
+	} else
+		i = di->di_used++;
+	k = hash & (di->di_size / 2 - 1);
+	di->di_ent[i].de_hash = hash;
+	di->di_ent[i].de_offset = offset;
+	di->di_ent[i].de_next = di->di_bucket[k];
+	di->di_bucket[k] = i;
+}
+
+static inline int dindex_full (struct ext2_dir_index * di)
+{
+	return di->di_free < 0 && di->di_used >= di->di_size;
+}
+
+/*
+ * Read the whole directory and build its index.  Nothing is installed
+ * if the directory changes meanwhile.
+ */
+static struct ext2_dir_index * dindex_build (struct inode * dir)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh[DINDEX_RA_BLOCKS];
+	struct buffer_head * bh_read[DINDEX_RA_BLOCKS];
+	struct ext2_dir_index * di;
+	struct ext2_dir_entry * de;
+	unsigned long version = dir->i_version;
+	unsigned long blocks, block, offset;
+	int i, n, toread, size, err;
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+
+	blocks = dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb);
+	di = kmalloc (sizeof (*di), GFP_KERNEL);
+	if (!di)
+		return NULL;
+	memset (di, 0, sizeof (*di));
+	di->di_ino = dir->i_ino;
+	di->di_free = -1;
+	/* a guess of 32 bytes a name; grown as needed */
+	for (size = 64; size < (sb->s_blocksize >> 5) * blocks; size <<= 1)
+		;
+	if (dindex_resize (di, size, blocks))
+		goto failed;
+
+	for (block = 0; block < blocks; block += n) {
+		n = blocks - block;
+		if (n > DINDEX_RA_BLOCKS)
+			n = DINDEX_RA_BLOCKS;
+		toread = 0;
+		for (i = 0; i < n; i++) {
+			bh[i] = ext2_getblk (dir, block + i, 0, &err);
+			if (bh[i] && !buffer_uptodate(bh[i]))
+				bh_read[toread++] = bh[i];
+		}
+		if (toread)
+			ll_rw_block (READ, toread, bh_read);
+		for (i = 0; i < n; i++) {
+			if (!bh[i])
+				goto failed_release;
+			wait_on_buffer (bh[i]);
+			if (!buffer_uptodate(bh[i]))
+				goto failed_release;
+			offset = (block + i) << EXT2_BLOCK_SIZE_BITS(sb);
+			de = (struct ext2_dir_entry *) bh[i]->b_data;
+			while ((char *) de < bh[i]->b_data + sb->s_blocksize) {
+				if (!ext2_check_dir_entry ("ext2_dindex_build",
+							   dir, de, bh[i],
+							   offset, bs))
+					goto failed_release;
+				if (de->inode) {
+					if (dindex_full (di) &&
+					    dindex_resize (di, di->di_size * 2,
+							   blocks))
+						goto failed_release;
+					dindex_insert (di,
+						dindex_hash (de->name,
+							e_swab (bs, de->name_len)),
+						offset);
+				}
+				offset += e_swab (bs, de->rec_len);
+				de = (struct ext2_dir_entry *) ((char *) de +
+					e_swab (bs, de->rec_len));
+			}
+			di->di_room[block + i] = dindex_room (bh[i], bs);
+		}
+		for (i = 0; i < n; i++)
+			brelse (bh[i]);
+	}
+	di->di_blocks = blocks;
+
+	if (dir->i_version != version ||
+	    dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb) != blocks ||
+	    !test_opt (sb, DIR_INDEX) || dindex_get (dir))
+		goto failed;
+	dindex_install (sb, di);
+	return di;
+
+failed_release:
+	for (i = 0; i < n; i++)
+		brelse (bh[i]);
+failed:
+	dindex_destroy (di);
+	return NULL;
+}
+
+/*
+ * The index of a directory if it is usable, building it if needed
+ */
+static struct ext2_dir_index * dindex_find (struct inode * dir)
+{
+	struct super_block * sb = dir->i_sb;
+	struct ext2_dir_index * di;
+
+	if (!test_opt (sb, DIR_INDEX))
+		return NULL;
+	di = dindex_get (dir);
+	if (di && di->di_blocks != dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb)) {
+		ext2_dindex_drop (dir);
+		di = NULL;
+	}
+	if (!di && dir->i_size >= EXT2_DIR_INDEX_BLOCKS * sb->s_blocksize)
+		di = dindex_build (dir);
+	return di;
+}
+
+/*
+ * Look a name up through the index.  Returns 0 if the directory has no
+ * usable index and must be searched; otherwise 1, with the buffer and
+ * entry of the name, or a NULL buffer if the name is not there.
+ */
+int ext2_dindex_lookup (struct inode * dir, const char * name, int namelen,
+			struct buffer_head ** res_bh,
+			struct ext2_dir_entry ** res_dir)
+{
+	struct super_block * sb = dir->i_sb;
+	struct ext2_dir_index * di;
+	struct ext2_dir_entry * de;
+	struct buffer_head * bh;
+	unsigned long version, stamp, offset;
+	__u32 hash;
+	int i, err;
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+
+	*res_bh = NULL;
+	*res_dir = NULL;
+	if (!namelen || !(di = dindex_find (dir)))
+		return 0;
+	hash = dindex_hash (name, namelen);
+	i = di->di_bucket[hash & (di->di_size / 2 - 1)];
+	for (; i >= 0; i = di->di_ent[i].de_next) {
+		if (di->di_ent[i].de_hash != hash)
+			continue;
+		offset = di->di_ent[i].de_offset;
+		version = dir->i_version;
+		stamp = di->di_stamp;
+		bh = ext2_bread (dir, offset >> EXT2_BLOCK_SIZE_BITS(sb), 0,
+				 &err);
+		/* the directory or its index may have changed while asleep */
+		if (dir->i_version != version || dindex_get (dir) != di ||
+		    di->di_stamp != stamp) {
+			brelse (bh);
+			return 0;
+		}
+		if (!bh)
+			goto stale;
+		de = (struct ext2_dir_entry *) (bh->b_data +
+			(offset & (sb->s_blocksize - 1)));
+		if (!ext2_check_dir_entry ("ext2_dindex_lookup", dir, de, bh,
+					   offset, bs) || !de->inode ||
+		    dindex_hash (de->name, e_swab (bs, de->name_len)) != hash) {
+			brelse (bh);
+			goto stale;
+		}
+		if (e_swab (bs, de->name_len) == namelen &&
+		    !memcmp (de->name, name, namelen)) {
+			*res_bh = bh;
+			*res_dir = de;
+			return 1;
+		}
+		brelse (bh);
+	}
+	return 1;
+
+stale:
+	ext2_warning (sb, "ext2_dindex_lookup",
+		      "index of directory #%lu out of date, dropped",
+		      dir->i_ino);
+	ext2_dindex_drop (dir);
+	return 0;
+}
+
+/*
+ * Find the first block with room for a record of rec_len bytes and make
+ * sure the index can take one more name and one more block, so that
+ * ext2_dindex_add() need not sleep.  Returns the last block if none has
+ * room (ext2_add_entry() then extends the directory), or -1 if the
+ * directory has no usable index.
+ */
+long ext2_dindex_space (struct inode * dir, int rec_len)
+{
+	struct ext2_dir_index * di;
+	unsigned long version, block;
+	int size;
+
+	di = dindex_get (dir);
+	if (!di || !di->di_blocks)
+		return -1;
+	if (dindex_full (di) || di->di_blocks >= di->di_room_size) {
+		version = dir->i_version;
+		dindex_unlink (dir);
+		size = dindex_full (di) ? di->di_size * 2 : di->di_size;
+		if (dindex_resize (di, size, di->di_blocks +
+				   (di->di_blocks >> 3) + 1) ||
+		    dir->i_version != version || dindex_get (dir)) {
+			dindex_destroy (di);
+			return -1;
+		}
+		dindex_install (dir->i_sb, di);
+	}
+	for (block = 0; block < di->di_blocks; block++)
+		if (di->di_room[block] >= rec_len)
+			return block;
+	return di->di_blocks - 1;
+}
+
+/*
+ * A name has been placed at "de" in logical block "block" of the
+ * directory.  Must not sleep.
+ */
+void ext2_dindex_add (struct inode * dir, struct ext2_dir_entry * de,
+		      struct buffer_head * bh, unsigned long block)
+{
+	struct ext2_dir_index * di = dindex_get (dir);
+	struct super_block * sb = dir->i_sb;
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+
+	if (!di)
+		return;
+	if (block > di->di_blocks || dindex_full (di) ||
+	    block >= di->di_room_size) {
+		ext2_dindex_drop (dir);
+		return;
+	}
+	if (block == di->di_blocks)
+		di->di_blocks++;
+	dindex_insert (di, dindex_hash (de->name, e_swab (bs, de->name_len)),
+		       (block << EXT2_BLOCK_SIZE_BITS(sb)) +
+		       ((char *) de - bh->b_data));
+	di->di_room[block] = dindex_room (bh, bs);
+}
+
+/*
+ * The entry at "de" has been removed.  The index only knows logical
+ * offsets, so the entry is recognised by its hash and its position in
+ * the block; should that be ambiguous the index is dropped.
+ */
+void ext2_dindex_remove (struct inode * dir, struct ext2_dir_entry * de,
+			 struct buffer_head * bh)
+{
+	struct ext2_dir_index * di = dindex_get (dir);
+	struct super_block * sb = dir->i_sb;
+	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
+	unsigned long pos = (char *) de - bh->b_data;
+	int i, * p, * found = NULL;
+	__u32 hash;
+
+	if (!di)
+		return;
+	hash = dindex_hash (de->name, e_swab (bs, de->name_len));
+	for (p = &di->di_bucket[hash & (di->di_size / 2 - 1)]; (i = *p) >= 0;
+	     p = &di->di_ent[i].de_next) {
+		if (di->di_ent[i].de_hash != hash ||
+		    (di->di_ent[i].de_offset & (sb->s_blocksize - 1)) != pos)
+			continue;
+		if (found) {
+			ext2_dindex_drop (dir);
+			return;
+		}
+		found = p;
+	}
+	if (!found) {
+		ext2_dindex_drop (dir);
+		return;
+	}
+	i = *found;
+	*found = di->di_ent[i].de_next;
+	di->di_ent[i].de_next = di->di_free;
+	di->di_free = i;
+	di->di_room[di->di_ent[i].de_offset >> EXT2_BLOCK_SIZE_BITS(sb)] =
+		dindex_room (bh, bs);
+}
@@ -157,7 +157,7 @@ static int ext2_file_write (struct inode * inode, struct file * filp,
 		written += c;
 		buf += c;
 		mark_buffer_uptodate(bh, 1);
-		mark_buffer_dirty(bh, 0);
+		mark_buffer_dirty_inode(bh, 0, inode);
 		if (filp->f_flags & O_SYNC)
 			bufferlist[buffercount++] = bh;
 		else
@@ -24,152 +24,15 @@
 #include <linux/locks.h>
 
 
-#define blocksize (EXT2_BLOCK_SIZE(inode->i_sb))
-#define addr_per_block (EXT2_ADDR_PER_BLOCK(inode->i_sb))
-
-static int sync_block (struct inode * inode, u32 * block, int wait, int bs)
-{
-	struct buffer_head * bh;
-	u32 tmp;
-	
-	tmp = *block;
-	if (!tmp)
-		return 0;
-	bh = get_hash_table (inode->i_dev, e_swab (bs, tmp), blocksize);
-	if (!bh)
-		return 0;
-	if (*block != tmp) {
-		brelse (bh);
-		return 1;
-	}
-	if (wait && buffer_req(bh) && !buffer_uptodate(bh)) {
-		brelse (bh);
-		return -1;
-	}
-	if (wait || !buffer_uptodate(bh) || !buffer_dirty(bh)) {
-		brelse (bh);
-		return 0;
-	}
-	ll_rw_block (WRITE, 1, &bh);
-	bh->b_count--;
-	return 0;
-}
-
-static int sync_iblock (struct inode * inode, u32 * iblock, 
-			struct buffer_head ** bh, int wait, int bs) 
-{
-	int rc;
-	u32 tmp;
-	
-	*bh = NULL;
-	tmp = *iblock;
-	if (!tmp)
-		return 0;
-	rc = sync_block (inode, iblock, wait, bs);
-	if (rc)
-		return rc;
-	*bh = bread (inode->i_dev, e_swab (bs, tmp), blocksize);
-	if (tmp != *iblock) {
-		brelse (*bh);
-		*bh = NULL;
-		return 1;
-	}
-	if (!*bh)
-		return -1;
-	return 0;
-}
-
-
-static int sync_direct (struct inode * inode, int wait)
-{
-	int i;
-	int rc, err = 0;
-
-	for (i = 0; i < EXT2_NDIR_BLOCKS; i++) {
-		rc = sync_block (inode, inode->u.ext2_i.i_data + i, wait, 0);
-		if (rc > 0)
-			break;
-		if (rc)
-			err = rc;
-	}
-	return err;
-}
-
-static int sync_indirect (struct inode * inode, u32 * iblock, int wait, int bs1)
-{
-	int i;
-	struct buffer_head * ind_bh;
-	int rc, err = 0;
-	int bs = BYTE_SWAP(inode->i_sb->u.ext2_sb.s_byte_swapped);
-
-	rc = sync_iblock (inode, iblock, &ind_bh, wait, bs1);
-	if (rc || !ind_bh)
-		return rc;
-	
-	for (i = 0; i < addr_per_block; i++) {
-		rc = sync_block (inode, 
-				 ((u32 *) ind_bh->b_data) + i,
-				 wait, bs);
-		if (rc > 0)
-			break;
-		if (rc)
-			err = rc;
-	}
-	brelse (ind_bh);
-	return err;
-}
-
-static int sync_dindirect (struct inode * inode, u32 * diblock, int wait, int bs1)
-{
-	int i;
-	struct buffer_head * dind_bh;
-	int rc, err = 0;
-	int bs = BYTE_SWAP(inode->i_sb->u.ext2_sb.s_byte_swapped);
-
-	rc = sync_iblock (inode, diblock, &dind_bh, wait, bs1);
-	if (rc || !dind_bh)
-		return rc;
-	
-	for (i = 0; i < addr_per_block; i++) {
-		rc = sync_indirect (inode,
-				    ((u32 *) dind_bh->b_data) + i,
-				    wait, bs);
-		if (rc > 0)
-			break;
-		if (rc)
-			err = rc;
-	}
-	brelse (dind_bh);
-	return err;
-}
-
-static int sync_tindirect (struct inode * inode, u32 * tiblock, int wait, int bs1)
-{
-	int i;
-	struct buffer_head * tind_bh;
-	int rc, err = 0;
-	int bs = BYTE_SWAP(inode->i_sb->u.ext2_sb.s_byte_swapped);
-
-	rc = sync_iblock (inode, tiblock, &tind_bh, wait, bs1);
-	if (rc || !tind_bh)
-		return rc;
-	
-	for (i = 0; i < addr_per_block; i++) {
-		rc = sync_dindirect (inode,
-				     ((u32 *) tind_bh->b_data) + i,
-				     wait, bs);
-		if (rc > 0)
-			break;
-		if (rc)
-			err = rc;
-	}
-	brelse (tind_bh);
-	return err;
-}
-
+/*
+ * The blocks of the file that may be dirty - data, indirect and
+ * directory blocks - are on its dirty buffer list (see
+ * mark_buffer_dirty_inode()), so only those need to be written,
+ * and then the inode itself.
+ */
 int ext2_sync_file (struct inode * inode, struct file * file)
 {
-	int wait, err = 0;
+	int err = 0;
 
 	if (S_ISLNK(inode->i_mode) && !(inode->i_blocks))
 		/*
@@ -177,19 +40,7 @@ int ext2_sync_file (struct inode * inode, struct file * file)
 		 */
 		goto skip;
 
-	for (wait=0; wait<=1; wait++)
-	{
-		err |= sync_direct (inode, wait);
-		err |= sync_indirect (inode,
-				      inode->u.ext2_i.i_data+EXT2_IND_BLOCK,
-				      wait, 0);
-		err |= sync_dindirect (inode,
-				       inode->u.ext2_i.i_data+EXT2_DIND_BLOCK, 
-				       wait, 0);
-		err |= sync_tindirect (inode, 
-				       inode->u.ext2_i.i_data+EXT2_TIND_BLOCK, 
-				       wait, 0);
-	}
+	err = fsync_inode_buffers (inode);
 skip:
 	err |= ext2_sync_inode (inode);
 	return (err < 0) ? -EIO : 0;
@@ -35,6 +35,8 @@ void ext2_put_inode (struct inode * inode)
 	if (inode->i_nlink || inode->i_ino == EXT2_ACL_IDX_INO ||
 	    inode->i_ino == EXT2_ACL_DATA_INO)
 		return;
+	if (S_ISDIR(inode->i_mode))
+		ext2_dindex_drop (inode);
 	inode->u.ext2_i.i_dtime	= CURRENT_TIME;
 	inode->i_dirt = 1;
 	ext2_update_inode(inode, IS_SYNC(inode));
@@ -108,7 +110,7 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal, int * err
 		}
 		memset(bh->b_data, 0, inode->i_sb->s_blocksize);
 		mark_buffer_uptodate(bh, 1);
-		mark_buffer_dirty(bh, 1);
+		mark_buffer_dirty_inode(bh, 1, inode);
 		brelse (bh);
 	} else {
 		ext2_discard_prealloc (inode);
@@ -317,7 +319,7 @@ repeat:
 		goto repeat;
 	}
 	e_set_swab (bs, *p, tmp);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, inode);
 	if (IS_SYNC(inode) || inode->u.ext2_i.i_osync) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -78,6 +78,9 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 	if (namelen > EXT2_NAME_LEN)
 		return NULL;
 
+	if (ext2_dindex_lookup (dir, name, namelen, &bh_use[0], res_dir))
+		return bh_use[0];
+
 	memset (bh_use, 0, sizeof (bh_use));
 	toread = 0;
 	for (block = 0; block < NAMEI_RA_SIZE; ++block) {
@@ -220,6 +223,7 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 	struct buffer_head * bh;
 	struct ext2_dir_entry * de, * de1;
 	struct super_block * sb;
+	long block;
 	int bs;
 
 	*err = -EINVAL;
@@ -245,11 +249,26 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 		*err = -ENOENT;
 		return NULL;
 	}
-	bh = ext2_bread (dir, 0, 0, err);
+	rec_len = EXT2_DIR_REC_LEN(namelen);
+	/*
+	 * With an index the name need not be looked for in every block,
+	 * and the search for room can start at a block which has some.
+	 */
+	block = 0;
+	if (ext2_dindex_lookup (dir, name, namelen, &bh, &de)) {
+		if (bh) {
+			brelse (bh);
+			*err = -EEXIST;
+			return NULL;
+		}
+		block = ext2_dindex_space (dir, rec_len);
+		if (block < 0)
+			block = 0;
+	}
+	bh = ext2_bread (dir, block, 0, err);
 	if (!bh)
 		return NULL;
-	rec_len = EXT2_DIR_REC_LEN(namelen);
-	offset = 0;
+	offset = block << EXT2_BLOCK_SIZE_BITS(sb);
 	de = (struct ext2_dir_entry *) bh->b_data;
 	*err = -ENOSPC;
 	while (1) {
@@ -293,6 +312,7 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 		if ((de->inode == 0 && e_swab (bs, de->rec_len) >= rec_len) ||
 		    (e_swab (bs, de->rec_len) >=
 		     EXT2_DIR_REC_LEN(e_swab (bs, de->name_len)) + rec_len)) {
+			block = offset >> EXT2_BLOCK_SIZE_BITS(sb);
 			offset += e_swab (bs, de->rec_len);
 			if (de->inode) {
 				de1 = (struct ext2_dir_entry *) ((char *) de +
@@ -307,6 +327,7 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 			de->inode = 0;
 			e_set_swab (bs, de->name_len, namelen);
 			memcpy (de->name, name, namelen);
+			ext2_dindex_add (dir, de, bh, block);
 			/*
 			 * XXX shouldn't update any times until successful
 			 * completion of syscall, but too many callers depend
@@ -321,7 +342,7 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 			dir->i_mtime = dir->i_ctime = CURRENT_TIME;
 			dir->i_dirt = 1;
 			dir->i_version = ++event;
-			mark_buffer_dirty(bh, 1);
+			mark_buffer_dirty_inode(bh, 1, dir);
 			*res_dir = de;
 			*err = 0;
 			return bh;
@@ -337,7 +358,8 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
  * ext2_delete_entry deletes a directory entry by merging it with the
  * previous entry
  */
-static int ext2_delete_entry (struct ext2_dir_entry * dir,
+static int ext2_delete_entry (struct inode * inode,
+			      struct ext2_dir_entry * dir,
 			      struct buffer_head * bh, int bs)
 {
 	struct ext2_dir_entry * de, * pde;
@@ -356,6 +378,7 @@ static int ext2_delete_entry (struct ext2_dir_entry * dir,
 					    e_swab (bs, pde->rec_len) +
 					    e_swab (bs, dir->rec_len));
 			dir->inode = 0;
+			ext2_dindex_remove (inode, dir, bh);
 			return 0;
 		}
 		i += e_swab (bs, de->rec_len);
@@ -396,7 +419,7 @@ int ext2_create (struct inode * dir,const char * name, int len, int mode,
 	e_set_swab (bs, de->inode, inode->i_ino);
 	dir->i_version = ++event;
 	dcache_add(dir, de->name, e_swab (bs, de->name_len), inode->i_ino);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -466,7 +489,7 @@ int ext2_mknod (struct inode * dir, const char * name, int len, int mode,
 	e_set_swab (bs, de->inode, inode->i_ino);
 	dir->i_version = ++event;
 	dcache_add(dir, de->name, e_swab (bs, de->name_len), inode->i_ino);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -528,7 +551,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 	e_set_swab (bs, de->name_len, 2);
 	strcpy (de->name, "..");
 	inode->i_nlink = 2;
-	mark_buffer_dirty(dir_block, 1);
+	mark_buffer_dirty_inode(dir_block, 1, inode);
 	brelse (dir_block);
 	inode->i_mode = S_IFDIR | (mode & (S_IRWXUGO|S_ISVTX) & ~current->fs->umask);
 	if (dir->i_mode & S_ISGID)
@@ -545,7 +568,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 	e_set_swab (bs, de->inode, inode->i_ino);
 	dir->i_version = ++event;
 	dcache_add(dir, de->name, e_swab (bs, de->name_len), inode->i_ino);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -681,13 +704,13 @@ repeat:
 		 */
 			inode->i_size = 0;
 		}
-		retval = ext2_delete_entry (de, bh, bs);
+		retval = ext2_delete_entry (dir, de, bh, bs);
 		dir->i_version = ++event;
 	}
 	up(&inode->i_sem);
 	if (retval)
 		goto end_rmdir;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -755,11 +778,11 @@ repeat:
 			      inode->i_ino, inode->i_nlink);
 		inode->i_nlink = 1;
 	}
-	retval = ext2_delete_entry (de, bh, bs);
+	retval = ext2_delete_entry (dir, de, bh, bs);
 	if (retval)
 		goto end_unlink;
 	dir->i_version = ++event;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -822,7 +845,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 		link[i++] = c;
 	link[i] = 0;
 	if (name_block) {
-		mark_buffer_dirty(name_block, 1);
+		mark_buffer_dirty_inode(name_block, 1, inode);
 		brelse (name_block);
 	}
 	inode->i_size = i;
@@ -848,7 +871,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 	e_set_swab (bs, de->inode, inode->i_ino);
 	dir->i_version = ++event;
 	dcache_add(dir, de->name, e_swab (bs, de->name_len), inode->i_ino);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -898,7 +921,7 @@ int ext2_link (struct inode * oldinode, struct inode * dir,
 	e_set_swab (bs, de->inode, oldinode->i_ino);
 	dir->i_version = ++event;
 	dcache_add(dir, de->name, e_swab (bs, de->name_len), oldinode->i_ino);
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -969,7 +992,7 @@ static int do_ext2_rename (struct inode * old_dir, const char * old_name,
 	goto start_up;
 try_again:
 	if (new_bh && new_de) {
-		ext2_delete_entry(new_de, new_bh, bs);
+		ext2_delete_entry(new_dir, new_de, new_bh, bs);
 		new_dir->i_version = ++event;
 	}
 	brelse (old_bh);
@@ -1079,7 +1102,7 @@ start_up:
 	e_set_swab (bs, new_de->inode, old_inode->i_ino);
 	dcache_add(new_dir, new_de->name, e_swab (bs, new_de->name_len),
 		   old_inode->i_ino);
-	retval = ext2_delete_entry (old_de, old_bh, bs);
+	retval = ext2_delete_entry (old_dir, old_de, old_bh, bs);
 	if (retval == -ENOENT)
 		goto try_again;
 	if (retval)
@@ -1095,7 +1118,7 @@ start_up:
 	if (dir_bh) {
 		e_set_swab (bs, PARENT_INO(bs, dir_bh->b_data), new_dir->i_ino);
 		dcache_add(old_inode, "..", 2, new_dir->i_ino);
-		mark_buffer_dirty(dir_bh, 1);
+		mark_buffer_dirty_inode(dir_bh, 1, old_inode);
 		old_dir->i_nlink--;
 		old_dir->i_dirt = 1;
 		if (new_inode) {
@@ -1106,12 +1129,12 @@ start_up:
 			new_dir->i_dirt = 1;
 		}
 	}
-	mark_buffer_dirty(old_bh,  1);
+	mark_buffer_dirty_inode(old_bh, 1, old_dir);
 	if (IS_SYNC(old_dir)) {
 		ll_rw_block (WRITE, 1, &old_bh);
 		wait_on_buffer (old_bh);
 	}
-	mark_buffer_dirty(new_bh, 1);
+	mark_buffer_dirty_inode(new_bh, 1, new_dir);
 	if (IS_SYNC(new_dir)) {
 		ll_rw_block (WRITE, 1, &new_bh);
 		wait_on_buffer (new_bh);
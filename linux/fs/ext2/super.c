@@ -119,9 +119,8 @@ void ext2_put_super (struct super_block * sb)
 	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
 		if (sb->u.ext2_sb.s_inode_bitmap[i])
 			brelse (sb->u.ext2_sb.s_inode_bitmap[i]);
-	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
-		if (sb->u.ext2_sb.s_block_bitmap[i])
-			brelse (sb->u.ext2_sb.s_block_bitmap[i]);
+	ext2_release_block_bitmaps (sb);
+	ext2_dindex_release (sb);
 	brelse (sb->u.ext2_sb.s_sbh);
 	unlock_super (sb);
 	MOD_DEC_USE_COUNT;
@@ -144,6 +143,7 @@ static struct super_operations ext2_sops = {
  */
 static int parse_options (char * options, unsigned long * sb_block,
 			  unsigned short *resuid, unsigned short * resgid,
+			  unsigned long * bitmaps,
 			  unsigned long * mount_options)
 {
 	char * this_char;
@@ -156,7 +156,20 @@ static int parse_options (char * options, unsigned long * sb_block,
 	     this_char = strtok (NULL, ",")) {
 		if ((value = strchr (this_char, '=')) != NULL)
 			*value++ = 0;
-		if (!strcmp (this_char, "bsddf"))
+		if (!strcmp (this_char, "bitmaps")) {
+			if (!value || !*value) {
+				printk ("EXT2-fs: the bitmaps option requires "
+					"an argument");
+				return 0;
+			}
+			*bitmaps = simple_strtoul (value, &value, 0);
+			if (*value || !*bitmaps) {
+				printk ("EXT2-fs: Invalid bitmaps option: %s\n",
+					value);
+				return 0;
+			}
+		}
+		else if (!strcmp (this_char, "bsddf"))
 			clear_opt (*mount_options, MINIX_DF);
 		else if (!strcmp (this_char, "check")) {
 			if (!value || !*value)
@@ -179,6 +192,8 @@ static int parse_options (char * options, unsigned long * sb_block,
 		}
 		else if (!strcmp (this_char, "debug"))
 			set_opt (*mount_options, DEBUG);
+		else if (!strcmp (this_char, "dirindex"))
+			set_opt (*mount_options, DIR_INDEX);
 		else if (!strcmp (this_char, "errors")) {
 			if (!value || !*value) {
 				printk ("EXT2-fs: the errors option requires "
@@ -215,6 +230,8 @@ static int parse_options (char * options, unsigned long * sb_block,
 			clear_opt (*mount_options, CHECK_NORMAL);
 			clear_opt (*mount_options, CHECK_STRICT);
 		}
+		else if (!strcmp (this_char, "nodirindex"))
+			clear_opt (*mount_options, DIR_INDEX);
 		else if (!strcmp (this_char, "nogrpid") ||
 			 !strcmp (this_char, "sysvgroups"))
 			clear_opt (*mount_options, GRPID);
@@ -387,6 +404,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 	unsigned long sb_block = 1;
 	unsigned short resuid = EXT2_DEF_RESUID;
 	unsigned short resgid = EXT2_DEF_RESGID;
+	unsigned long bitmaps = 0;
 	unsigned long logic_sb_block = 1;
 	kdev_t dev = sb->s_dev;
 	int db_count;
@@ -395,7 +413,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 	sb->u.ext2_sb.s_mount_opt = 0;
 	set_opt (sb->u.ext2_sb.s_mount_opt, CHECK_NORMAL);
 	if (!parse_options ((char *) data, &sb_block, &resuid, &resgid,
-	    &sb->u.ext2_sb.s_mount_opt)) {
+	    &bitmaps, &sb->u.ext2_sb.s_mount_opt)) {
 		sb->s_dev = 0;
 		return NULL;
 	}
@@ -589,12 +607,23 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++) {
 		sb->u.ext2_sb.s_inode_bitmap_number[i] = 0;
 		sb->u.ext2_sb.s_inode_bitmap[i] = NULL;
-		sb->u.ext2_sb.s_block_bitmap_number[i] = 0;
-		sb->u.ext2_sb.s_block_bitmap[i] = NULL;
 	}
 	sb->u.ext2_sb.s_loaded_inode_bitmaps = 0;
-	sb->u.ext2_sb.s_loaded_block_bitmaps = 0;
 	sb->u.ext2_sb.s_db_per_group = db_count;
+	sb->u.ext2_sb.s_block_bitmap_number = NULL;
+	sb->u.ext2_sb.s_block_bitmap = NULL;
+	sb->u.ext2_sb.s_max_free_run = NULL;
+	sb->u.ext2_sb.s_block_bitmap_slots = 0;
+	sb->u.ext2_sb.s_dir_index = NULL;
+	sb->u.ext2_sb.s_dir_indexes = 0;
+	if (ext2_setup_block_bitmaps (sb, bitmaps)) {
+		for (j = 0; j < db_count; j++)
+			brelse (sb->u.ext2_sb.s_group_desc[j]);
+		kfree_s (sb->u.ext2_sb.s_group_desc,
+			 db_count * sizeof (struct buffer_head *));
+		printk ("EXT2-fs: not enough memory\n");
+		goto failed_mount;
+	}
 	unlock_super (sb);
 	/*
 	 * set up enough so that it can read an inode
@@ -608,6 +637,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 				brelse (sb->u.ext2_sb.s_group_desc[i]);
 		kfree_s (sb->u.ext2_sb.s_group_desc,
 			 db_count * sizeof (struct buffer_head *));
+		ext2_release_block_bitmaps (sb);
 		brelse (bh);
 		printk ("EXT2-fs: get root inode failed\n");
 		MOD_DEC_USE_COUNT;
@@ -663,17 +693,22 @@ int ext2_remount (struct super_block * sb, int * flags, char * data)
 	unsigned short resgid = sb->u.ext2_sb.s_resgid;
 	unsigned long new_mount_opt;
 	unsigned long tmp;
+	unsigned long bitmaps;
 	int bs = BYTE_SWAP(sb->u.ext2_sb.s_byte_swapped);
 
 	/*
-	 * Allow the "check" option to be passed as a remount option.
+	 * Allow the "check" and "dirindex" options to be passed as remount
+	 * options.
+	 * The bitmap cache size is only set at mount time.
 	 */
 	new_mount_opt = EXT2_MOUNT_CHECK_NORMAL;
-	if (!parse_options (data, &tmp, &resuid, &resgid,
+	if (!parse_options (data, &tmp, &resuid, &resgid, &bitmaps,
 			    &new_mount_opt))
 		return -EINVAL;
 
 	sb->u.ext2_sb.s_mount_opt = new_mount_opt;
+	if (!test_opt (sb, DIR_INDEX))
+		ext2_dindex_release (sb);
 	sb->u.ext2_sb.s_resuid = resuid;
 	sb->u.ext2_sb.s_resgid = resgid;
 	es = sb->u.ext2_sb.s_es;
@@ -156,7 +156,7 @@ repeat:
 			continue;
 		}
 		*ind = 0;
-		mark_buffer_dirty(ind_bh, 1);
+		mark_buffer_dirty_inode(ind_bh, 1, inode);
 		bforget(bh);
 		tmp = e_swab (bs, tmp);
 		if (free_count == 0) {
@@ -234,7 +234,7 @@ repeat:
 			continue;
 		retry |= trunc_indirect (inode, offset + (i * addr_per_block),
 					  dind, bs);
-		mark_buffer_dirty(dind_bh, 1);
+		mark_buffer_dirty_inode(dind_bh, 1, inode);
 	}
 	dind = (u32 *) dind_bh->b_data;
 	for (i = 0; i < addr_per_block; i++)
@@ -294,7 +294,7 @@ repeat:
 		retry |= trunc_dindirect(inode, EXT2_NDIR_BLOCKS +
 			addr_per_block + (i + 1) * addr_per_block * addr_per_block,
 			tind, bs);
-		mark_buffer_dirty(tind_bh, 1);
+		mark_buffer_dirty_inode(tind_bh, 1, inode);
 	}
 	tind = (u32 *) tind_bh->b_data;
 	for (i = 0; i < addr_per_block; i++)
@@ -360,7 +360,7 @@ void ext2_truncate (struct inode * inode)
 		if (bh) {
 			memset (bh->b_data + offset, 0,
 				inode->i_sb->s_blocksize - offset);
-			mark_buffer_dirty (bh, 0);
+			mark_buffer_dirty_inode (bh, 0, inode);
 			brelse (bh);
 		}
 	}
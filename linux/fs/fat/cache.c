@@ -10,6 +10,7 @@
 #include <linux/errno.h>
 #include <linux/string.h>
 #include <linux/stat.h>
+#include <linux/malloc.h>
 
 #include "msbuffer.h"
 
@@ -19,8 +20,6 @@
 #  define PRINTK(x)
 #endif
 
-static struct fat_cache *fat_cache,cache[FAT_CACHE];
-
 /* Returns the this'th FAT entry, -1 if it is an end-of-file entry. If
    new_value is != -1, that FAT entry is replaced by it. */
 
@@ -118,125 +117,228 @@ int fat_access(struct super_block *sb,int nr,int new_value)
 }
 
 
-void cache_init(void)
+/*
+ * Each inode keeps its own cache of cluster runs, (file cluster -> disk
+ * cluster, length), sorted by file cluster. A lookup is a binary search
+ * from the last extent hit, so walking the FAT chain is only needed for
+ * the part of the file not seen yet. The array is allocated on the first
+ * miss, grown up to FAT_EXT_MAX extents and freed on the last iput().
+ */
+
+/* The extent with the greatest file_cluster <= cluster, -1 if none */
+static int fat_ext_find(struct fat_extent_cache *c,int cluster)
+{
+	int lo,hi,mid;
+
+	if (c->hint < c->count && c->ext[c->hint].file_cluster <= cluster
+	    && (c->hint+1 == c->count
+		|| c->ext[c->hint+1].file_cluster > cluster))
+		return c->hint;
+	lo = 0;
+	hi = c->count-1;
+	while (lo <= hi) {
+		mid = (lo+hi)/2;
+		if (c->ext[mid].file_cluster <= cluster) lo = mid+1;
+		else hi = mid-1;
+	}
+	return hi;
+}
+
+
+static void fat_ext_remove(struct fat_extent_cache *c,int i)
+{
+	memmove(&c->ext[i],&c->ext[i+1],(c->count-i-1)*sizeof(c->ext[0]));
+	c->count--;
+	c->hint = 0;
+}
+
+
+/* Make room for one more extent: grow the array, or when it is at
+   FAT_EXT_MAX already drop the extent whose neighbours are closest, so
+   that what is left stays spread evenly over the file. */
+
+static struct fat_extent_cache *fat_ext_room(struct inode *inode)
 {
-	static int initialized = 0;
-	int count;
-
-	if (initialized) return;
-	fat_cache = &cache[0];
-	for (count = 0; count < FAT_CACHE; count++) {
-		cache[count].device = 0;
-		cache[count].next = count == FAT_CACHE-1 ? NULL :
-		    &cache[count+1];
+	struct fat_extent_cache *c,*new;
+	int i,size,gap,best,best_gap;
+
+	c = MSDOS_I(inode)->i_ext;
+	if (c && c->count < c->size) return c;
+	size = c ? c->size*2 : FAT_EXT_MIN;
+	if (size <= FAT_EXT_MAX) {
+		new = kmalloc(sizeof(*new)+size*sizeof(new->ext[0]),
+		    GFP_KERNEL);
+		/* kmalloc may have slept */
+		if (MSDOS_I(inode)->i_ext != c) {
+			if (new) kfree(new);
+			return fat_ext_room(inode);
+		}
+		if (new) {
+			if (c) {
+				memcpy(new,c,sizeof(*c)+
+				    c->count*sizeof(c->ext[0]));
+				kfree(c);
+			} else {
+				new->count = 0;
+				new->hint = 0;
+			}
+			new->size = size;
+			MSDOS_I(inode)->i_ext = new;
+			return new;
+		}
+	}
+	if (!c) return NULL;
+	best = 1;
+	best_gap = INT_MAX;
+	for (i = 1; i < c->count-1; i++) {
+		gap = c->ext[i+1].file_cluster-c->ext[i-1].file_cluster-
+		    c->ext[i-1].len;
+		if (gap < best_gap) {
+			best_gap = gap;
+			best = i;
+		}
 	}
-	initialized = 1;
+	fat_ext_remove(c,best);
+	return c;
 }
 
 
 void cache_lookup(struct inode *inode,int cluster,int *f_clu,int *d_clu)
 {
-	struct fat_cache *walk;
+	struct fat_extent_cache *c = MSDOS_I(inode)->i_ext;
+	struct fat_extent *e;
+	int i,last;
 
 #ifdef DEBUG
 printk("cache lookup: <%s,%d> %d (%d,%d) -> ", kdevname(inode->i_dev),
        inode->i_ino, cluster, *f_clu, *d_clu);
 #endif
-	for (walk = fat_cache; walk; walk = walk->next)
-		if (inode->i_dev == walk->device
-		    && walk->ino == inode->i_ino
-		    && walk->file_cluster <= cluster
-		    && walk->file_cluster > *f_clu) {
-			*d_clu = walk->disk_cluster;
+	if (!c || (i = fat_ext_find(c,cluster)) < 0) {
 #ifdef DEBUG
-printk("cache hit: %d (%d)\n",walk->file_cluster,*d_clu);
+printk("cache miss\n");
 #endif
-			if ((*f_clu = walk->file_cluster) == cluster) return;
-		}
+		return;
+	}
+	c->hint = i;
+	e = &c->ext[i];
+	last = e->file_cluster+e->len-1;
+	if (last > cluster) last = cluster;
+	if (last > *f_clu) {
+		*f_clu = last;
+		*d_clu = e->disk_cluster+(last-e->file_cluster);
+	}
 #ifdef DEBUG
-printk("cache miss\n");
+printk("cache hit: %d (%d)\n",*f_clu,*d_clu);
 #endif
 }
 
 
 #ifdef DEBUG
-static void list_cache(void)
+static void list_cache(struct inode *inode)
 {
-	struct fat_cache *walk;
+	struct fat_extent_cache *c = MSDOS_I(inode)->i_ext;
+	int i;
 
-	for (walk = fat_cache; walk; walk = walk->next) {
-		if (walk->device)
-			printk("<%s,%d>(%d,%d) ", kdevname(walk->device),
-			       walk->ino, walk->file_cluster, walk->disk_cluster);
-		else printk("-- ");
-	}
+	for (i = 0; c && i < c->count; i++)
+		printk("(%d,%d,%d) ", c->ext[i].file_cluster,
+		       c->ext[i].disk_cluster, c->ext[i].len);
 	printk("\n");
 }
 #endif
 
 
+/* Fit cluster f_clu at d_clu into the extents there are: returns 1 if it
+   is covered already or extends an extent, 0 if it needs one of its own. */
+
+static int fat_ext_merge(struct inode *inode,struct fat_extent_cache *c,
+    int f_clu,int d_clu)
+{
+	struct fat_extent *e;
+	int i;
+
+	i = fat_ext_find(c,f_clu);
+	if (i >= 0) {
+		e = &c->ext[i];
+		if (f_clu < e->file_cluster+e->len) {
+			if (e->disk_cluster+(f_clu-e->file_cluster) != d_clu) {
+				printk("FAT cache corruption");
+				fat_cache_inval_inode(inode);
+			}
+			return 1;
+		}
+		if (f_clu == e->file_cluster+e->len
+		    && d_clu == e->disk_cluster+e->len) {
+			e->len++;
+			/* closes the gap to the next run? */
+			if (i+1 < c->count && c->ext[i+1].file_cluster == f_clu+1
+			    && c->ext[i+1].disk_cluster == d_clu+1) {
+				e->len += c->ext[i+1].len;
+				fat_ext_remove(c,i+1);
+			}
+			c->hint = i;
+			return 1;
+		}
+	}
+	i++;
+	if (i < c->count && c->ext[i].file_cluster == f_clu+1
+	    && c->ext[i].disk_cluster == d_clu+1) {
+		c->ext[i].file_cluster--;
+		c->ext[i].disk_cluster--;
+		c->ext[i].len++;
+		c->hint = i;
+		return 1;
+	}
+	return 0;
+}
+
+
 void cache_add(struct inode *inode,int f_clu,int d_clu)
 {
-	struct fat_cache *walk,*last;
+	struct fat_extent_cache *c;
+	int i;
 
 #ifdef DEBUG
 printk("cache add: <%s,%d> %d (%d)\n", kdevname(inode->i_dev),
        inode->i_ino, f_clu, d_clu);
 #endif
-	last = NULL;
-	for (walk = fat_cache; walk->next; walk = (last = walk)->next)
-		if (inode->i_dev == walk->device
-		    && walk->ino == inode->i_ino
-		    && walk->file_cluster == f_clu) {
-			if (walk->disk_cluster != d_clu) {
-				printk("FAT cache corruption");
-				fat_cache_inval_inode(inode);
-				return;
-			}
-			/* update LRU */
-			if (last == NULL) return;
-			last->next = walk->next;
-			walk->next = fat_cache;
-			fat_cache = walk;
-#ifdef DEBUG
-list_cache();
-#endif
-			return;
-		}
-	walk->device = inode->i_dev;
-	walk->ino = inode->i_ino;
-	walk->file_cluster = f_clu;
-	walk->disk_cluster = d_clu;
-	last->next = NULL;
-	walk->next = fat_cache;
-	fat_cache = walk;
+	/* only make room (and maybe drop an extent) for a new extent */
+	c = MSDOS_I(inode)->i_ext;
+	if (c && fat_ext_merge(inode,c,f_clu,d_clu)) return;
+	if (!(c = fat_ext_room(inode))) return;
+	/* fat_ext_room may have slept or dropped a neighbour: look again */
+	if (fat_ext_merge(inode,c,f_clu,d_clu)) return;
+	i = fat_ext_find(c,f_clu)+1;
+	memmove(&c->ext[i+1],&c->ext[i],(c->count-i)*sizeof(c->ext[0]));
+	c->ext[i].file_cluster = f_clu;
+	c->ext[i].disk_cluster = d_clu;
+	c->ext[i].len = 1;
+	c->count++;
+	c->hint = i;
 #ifdef DEBUG
-list_cache();
+list_cache(inode);
 #endif
 }
 
 
-/* Cache invalidation occurs rarely, thus the LRU chain is not updated. It
-   fixes itself after a while. */
+/* The chain has changed: forget the extents but keep the array. */
 
 void fat_cache_inval_inode(struct inode *inode)
 {
-	struct fat_cache *walk;
+	struct fat_extent_cache *c = MSDOS_I(inode)->i_ext;
 
-	for (walk = fat_cache; walk; walk = walk->next)
-		if (walk->device == inode->i_dev
-		    && walk->ino == inode->i_ino)
-			walk->device = 0;
+	if (c) {
+		c->count = 0;
+		c->hint = 0;
+	}
 }
 
 
-void fat_cache_inval_dev(kdev_t device)
+void fat_cache_free_inode(struct inode *inode)
 {
-	struct fat_cache *walk;
-
-	for (walk = fat_cache; walk; walk = walk->next)
-		if (walk->device == device)
-			walk->device = 0;
+	if (MSDOS_I(inode)->i_ext) {
+		kfree(MSDOS_I(inode)->i_ext);
+		MSDOS_I(inode)->i_ext = NULL;
+	}
 }
 
 
@@ -247,12 +349,15 @@ int get_cluster(struct inode *inode,int cluster)
 	if (!(nr = MSDOS_I(inode)->i_start)) return 0;
 	if (!cluster) return nr;
 	count = 0;
-	for (cache_lookup(inode,cluster,&count,&nr); count < cluster;
-	    count++) {
+	cache_lookup(inode,cluster,&count,&nr);
+	if (count == cluster) return nr;
+	if (!count) cache_add(inode,0,nr);
+	/* remember every cluster walked, so runs are cached whole */
+	for (; count < cluster; count++) {
 		if ((nr = fat_access(inode->i_sb,nr,-1)) == -1) return 0;
 		if (!nr) return 0;
+		cache_add(inode,count+1,nr);
 	}
-	cache_add(inode,cluster,nr);
 	return nr;
 }
 
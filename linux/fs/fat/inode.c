@@ -49,6 +49,7 @@ void fat_put_inode(struct inode *inode)
 	depend = MSDOS_I(inode)->i_depend;
 	linked = MSDOS_I(inode)->i_linked;
 	sb = inode->i_sb;
+	fat_cache_free_inode(inode);
 	if (inode->i_nlink) {
 		if (depend) {
 			iput(depend);
@@ -57,7 +58,6 @@ void fat_put_inode(struct inode *inode)
 			iput(linked);
 			MSDOS_I(inode)->i_linked = NULL;
 		}
-		if (MSDOS_I(inode)->i_busy) fat_cache_inval_inode(inode);
 		return;
 	}
 	inode->i_size = 0;
@@ -92,7 +92,6 @@ void fat_put_super(struct super_block *sb)
 	if (MSDOS_SB(sb)->fat_bits == 32) {
 		fat_clusters_flush(sb);
 	}
-	fat_cache_inval_dev(sb->s_dev);
 	set_blocksize (sb->s_dev,BLOCK_SIZE);
 	if (MSDOS_SB(sb)->nls_disk) {
 		unload_nls(MSDOS_SB(sb)->nls_disk);
@@ -277,7 +276,6 @@ struct super_block *fat_read_super(struct super_block *sb,void *data, int silent
 		MOD_DEC_USE_COUNT;
 		return NULL;
 	}
-	cache_init();
 	lock_super(sb);
 	/* The first read is always 1024 bytes */
 	sb->s_blocksize = 1024;
@@ -543,6 +541,7 @@ void fat_read_inode(struct inode *inode, struct inode_operations *fs_dir_inode_o
 	MSDOS_I(inode)->i_depend = MSDOS_I(inode)->i_old = NULL;
 	MSDOS_I(inode)->i_linked = MSDOS_I(inode)->i_oldlink = NULL;
 	MSDOS_I(inode)->i_binary = 1;
+	fat_cache_inval_inode(inode);
 	inode->i_uid = MSDOS_SB(sb)->options.fs_uid;
 	inode->i_gid = MSDOS_SB(sb)->options.fs_gid;
 	inode->i_version = ++event;
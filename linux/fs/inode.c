@@ -194,6 +194,12 @@ void clear_inode(struct inode * inode)
 	
 	truncate_inode_pages(inode, 0);
 	wait_on_inode(inode);
+	/* A later fsync() would not find these on a fresh inode */
+	if (inode->i_dirty_buffers) {
+		if (inode->i_nlink)
+			fsync_inode_buffers(inode);
+		forget_inode_buffers(inode);
+	}
 	if (IS_WRITABLE(inode)) {
 		if (inode->i_sb && inode->i_sb->dq_op)
 			inode->i_sb->dq_op->drop(inode);
@@ -525,7 +531,8 @@ repeat:
 	for (i = nr_inodes/2; i > 0; i--,inode = inode->i_next) {
 		if (!inode->i_count) {
 			unsigned long i = 999;
-			if (!(inode->i_lock || inode->i_dirt))
+			if (!(inode->i_lock || inode->i_dirt ||
+			      inode_has_dirty_buffers(inode)))
 				i = inode->i_nrpages;
 			if (i < badness) {
 				best = inode;
@@ -0,0 +1,447 @@
+/*
+ *  linux/fs/isofs/cache.c
+ *
+ *  Directory name and symbolic link caches
+ *
+ *  The first lookup in a directory of more than one sector reads the
+ *  whole directory, ISOFS_DIR_RA_BLOCKS blocks to a request, and keeps
+ *  every name a lookup can see (the Rock Ridge, Joliet or mapped ISO
+ *  name) hashed to its inode number.  Later lookups in it, of names
+ *  that are there or not, need neither the directory nor the Rock Ridge
+ *  continuation records of its entries again.  The targets of Rock
+ *  Ridge symbolic links are kept as well, so that following a link
+ *  does not parse its records every time.
+ *
+ *  The disk cannot change under a mounted file system, so nothing is
+ *  ever invalidated: the caches are dropped to make room, and at umount.
+ *  They hang off the super block in LRU order, keyed by inode number,
+ *  since the in-core inode is cleared without notice when reused.
+ */
+
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/iso_fs.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/locks.h>
+#include <linux/malloc.h>
+#include <linux/mm.h>
+
+struct dircache_ent {
+	__u32 de_hash;
+	unsigned long de_ino;
+	unsigned int de_name;		/* offset in dc_names */
+	unsigned short de_len;
+	int de_next;			/* next on the chain, or -1 */
+};
+
+struct isofs_dir_cache {
+	struct isofs_dir_cache * dc_next;	/* LRU list, most recent first */
+	unsigned long dc_ino;
+	int dc_size;			/* allocated entries of dc_ent */
+	int dc_used;
+	struct dircache_ent * dc_ent;
+	int dc_buckets;			/* a power of two */
+	int * dc_bucket;		/* chain heads */
+	unsigned int dc_names_size;
+	unsigned int dc_names_used;
+	char * dc_names;
+};
+
+struct isofs_link_cache {
+	struct isofs_link_cache * lc_next;	/* LRU list, most recent first */
+	unsigned long lc_ino;
+	int lc_len;
+	char lc_link[0];
+};
+
+static inline __u32 dircache_hash(const char * name, int len)
+{
+	__u32 hash = 5381;
+
+	while (len--)
+		hash = (hash << 5) + hash + (unsigned char) *name++;
+	return hash;
+}
+
+static void * dircache_alloc(unsigned long size)
+{
+	if (size <= PAGE_SIZE / 4)
+		return kmalloc(size, GFP_KERNEL);
+	return vmalloc(size);
+}
+
+static void dircache_free(void * p, unsigned long size)
+{
+	if (!p)
+		return;
+	if (size <= PAGE_SIZE / 4)
+		kfree_s(p, size);
+	else
+		vfree(p);
+}
+
+static void dircache_destroy(struct isofs_dir_cache * dc)
+{
+	dircache_free(dc->dc_ent, dc->dc_size * sizeof(struct dircache_ent));
+	dircache_free(dc->dc_bucket, dc->dc_buckets * sizeof(int));
+	dircache_free(dc->dc_names, dc->dc_names_size);
+	kfree_s(dc, sizeof(*dc));
+}
+
+/*
+ * Find the cache of a directory and move it to the head of the list
+ */
+static struct isofs_dir_cache * dircache_get(struct inode * dir)
+{
+	struct isofs_dir_cache ** p, * dc;
+
+	for (p = &dir->i_sb->u.isofs_sb.s_dir_cache; (dc = *p); p = &dc->dc_next)
+		if (dc->dc_ino == dir->i_ino) {
+			*p = dc->dc_next;
+			dc->dc_next = dir->i_sb->u.isofs_sb.s_dir_cache;
+			dir->i_sb->u.isofs_sb.s_dir_cache = dc;
+			return dc;
+		}
+	return NULL;
+}
+
+/*
+ * Put a new cache on the list, unless somebody else built one for the
+ * same directory while we slept.  Returns the cache to use.
+ */
+static struct isofs_dir_cache * dircache_install(struct inode * dir,
+						 struct isofs_dir_cache * dc)
+{
+	struct isofs_sb_info * sbi = &dir->i_sb->u.isofs_sb;
+	struct isofs_dir_cache ** p, * old;
+
+	if ((old = dircache_get(dir)) != NULL) {
+		dircache_destroy(dc);
+		return old;
+	}
+	if (sbi->s_dir_caches >= ISOFS_MAX_DIR_CACHES) {
+		for (p = &sbi->s_dir_cache; (*p)->dc_next; p = &(*p)->dc_next)
+			;
+		dircache_destroy(*p);
+		*p = NULL;
+		sbi->s_dir_caches--;
+	}
+	dc->dc_next = sbi->s_dir_cache;
+	sbi->s_dir_cache = dc;
+	sbi->s_dir_caches++;
+	return dc;
+}
+
+/*
+ * Append a name, under "len" and, if "trail" is set, also under
+ * "len - 1", as a lookup may leave out its trailing period
+ */
+static int dircache_enter(struct isofs_dir_cache * dc, const char * name,
+			  int len, int trail, unsigned long ino)
+{
+	struct dircache_ent * ent;
+	unsigned int size;
+	char * names;
+	int n;
+
+	if (dc->dc_used + 2 > dc->dc_size) {
+		n = dc->dc_size * 2;
+		if (!(ent = dircache_alloc(n * sizeof(struct dircache_ent))))
+			return -ENOMEM;
+		memcpy(ent, dc->dc_ent, dc->dc_used * sizeof(struct dircache_ent));
+		dircache_free(dc->dc_ent, dc->dc_size * sizeof(struct dircache_ent));
+		dc->dc_ent = ent;
+		dc->dc_size = n;
+	}
+	if (dc->dc_names_used + len > dc->dc_names_size) {
+		for (size = dc->dc_names_size * 2;
+		     size < dc->dc_names_used + len; size *= 2)
+			;
+		if (!(names = dircache_alloc(size)))
+			return -ENOMEM;
+		memcpy(names, dc->dc_names, dc->dc_names_used);
+		dircache_free(dc->dc_names, dc->dc_names_size);
+		dc->dc_names = names;
+		dc->dc_names_size = size;
+	}
+	memcpy(dc->dc_names + dc->dc_names_used, name, len);
+	for (n = len; n >= (trail && len > 1 ? len - 1 : len); n--) {
+		ent = &dc->dc_ent[dc->dc_used++];
+		ent->de_hash = dircache_hash(name, n);
+		ent->de_ino = ino;
+		ent->de_name = dc->dc_names_used;
+		ent->de_len = n;
+	}
+	dc->dc_names_used += len;
+	return 0;
+}
+
+/*
+ * Hash the names, keeping each chain in directory order: of two
+ * entries with the same name, the first one is found
+ */
+static int dircache_hash_names(struct isofs_dir_cache * dc)
+{
+	int i, k;
+
+	for (dc->dc_buckets = 16; dc->dc_buckets < dc->dc_used / 2;
+	     dc->dc_buckets <<= 1)
+		;
+	if (!(dc->dc_bucket = dircache_alloc(dc->dc_buckets * sizeof(int))))
+		return -ENOMEM;
+	for (i = 0; i < dc->dc_buckets; i++)
+		dc->dc_bucket[i] = -1;
+	for (i = dc->dc_used; i--; ) {
+		k = dc->dc_ent[i].de_hash & (dc->dc_buckets - 1);
+		dc->dc_ent[i].de_next = dc->dc_bucket[k];
+		dc->dc_bucket[k] = i;
+	}
+	return 0;
+}
+
+/*
+ * Start reading up to ISOFS_DIR_RA_BLOCKS directory blocks from
+ * "block" in one go; the extent is contiguous, so the driver gets a
+ * single request for those not in the buffer cache yet.
+ */
+static void dircache_readahead(struct inode * dir, int block, int blocks)
+{
+	struct buffer_head * bh[ISOFS_DIR_RA_BLOCKS];
+	int i, n, phys;
+
+	for (i = n = 0; i < ISOFS_DIR_RA_BLOCKS && block + i < blocks; i++) {
+		if (!(phys = isofs_bmap(dir, block + i)))
+			break;
+		bh[n] = getblk(dir->i_dev, phys, ISOFS_BUFFER_SIZE(dir));
+		if (buffer_uptodate(bh[n]))
+			brelse(bh[n]);
+		else
+			n++;
+	}
+	if (n)
+		ll_rw_block(READ, n, bh);
+	for (i = 0; i < n; i++)
+		brelse(bh[i]);
+}
+
+static struct buffer_head * dircache_bread(struct inode * dir, int block,
+					   int blocks, int * ra_next)
+{
+	int phys;
+
+	if (block >= *ra_next) {
+		dircache_readahead(dir, block, blocks);
+		*ra_next = block + ISOFS_DIR_RA_BLOCKS;
+	}
+	if (!(phys = isofs_bmap(dir, block)))
+		return NULL;
+	return bread(dir->i_dev, phys, ISOFS_BUFFER_SIZE(dir));
+}
+
+/*
+ * Read the whole directory and enter the names isofs_find_entry()
+ * could match, with the inode numbers it would return
+ */
+static struct isofs_dir_cache * dircache_build(struct inode * dir)
+{
+	unsigned long bufsize = ISOFS_BUFFER_SIZE(dir);
+	unsigned char bufbits = ISOFS_BUFFER_BITS(dir);
+	int high_sierra = dir->i_sb->u.isofs_sb.s_high_sierra;
+	int blocks = (dir->i_size + bufsize - 1) >> bufbits;
+	struct isofs_dir_cache * dc;
+	struct buffer_head * bh = NULL;
+	struct iso_directory_record * de, * tmpde;
+	unsigned int f_pos, offset, de_len;
+	unsigned long ino;
+	int block = -1, ra_next = 0, len, trail;
+	char * page, * name;
+
+	if (!(dc = kmalloc(sizeof(*dc), GFP_KERNEL)))
+		return NULL;
+	memset(dc, 0, sizeof(*dc));
+	dc->dc_ino = dir->i_ino;
+	/* a guess of 64 bytes a record; grown as needed */
+	dc->dc_size = dir->i_size / 64 + 2;
+	dc->dc_names_size = dir->i_size / 4;
+	dc->dc_ent = dircache_alloc(dc->dc_size * sizeof(struct dircache_ent));
+	dc->dc_names = dircache_alloc(dc->dc_names_size);
+	/* for isofs_entry_name(), and records split between two blocks */
+	page = (char *) __get_free_page(GFP_KERNEL);
+	if (!dc->dc_ent || !dc->dc_names || !page)
+		goto failed;
+	tmpde = (struct iso_directory_record *) (page + 1024);
+
+	for (f_pos = 0; f_pos < dir->i_size; ) {
+		if (block != f_pos >> bufbits) {
+			brelse(bh);
+			block = f_pos >> bufbits;
+			if (!(bh = dircache_bread(dir, block, blocks, &ra_next)))
+				goto failed;
+		}
+		offset = f_pos & (bufsize - 1);
+		de = (struct iso_directory_record *) (bh->b_data + offset);
+		de_len = *(unsigned char *) de;
+		if (!de_len) {
+			f_pos = (f_pos & ~(ISOFS_BLOCK_SIZE - 1))
+				+ ISOFS_BLOCK_SIZE;
+			continue;
+		}
+		ino = (bh->b_blocknr << bufbits) + offset;
+		f_pos += de_len;
+		if (offset + de_len > bufsize) {
+			memcpy(tmpde, de, bufsize - offset);
+			brelse(bh);
+			block++;
+			if (!(bh = dircache_bread(dir, block, blocks, &ra_next)))
+				goto failed;
+			memcpy((char *) tmpde + bufsize - offset, bh->b_data,
+			       offset + de_len - bufsize);
+			de = tmpde;
+		}
+
+		/* "." and ".." are left to isofs_find_entry() */
+		if (de->name_len[0] == 1 && (de->name[0] == 0 || de->name[0] == 1))
+			continue;
+		if ((de->flags[-high_sierra] & 5) &&
+		    dir->i_sb->u.isofs_sb.s_unhide != 'y')
+			continue;
+		len = isofs_entry_name(dir, de, page, &name, &trail);
+		if (len > 0 && dircache_enter(dc, name, len, trail, ino))
+			goto failed;
+	}
+	brelse(bh);
+	bh = NULL;
+	if (dircache_hash_names(dc))
+		goto failed;
+	free_page((unsigned long) page);
+	return dc;
+
+failed:
+	brelse(bh);
+	if (page)
+		free_page((unsigned long) page);
+	dircache_destroy(dc);
+	return NULL;
+}
+
+/*
+ * Look a name up in the cache of a directory, building it first if
+ * needed.  Returns 1 and the inode number if the name is there, 0 if
+ * it is not, or -1 if the caller has to search the directory itself.
+ */
+int isofs_dircache_find(struct inode * dir, const char * name, int len,
+			unsigned long * ino)
+{
+	struct isofs_dir_cache * dc;
+	struct dircache_ent * ent;
+	__u32 hash;
+	int i;
+
+	if (!len || (name[0] == '.' &&
+		     (len == 1 || (len == 2 && name[1] == '.'))))
+		return -1;
+	if (dir->i_size <= ISOFS_BLOCK_SIZE ||
+	    dir->i_size > ISOFS_DIR_CACHE_MAXSIZE)
+		return -1;
+	if (!(dc = dircache_get(dir))) {
+		if (!(dc = dircache_build(dir)))
+			return -1;
+		dc = dircache_install(dir, dc);
+	}
+
+	hash = dircache_hash(name, len);
+	for (i = dc->dc_bucket[hash & (dc->dc_buckets - 1)]; i >= 0;
+	     i = ent->de_next) {
+		ent = &dc->dc_ent[i];
+		if (ent->de_hash == hash && ent->de_len == len &&
+		    !memcmp(dc->dc_names + ent->de_name, name, len)) {
+			*ino = ent->de_ino;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static struct isofs_link_cache * lcache_get(struct inode * inode)
+{
+	struct isofs_link_cache ** p, * lc;
+
+	for (p = &inode->i_sb->u.isofs_sb.s_link_cache; (lc = *p);
+	     p = &lc->lc_next)
+		if (lc->lc_ino == inode->i_ino) {
+			*p = lc->lc_next;
+			lc->lc_next = inode->i_sb->u.isofs_sb.s_link_cache;
+			inode->i_sb->u.isofs_sb.s_link_cache = lc;
+			return lc;
+		}
+	return NULL;
+}
+
+static void lcache_install(struct inode * inode, const char * link)
+{
+	struct isofs_sb_info * sbi = &inode->i_sb->u.isofs_sb;
+	struct isofs_link_cache ** p, * lc;
+	int len = strlen(link);
+
+	if (!(lc = kmalloc(sizeof(*lc) + len + 1, GFP_KERNEL)))
+		return;
+	/* kmalloc() may have slept */
+	if (lcache_get(inode)) {
+		kfree(lc);
+		return;
+	}
+	lc->lc_ino = inode->i_ino;
+	lc->lc_len = len;
+	memcpy(lc->lc_link, link, len + 1);
+	if (sbi->s_link_caches >= ISOFS_MAX_LINK_CACHES) {
+		for (p = &sbi->s_link_cache; (*p)->lc_next; p = &(*p)->lc_next)
+			;
+		kfree(*p);
+		*p = NULL;
+		sbi->s_link_caches--;
+	}
+	lc->lc_next = sbi->s_link_cache;
+	sbi->s_link_cache = lc;
+	sbi->s_link_caches++;
+}
+
+/*
+ * get_rock_ridge_symlink(), through the cache.  The caller frees the
+ * returned copy.
+ */
+char * isofs_get_symlink(struct inode * inode)
+{
+	struct isofs_link_cache * lc;
+	char * link;
+
+	if ((lc = lcache_get(inode)) != NULL &&
+	    (link = kmalloc(lc->lc_len + 1, GFP_KERNEL)) != NULL) {
+		/* the entry may have been dropped while kmalloc() slept */
+		if ((lc = lcache_get(inode)) != NULL) {
+			memcpy(link, lc->lc_link, lc->lc_len + 1);
+			return link;
+		}
+		kfree(link);
+	}
+	if ((link = get_rock_ridge_symlink(inode)) != NULL)
+		lcache_install(inode, link);
+	return link;
+}
+
+void isofs_cache_release(struct super_block * sb)
+{
+	struct isofs_dir_cache * dc;
+	struct isofs_link_cache * lc;
+
+	while ((dc = sb->u.isofs_sb.s_dir_cache)) {
+		sb->u.isofs_sb.s_dir_cache = dc->dc_next;
+		dircache_destroy(dc);
+	}
+	sb->u.isofs_sb.s_dir_caches = 0;
+	while ((lc = sb->u.isofs_sb.s_link_cache)) {
+		sb->u.isofs_sb.s_link_cache = lc->lc_next;
+		kfree(lc);
+	}
+	sb->u.isofs_sb.s_link_caches = 0;
+}
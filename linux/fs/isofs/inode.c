@@ -44,6 +44,7 @@ void isofs_put_super(struct super_block *sb)
 		sb->u.isofs_sb.s_nls_iocharset = NULL;
 	}
 	lock_super(sb);
+	isofs_cache_release(sb);
 
 #ifdef LEAK_CHECK
 	printk("Outstanding mallocs:%d, outstanding buffers: %d\n", 
@@ -506,6 +507,10 @@ struct super_block *isofs_read_super(struct super_block *s,void *data,
 	s->u.isofs_sb.s_uid = opt.uid;
 	s->u.isofs_sb.s_gid = opt.gid;
 	s->u.isofs_sb.s_utf8 = opt.utf8;
+	s->u.isofs_sb.s_dir_cache = NULL;
+	s->u.isofs_sb.s_dir_caches = 0;
+	s->u.isofs_sb.s_link_cache = NULL;
+	s->u.isofs_sb.s_link_caches = 0;
 	/*
 	 * It would be incredibly stupid to allow people to mark every file on the disk
 	 * as suid, so we merely allow them to set the default permissions.
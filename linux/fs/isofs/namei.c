@@ -50,6 +50,50 @@ static int isofs_match(int len,const char * name, const char * compare, int dlen
 	return !memcmp(name, compare, len);
 }
 
+/*
+ * The name of a directory record as a lookup sees it: the Rock Ridge or
+ * Joliet name, or the ISO name mapped as the mount options ask, built
+ * in "buf" (a page) when it differs from the record.  "*trail" is set
+ * when a trailing period may be left out of the name.  Returns the
+ * length, or -1 for the place holder of a relocated directory.
+ */
+int isofs_entry_name(struct inode * dir, struct iso_directory_record * de,
+		     char * buf, char ** name, int * trail)
+{
+	int i, len;
+	char c;
+
+	*name = de->name;
+	*trail = 0;
+	len = de->name_len[0];
+	if (dir->i_sb->u.isofs_sb.s_rock &&
+	    (i = get_rock_ridge_filename(de, buf, dir)) != 0) {
+		if (i < 0)
+			return -1;
+		*name = buf;
+		return i;
+	}
+	if (dir->i_sb->u.isofs_sb.s_joliet_level) {
+		*name = buf;
+		return get_joliet_filename(de, dir, buf);
+	}
+	if (dir->i_sb->u.isofs_sb.s_mapping == 'n') {
+		for (i = 0; i < len; i++) {
+			c = de->name[i];
+			/* lower case */
+			if (c >= 'A' && c <= 'Z') c |= 0x20;
+			if (c == ';' && i == len-2 && de->name[i+1] == '1')
+				break;
+			if (c == ';') c = '.';
+			buf[i] = c;
+		}
+		*name = buf;
+		*trail = i > 0 && buf[i-1] == '.';
+		return i;
+	}
+	return len;
+}
+
 /*
  *	isofs_find_entry()
  *
@@ -64,16 +108,15 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 {
 	unsigned long bufsize = ISOFS_BUFFER_SIZE(dir);
 	unsigned char bufbits = ISOFS_BUFFER_BITS(dir);
-	unsigned int block, i, f_pos, offset, inode_number;
+	unsigned int block, f_pos, offset, inode_number;
 	struct buffer_head * bh;
 	void * cpnt = NULL;
 	unsigned int old_offset;
 	unsigned int backlink;
-	int dlen, match;
+	int dlen, match, trail;
 	char * dpnt;
-	unsigned char *page = NULL;
+	char * page;
 	struct iso_directory_record * de;
-	char c;
 
 	*ino = 0;
 	if (!dir) return NULL;
@@ -86,6 +129,12 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 	block = isofs_bmap(dir,f_pos >> bufbits);
 
 	if (!block || !(bh = bread(dir->i_dev,block,bufsize))) return NULL;
+
+	/* for the names built by isofs_entry_name() */
+	if (!(page = (char *) __get_free_page(GFP_KERNEL))) {
+		brelse(bh);
+		return NULL;
+	}
   
 	while (f_pos < dir->i_size) {
 		de = (struct iso_directory_record *) (bh->b_data + offset);
@@ -101,8 +150,10 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 			f_pos = ((f_pos & ~(ISOFS_BLOCK_SIZE - 1))
 				 + ISOFS_BLOCK_SIZE);
 			block = isofs_bmap(dir,f_pos>>bufbits);
-			if (!block || !(bh = bread(dir->i_dev,block,bufsize)))
+			if (!block || !(bh = bread(dir->i_dev,block,bufsize))) {
+				free_page((unsigned long) page);
 				return NULL;
+			}
 			continue; /* Will kick out if past end of directory */
 		}
 
@@ -116,7 +167,10 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 		        unsigned int frag1;
 			frag1 = bufsize - old_offset;
 			cpnt = kmalloc(*((unsigned char *) de),GFP_KERNEL);
-			if (!cpnt) return NULL;
+			if (!cpnt) {
+				free_page((unsigned long) page);
+				return NULL;
+			}
 			memcpy(cpnt, bh->b_data + old_offset, frag1);
 
 			de = (struct iso_directory_record *) cpnt;
@@ -125,6 +179,7 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 			block = isofs_bmap(dir,f_pos>>bufbits);
 			if (!block || !(bh = bread(dir->i_dev,block,bufsize))) {
 			        kfree(cpnt);
+				free_page((unsigned long) page);
 				return NULL;
 			};
 			memcpy((char *)cpnt+frag1, bh->b_data, offset);
@@ -154,45 +209,20 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 				inode_number = dir->i_ino;
 			backlink = 0;
 		} else {
-			if (dir->i_sb->u.isofs_sb.s_rock ||
-			    dir->i_sb->u.isofs_sb.s_joliet_level) {
-				page = (unsigned char *)
-					__get_free_page(GFP_KERNEL);
-				if (!page) return NULL;
-			}
-			if (dir->i_sb->u.isofs_sb.s_rock &&
-			    ((i = get_rock_ridge_filename(de, page, dir)))){
-				if (i == -1)
-					goto out;/* Relocated deep directory */
-				dlen = i;
-				dpnt = page;
-			} else if (dir->i_sb->u.isofs_sb.s_joliet_level) {
-				dlen = get_joliet_filename(de, dir, page);
-				dpnt = page;
-			} else if (dir->i_sb->u.isofs_sb.s_mapping == 'n') {
-				for (i = 0; i < dlen; i++) {
-					c = dpnt[i];
-					/* lower case */
-					if (c >= 'A' && c <= 'Z') c |= 0x20;
-					if (c == ';' && i == dlen-2 && dpnt[i+1] == '1') {
-						dlen -= 2;
-						break;
-					}
-					if (c == ';') c = '.';
-					dpnt[i] = c;
-				}
-				/* This allows us to match with and without
-				 * a trailing period. */
-				if(dpnt[dlen-1] == '.' && namelen == dlen-1)
-					dlen--;
-			}
+			/* A relocated directory is skipped, as by readdir */
+			dlen = isofs_entry_name(dir, de, page, &dpnt, &trail);
+			/* This allows us to match with and without
+			 * a trailing period. */
+			if (trail && namelen == dlen-1)
+				dlen--;
 		}
 		/*
 		 * Skip hidden or associated files unless unhide is set 
 		 */
 		match = 0;
-		if(   !(de->flags[-dir->i_sb->u.isofs_sb.s_high_sierra] & 5)
-		   || dir->i_sb->u.isofs_sb.s_unhide == 'y' )
+		if(dlen > 0 &&
+		   (!(de->flags[-dir->i_sb->u.isofs_sb.s_high_sierra] & 5)
+		    || dir->i_sb->u.isofs_sb.s_unhide == 'y'))
 		{
 			match = isofs_match(namelen,name,dpnt,dlen);
 		}
@@ -203,7 +233,6 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 			cpnt = NULL;
 		}
 
-		if (page) free_page((unsigned long) page);
 		if (match) {
 			if(inode_number == -1) {
 				/* Should only happen for the '..' entry */
@@ -218,23 +247,43 @@ isofs_find_entry(struct inode * dir, const char * name, int namelen,
 					goto out;
 				}
 			}
+			free_page((unsigned long) page);
 			*ino = inode_number;
 			*ino_back = backlink;
 			return bh;
 		}
 	}
  out:
-	if (cpnt)
-		kfree(cpnt);
+	free_page((unsigned long) page);
 	brelse(bh);
 	return NULL;
 }
 
+/*
+ * Look a name up through the cache of the directory where there is one
+ * (see cache.c), else by reading the directory
+ */
+static int isofs_find_name(struct inode * dir, const char * name, int len,
+			   unsigned long * ino, unsigned long * ino_back)
+{
+	struct buffer_head * bh;
+	int found;
+
+	if ((found = isofs_dircache_find(dir, name, len, ino)) >= 0) {
+		*ino_back = dir->i_ino;
+		return found;
+	}
+	if (!(bh = isofs_find_entry(dir, name, len, ino, ino_back)))
+		return 0;
+	brelse(bh);
+	return 1;
+}
+
 int isofs_lookup(struct inode * dir,const char * name, int len,
 	struct inode ** result)
 {
 	unsigned long ino, ino_back;
-	struct buffer_head * bh;
+	int found;
 
 #ifdef DEBUG
 	printk("lookup: %x %d\n",dir->i_ino, len);
@@ -260,7 +309,7 @@ int isofs_lookup(struct inode * dir,const char * name, int len,
 		 * was mounted with check=relaxed, convert the name to lower
 		 * case and try again.
 		 */
-		if (!(bh = isofs_find_entry(dir,name,len, &ino, &ino_back))
+		if (!(found = isofs_find_name(dir,name,len, &ino, &ino_back))
 		    && dir->i_sb->u.isofs_sb.s_name_check == 'r'
 		    && (lcname = kmalloc(len, GFP_KERNEL)) != NULL) {
 			int i;
@@ -271,18 +320,17 @@ int isofs_lookup(struct inode * dir,const char * name, int len,
 				if (c >= 'A' && c <= 'Z') c |= 0x20;
 				lcname[i] = c;
 			}
-			bh = isofs_find_entry(dir,lcname,len, &ino, &ino_back);
+			found = isofs_find_name(dir,lcname,len, &ino, &ino_back);
 			kfree(lcname);
 		}
 
-		if (!bh) {
+		if (!found) {
 			iput(dir);
 	  		return -ENOENT;
 		}
 		if (ino_back == dir->i_ino) {
 			dcache_add(dir, name, len, ino);
 		}
-		brelse(bh);
 	}
 
 	if (!(*result = iget(dir->i_sb,ino))) {
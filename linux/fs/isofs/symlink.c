@@ -65,7 +65,7 @@ static int isofs_follow_link(struct inode * dir, struct inode * inode,
 		return 0;
 	}
 	if ((current->link_count > 5) ||
-	   !(pnt = get_rock_ridge_symlink(inode))) {
+	   !(pnt = isofs_get_symlink(inode))) {
 		iput(dir);
 		iput(inode);
 		*res_inode = NULL;
@@ -92,7 +92,7 @@ static int isofs_readlink(struct inode * inode, char * buffer, int buflen)
 
 	if (buflen > 1023)
 		buflen = 1023;
-	pnt = get_rock_ridge_symlink(inode);
+	pnt = isofs_get_symlink(inode);
 
 	iput(inode);
 	if (!pnt)
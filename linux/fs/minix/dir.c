@@ -31,7 +31,7 @@ static struct file_operations minix_dir_operations = {
 	NULL,			/* mmap */
 	NULL,			/* no special open code */
 	NULL,			/* no special release code */
-	file_fsync		/* default fsync */
+	minix_sync_file		/* fsync */
 };
 
 /*
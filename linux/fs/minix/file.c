@@ -59,7 +59,7 @@ struct inode_operations minix_file_inode_operations = {
 	NULL,			/* rename */
 	NULL,			/* readlink */
 	NULL,			/* follow_link */
-	generic_readpage,	/* readpage */
+	minix_readpage,		/* readpage */
 	NULL,			/* writepage */
 	minix_bmap,		/* bmap */
 	minix_truncate,		/* truncate */
@@ -110,7 +110,7 @@ static int minix_file_write(struct inode * inode, struct file * filp, const char
 		memcpy_fromfs(p,buf,c);
 		update_vm_cache(inode, pos, p, c);
 		mark_buffer_uptodate(bh, 1);
-		mark_buffer_dirty(bh, 0);
+		mark_buffer_dirty_inode(bh, 0, inode);
 		brelse(bh);
 		pos += c;
 		written += c;
@@ -438,6 +438,30 @@ int minix_bmap(struct inode * inode,int block)
 		return V2_minix_bmap(inode, block);
 }
 
+/*
+ * The same trees for bmap_readpage(): 7 direct blocks, then single and
+ * double (V2: and triple) indirect blocks of 16 (V2: 32) bit pointers.
+ */
+static const struct bmap_tree V1_minix_tree = { 7, 2, 9, 2, BLOCK_SIZE };
+static const struct bmap_tree V2_minix_tree = { 7, 3, 8, 4, BLOCK_SIZE };
+
+int minix_readpage(struct inode * inode, struct page * page)
+{
+	unsigned long roots[3];
+
+	if (INODE_VERSION(inode) == MINIX_V1) {
+		roots[0] = inode->u.minix_i.u.i1_data[7];
+		roots[1] = inode->u.minix_i.u.i1_data[8];
+		return bmap_readpage(inode, page, &V1_minix_tree,
+			inode->u.minix_i.u.i1_data, roots);
+	}
+	roots[0] = inode->u.minix_i.u.i2_data[7];
+	roots[1] = inode->u.minix_i.u.i2_data[8];
+	roots[2] = inode->u.minix_i.u.i2_data[9];
+	return bmap_readpage(inode, page, &V2_minix_tree,
+		inode->u.minix_i.u.i2_data, roots);
+}
+
 /*
  * The minix V1 fs getblk functions.
  */
@@ -470,6 +494,8 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
+	/* zeroed by minix_new_block(); the file has it now */
+	mark_buffer_dirty_inode(result, 1, inode);
 	inode->i_ctime = CURRENT_TIME;
 	inode->i_dirt = 1;
 	return result;
@@ -520,7 +546,9 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, inode);
+	/* zeroed by minix_new_block(); the file has it now */
+	mark_buffer_dirty_inode(result, 1, inode);
 	brelse(bh);
 	return result;
 }
@@ -583,6 +611,8 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
+	/* zeroed by minix_new_block(); the file has it now */
+	mark_buffer_dirty_inode(result, 1, inode);
 	inode->i_ctime = CURRENT_TIME;
 	inode->i_dirt = 1;
 	return result;
@@ -633,7 +663,9 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, inode);
+	/* zeroed by minix_new_block(); the file has it now */
+	mark_buffer_dirty_inode(result, 1, inode);
 	brelse(bh);
 	return result;
 }
@@ -193,7 +193,7 @@ static int minix_add_entry(struct inode * dir,
 			for (i = 0; i < info->s_namelen ; i++)
 				de->name[i] = (i < namelen) ? name[i] : 0;
 			dir->i_version = ++event;
-			mark_buffer_dirty(bh, 1);
+			mark_buffer_dirty_inode(bh, 1, dir);
 			*res_dir = de;
 			break;
 		}
@@ -236,7 +236,7 @@ int minix_create(struct inode * dir,const char * name, int len, int mode,
 		return error;
 	}
 	de->inode = inode->i_ino;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	brelse(bh);
 	iput(dir);
 	*result = inode;
@@ -293,7 +293,7 @@ int minix_mknod(struct inode * dir, const char * name, int len, int mode, int rd
 		return error;
 	}
 	de->inode = inode->i_ino;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	brelse(bh);
 	iput(dir);
 	iput(inode);
@@ -345,7 +345,7 @@ int minix_mkdir(struct inode * dir, const char * name, int len, int mode)
 	de->inode = dir->i_ino;
 	strcpy(de->name,"..");
 	inode->i_nlink = 2;
-	mark_buffer_dirty(dir_block, 1);
+	mark_buffer_dirty_inode(dir_block, 1, inode);
 	brelse(dir_block);
 	inode->i_mode = S_IFDIR | (mode & 0777 & ~current->fs->umask);
 	if (dir->i_mode & S_ISGID)
@@ -359,7 +359,7 @@ int minix_mkdir(struct inode * dir, const char * name, int len, int mode)
 		return error;
 	}
 	de->inode = inode->i_ino;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	dir->i_nlink++;
 	dir->i_dirt = 1;
 	iput(dir);
@@ -470,7 +470,7 @@ int minix_rmdir(struct inode * dir, const char * name, int len)
 		printk("empty directory has nlink!=2 (%d)\n",inode->i_nlink);
 	de->inode = 0;
 	dir->i_version = ++event;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	inode->i_nlink=0;
 	inode->i_dirt=1;
 	inode->i_ctime = dir->i_ctime = dir->i_mtime = CURRENT_TIME;
@@ -525,7 +525,7 @@ repeat:
 	}
 	de->inode = 0;
 	dir->i_version = ++event;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
 	dir->i_dirt = 1;
 	inode->i_nlink--;
@@ -565,7 +565,7 @@ int minix_symlink(struct inode * dir, const char * name, int len, const char * s
 	while (i < 1023 && (c=*(symname++)))
 		name_block->b_data[i++] = c;
 	name_block->b_data[i] = 0;
-	mark_buffer_dirty(name_block, 1);
+	mark_buffer_dirty_inode(name_block, 1, inode);
 	brelse(name_block);
 	inode->i_size = i;
 	inode->i_dirt = 1;
@@ -587,7 +587,7 @@ int minix_symlink(struct inode * dir, const char * name, int len, const char * s
 		return i;
 	}
 	de->inode = inode->i_ino;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	brelse(bh);
 	iput(dir);
 	iput(inode);
@@ -624,7 +624,7 @@ int minix_link(struct inode * oldinode, struct inode * dir, const char * name, i
 		return error;
 	}
 	de->inode = oldinode->i_ino;
-	mark_buffer_dirty(bh, 1);
+	mark_buffer_dirty_inode(bh, 1, dir);
 	brelse(bh);
 	iput(dir);
 	oldinode->i_nlink++;
@@ -781,11 +781,11 @@ start_up:
 		new_inode->i_ctime = CURRENT_TIME;
 		new_inode->i_dirt = 1;
 	}
-	mark_buffer_dirty(old_bh, 1);
-	mark_buffer_dirty(new_bh, 1);
+	mark_buffer_dirty_inode(old_bh, 1, old_dir);
+	mark_buffer_dirty_inode(new_bh, 1, new_dir);
 	if (dir_bh) {
 		PARENT_INO(dir_bh->b_data) = new_dir->i_ino;
-		mark_buffer_dirty(dir_bh, 1);
+		mark_buffer_dirty_inode(dir_bh, 1, old_inode);
 		old_dir->i_nlink--;
 		old_dir->i_dirt = 1;
 		if (new_inode) {
@@ -19,6 +19,13 @@
  *
  * June 96: Added retries of RPCs that seem to have failed for a transient
  * reason.
+ *
+ * Sequential reads are read ahead here rather than by generic_file_read(),
+ * which issues one page at a time and cannot tell how many calls are in
+ * flight. nfs_readahead() keeps a window of READs queued to the nfsiods
+ * in front of the reader. The window grows by a page each time the reader
+ * catches up with it, and shrinks back towards what the reader consumes
+ * in one smoothed round trip to the server.
  */
 
 #include <linux/sched.h>
@@ -85,6 +92,7 @@ do_read_nfs_sync(struct inode * inode, struct page * page)
 	result = 0;
 
 io_error:
+	nfs_read_account(NFS_SERVER(inode), pos - page->offset);
 	if (refresh)
 		nfs_refresh_inode(inode, &fattr);
 	clear_bit(PG_locked, &page->flags);
@@ -107,6 +115,19 @@ nfsiod_read_setup(struct nfsiod_req *req)
 			(__u32 *) page_address(page));
 }
 
+/*
+ * Fold a READ round trip into the mount's smoothed RTT (scaled by 8,
+ * as in TCP).
+ */
+static inline void
+nfs_read_rtt(struct nfs_server *server, unsigned long rtt)
+{
+	if (!server->rd_srtt)
+		server->rd_srtt = rtt << 3;
+	else
+		server->rd_srtt += rtt - (server->rd_srtt >> 3);
+}
+
 /*
  * This is the callback from nfsiod telling us whether a reply was
  * received or some error occurred (timeout or socket shutdown).
@@ -127,6 +148,8 @@ nfsiod_read_result(int result, struct nfsiod_req *req)
 
 		result = nfs_proc_read_reply(&req->rq_rpcreq, &fattr);
 		if (result >= 0) {
+			if (req->rq_stamp)
+				nfs_read_rtt(server, jiffies - req->rq_stamp);
 			nfs_refresh_inode(req->rq_inode, &fattr);
 			if (result < PAGE_SIZE)
 				memset((u8 *) page_address(page)+result,
@@ -150,10 +173,13 @@ nfsiod_read_result(int result, struct nfsiod_req *req)
 		current->fsgid = req->rq_fsgid;
 		for (i = 0; i < NGROUPS; i++)
 			current->groups[i] = req->rq_groups[i];
+		req->rq_stamp = 0;	/* no RTT sample from a retransmit */
 		nfsiod_read_setup(req);
 		return 0;
 	}
+	server->rd_inflight--;
 	if (result >= 0) {
+		nfs_read_account(server, result);
 		set_bit(PG_uptodate, &page->flags);
 		succ++;
 	} else {
@@ -175,16 +201,18 @@ do_read_nfs_async(struct inode *inode, struct page *page)
 
 	dprintk("NFS: do_read_nfs_async(%p)\n", page);
 
-	set_bit(PG_locked, &page->flags);
-	clear_bit(PG_error, &page->flags);
-
+	/* leave the page alone unless the READ can be queued */
 	if (!(req = nfsiod_reserve(NFS_SERVER(inode))))
 		return -EAGAIN;
 
+	set_bit(PG_locked, &page->flags);
+	clear_bit(PG_error, &page->flags);
+
 	req->rq_retries = 5;
 	req->rq_callback = nfsiod_read_result;
 	req->rq_inode = inode;
 	req->rq_page = page;
+	req->rq_stamp = jiffies;
 
 	req->rq_fsuid = current->fsuid;
 	req->rq_fsgid = current->fsgid;
@@ -193,6 +221,7 @@ do_read_nfs_async(struct inode *inode, struct page *page)
 
 	if ((result = nfsiod_read_setup(req)) >= 0) {
 		page->count++;
+		NFS_SERVER(inode)->rd_inflight++;
 		nfsiod_enqueue(req);
 	} else {
 		dprintk("NFS: deferring async READ request.\n");
@@ -223,3 +252,107 @@ nfs_readpage(struct inode *inode, struct page *page)
 	free_page(address);
 	return error;
 }
+
+static inline void
+nfs_add_to_page_cache(struct page *page, struct inode *inode,
+		unsigned long offset, struct page **hash)
+{
+	page->count++;
+	page->flags &= ~((1 << PG_uptodate) | (1 << PG_error));
+	page->offset = offset;
+	add_page_to_inode_queue(inode, page);
+	__add_page_to_hash_queue(page, hash);
+}
+
+/*
+ * Called by nfs_file_read() before generic_file_read(). When the read
+ * continues the previous one, adjust the file's window and queue READs
+ * for the pages of this read and the window beyond it that are not in
+ * the page cache yet. Stops at the first page no nfsiod is free for and
+ * takes that one out of the page cache again, so that generic_file_read()
+ * gets it through nfs_readpage() instead of finding a page nobody reads.
+ */
+void
+nfs_readahead(struct inode *inode, unsigned long pos, int count)
+{
+	struct nfs_server *server = NFS_SERVER(inode);
+	struct page	*page, **hash;
+	unsigned long	offset, end, page_cache = 0;
+	long		gap;
+	int		window, want, stalled, result;
+
+	if (server->rsize < PAGE_SIZE || count <= 0)
+		return;
+	if (pos != NFS_RANEXT(inode) || !NFS_RAWINDOW(inode)) {
+		/* not sequential (yet): start over with a small window */
+		NFS_RANEXT(inode) = pos + count;
+		NFS_RAEND(inode) = 0;
+		NFS_RAWINDOW(inode) = NFS_MIN_READAHEAD;
+		NFS_RALAST(inode) = jiffies;
+		return;
+	}
+	NFS_RANEXT(inode) = pos + count;
+	gap = jiffies - NFS_RALAST(inode);
+	NFS_RALAST(inode) = jiffies;
+
+	/* Is the reader going to wait for the server? */
+	offset = pos & PAGE_MASK;
+	page = find_page(inode, offset);
+	stalled = !page || PageLocked(page);
+	if (page)
+		__free_page(page);
+	else if (offset < NFS_RAEND(inode))
+		NFS_RAEND(inode) = offset;	/* dropped from the cache */
+
+	window = NFS_RAWINDOW(inode);
+	if (stalled)
+		window++;
+	else {
+		/* the pages read in one round trip at the current pace */
+		if (gap < 1)
+			gap = 1;
+		want = (server->rd_srtt >> 3) * count / (gap * PAGE_SIZE) + 1;
+		if (window > want + 1)
+			window--;
+	}
+	if (window > nfs_readahead_max)
+		window = nfs_readahead_max;
+	if (window < NFS_MIN_READAHEAD)
+		window = NFS_MIN_READAHEAD;
+	NFS_RAWINDOW(inode) = window;
+	if (nfs_readahead_max < NFS_MIN_READAHEAD)
+		return;			/* switched off */
+
+	end = PAGE_ALIGN(pos + count) + window * PAGE_SIZE;
+	if (end > PAGE_ALIGN(inode->i_size))
+		end = PAGE_ALIGN(inode->i_size);
+	if (offset < NFS_RAEND(inode))
+		offset = NFS_RAEND(inode);
+	dprintk("NFS: readahead %ld-%ld, window %d\n", offset, end, window);
+
+	for (; offset < end; offset += PAGE_SIZE) {
+		/* get the page first, allocating may sleep */
+		if (!page_cache && !(page_cache = __get_free_page(GFP_KERNEL)))
+			break;
+		hash = page_hash(inode, offset);
+		if ((page = __find_page(inode, offset, *hash)) != NULL) {
+			__free_page(page);
+			continue;
+		}
+		page = mem_map + MAP_NR(page_cache);
+		page_cache = 0;
+		nfs_add_to_page_cache(page, inode, offset, hash);
+		result = do_read_nfs_async(inode, page);
+		if (result < 0) {
+			remove_page_from_hash_queue(page);
+			remove_page_from_inode_queue(page);
+			__free_page(page);
+		}
+		__free_page(page);
+		if (result < 0)
+			break;
+	}
+	NFS_RAEND(inode) = offset;
+	if (page_cache)
+		free_page(page_cache);
+}
@@ -38,6 +38,7 @@ static int nfs_link(struct inode *, struct inode *, const char *, int);
 static int nfs_mknod(struct inode *, const char *, int, int, int);
 static int nfs_rename(struct inode *, const char *, int,
 		      struct inode *, const char *, int, int);
+static void nfs_dircache_invalidate(kdev_t, int);
 
 static struct file_operations nfs_dir_operations = {
 	NULL,			/* lseek - default */
@@ -76,8 +77,10 @@ static inline void revalidate_dir(struct nfs_server * server, struct inode * dir
 {
 	struct nfs_fattr fattr;
 
-	if (jiffies - NFS_READTIME(dir) < NFS_ATTRTIMEO(dir))
+	if (jiffies - NFS_READTIME(dir) < NFS_ATTRTIMEO(dir)) {
+		server->getattr_saved++;
 		return;
+	}
 
 	NFS_READTIME(dir) = jiffies;
 	if (nfs_proc_getattr(server, NFS_FH(dir), &fattr) == 0) {
@@ -89,7 +92,8 @@ static inline void revalidate_dir(struct nfs_server * server, struct inode * dir
 		}
 		NFS_OLDMTIME(dir) = fattr.mtime.seconds;
 	}
-	/* invalidate directory cache here when we _really_ start caching */
+	/* lookups check the mtime themselves, readdir chunks go now */
+	nfs_dircache_invalidate(dir->i_dev, dir->i_ino);
 }
 
 static int nfs_dir_open(struct inode * dir, struct file * file)
@@ -108,29 +112,159 @@ static struct nfs_entry *c_entry = NULL;
 
 /*
  * We need to do caching of directory entries to prevent an
- * incredible amount of RPC traffic.  Only the most recent open
- * directory is cached.  This seems sufficient for most purposes.
- * Technically, we ought to flush the cache on close but this is
- * not a problem in practice.
+ * incredible amount of RPC traffic. A READDIR reply is decoded into
+ * c_entry and then copied, names packed, into one of the
+ * NFS_READDIR_CACHES chunks below, the least recently used one. A
+ * chunk is found again by its directory and the cookie it starts at,
+ * or by the cookie of one of its entries, and is good until the
+ * directory's mtime changes or the directory is changed from here.
+ */
+
+static struct nfs_dircache {
+	kdev_t dev;
+	int ino;
+	int mtime;		/* of the directory when read */
+	int cookie;		/* the chunk starts after this one */
+	int size;		/* entries */
+	int alloc;		/* bytes at entry */
+	struct nfs_entry *entry;
+	unsigned long used;	/* jiffies of last use */
+	unsigned long gen;	/* changes when refilled */
+} nfs_dircache[NFS_READDIR_CACHES];
+
+static unsigned long nfs_dircache_gen = 0;
+
+static void nfs_dircache_free(struct nfs_dircache *cache)
+{
+	if (cache->entry)
+		kfree_s(cache->entry, cache->alloc);
+	cache->entry = NULL;
+	cache->dev = 0;
+	cache->gen = ++nfs_dircache_gen;
+}
+
+/*
+ * Drop the chunks of a directory, or of all directories of a device
+ * if ino is 0.
+ */
+static void nfs_dircache_invalidate(kdev_t dev, int ino)
+{
+	struct nfs_dircache *cache;
+
+	for (cache = nfs_dircache; cache < nfs_dircache + NFS_READDIR_CACHES;
+	     cache++)
+		if (cache->dev == dev && (!ino || cache->ino == ino))
+			nfs_dircache_free(cache);
+}
+
+/*
+ * Find the chunk holding the entries after cookie, and the index of
+ * the first of them. Returns NULL if there is none, or sets *index
+ * to -1 at the end of the directory.
+ */
+static struct nfs_dircache *nfs_dircache_find(struct inode *dir, int cookie,
+					      int *index)
+{
+	struct nfs_dircache *cache, *found = NULL;
+	int i;
+
+	for (cache = nfs_dircache; cache < nfs_dircache + NFS_READDIR_CACHES;
+	     cache++) {
+		if (cache->dev != dir->i_dev || cache->ino != dir->i_ino)
+			continue;
+		if (cache->mtime != dir->i_mtime) {
+			nfs_dircache_free(cache);
+			continue;
+		}
+		if (cache->cookie == cookie) {
+			*index = 0;
+			found = cache;
+			break;
+		}
+		for (i = 0; i < cache->size; i++)
+			if (cache->entry[i].cookie == cookie)
+				break;
+		if (i == cache->size)
+			continue;
+		if (i < cache->size - 1) {
+			*index = i + 1;
+			found = cache;
+			break;
+		}
+		if (cache->entry[i].eof) {
+			*index = -1;
+			found = cache;
+			break;
+		}
+		/* the next chunk may be cached too: keep looking */
+	}
+	if (found)
+		found->used = jiffies;
+	return found;
+}
+
+/*
+ * Copy the size entries just decoded into c_entry into a chunk.
  */
+static struct nfs_dircache *nfs_dircache_fill(struct inode *dir, int cookie,
+					      int size)
+{
+	struct nfs_dircache *cache, *victim = nfs_dircache;
+	struct nfs_entry *entry;
+	char *names;
+	int i, alloc;
+
+	alloc = size * sizeof(struct nfs_entry);
+	for (i = 0; i < size; i++)
+		alloc += strlen(c_entry[i].name) + 1;
+	if (!(entry = (struct nfs_entry *) kmalloc(alloc, GFP_KERNEL)))
+		return NULL;
+	names = (char *) (entry + size);
+	for (i = 0; i < size; i++) {
+		entry[i] = c_entry[i];
+		entry[i].name = names;
+		strcpy(names, c_entry[i].name);
+		names += strlen(names) + 1;
+	}
+
+	for (cache = nfs_dircache; cache < nfs_dircache + NFS_READDIR_CACHES;
+	     cache++) {
+		if (!cache->dev) {
+			victim = cache;
+			break;
+		}
+		if (cache->used < victim->used)
+			victim = cache;
+	}
+	nfs_dircache_free(victim);
+	victim->dev = dir->i_dev;
+	victim->ino = dir->i_ino;
+	victim->mtime = dir->i_mtime;
+	victim->cookie = cookie;
+	victim->size = size;
+	victim->alloc = alloc;
+	victim->entry = entry;
+	victim->used = jiffies;
+	return victim;
+}
 
 static int nfs_readdir(struct inode *inode, struct file *filp,
 		       void *dirent, filldir_t filldir)
 {
-	static kdev_t c_dev = 0;
-	static int c_ino;
-	static int c_size;
-
+	struct nfs_server *server;
+	struct nfs_dircache *cache;
+	struct nfs_entry *entry;
+	unsigned long gen;
 	int result;
 	int i, index = 0;
-	struct nfs_entry *entry;
 
 	if (!inode || !S_ISDIR(inode->i_mode)) {
 		printk("nfs_readdir: inode is NULL or not a directory\n");
 		return -EBADF;
 	}
+	server = NFS_SERVER(inode);
 
-	revalidate_dir(NFS_SERVER(inode), inode);
+	revalidate_dir(server, inode);
 
 	/* initialize cache memory if it hasn't been used before */
 
@@ -154,55 +288,39 @@ static int nfs_readdir(struct inode *inode, struct file *filp,
 			}
 		}
 	}
-	entry = NULL;
 
 	/* try to find it in the cache */
 
-	if (inode->i_dev == c_dev && inode->i_ino == c_ino) {
-		for (i = 0; i < c_size; i++) {
-			if (filp->f_pos == c_entry[i].cookie) {
-				if (i == c_size - 1) {
-					if (c_entry[i].eof)
-						return 0;
-				}
-				else
-					entry = c_entry + (index = i + 1);
-				break;
-			}
-		}
+	if (!(server->flags & NFS_MOUNT_NOAC)
+	    && (cache = nfs_dircache_find(inode, filp->f_pos, &index))) {
+		server->readdir_hits++;
+		if (index < 0)
+			return 0;
 	}
 
 	/* if we didn't find it in the cache, revert to an nfs call */
 
-	if (!entry) {
-		result = nfs_proc_readdir(NFS_SERVER(inode), NFS_FH(inode),
+	else {
+		server->readdir_calls++;
+		result = nfs_proc_readdir(server, NFS_FH(inode),
 			filp->f_pos, NFS_READDIR_CACHE_SIZE, c_entry);
-		if (result < 0) {
-			c_dev = 0;
+		if (result <= 0)
 			return result;
-		}
-		if (result > 0) {
-			c_dev = inode->i_dev;
-			c_ino = inode->i_ino;
-			c_size = result;
-			entry = c_entry + (index = 0);
-		}
+		if (!(cache = nfs_dircache_fill(inode, filp->f_pos, result)))
+			return -ENOMEM;
+		index = 0;
 	}
 
-	/* if we found it in the cache or from an nfs call, return results */
-	if (!entry)
-		return 0;
-	while (index < c_size) {
+	/* return results from the cache */
+	gen = cache->gen;
+	entry = cache->entry + index;
+	while (index < cache->size) {
 		int nextpos = entry->cookie;
 		if (filldir(dirent, entry->name, strlen(entry->name), filp->f_pos, entry->fileid) < 0)
 			break;
 		filp->f_pos = nextpos;
-		/* revalidate the cache if we slept in filldir() */
-		if (inode->i_dev != c_dev)
-			break;
-		if (inode->i_ino != c_ino)
-			break;
-		if (nextpos != entry->cookie)
+		/* the chunk may have gone if we slept in filldir() */
+		if (cache->gen != gen)
 			break;
 		index++;
 		entry++;
@@ -217,8 +335,12 @@ static int nfs_readdir(struct inode *inode, struct file *filp,
 
 void nfs_kfree_cache(void)
 {
+	struct nfs_dircache *cache;
 	int i;
 
+	for (cache = nfs_dircache; cache < nfs_dircache + NFS_READDIR_CACHES;
+	     cache++)
+		nfs_dircache_free(cache);
 	if (c_entry == NULL)
 		return;
 	for (i = 0; i < NFS_READDIR_CACHE_SIZE; i++)
@@ -229,61 +351,130 @@ void nfs_kfree_cache(void)
  
 
 /*
- * Lookup caching is a big win for performance but this is just
- * a trial to see how well it works on a small scale.
+ * Lookup caching is a big win for performance.
  * For example, bash does a lookup on ".." 13 times for each path
  * element when running pwd.  Yes, hard to believe but true.
  * Try pwd in a filesystem mounted with noac.
  *
  * It trades a little cpu time and memory for a lot of network bandwidth.
- * Since the cache is not hashed yet, it is a good idea not to make it too
- * large because every lookup looks through the entire cache even
- * though most of them will fail.
+ * Entries are hashed by directory and name, and by the file they name
+ * so that changes to the file's attributes find them. An entry notes
+ * the mtime its directory had when it was made and goes when that
+ * changes. nfs_lookup() revalidates the directory first, which costs a
+ * GETATTR only when the directory's attribute timeout has run out. As
+ * the mtime check guards the name, the file handle is kept for acdirmax
+ * or acregmax. The attributes are only good for acdirmin or acregmin
+ * since the inode was last refreshed; a hit after that costs a GETATTR
+ * on the cached file handle instead of a LOOKUP.
  */
 
 static struct nfs_lookup_cache_entry {
+	struct nfs_lookup_cache_entry *name_next;	/* hash by dir, name */
+	struct nfs_lookup_cache_entry *file_next;	/* hash by fileid */
 	kdev_t dev;
 	int inode;
-	char filename[NFS_MAXNAMLEN + 1];
+	int dir_mtime;
+	char filename[NFS_LOOKUP_NAMELEN + 1];
 	struct nfs_fh fhandle;
 	struct nfs_fattr fattr;
 	int expiration_date;
+	int attr_expiration;
 } nfs_lookup_cache[NFS_LOOKUP_CACHE_SIZE];
 
+static struct nfs_lookup_cache_entry *nfs_lookup_name_hash[NFS_LOOKUP_HASH_SIZE];
+static struct nfs_lookup_cache_entry *nfs_lookup_file_hash[NFS_LOOKUP_HASH_SIZE];
+
+static inline int nfs_lookup_name_hashfn(kdev_t dev, int dir,
+					 const char *filename)
+{
+	unsigned long hash = dev ^ dir;
+
+	while (*filename)
+		hash = hash * 31 + *filename++;
+	return hash & (NFS_LOOKUP_HASH_SIZE - 1);
+}
+
+#define nfs_lookup_file_hashfn(dev, fileid) \
+	(((dev) ^ (fileid)) & (NFS_LOOKUP_HASH_SIZE - 1))
+
+static void nfs_lookup_cache_unhash(struct nfs_lookup_cache_entry *entry)
+{
+	struct nfs_lookup_cache_entry **p;
+
+	p = nfs_lookup_name_hash + nfs_lookup_name_hashfn(entry->dev,
+				entry->inode, entry->filename);
+	for (; *p; p = &(*p)->name_next)
+		if (*p == entry) {
+			*p = entry->name_next;
+			break;
+		}
+	p = nfs_lookup_file_hash + nfs_lookup_file_hashfn(entry->dev,
+				entry->fattr.fileid);
+	for (; *p; p = &(*p)->file_next)
+		if (*p == entry) {
+			*p = entry->file_next;
+			break;
+		}
+	entry->dev = 0;
+}
+
+static void nfs_lookup_cache_hash(struct nfs_lookup_cache_entry *entry)
+{
+	int h;
+
+	h = nfs_lookup_name_hashfn(entry->dev, entry->inode, entry->filename);
+	entry->name_next = nfs_lookup_name_hash[h];
+	nfs_lookup_name_hash[h] = entry;
+	h = nfs_lookup_file_hashfn(entry->dev, entry->fattr.fileid);
+	entry->file_next = nfs_lookup_file_hash[h];
+	nfs_lookup_file_hash[h] = entry;
+}
+
 static struct nfs_lookup_cache_entry *nfs_lookup_cache_index(struct inode *dir,
 							     const char *filename)
 {
 	struct nfs_lookup_cache_entry *entry;
-	int i;
 
-	for (i = 0; i < NFS_LOOKUP_CACHE_SIZE; i++) {
-		entry = nfs_lookup_cache + i;
+	entry = nfs_lookup_name_hash[nfs_lookup_name_hashfn(dir->i_dev,
+						dir->i_ino, filename)];
+	for (; entry; entry = entry->name_next)
 		if (entry->dev == dir->i_dev
 		    && entry->inode == dir->i_ino
-		    && !strncmp(filename, entry->filename, NFS_MAXNAMLEN))
+		    && !strcmp(filename, entry->filename))
 			return entry;
-	}
 	return NULL;
 }
 
+static inline int nfs_lookup_attr_timeo(struct nfs_server *server,
+					struct nfs_fattr *fattr)
+{
+	return S_ISDIR(fattr->mode) ? server->acdirmin : server->acregmin;
+}
+
 static int nfs_lookup_cache_lookup(struct inode *dir, const char *filename,
 				   struct nfs_fh *fhandle,
 				   struct nfs_fattr *fattr)
 {
-	static int nfs_lookup_cache_in_use = 0;
-
 	struct nfs_lookup_cache_entry *entry;
 
-	if (!nfs_lookup_cache_in_use) {
-		memset(nfs_lookup_cache, 0, sizeof(nfs_lookup_cache));
-		nfs_lookup_cache_in_use = 1;
-	}
 	if ((entry = nfs_lookup_cache_index(dir, filename))) {
-		if (jiffies > entry->expiration_date) {
-			entry->dev = 0;
+		if (jiffies > entry->expiration_date
+		    || entry->dir_mtime != dir->i_mtime) {
+			nfs_lookup_cache_unhash(entry);
 			return 0;
 		}
 		*fhandle = entry->fhandle;
+		if (jiffies > entry->attr_expiration) {
+			/* the name still holds, its attributes may not;
+			   nfs_fhget() puts the new ones into the entry */
+			if (nfs_proc_getattr(NFS_SERVER(dir), fhandle, fattr)) {
+				/* we slept: the entry may be gone or reused */
+				if ((entry = nfs_lookup_cache_index(dir, filename)))
+					nfs_lookup_cache_unhash(entry);
+				return 0;
+			}
+			return 1;
+		}
 		*fattr = entry->fattr;
 		return 1;
 	}
@@ -301,27 +492,34 @@ static void nfs_lookup_cache_add(struct inode *dir, const char *filename,
 	if (fattr->size == -1 || fattr->uid == -1 || fattr->gid == -1
 	    || fattr->atime.seconds == -1 || fattr->mtime.seconds == -1)
 		return;
+	if (strlen(filename) > NFS_LOOKUP_NAMELEN)
+		return;
 	if (!(entry = nfs_lookup_cache_index(dir, filename))) {
 		entry = nfs_lookup_cache + nfs_lookup_cache_pos++;
 		if (nfs_lookup_cache_pos == NFS_LOOKUP_CACHE_SIZE)
 			nfs_lookup_cache_pos = 0;
 	}
+	if (entry->dev)
+		nfs_lookup_cache_unhash(entry);
 	entry->dev = dir->i_dev;
 	entry->inode = dir->i_ino;
+	entry->dir_mtime = dir->i_mtime;
 	strcpy(entry->filename, filename);
 	entry->fhandle = *fhandle;
 	entry->fattr = *fattr;
 	entry->expiration_date = jiffies + (S_ISDIR(fattr->mode)
-		? NFS_SERVER(dir)->acdirmin : NFS_SERVER(dir)->acregmin);
+		? NFS_SERVER(dir)->acdirmax : NFS_SERVER(dir)->acregmax);
+	entry->attr_expiration = jiffies +
+		nfs_lookup_attr_timeo(NFS_SERVER(dir), fattr);
+	nfs_lookup_cache_hash(entry);
 }
 
 static void nfs_lookup_cache_remove(struct inode *dir, struct inode *inode,
 				    const char *filename)
 {
-	struct nfs_lookup_cache_entry *entry;
+	struct nfs_lookup_cache_entry *entry, *next;
 	kdev_t dev;
 	int fileid;
-	int i;
 
 	if (inode) {
 		dev = inode->i_dev;
@@ -333,10 +531,11 @@ static void nfs_lookup_cache_remove(struct inode *dir, struct inode *inode,
 	}
 	else
 		return;
-	for (i = 0; i < NFS_LOOKUP_CACHE_SIZE; i++) {
-		entry = nfs_lookup_cache + i;
+	entry = nfs_lookup_file_hash[nfs_lookup_file_hashfn(dev, fileid)];
+	for (; entry; entry = next) {
+		next = entry->file_next;
 		if (entry->dev == dev && entry->fattr.fileid == fileid)
-			entry->dev = 0;
+			nfs_lookup_cache_unhash(entry);
 	}
 }
 
@@ -346,18 +545,44 @@ static void nfs_lookup_cache_refresh(struct inode *file,
 	struct nfs_lookup_cache_entry *entry;
 	kdev_t dev = file->i_dev;
 	int fileid = file->i_ino;
-	int i;
 
-	for (i = 0; i < NFS_LOOKUP_CACHE_SIZE; i++) {
-		entry = nfs_lookup_cache + i;
-		if (entry->dev == dev && entry->fattr.fileid == fileid)
+	entry = nfs_lookup_file_hash[nfs_lookup_file_hashfn(dev, fileid)];
+	for (; entry; entry = entry->file_next)
+		if (entry->dev == dev && entry->fattr.fileid == fileid) {
 			entry->fattr = *fattr;
-	}
+			entry->attr_expiration = jiffies +
+				nfs_lookup_attr_timeo(NFS_SERVER(file), fattr);
+		}
+}
+
+/*
+ * The directory has been changed from here: its cached chunks are no
+ * good any more, though its mtime as we know it may not show it yet.
+ */
+static inline void nfs_dir_changed(struct inode *dir)
+{
+	nfs_dircache_invalidate(dir->i_dev, dir->i_ino);
+}
+
+/*
+ * Forget everything cached about a device, as at umount: its number
+ * can be given to the next mount.
+ */
+void nfs_dircache_flush(kdev_t dev)
+{
+	struct nfs_lookup_cache_entry *entry;
+
+	for (entry = nfs_lookup_cache;
+	     entry < nfs_lookup_cache + NFS_LOOKUP_CACHE_SIZE; entry++)
+		if (entry->dev == dev)
+			nfs_lookup_cache_unhash(entry);
+	nfs_dircache_invalidate(dev, 0);
 }
 
 static int nfs_lookup(struct inode *dir, const char *__name, int len,
 		      struct inode **result)
 {
+	struct nfs_server *server;
 	struct nfs_fh fhandle;
 	struct nfs_fattr fattr;
 	char name[len > NFS_MAXNAMLEN? 1 : len+1];
@@ -379,15 +604,20 @@ static int nfs_lookup(struct inode *dir, const char *__name, int len,
 		*result = dir;
 		return 0;
 	}
-	if ((NFS_SERVER(dir)->flags & NFS_MOUNT_NOAC)
+	server = NFS_SERVER(dir);
+	if (!(server->flags & NFS_MOUNT_NOAC))
+		revalidate_dir(server, dir);
+	if ((server->flags & NFS_MOUNT_NOAC)
 	    || !nfs_lookup_cache_lookup(dir, name, &fhandle, &fattr)) {
-		if ((error = nfs_proc_lookup(NFS_SERVER(dir), NFS_FH(dir),
+		server->lookup_calls++;
+		if ((error = nfs_proc_lookup(server, NFS_FH(dir),
 		    name, &fhandle, &fattr))) {
 			iput(dir);
 			return error;
 		}
 		nfs_lookup_cache_add(dir, name, &fhandle, &fattr);
-	}
+	} else
+		server->lookup_hits++;
 	if (!(*result = nfs_fhget(dir->i_sb, &fhandle, &fattr))) {
 		iput(dir);
 		return -EACCES;
@@ -417,8 +647,10 @@ static int nfs_create(struct inode *dir, const char *name, int len, int mode,
 	sattr.mode = mode;
 	sattr.uid = sattr.gid = sattr.size = (unsigned) -1;
 	sattr.atime.seconds = sattr.mtime.seconds = (unsigned) -1;
-	if ((error = nfs_proc_create(NFS_SERVER(dir), NFS_FH(dir),
-		name, &sattr, &fhandle, &fattr))) {
+	error = nfs_proc_create(NFS_SERVER(dir), NFS_FH(dir),
+		name, &sattr, &fhandle, &fattr);
+	nfs_dir_changed(dir);
+	if (error) {
 		iput(dir);
 		return error;
 	}
@@ -465,6 +697,7 @@ static int nfs_mknod(struct inode *dir, const char *name, int len,
 		error = nfs_proc_create(NFS_SERVER(dir), NFS_FH(dir),
 					name, &sattr, &fhandle, &fattr);
 	}
+	nfs_dir_changed(dir);
 	if (!error)
 	{
 		nfs_lookup_cache_add(dir, name, &fhandle, &fattr);
@@ -497,6 +730,7 @@ static int nfs_mkdir(struct inode *dir, const char *name, int len, int mode)
 	sattr.atime.seconds = sattr.mtime.seconds = (unsigned) -1;
 	error = nfs_proc_mkdir(NFS_SERVER(dir), NFS_FH(dir),
 		name, &sattr, &fhandle, &fattr);
+	nfs_dir_changed(dir);
 	if (!error) {
 		if (fattr.fileid == dir->i_ino)
 			printk("Sony NewsOS 4.1R buggy nfs server?\n");
@@ -524,6 +758,7 @@ static int nfs_rmdir(struct inode *dir, const char *name, int len)
 	}
 	error = nfs_proc_rmdir(NFS_SERVER(dir), NFS_FH(dir), name);
 	nfs_lookup_cache_remove(dir, NULL, name);
+	nfs_dir_changed(dir);
 	iput(dir);
 	return error;
 }
@@ -549,6 +784,7 @@ static int nfs_sillyrename(struct inode *dir, const char *name, int len)
 	}
 	ret = nfs_proc_rename(NFS_SERVER(dir), NFS_FH(dir), name,
 					       NFS_FH(dir), silly, 0);
+	nfs_dir_changed(dir);
 	if (ret >= 0) {
 		nfs_lookup_cache_remove(dir, NULL, name);
 		nfs_lookup_cache_remove(dir, NULL, silly);
@@ -568,6 +804,7 @@ void nfs_sillyrename_cleanup(struct inode *inode)
 	slen = sprintf(silly, ".nfs%ld", inode->i_ino);
 	error = nfs_proc_remove(NFS_SERVER(dir), NFS_FH(dir), silly);
 	nfs_lookup_cache_remove(dir, NULL, silly);
+	nfs_dir_changed(dir);
 	if (error < 0)
 		printk("NFS silly_rename cleanup failed (err = %d)\n",
 					-error);
@@ -591,6 +828,7 @@ static int nfs_unlink(struct inode *dir, const char *name, int len)
 	if ((error = nfs_sillyrename(dir, name, len)) < 0) {
 		error = nfs_proc_remove(NFS_SERVER(dir), NFS_FH(dir), name);
 		nfs_lookup_cache_remove(dir, NULL, name);
+		nfs_dir_changed(dir);
 	}
 	iput(dir);
 	return error;
@@ -620,6 +858,7 @@ static int nfs_symlink(struct inode *dir, const char *name, int len,
 	sattr.atime.seconds = sattr.mtime.seconds = (unsigned) -1;
 	error = nfs_proc_symlink(NFS_SERVER(dir), NFS_FH(dir),
 		name, symname, &sattr);
+	nfs_dir_changed(dir);
 	iput(dir);
 	return error;
 }
@@ -650,6 +889,7 @@ static int nfs_link(struct inode *oldinode, struct inode *dir,
 		NFS_FH(dir), name);
 
 	nfs_lookup_cache_remove(dir, oldinode, NULL);
+	nfs_dir_changed(dir);
 	NFS_CACHEINV(oldinode);
 	iput(oldinode);
 	iput(dir);
@@ -686,6 +926,8 @@ static int nfs_rename(struct inode *old_dir, const char *old_name, int old_len,
 
 	nfs_lookup_cache_remove(old_dir, NULL, old_name);
 	nfs_lookup_cache_remove(new_dir, NULL, new_name);
+	nfs_dir_changed(old_dir);
+	nfs_dir_changed(new_dir);
 	iput(old_dir);
 	iput(new_dir);
 	return error;
@@ -725,6 +967,9 @@ void nfs_refresh_inode(struct inode *inode, struct nfs_fattr *fattr)
 	inode->i_uid = fattr->uid;
 	inode->i_gid = fattr->gid;
 
+	/* The server has not seen writes still queued here */
+	if (NFS_WRITEBACK(inode) && fattr->size < inode->i_size)
+		fattr->size = inode->i_size;
 	/* Size changed from outside: invalidate caches on next read */
 	if (inode->i_size != fattr->size)
 		NFS_CACHEINV(inode);
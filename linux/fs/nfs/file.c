@@ -33,6 +33,9 @@ static int nfs_file_mmap(struct inode *, struct file *, struct vm_area_struct *)
 static int nfs_file_read(struct inode *, struct file *, char *, int);
 static int nfs_file_write(struct inode *, struct file *, const char *, int);
 static int nfs_fsync(struct inode *, struct file *);
+static int nfs_file_flush(struct inode *, struct file *);
+static int nfs_file_prepare_read(struct inode *, struct file *,
+				 unsigned long, int);
 
 static struct file_operations nfs_file_operations = {
 	NULL,			/* lseek - default */
@@ -45,6 +48,11 @@ static struct file_operations nfs_file_operations = {
 	NULL,			/* no special open is needed */
 	NULL,			/* release */
 	nfs_fsync,		/* fsync */
+	NULL,			/* fasync */
+	NULL,			/* check_media_change */
+	NULL,			/* revalidate */
+	nfs_file_flush,		/* flush */
+	nfs_file_prepare_read,	/* prepare_read */
 };
 
 struct inode_operations nfs_file_inode_operations = {
@@ -70,8 +78,10 @@ static inline void revalidate_inode(struct nfs_server * server, struct inode * i
 {
 	struct nfs_fattr fattr;
 
-	if (jiffies - NFS_READTIME(inode) < NFS_ATTRTIMEO(inode))
+	if (jiffies - NFS_READTIME(inode) < NFS_ATTRTIMEO(inode)) {
+		server->getattr_saved++;
 		return;
+	}
 
 	NFS_READTIME(inode) = jiffies;
 	if (nfs_proc_getattr(server, NFS_FH(inode), &fattr) == 0) {
@@ -87,29 +97,55 @@ static inline void revalidate_inode(struct nfs_server * server, struct inode * i
 }
 
 
+/*
+ * Everything to do before the page cache can be read from: also called
+ * by sendfile(), which goes to the page cache without read().
+ */
+static int nfs_file_prepare_read(struct inode * inode, struct file * file,
+	unsigned long pos, int count)
+{
+	if (NFS_WRITEBACK(inode))
+		nfs_flush_writes(inode);
+	revalidate_inode(NFS_SERVER(inode), inode);
+	nfs_readahead(inode, pos, count);
+	return 0;
+}
+
 static int nfs_file_read(struct inode * inode, struct file * file,
 	char * buf, int count)
 {
-	revalidate_inode(NFS_SERVER(inode), inode);
+	nfs_file_prepare_read(inode, file, file->f_pos, count);
 	return generic_file_read(inode, file, buf, count);
 }
 
 static int nfs_file_mmap(struct inode * inode, struct file * file, struct vm_area_struct * vma)
 {
+	if (NFS_WRITEBACK(inode))
+		nfs_flush_writes(inode);
 	revalidate_inode(NFS_SERVER(inode), inode);
 	return generic_file_mmap(inode, file, vma);
 }
 
 static int nfs_fsync(struct inode *inode, struct file *file)
 {
-	return 0;
+	return nfs_write_error(inode);
+}
+
+/*
+ * Called on every close: the data written must be on the server
+ * before close() returns, and so must any error in writing it.
+ */
+static int nfs_file_flush(struct inode *inode, struct file *file)
+{
+	if (!(file->f_mode & FMODE_WRITE))
+		return 0;
+	return nfs_write_error(inode);
 }
 
 static int nfs_file_write(struct inode *inode, struct file *file, const char *buf,
 			  int count)
 {
-	int result, written, wsize;
-	struct nfs_fattr fattr;
+	int written;
 	unsigned long pos;
 
 	if (!inode) {
@@ -127,31 +163,19 @@ static int nfs_file_write(struct inode *inode, struct file *file, const char *bu
 	pos = file->f_pos;
 	if (file->f_flags & O_APPEND)
 		pos = inode->i_size;
-	wsize = NFS_SERVER(inode)->wsize;
-	result = 0;
-	written = 0;
-	while (written < count) {
-		int hunk = count - written;
-		if (hunk >= wsize)
-			hunk = wsize;
-		result = nfs_proc_write(inode,
-			pos, hunk, buf, &fattr);
-		if (result < 0)
-			break;
-		pos += hunk;
-		buf += hunk;
-		written += hunk;
-		if (hunk < wsize)
-			break;
-	}
-	if (!written)
-		return result;
+	/* queued for the nfsiods, see write.c */
+	written = nfs_writeback(inode, pos, buf, count);
+	if (written <= 0)
+		return written;
+	pos += written;
 	file->f_pos = pos;
 	if (pos > inode->i_size)
 		inode->i_size = pos;
-	/* Avoid possible Solaris 2.5 nfsd bug */
-	if (inode->i_ino == fattr.fileid)
-		nfs_refresh_inode(inode, &fattr);
+	if (file->f_flags & O_SYNC) {
+		int error = nfs_write_error(inode);
+		if (error)
+			return error;
+	}
 	return written;
 }
 
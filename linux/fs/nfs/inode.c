@@ -75,6 +75,8 @@ static void nfs_read_inode(struct inode * inode)
 
 static void nfs_put_inode(struct inode * inode)
 {
+	if (NFS_WRITEBACK(inode))
+		nfs_flush_writes(inode);
 	if (NFS_RENAMED_DIR(inode))
 		nfs_sillyrename_cleanup(inode);
 	if (inode->i_pipe)
@@ -83,6 +85,7 @@ static void nfs_put_inode(struct inode * inode)
 
 void nfs_put_super(struct super_block *sb)
 {
+	nfs_dircache_flush(sb->s_dev);
 	close_fp(sb->u.nfs_sb.s_server.file);
 	rpc_closesock(sb->u.nfs_sb.s_server.rsock);
 	lock_super(sb);
@@ -163,6 +166,13 @@ struct super_block *nfs_read_super(struct super_block *sb, void *raw_data,
 	server->acdirmin = data->acdirmin*HZ;
 	server->acdirmax = data->acdirmax*HZ;
 	strcpy(server->hostname, data->hostname);
+	server->rd_inflight = 0;
+	server->rd_srtt = 0;
+	server->rd_bytes = server->rd_mark = server->rd_rate = 0;
+	server->rd_stamp = jiffies;
+	server->lookup_hits = server->lookup_calls = 0;
+	server->readdir_hits = server->readdir_calls = 0;
+	server->getattr_saved = 0;
 
 	/* Start of JSP NFS patch */
 	/* Check if passed address in data->addr */
@@ -279,6 +289,10 @@ int nfs_notify_change(struct inode *inode, struct iattr *attr)
 	struct nfs_fattr fattr;
 	int error;
 
+	/* a truncate must not be overtaken by data still queued */
+	if (NFS_WRITEBACK(inode))
+		nfs_flush_writes(inode);
+
 	sattr.mode = (unsigned) -1;
 	if (attr->ia_valid & ATTR_MODE) 
 		sattr.mode = attr->ia_mode;
@@ -354,11 +368,12 @@ static int run_nfsiod(void *dummy)
 
 int init_nfs_fs(void)
 {
-	/* Fork four biod's */
-	kernel_thread(run_nfsiod, NULL, 0);
-	kernel_thread(run_nfsiod, NULL, 0);
-	kernel_thread(run_nfsiod, NULL, 0);
-	kernel_thread(run_nfsiod, NULL, 0);
+	int i;
+
+	/* Fork the biod's */
+	for (i = 0; i < NFS_NFSIODS; i++)
+		kernel_thread(run_nfsiod, NULL, 0);
+	nfs_stats_init();
         return register_filesystem(&nfs_fs_type);
 }
 
@@ -375,6 +390,7 @@ int init_module(void)
 void cleanup_module(void)
 {
 	unregister_filesystem(&nfs_fs_type);
+	nfs_stats_cleanup();
 	nfs_kfree_cache();
 }
 
@@ -460,6 +460,7 @@ nfs_proc_read_request(struct rpc_ioreq *req, struct nfs_server *server,
 
 	req->rq_addr = &server->toaddr;
 	req->rq_alen = sizeof(server->toaddr);
+	req->rq_timer = RPC_TIMER_READ;
 
 	return rpc_transmit(server->rsock, req);
 }
@@ -546,6 +547,77 @@ retry:
 	return status;
 }
 
+/*
+ * Asynchronous WRITE for nfsiod.  The data is sent straight from the
+ * caller's buffer, which must stay put until the reply is in.
+ */
+int
+nfs_proc_write_request(struct rpc_ioreq *req, struct nfs_server *server,
+			struct nfs_fh *fh, unsigned long offset,
+			unsigned long count, const char *data, int ruid)
+{
+	static __u32	pad = 0;
+	__u32		*p, *p0;
+
+	PRINTK("NFS reqst write %ld @ %ld\n", count, offset);
+	if (!(p0 = nfs_rpc_alloc(NFS_SLACK_SPACE)))
+		return -EIO;
+
+	p = nfs_rpc_header(p0, NFSPROC_WRITE, ruid);
+	p = xdr_encode_fhandle(p, fh);
+	*p++ = htonl(offset); /* traditional, could be any value */
+	*p++ = htonl(offset);
+	*p++ = htonl(count); /* traditional, could be any value */
+	*p++ = htonl(count);
+	req->rq_svec[0].iov_base = p0;
+	req->rq_svec[0].iov_len  = (p - p0) << 2;
+	req->rq_svec[1].iov_base = (void *) data;
+	req->rq_svec[1].iov_len  = count;
+	req->rq_slen = ((p - p0) << 2) + count;
+	req->rq_snr = 2;
+	if (count & 3) {
+		req->rq_svec[2].iov_base = &pad;
+		req->rq_svec[2].iov_len  = 4 - (count & 3);
+		req->rq_slen += 4 - (count & 3);
+		req->rq_snr = 3;
+	}
+
+	req->rq_rvec[0].iov_base = p0;
+	req->rq_rvec[0].iov_len  = NFS_SLACK_SPACE;
+	req->rq_rlen = NFS_SLACK_SPACE;
+	req->rq_rnr = 1;
+
+	req->rq_addr = &server->toaddr;
+	req->rq_alen = sizeof(server->toaddr);
+	req->rq_timer = RPC_TIMER_WRITE;
+
+	return rpc_transmit(server->rsock, req);
+}
+
+int
+nfs_proc_write_reply(struct rpc_ioreq *req, struct nfs_fattr *fattr)
+{
+	int		status;
+	__u32		*p0, *p;
+
+	p0 = (__u32 *) req->rq_rvec[0].iov_base;
+
+	if (!(p = nfs_rpc_verify(p0))) {
+		/* Tell the upper layers to retry */
+		status = -EAGAIN;
+	} else if ((status = ntohl(*p++)) == NFS_OK) {
+		p = xdr_decode_fattr(p, fattr);
+		PRINTK("NFS reply write\n");
+		status = 0;
+	}
+	else {
+		PRINTK("NFS reply write failed = %d\n", status);
+		status = -nfs_stat_to_errno(status);
+	}
+	nfs_rpc_free(p0);
+	return status;
+}
+
 int nfs_proc_create(struct nfs_server *server, struct nfs_fh *dir,
 		    const char *name, struct nfs_sattr *sattr,
 		    struct nfs_fh *fhandle, struct nfs_fattr *fattr)
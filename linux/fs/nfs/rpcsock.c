@@ -26,6 +26,21 @@
  *	style. Found an interesting bug this way, too.
  *  -	Added entry points for nfsiod.
  *
+ *  -	Replies update a smoothed round trip time and deviation per
+ *	timer class of the request; rpc_rto() turns them into the
+ *	initial timeout of the next call (Jacobson/Karels, with Karn's
+ *	rule of not sampling retransmitted calls).
+ *  -	Request slots are allocated as the congestion window grows,
+ *	instead of a fixed table.
+ *  -	Connected TCP sockets work too. Each call and reply is a record
+ *	in the RPC record marking standard (RFC 1057): a 4 byte header
+ *	holding the fragment length and a last-fragment bit. One process
+ *	sends a record at a time. How far the reply being received has
+ *	got is kept in the rpc_sock, so a receiver taking a signal in the
+ *	middle of it leaves the rest to the next one. There is no
+ *	reconnect: once the server closes the connection, calls fail
+ *	with EIO.
+ *
  *  Copyright (C) 1995, 1996, Olaf Kirch <okir@monad.swb.de>
  */
 
@@ -95,6 +110,9 @@ rpc_remque(struct rpc_sock *rsock, struct rpc_wait *slot)
 		next->w_prev = prev;
 
 	slot->w_queued = 0;
+	/* the rest of a reply it was receiving goes nowhere */
+	if (rsock->rec.slot == slot)
+		rsock->rec.slot = NULL;
 	dprintk("RPC: removed %p from queue, head now %p.\n",
 			slot, rsock->pending);
 }
@@ -146,7 +164,8 @@ rpc_recvmsg(struct rpc_sock *rsock, struct iovec *iov,
 
 	oldfs = get_fs();
 	set_fs(get_ds());
-	result = sock->ops->recvmsg(sock, &msg, len, 1, flags, &alen);
+	result = sock->ops->recvmsg(sock, &msg, len, !rsock->stream, flags,
+					&alen);
 	set_fs(oldfs);
 
 	dprintk("RPC: rpc_recvmsg(iov %p, len %d) = %d\n", iov, len, result);
@@ -184,6 +203,27 @@ rpc_select(struct rpc_sock *rsock)
 	return 0;
 }
 
+/*
+ * Add a request slot, unless there are RPC_MAXREQS already.
+ */
+static int
+rpc_grow(struct rpc_sock *rsock, int priority)
+{
+	struct rpc_wait	*slot;
+
+	if (rsock->nslots >= RPC_MAXREQS)
+		return 0;
+	if (!(slot = (struct rpc_wait *) kmalloc(sizeof(*slot), priority)))
+		return 0;
+	memset(slot, 0, sizeof(*slot));
+	slot->w_sock = rsock;
+	slot->w_next = rsock->free;
+	rsock->free = slot;
+	rsock->nslots++;
+	dprintk("RPC: %d slots\n", rsock->nslots);
+	return 1;
+}
+
 /*
  * Reserve an RPC call slot. nocwait determines whether we wait in case
  * of congestion or not.
@@ -196,6 +236,10 @@ rpc_reserve(struct rpc_sock *rsock, struct rpc_ioreq *req, int nocwait)
 	req->rq_slot = NULL;
 
 	while (!(slot = rsock->free) || rsock->cong >= rsock->cwnd) {
+		/* the window has room, but no slot is free */
+		if (!slot && rsock->cong < rsock->cwnd
+		 && rpc_grow(rsock, nocwait? GFP_ATOMIC : GFP_KERNEL))
+			continue;
 		if (nocwait) {
 			current->timeout = 0;
 			return -ENOBUFS;
@@ -215,6 +259,8 @@ rpc_reserve(struct rpc_sock *rsock, struct rpc_ioreq *req, int nocwait)
 
 	slot->w_queued = 0;
 	slot->w_gotit = 0;
+	slot->w_resent = 0;
+	slot->w_sent = 0;
 	slot->w_req = req;
 
 	dprintk("RPC: reserved slot %p\n", slot);
@@ -282,6 +328,49 @@ rpc_cwnd_adjust(struct rpc_sock *rsock, int timeout)
 	rsock->cwnd = cwnd;
 }
 
+/*
+ * Fold a round trip into the estimate of its timer class.
+ */
+static void
+rpc_rtt_update(struct rpc_sock *rsock, int timer, long rtt)
+{
+	long	*srtt = &rsock->srtt[timer], *rttvar = &rsock->rttvar[timer];
+
+	if (timer <= RPC_TIMER_NONE || timer >= RPC_NTIMERS)
+		return;
+	if (!rtt)
+		rtt = 1;
+	if (!*srtt) {
+		*srtt = rtt << 3;
+		*rttvar = rtt << 1;	/* deviation: rtt/2 */
+		return;
+	}
+	rtt -= *srtt >> 3;
+	*srtt += rtt;
+	if (rtt < 0)
+		rtt = -rtt;
+	*rttvar += rtt - (*rttvar >> 2);
+}
+
+/*
+ * The retransmit timeout for a call of the given timer class: the
+ * smoothed RTT plus four times its deviation, or dflt as long as
+ * nothing is known.
+ */
+unsigned long
+rpc_rto(struct rpc_sock *rsock, int timer, unsigned long dflt)
+{
+	long	rto;
+
+	if (timer <= RPC_TIMER_NONE || timer >= RPC_NTIMERS
+	 || !rsock->srtt[timer])
+		return dflt;
+	rto = (rsock->srtt[timer] >> 3) + rsock->rttvar[timer];
+	if (rto < RPC_MINRTO)
+		rto = RPC_MINRTO;
+	return rto;
+}
+
 static inline void
 rpc_send_check(char *where, u32 *ptr)
 {
@@ -294,6 +383,67 @@ rpc_send_check(char *where, u32 *ptr)
 	}
 }
 
+/*
+ * A TCP connection cannot be resynchronized once part of a record has
+ * gone missing in either direction. Shut the socket down and fail every
+ * call waiting on it; there is no reconnect, the mount is dead.
+ */
+static void
+rpc_stream_broken(struct rpc_sock *rsock)
+{
+	struct rpc_wait	*rovr;
+
+	if (!rsock->shutdown)
+		printk(KERN_WARNING "RPC: TCP record stream lost, "
+					"shutting down socket\n");
+	rsock->shutdown = 1;
+	for (rovr = rsock->pending; rovr; rovr = rovr->w_next)
+		if (!rovr->w_gotit) {
+			rovr->w_result = -EIO;
+			rovr->w_gotit = 1;
+			wake_up(&rovr->w_wait);
+		}
+	wake_up(&rsock->sendwait);
+	wake_up(&rsock->backlog);
+}
+
+/*
+ * Send a call as one record on a TCP connection, after the calls
+ * other processes are sending.
+ */
+static int
+rpc_send_record(struct rpc_sock *rsock, struct rpc_ioreq *req)
+{
+	struct iovec	iov[UIO_MAXIOV + 1];
+	u32		mark;
+	int		result;
+
+	while (rsock->sending) {
+		interruptible_sleep_on(&rsock->sendwait);
+		if (current->signal & ~current->blocked)
+			return -ERESTARTSYS;
+		if (rsock->shutdown)
+			return -EIO;
+	}
+	rsock->sending = 1;
+
+	mark = htonl(RPC_LASTFRAG | req->rq_slen);
+	iov[0].iov_base = (void *) &mark;
+	iov[0].iov_len  = sizeof(mark);
+	memcpy(iov + 1, req->rq_svec, req->rq_snr * sizeof(iov[0]));
+	result = rpc_sendmsg(rsock, iov, req->rq_snr + 1,
+				req->rq_slen + sizeof(mark), NULL, 0);
+
+	rsock->sending = 0;
+	wake_up(&rsock->sendwait);
+	/* nothing sent is harmless, half a record is not */
+	if (result >= 0 && result < req->rq_slen + sizeof(mark)) {
+		rpc_stream_broken(rsock);
+		result = -EIO;
+	}
+	return result;
+}
+
 /*
  * Place the actual RPC call.
  * We have to copy the iovec because sendmsg fiddles with its contents.
@@ -307,13 +457,21 @@ rpc_send(struct rpc_sock *rsock, struct rpc_wait *slot)
 	if (rsock->shutdown)
 		return -EIO;
 
-	memcpy(iov, req->rq_svec, req->rq_snr * sizeof(iov[0]));
-	slot->w_xid = *(u32 *)(iov[0].iov_base);
+	slot->w_xid = *(u32 *)(req->rq_svec[0].iov_base);
 	if (!slot->w_queued)
 		rpc_insque(rsock, slot);
+	if (slot->w_sent) {
+		slot->w_resent = 1;
+		rsock->retrans++;
+	} else
+		rsock->calls++;
+	slot->w_sent = jiffies;
 
 	dprintk("rpc_send(%p, %x)\n", slot, slot->w_xid);
 	rpc_send_check("rpc_send", (u32 *) req->rq_svec[0].iov_base);
+	if (rsock->stream)
+		return rpc_send_record(rsock, req);
+	memcpy(iov, req->rq_svec, req->rq_snr * sizeof(iov[0]));
 	return rpc_sendmsg(rsock, iov, req->rq_snr, req->rq_slen,
 				req->rq_addr, req->rq_alen);
 }
@@ -328,6 +486,199 @@ rpc_transmit(struct rpc_sock *rsock, struct rpc_ioreq *req)
 	return rpc_send(rsock, req->rq_slot);
 }
 
+/*
+ * Find the request a reply is for.
+ */
+static struct rpc_wait *
+rpc_lookup_xid(struct rpc_sock *rsock, u32 xid)
+{
+	struct rpc_wait	*rovr;
+	int		safe = 0;
+
+	for (rovr = rsock->pending; rovr; rovr = rovr->w_next) {
+		if (rovr->w_xid == xid)
+			break;
+		if (safe++ > RPC_MAXREQS) {
+			printk(KERN_WARNING "RPC: loop in request Q!!\n");
+			return NULL;
+		}
+	}
+	return rovr;
+}
+
+/*
+ * A reply has been received: time it and wake up the caller.
+ */
+static void
+rpc_reply(struct rpc_sock *rsock, struct rpc_wait *rovr, int result)
+{
+	rovr->w_result = result;
+	rovr->w_gotit = 1;
+	if (result >= 0 && !rovr->w_resent)
+		rpc_rtt_update(rsock, rovr->w_req->rq_timer,
+				jiffies - rovr->w_sent);
+	wake_up(&rovr->w_wait);
+}
+
+/*
+ * One read from a TCP connection into iov, or of up to len bytes thrown
+ * away if iov is NULL.
+ */
+static int
+rpc_stream_read(struct rpc_sock *rsock, struct iovec *iov, int nr, int len)
+{
+	struct iovec	junk;
+	char		buf[64];
+	int		result;
+
+	if (!iov) {
+		junk.iov_base = buf;
+		junk.iov_len  = len < sizeof(buf)? len : sizeof(buf);
+		iov = &junk;
+		nr  = 1;
+		len = junk.iov_len;
+	}
+	result = rpc_recvmsg(rsock, iov, nr, len, 0);
+	if (result == 0) {
+		printk(KERN_WARNING "RPC: server closed connection\n");
+		return -EIO;
+	}
+	return result;
+}
+
+/*
+ * Copy the iovec from, skipping its first skip bytes. Returns the number
+ * of entries left.
+ */
+static int
+rpc_iov_skip(struct iovec *to, struct iovec *from, int nr, int skip)
+{
+	while (nr > 0 && skip >= from->iov_len) {
+		skip -= from->iov_len;
+		from++;
+		nr--;
+	}
+	memcpy(to, from, nr * sizeof(*to));
+	if (nr > 0) {
+		to[0].iov_base += skip;
+		to[0].iov_len  -= skip;
+	}
+	return nr;
+}
+
+/*
+ * Receive and dispatch a reply record from a TCP connection. What does
+ * not fit into the caller's buffers is thrown away, like the rest of
+ * a datagram. rsock->rec is updated after every read, so a signal
+ * anywhere in the record just returns; the next receiver carries on
+ * where this one stopped. Any other error breaks the stream.
+ */
+static int
+rpc_grok_stream(struct rpc_sock *rsock)
+{
+	struct rpc_record *rec = &rsock->rec;
+	struct rpc_wait	*rovr;
+	struct rpc_ioreq *req;
+	struct iovec	iov[UIO_MAXIOV];
+	u32		mark;
+	int		n, nr, result;
+
+	for (;;) {
+		switch (rec->state) {
+		case RPC_REC_MARK:
+			iov[0].iov_base = (char *) &rec->mark + rec->pos;
+			iov[0].iov_len  = sizeof(rec->mark) - rec->pos;
+			if ((result = rpc_stream_read(rsock, iov, 1,
+						iov[0].iov_len)) < 0)
+				goto error;
+			if ((rec->pos += result) < sizeof(rec->mark))
+				break;
+			rec->pos = 0;
+			mark = ntohl(rec->mark);
+			rec->frag = mark & ~RPC_LASTFRAG;
+			rec->last = (mark & RPC_LASTFRAG) != 0;
+			if (rec->started) {
+				rec->state = RPC_REC_DATA;
+				break;
+			}
+			if (rec->frag < sizeof(rec->xid)) {
+				printk(KERN_WARNING "RPC: impossible RPC "
+					"record size %d\n", rec->frag);
+				goto broken;
+			}
+			rec->started = 1;
+			rec->state = RPC_REC_XID;
+			break;
+
+		case RPC_REC_XID:
+			iov[0].iov_base = (char *) &rec->xid + rec->pos;
+			iov[0].iov_len  = sizeof(rec->xid) - rec->pos;
+			if ((result = rpc_stream_read(rsock, iov, 1,
+						iov[0].iov_len)) < 0)
+				goto error;
+			if ((rec->pos += result) < sizeof(rec->xid))
+				break;
+			rec->pos = 0;
+			rec->frag -= sizeof(rec->xid);
+			rec->state = RPC_REC_DATA;
+
+			dprintk("RPC: rpc_grok_stream: got xid %08lx\n",
+					(unsigned long) rec->xid);
+			rovr = rpc_lookup_xid(rsock, rec->xid);
+			if (rovr && !rovr->w_gotit) {
+				req = rovr->w_req;
+				*(u32 *) req->rq_rvec[0].iov_base = rec->xid;
+				rec->slot = rovr;
+				rec->got  = sizeof(rec->xid);
+			} else
+				dprintk("RPC: rpc_grok_stream: %s.\n",
+					rovr? "duplicate reply" : "bad XID");
+			break;
+
+		case RPC_REC_DATA:
+			if (rec->frag == 0) {
+				if (rec->last)
+					goto done;
+				rec->state = RPC_REC_MARK;
+				break;
+			}
+			req = rec->slot? rec->slot->w_req : NULL;
+			n = req? req->rq_rlen - rec->got : 0;
+			if (n > rec->frag)
+				n = rec->frag;
+			if (n > 0) {
+				nr = rpc_iov_skip(iov, req->rq_rvec,
+						req->rq_rnr, rec->got);
+				result = rpc_stream_read(rsock, iov, nr, n);
+			} else
+				result = rpc_stream_read(rsock, NULL, 0,
+							rec->frag);
+			if (result < 0)
+				goto error;
+			rec->frag -= result;
+			if (n > 0)
+				rec->got += result;
+			break;
+		}
+	}
+
+done:
+	rovr = rec->slot;
+	n = rec->got;
+	memset(rec, 0, sizeof(*rec));
+	if (!rovr)
+		return 0;
+	rpc_reply(rsock, rovr, n);
+	return n;
+
+error:
+	if (result == -ERESTARTSYS)
+		return result;
+broken:
+	rpc_stream_broken(rsock);
+	return -EIO;
+}
+
 /*
  * Receive and dispatch a single reply
  */
@@ -338,7 +689,10 @@ rpc_grok(struct rpc_sock *rsock)
 	struct rpc_ioreq *req;
 	struct iovec	iov[UIO_MAXIOV];
 	u32		xid;
-	int		safe, result;
+	int		result;
+
+	if (rsock->stream)
+		return rpc_grok_stream(rsock);
 
 	iov[0].iov_base = (void *) &xid;
 	iov[0].iov_len  = sizeof(xid);
@@ -366,16 +720,7 @@ rpc_grok(struct rpc_sock *rsock)
 	dprintk("RPC: rpc_grok: got xid %08lx\n", (unsigned long) xid);
 
 	/* Look for the caller */
-	safe = 0;
-	for (rovr = rsock->pending; rovr; rovr = rovr->w_next) {
-		if (rovr->w_xid == xid)
-			break;
-		if (safe++ > RPC_MAXREQS) {
-			printk(KERN_WARNING "RPC: loop in request Q!!\n");
-			rovr = NULL;
-			break;
-		}
-	}
+	rovr = rpc_lookup_xid(rsock, xid);
 
 	if (!rovr || rovr->w_gotit) {
 		/* discard dgram */
@@ -392,11 +737,9 @@ rpc_grok(struct rpc_sock *rsock)
 	 * memcpy_fromiovec fiddling. */
 	memcpy(iov, req->rq_rvec, req->rq_rnr * sizeof(iov[0]));
 	result = rpc_recvmsg(rsock, iov, req->rq_rnr, req->rq_rlen, 0);
-	rovr->w_result = result;
-	rovr->w_gotit = 1;
 
 	/* ... and wake up the process */
-	wake_up(&rovr->w_wait);
+	rpc_reply(rsock, rovr, result);
 
 	return result;
 }
@@ -531,13 +874,13 @@ rpc_makesock(struct file *file)
 	struct rpc_sock	*rsock;
 	struct socket	*sock;
 	struct sock	*sk;
-	struct rpc_wait	*slot;
 	int		i;
 
 	dprintk("RPC: make RPC socket...\n");
 	sock = &file->f_inode->u.socket_i;
-	if (sock->type != SOCK_DGRAM || sock->ops->family != AF_INET) {
-		printk(KERN_WARNING "RPC: only UDP sockets supported\n");
+	if ((sock->type != SOCK_DGRAM && sock->type != SOCK_STREAM)
+	 || sock->ops->family != AF_INET) {
+		printk(KERN_WARNING "RPC: only UDP and TCP sockets supported\n");
 		return NULL;
 	}
 	sk = (struct sock *) sock->data;
@@ -549,13 +892,16 @@ rpc_makesock(struct file *file)
 	rsock->sock = sock;
 	rsock->inet = sk;
 	rsock->file = file;
+	rsock->stream = (sock->type == SOCK_STREAM);
 	rsock->cwnd = RPC_INITCWND;
 
-	dprintk("RPC: slots %p, %p, ...\n", rsock->waiting, rsock->waiting + 1);
-	rsock->free = rsock->waiting;
-	for (i = 0, slot = rsock->waiting; i < RPC_MAXREQS-1; i++, slot++)
-		slot->w_next = slot + 1;
-	slot->w_next = NULL;
+	for (i = 0; i < RPC_INITREQS; i++)
+		if (!rpc_grow(rsock, GFP_KERNEL))
+			break;
+	if (!rsock->nslots) {
+		kfree(rsock);
+		return NULL;
+	}
 
 	dprintk("RPC: made socket %p\n", rsock);
 	return rsock;
@@ -564,6 +910,7 @@ rpc_makesock(struct file *file)
 int
 rpc_closesock(struct rpc_sock *rsock)
 {
+	struct rpc_wait	*slot;
 	unsigned long	t0 = jiffies;
 
 	rsock->shutdown = 1;
@@ -579,6 +926,10 @@ rpc_closesock(struct rpc_sock *rsock)
 #endif
 	}
 
+	while ((slot = rsock->free) != NULL) {
+		rsock->free = slot->w_next;
+		kfree_s(slot, sizeof(*slot));
+	}
 	kfree(rsock);
 	return 0;
 }
@@ -61,6 +61,32 @@ nfs_rpc_call(struct nfs_server *server, int *start, int *end, int size)
 	return nfs_rpc_doio(server, &req, 0);
 }
 
+/*
+ * The round trip timer for an NFS call, by its procedure number.
+ * Calls that change the directory tree take the server too long and
+ * too irregularly to estimate; they keep the mount's timeo, as do
+ * the mount and portmap calls of nfsroot.
+ */
+int
+nfs_rpc_timer(__u32 *call)
+{
+	if (ntohl(call[3]) != NFS_PROGRAM)
+		return RPC_TIMER_NONE;
+	switch (ntohl(call[5])) {
+	case NFSPROC_GETATTR:
+	case NFSPROC_LOOKUP:
+	case NFSPROC_READLINK:
+	case NFSPROC_STATFS:
+		return RPC_TIMER_SMALL;
+	case NFSPROC_READ:
+	case NFSPROC_READDIR:
+		return RPC_TIMER_READ;
+	case NFSPROC_WRITE:
+		return RPC_TIMER_WRITE;
+	}
+	return RPC_TIMER_NONE;
+}
+
 int
 nfs_rpc_doio(struct nfs_server *server, struct rpc_ioreq *req, int async)
 {
@@ -69,7 +95,9 @@ nfs_rpc_doio(struct nfs_server *server, struct rpc_ioreq *req, int async)
 	unsigned long		oldmask;
 	int			major_timeout_seen, result;
 
-	timeout.to_initval = server->timeo;
+	req->rq_timer = nfs_rpc_timer((__u32 *) req->rq_svec[0].iov_base);
+	timeout.to_initval = rpc_rto(server->rsock, req->rq_timer,
+					server->timeo);
 	timeout.to_maxval = NFS_MAX_RPC_TIMEOUT*HZ/10;
 	timeout.to_retries = server->retrans;
 	timeout.to_exponential = 1;
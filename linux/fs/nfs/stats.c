@@ -0,0 +1,164 @@
+/*
+ * linux/fs/nfs/stats.c
+ *
+ * Per-mount NFS client statistics and tunables
+ *
+ * /proc/nfsstat shows a line per mounted NFS file system: the RPCs in
+ * flight on its socket, how many of them are READs queued to the nfsiods,
+ * the smoothed READ round trip and what has been read, in total and per
+ * second. Then, for LOOKUP and READDIR, the calls answered from the
+ * caches in dir.c and those sent, and the GETATTRs the attribute cache
+ * saved. Last, the RPC client's congestion window and request slots,
+ * the calls it retransmitted, and the retransmit timeouts it has
+ * estimated for quick calls, READs and WRITEs (see rpcsock.c).
+ * /proc/sys/fs/nfs/readahead_max limits the read-ahead window of
+ * a file (see bio.c); 0 switches read-ahead off.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/nfs_fs.h>
+#include <linux/proc_fs.h>
+#include <linux/sysctl.h>
+
+int nfs_readahead_max = NFS_DEF_READAHEAD;
+
+/*
+ * Recompute the read rate of a mount, at most once a second. After a
+ * pause of more than ten seconds the old rate is forgotten.
+ */
+static void
+nfs_rate_update(struct nfs_server *server)
+{
+	unsigned long	elapsed = jiffies - server->rd_stamp;
+	unsigned long	bytes, rate;
+
+	if (elapsed < HZ)
+		return;
+	bytes = server->rd_bytes - server->rd_mark;
+	rate = bytes / elapsed * HZ + bytes % elapsed * HZ / elapsed;
+	if (elapsed <= 10*HZ)
+		rate = (server->rd_rate + rate) / 2;
+	server->rd_rate = rate;
+	server->rd_mark = server->rd_bytes;
+	server->rd_stamp = jiffies;
+}
+
+void
+nfs_read_account(struct nfs_server *server, int bytes)
+{
+	server->rd_bytes += bytes;
+	nfs_rate_update(server);
+}
+
+#ifdef CONFIG_PROC_FS
+
+static unsigned long
+nfs_rto_ms(struct nfs_server *server, int timer)
+{
+	return rpc_rto(server->rsock, timer, server->timeo) * 1000 / HZ;
+}
+
+static int
+nfs_stats_get_info(char *buffer, char **start, off_t offset, int length,
+		int dummy)
+{
+	struct super_block *sb;
+	struct nfs_server *server;
+	struct rpc_sock	*rsock;
+	off_t		pos, begin = 0;
+	int		len;
+
+	len = sprintf(buffer, "%-8s %-24s %5s %5s %7s %10s %9s "
+			"%8s %8s %8s %8s %8s %5s %5s %8s %8s %6s %6s %6s\n",
+			"dev", "server", "rpcs", "reads", "rtt_ms",
+			"read_kb", "read_bps", "lk_hits", "lk_calls",
+			"rd_hits", "rd_calls", "ga_saved", "cwnd", "slots",
+			"calls", "retrans", "rto_sm", "rto_rd", "rto_wr");
+	for (sb = super_blocks; sb < super_blocks + NR_SUPER; sb++) {
+		/* s_mounted is set last by nfs_read_super() */
+		if (!sb->s_dev || sb->s_magic != NFS_SUPER_MAGIC ||
+		    !sb->s_mounted)
+			continue;
+		server = &sb->u.nfs_sb.s_server;
+		rsock = server->rsock;
+		nfs_rate_update(server);
+		len += sprintf(buffer + len,
+				"%-8s %-24.24s %5lu %5d %7lu %10lu %9lu "
+				"%8lu %8lu %8lu %8lu %8lu "
+				"%5lu %5d %8lu %8lu %6lu %6lu %6lu\n",
+				kdevname(sb->s_dev), server->hostname,
+				rsock->cong / RPC_CWNDSCALE,
+				server->rd_inflight,
+				(unsigned long) (server->rd_srtt >> 3) * 1000 / HZ,
+				server->rd_bytes >> 10, server->rd_rate,
+				server->lookup_hits, server->lookup_calls,
+				server->readdir_hits, server->readdir_calls,
+				server->getattr_saved,
+				rsock->cwnd / RPC_CWNDSCALE, rsock->nslots,
+				rsock->calls, rsock->retrans,
+				nfs_rto_ms(server, RPC_TIMER_SMALL),
+				nfs_rto_ms(server, RPC_TIMER_READ),
+				nfs_rto_ms(server, RPC_TIMER_WRITE));
+		pos = begin + len;
+		if (pos < offset) {
+			len = 0;
+			begin = pos;
+		}
+		if (pos > offset + length)
+			break;
+	}
+	*start = buffer + (offset - begin);
+	len -= (offset - begin);
+	if (len > length)
+		len = length;
+	return len;
+}
+
+static struct proc_dir_entry nfs_proc_entry = {
+	0, 7, "nfsstat", S_IFREG | S_IRUGO, 1, 0, 0, 0, NULL,
+	nfs_stats_get_info
+};
+
+#endif /* CONFIG_PROC_FS */
+
+static int min_readahead[] = {0}, max_readahead[] = {NFS_MAX_READAHEAD};
+
+static struct ctl_table_header *nfs_table_header;
+
+static ctl_table nfs_table[] = {
+	{NFS_READAHEAD_MAX, "readahead_max",
+	 &nfs_readahead_max, sizeof(int), 0644, NULL,
+	 &proc_dointvec_minmax, &sysctl_intvec, NULL,
+	 &min_readahead, &max_readahead},
+	{0}
+};
+
+static ctl_table nfs_dir_table[] = {
+	{FS_NFS, "nfs", NULL, 0, 0555, nfs_table},
+	{0}
+};
+
+static ctl_table nfs_root_table[] = {
+	{CTL_FS, "fs", NULL, 0, 0555, nfs_dir_table},
+	{0}
+};
+
+void
+nfs_stats_init(void)
+{
+	nfs_table_header = register_sysctl_table(nfs_root_table, 1);
+#ifdef CONFIG_PROC_FS
+	proc_register_dynamic(&proc_root, &nfs_proc_entry);
+#endif
+}
+
+void
+nfs_stats_cleanup(void)
+{
+#ifdef CONFIG_PROC_FS
+	proc_unregister(&proc_root, nfs_proc_entry.low_ino);
+#endif
+	unregister_sysctl_table(nfs_table_header);
+}
@@ -0,0 +1,406 @@
+/*
+ * linux/fs/nfs/write.c
+ *
+ * Write-behind for NFS files
+ *
+ * nfs_file_write() used to send every wsize bytes with a synchronous
+ * WRITE and wait for the reply before copying any more. Now the data is
+ * copied into a wsize buffer (a struct nfs_wreq) and the call returns.
+ * Following writes that land in or right after that buffer are gathered
+ * into it; once it is full, or a write goes elsewhere, it is handed to
+ * an nfsiod, which collects the reply. Up to NFS_MAX_WRITEBACK WRITEs of
+ * a file can be in flight that way. If no nfsiod is free and none of
+ * this file's calls is outstanding, the buffer is written synchronously
+ * instead.
+ *
+ * Two requests covering the same bytes are never in flight together, as
+ * the server might apply them in the wrong order. Reads, mmap, setattr,
+ * fsync and close wait for everything to get to the server. The first
+ * error of an asynchronous WRITE is kept on the inode and returned by
+ * the next fsync() or close().
+ *
+ * A buffer is flushed by whichever process comes along next, so it
+ * carries the credentials of the process that wrote the data, and only
+ * writes with the same credentials are gathered into it.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/nfs_fs.h>
+#include <linux/nfsiod.h>
+#include <linux/malloc.h>
+#include <linux/pagemap.h>
+
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#undef DEBUG_WRITE
+#ifdef DEBUG_WRITE
+#define dprintk(args...)	printk(## args)
+#else
+#define dprintk(args...)	/* nothing */
+#endif
+
+/* what nfs_rpc_header() puts into the AUTH_UNIX credentials */
+struct nfs_wcred {
+	uid_t			wc_uid;		/* for the real uid retry */
+	uid_t			wc_fsuid;
+	gid_t			wc_egid;
+	int			wc_groups[NGROUPS];
+};
+
+struct nfs_wreq {
+	struct nfs_wreq *	wb_next;	/* on NFS_WBLIST while in flight */
+	unsigned long		wb_offset;
+	unsigned int		wb_count;
+	unsigned int		wb_size;	/* of wb_data */
+	char *			wb_data;
+	struct nfs_wcred	wb_cred;	/* of the writer */
+	int			wb_ruid;	/* sent as wc_uid, not wc_fsuid */
+};
+
+static inline void
+nfs_wcred_get(struct nfs_wcred *cred)
+{
+	cred->wc_uid = current->uid;
+	cred->wc_fsuid = current->fsuid;
+	cred->wc_egid = current->egid;
+	memcpy(cred->wc_groups, current->groups, sizeof(cred->wc_groups));
+}
+
+static inline void
+nfs_wcred_set(const struct nfs_wcred *cred)
+{
+	current->uid = cred->wc_uid;
+	current->fsuid = cred->wc_fsuid;
+	current->egid = cred->wc_egid;
+	memcpy(current->groups, cred->wc_groups, sizeof(cred->wc_groups));
+}
+
+static inline int
+nfs_wcred_current(const struct nfs_wcred *cred)
+{
+	return cred->wc_uid == current->uid &&
+	       cred->wc_fsuid == current->fsuid &&
+	       cred->wc_egid == current->egid &&
+	       !memcmp(cred->wc_groups, current->groups,
+		       sizeof(cred->wc_groups));
+}
+
+static struct nfs_wreq *
+nfs_write_alloc(struct inode *inode, unsigned long pos)
+{
+	struct nfs_wreq *wb;
+	int		wsize = NFS_SERVER(inode)->wsize;
+
+	if (!(wb = (struct nfs_wreq *) kmalloc(sizeof(*wb), GFP_NFS)))
+		return NULL;
+	if (!(wb->wb_data = (char *) kmalloc(wsize, GFP_NFS))) {
+		kfree_s(wb, sizeof(*wb));
+		return NULL;
+	}
+	wb->wb_next = NULL;
+	wb->wb_offset = pos;
+	wb->wb_count = 0;
+	wb->wb_size = wsize;
+	wb->wb_ruid = 0;
+	nfs_wcred_get(&wb->wb_cred);
+	return wb;
+}
+
+static void
+nfs_write_free(struct nfs_wreq *wb)
+{
+	kfree_s(wb->wb_data, wb->wb_size);
+	kfree_s(wb, sizeof(*wb));
+}
+
+static inline void
+nfs_write_seterror(struct inode *inode, int result)
+{
+	if (result < 0 && !NFS_WBERROR(inode))
+		NFS_WBERROR(inode) = result;
+}
+
+static void
+nfs_write_unlist(struct inode *inode, struct nfs_wreq *wb)
+{
+	struct nfs_wreq **p;
+
+	for (p = &NFS_WBLIST(inode); *p; p = &(*p)->wb_next)
+		if (*p == wb) {
+			*p = wb->wb_next;
+			break;
+		}
+	NFS_WBPENDING(inode)--;
+}
+
+/*
+ * A WRITE has finished: take it off the inode's list and wake up
+ * anybody waiting for a slot or for the file to be flushed.
+ */
+static void
+nfs_write_done(struct inode *inode, struct nfs_wreq *wb)
+{
+	nfs_write_unlist(inode, wb);
+	nfs_write_free(wb);
+	wake_up(&NFS_WBWAIT(inode));
+}
+
+static int
+nfs_write_overlaps(struct inode *inode, struct nfs_wreq *wb)
+{
+	struct nfs_wreq *q;
+
+	for (q = NFS_WBLIST(inode); q; q = q->wb_next)
+		if (q->wb_offset < wb->wb_offset + wb->wb_count &&
+		    wb->wb_offset < q->wb_offset + q->wb_count)
+			return 1;
+	return 0;
+}
+
+/*
+ * This is the function to (re-) transmit an NFS write request
+ */
+static int
+nfsiod_write_setup(struct nfsiod_req *req)
+{
+	struct inode	*inode = req->rq_inode;
+	struct nfs_wreq	*wb = req->rq_wreq;
+
+	return nfs_proc_write_request(&req->rq_rpcreq,
+			NFS_SERVER(inode), NFS_FH(inode),
+			wb->wb_offset, wb->wb_count, wb->wb_data, wb->wb_ruid);
+}
+
+/*
+ * This is the callback from nfsiod telling us whether a reply was
+ * received or some error occurred (timeout or socket shutdown).
+ * Must not sleep.
+ */
+static int
+nfsiod_write_result(int result, struct nfsiod_req *req)
+{
+	struct inode	*inode = req->rq_inode;
+	struct nfs_server *server = NFS_SERVER(inode);
+	struct nfs_wreq	*wb = req->rq_wreq;
+	struct nfs_fattr fattr;
+
+	dprintk("NFS: write callback for %p, result %d\n",
+			wb, result);
+
+	if (result >= 0) {
+		result = nfs_proc_write_reply(&req->rq_rpcreq, &fattr);
+		if (result >= 0) {
+			if (inode->i_ino == fattr.fileid)
+				nfs_refresh_inode(inode, &fattr);
+		} else if (result != -EAGAIN && !wb->wb_ruid &&
+			   wb->wb_cred.wc_fsuid == 0 &&
+			   wb->wb_cred.wc_uid != 0) {
+			/* as nfs_proc_write(): try the writer's real uid */
+			wb->wb_ruid = 1;
+			result = -EAGAIN;
+		}
+	} else {
+		/* no reply to parse: free the call buffer ourselves */
+		kfree(req->rq_rpcreq.rq_svec[0].iov_base);
+		if (result == -ETIMEDOUT && !(server->flags & NFS_MOUNT_SOFT))
+			result = -EAGAIN;
+	}
+
+	/* On a hard mount the data is never given up */
+	if (result == -EAGAIN &&
+	    (req->rq_retries-- > 0 || !(server->flags & NFS_MOUNT_SOFT))) {
+		dprintk("NFS: retransmitting write request.\n");
+		memset(&req->rq_rpcreq, 0, sizeof(struct rpc_ioreq));
+		while (rpc_reserve(server->rsock, &req->rq_rpcreq, 1) < 0)
+			schedule();
+		nfs_wcred_set(&wb->wb_cred);
+		nfsiod_write_setup(req);
+		return 0;
+	}
+	if (result < 0)
+		printk("NFS: write-behind to %s failed, error %d\n",
+			server->hostname, result);
+	nfs_write_seterror(inode, result);
+	nfs_write_done(inode, wb);
+	return 1;
+}
+
+/*
+ * Write a request synchronously, for when no nfsiod can take it.
+ */
+static void
+nfs_write_sync(struct inode *inode, struct nfs_wreq *wb)
+{
+	struct nfs_fattr fattr;
+	struct nfs_wcred cred;
+	unsigned long	fs;
+	int		result;
+
+	/* nfs_proc_write copies from user space */
+	fs = get_fs();
+	set_fs(get_ds());
+	nfs_wcred_get(&cred);
+	nfs_wcred_set(&wb->wb_cred);
+	result = nfs_proc_write(inode, wb->wb_offset, wb->wb_count,
+				wb->wb_data, &fattr);
+	nfs_wcred_set(&cred);
+	set_fs(fs);
+	if (result >= 0 && inode->i_ino == fattr.fileid)
+		nfs_refresh_inode(inode, &fattr);
+	nfs_write_seterror(inode, result);
+	nfs_write_free(wb);
+}
+
+/*
+ * Send a filled request on its way. May sleep for a free slot, but
+ * always disposes of the request.
+ */
+static void
+nfs_write_send(struct inode *inode, struct nfs_wreq *wb)
+{
+	struct nfsiod_req *req;
+	struct nfs_wcred cred;
+	int		result;
+
+	if (!wb->wb_count) {
+		nfs_write_free(wb);
+		return;
+	}
+	for (;;) {
+		if (NFS_WBPENDING(inode) < NFS_MAX_WRITEBACK &&
+		    !nfs_write_overlaps(inode, wb)) {
+			if ((req = nfsiod_reserve(NFS_SERVER(inode))) != NULL)
+				break;
+			if (!NFS_WBPENDING(inode)) {
+				dprintk("NFS: no nfsiod, writing synchronously.\n");
+				nfs_write_sync(inode, wb);
+				return;
+			}
+		}
+		sleep_on(&NFS_WBWAIT(inode));
+	}
+
+	req->rq_retries = 5;
+	req->rq_callback = nfsiod_write_result;
+	req->rq_inode = inode;
+	req->rq_wreq = wb;
+
+	/* on the list before transmitting, which may sleep */
+	wb->wb_next = NFS_WBLIST(inode);
+	NFS_WBLIST(inode) = wb;
+	NFS_WBPENDING(inode)++;
+	nfs_wcred_get(&cred);
+	nfs_wcred_set(&wb->wb_cred);
+	result = nfsiod_write_setup(req);
+	nfs_wcred_set(&cred);
+	if (result < 0) {
+		dprintk("NFS: deferring async WRITE request.\n");
+		kfree(req->rq_rpcreq.rq_svec[0].iov_base);
+		nfsiod_release(req);
+		nfs_write_unlist(inode, wb);
+		nfs_write_sync(inode, wb);
+		wake_up(&NFS_WBWAIT(inode));
+		return;
+	}
+	nfsiod_enqueue(req);
+}
+
+/*
+ * Copy data to be written to the file into write-behind buffers.
+ * Returns the number of bytes taken, or an error if none.
+ */
+int
+nfs_writeback(struct inode *inode, unsigned long pos, const char *buf,
+		int count)
+{
+	struct nfs_wreq *wb;
+	struct nfs_fattr fattr;
+	int		written = 0, wsize, skip, hunk, result;
+
+	while (written < count) {
+		/*
+		 * Take the buffer being filled off the inode while we
+		 * copy, which may sleep: a concurrent writer then starts
+		 * a buffer of its own instead of scribbling on this one.
+		 */
+		wb = NFS_WBGATHER(inode);
+		NFS_WBGATHER(inode) = NULL;
+		if (wb && (pos < wb->wb_offset ||
+			   pos > wb->wb_offset + wb->wb_count ||
+			   pos >= wb->wb_offset + wb->wb_size ||
+			   !nfs_wcred_current(&wb->wb_cred))) {
+			nfs_write_send(inode, wb);
+			wb = NULL;
+		}
+		if (!wb && !(wb = nfs_write_alloc(inode, pos))) {
+			/* out of memory: the old synchronous way */
+			nfs_flush_writes(inode);
+			wsize = NFS_SERVER(inode)->wsize;
+			hunk = count - written;
+			if (hunk > wsize)
+				hunk = wsize;
+			result = nfs_proc_write(inode, pos, hunk, buf, &fattr);
+			if (result < 0)
+				return written ? written : result;
+			if (inode->i_ino == fattr.fileid)
+				nfs_refresh_inode(inode, &fattr);
+			pos += hunk;
+			buf += hunk;
+			written += hunk;
+			continue;
+		}
+
+		skip = pos - wb->wb_offset;
+		hunk = count - written;
+		if (hunk > wb->wb_size - skip)
+			hunk = wb->wb_size - skip;
+		memcpy_fromfs(wb->wb_data + skip, buf, hunk);
+		update_vm_cache(inode, pos, wb->wb_data + skip, hunk);
+		if (skip + hunk > wb->wb_count)
+			wb->wb_count = skip + hunk;
+		pos += hunk;
+		buf += hunk;
+		written += hunk;
+
+		if (wb->wb_count == wb->wb_size || NFS_WBGATHER(inode))
+			nfs_write_send(inode, wb);
+		else
+			NFS_WBGATHER(inode) = wb;
+	}
+	return written;
+}
+
+/*
+ * Push out the buffer being filled and wait until the server has
+ * everything.
+ */
+void
+nfs_flush_writes(struct inode *inode)
+{
+	struct nfs_wreq *wb;
+
+	if ((wb = NFS_WBGATHER(inode)) != NULL) {
+		NFS_WBGATHER(inode) = NULL;
+		nfs_write_send(inode, wb);
+	}
+	while (NFS_WBPENDING(inode))
+		sleep_on(&NFS_WBWAIT(inode));
+}
+
+/*
+ * Flush, and return (and forget) the first write-behind error.
+ */
+int
+nfs_write_error(struct inode *inode)
+{
+	int		error;
+
+	nfs_flush_writes(inode);
+	error = NFS_WBERROR(inode);
+	NFS_WBERROR(inode) = 0;
+	return error;
+}
@@ -622,16 +622,20 @@ void __fput(struct file *filp, struct inode *inode)
 int close_fp(struct file *filp)
 {
 	struct inode *inode;
+	int error = 0;
 
 	if (filp->f_count == 0) {
 		printk("VFS: Close: file count is 0\n");
 		return 0;
 	}
 	inode = filp->f_inode;
-	if (inode)
+	if (inode) {
 		locks_remove_locks(current, filp);
+		if (filp->f_op && filp->f_op->flush)
+			error = filp->f_op->flush(inode, filp);
+	}
 	fput(filp, inode);
-	return 0;
+	return error;
 }
 
 asmlinkage int sys_close(unsigned int fd)
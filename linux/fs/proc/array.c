@@ -1011,6 +1011,7 @@ extern int get_pci_list(char*);
 extern int get_md_status (char *);
 extern int get_rtc_status (char *);
 extern int get_locks_status (char *, char **, off_t, int);
+extern int get_fsync_stats (char *);
 #ifdef __SMP_PROF__
 extern int get_smp_prof_list(char *);
 #endif
@@ -1093,6 +1094,8 @@ static int get_root_array(char * page, int type, char **start, off_t offset, int
 #endif
 		case PROC_LOCKS:
 			return get_locks_status(page, start, offset, length);
+		case PROC_FSYNC:
+			return get_fsync_stats(page);
 #ifdef __mc68000__
 		case PROC_HARDWARE:
 			return get_hardware_list(page);
@@ -362,6 +362,10 @@ void proc_root_init(void)
 		PROC_LOCKS, 5, "locks",
 		S_IFREG | S_IRUGO, 1, 0, 0,
 	});
+	proc_register(&proc_root, &(struct proc_dir_entry) {
+		PROC_FSYNC, 5, "fsync",
+		S_IFREG | S_IRUGO, 1, 0, 0,
+	});
 #ifdef __mc68000__
 	proc_register(&proc_root, &(struct proc_dir_entry) {
 		PROC_HARDWARE, 8, "hardware",
@@ -3,6 +3,15 @@
  *
  *  Copyright (C) 1995, 1996 by Paal-Kr. Engstad and Volker Lendecke
  *
+ *  Reads and writes are cut into packet sized pieces which are sent
+ *  several at a time (see smb_request_pipe), so a large transfer waits
+ *  for about one round trip per SMB_MAX_PIPE packets instead of one per
+ *  packet. A read that carries on where the previous one stopped goes
+ *  through the page cache: the pages it needs are fetched together with
+ *  a window of pages beyond them, which grows up to SMB_MAX_READAHEAD
+ *  while the reads stay sequential. Since nothing tells us when a file
+ *  changes on the server, those pages are dropped on a seek, a write or
+ *  a truncate.
  */
 
 #include <asm/segment.h>
@@ -16,6 +25,7 @@
 #include <linux/mm.h>
 #include <linux/smb_fs.h>
 #include <linux/malloc.h>
+#include <linux/pagemap.h>
 
 static inline int
 min(int a, int b)
@@ -65,10 +75,225 @@ smb_make_open(struct inode *i, int right)
 	return -EACCES;
 }
 
+/* What one SMBread or SMBwrite carries */
+static inline int
+smb_bufsize(struct inode *inode)
+{
+	return SMB_SERVER(inode)->max_xmit - SMB_HEADER_LEN - 5 * 2 - 5;
+}
+
+/*
+ * Transfer what fits in SMB_PIPE_BATCH packets of count bytes at pos.
+ * Returns the bytes up to the first short or failed piece, or the
+ * error of the first piece.
+ */
+static int
+smb_transfer(struct inode *inode, off_t pos, char *buf, int count, int write)
+{
+	struct smb_io io[SMB_PIPE_BATCH];
+	int bufsize = smb_bufsize(inode);
+	int i, n, done, result;
+
+	for (n = 0, done = 0; (done < count) && (n < SMB_PIPE_BATCH); n++)
+	{
+		io[n].offset = pos + done;
+		io[n].count = min(bufsize, count - done);
+		io[n].data = buf + done;
+		done += io[n].count;
+	}
+	if (write)
+	{
+		result = smb_proc_write_pipe(SMB_SERVER(inode),
+					     SMB_FINFO(inode), io, n);
+	} else
+	{
+		result = smb_proc_read_pipe(SMB_SERVER(inode),
+					    SMB_FINFO(inode), io, n, 1);
+	}
+	if (result < 0)
+	{
+		return result;
+	}
+	for (i = 0, done = 0; i < n; i++)
+	{
+		if (io[i].result < 0)
+		{
+			return done ? done : io[i].result;
+		}
+		done += io[i].result;
+		if (io[i].result < io[i].count)
+		{
+			break;
+		}
+	}
+	return done;
+}
+
+static void
+smb_add_page(struct inode *inode, unsigned long addr, unsigned long offset)
+{
+	struct page *page, **hash = page_hash(inode, offset);
+
+	if ((page = __find_page(inode, offset, *hash)) != NULL)
+	{
+		/* somebody else read it while we slept */
+		__free_page(page);
+		free_page(addr);
+		return;
+	}
+	page = mem_map + MAP_NR(addr);
+	page->flags &= ~(1 << PG_error);
+	set_bit(PG_uptodate, &page->flags);
+	page->offset = offset;
+	add_page_to_inode_queue(inode, page);
+	__add_page_to_hash_queue(page, hash);
+}
+
+/*
+ * Read the pages from offset up to end, and the read-ahead window
+ * beyond, into the page cache, stopping at one that is there already.
+ * As many as fit into SMB_PIPE_BATCH packets go at once.
+ */
+static int
+smb_readahead(struct inode *inode, unsigned long offset, unsigned long end)
+{
+	struct smb_inode_info *info = SMB_INOP(inode);
+	unsigned long pages[SMB_PIPE_BATCH];
+	struct smb_io io[SMB_PIPE_BATCH];
+	struct page *page;
+	unsigned long limit;
+	int bufsize = min(smb_bufsize(inode), PAGE_SIZE);
+	int i, k, n, npages, pieces, filled, res, error, result;
+
+	if (info->ra_window < SMB_MIN_READAHEAD)
+	{
+		info->ra_window = SMB_MIN_READAHEAD;
+	} else
+	{
+		info->ra_window = min(info->ra_window * 2, SMB_MAX_READAHEAD);
+	}
+	limit = PAGE_ALIGN(end) + info->ra_window * PAGE_SIZE;
+	if (limit > PAGE_ALIGN(inode->i_size))
+	{
+		limit = PAGE_ALIGN(inode->i_size);
+	}
+	n = npages = 0;
+	for (; offset < limit; offset += PAGE_SIZE)
+	{
+		if ((page = find_page(inode, offset)) != NULL)
+		{
+			__free_page(page);
+			break;
+		}
+		pieces = (min(PAGE_SIZE, inode->i_size - offset)
+			  + bufsize - 1) / bufsize;
+		if (n + pieces > SMB_PIPE_BATCH)
+		{
+			break;
+		}
+		if ((pages[npages] = __get_free_page(GFP_KERNEL)) == 0)
+		{
+			break;
+		}
+		for (i = 0; i < pieces; i++)
+		{
+			io[n].offset = offset + i * bufsize;
+			io[n].count = min(bufsize, PAGE_SIZE - i * bufsize);
+			io[n].data = (char *) pages[npages] + i * bufsize;
+			n++;
+		}
+		npages++;
+	}
+	if (npages == 0)
+	{
+		return 0;
+	}
+	result = smb_proc_read_pipe(SMB_SERVER(inode), SMB_FINFO(inode),
+				    io, n, 0);
+
+	/* Only a failure of the first page matters to the caller */
+	error = 0;
+	for (k = 0, i = 0; k < npages; k++)
+	{
+		offset = io[i].offset;
+		filled = 0;
+		for (; (i < n) && (io[i].offset < offset + PAGE_SIZE); i++)
+		{
+			res = (result < 0) ? result : io[i].result;
+			if (res < 0)
+			{
+				filled = -1;
+				if (k == 0)
+				{
+					error = res;
+				}
+			} else if (filled == io[i].offset - offset)
+			{
+				/* nothing after a short piece counts */
+				filled += res;
+			}
+		}
+		if (filled < 0)
+		{
+			free_page(pages[k]);
+			continue;
+		}
+		/* past the end of file, as far as the server is concerned */
+		memset((char *) pages[k] + filled, 0, PAGE_SIZE - filled);
+		smb_add_page(inode, pages[k], offset);
+	}
+	return error;
+}
+
+/*
+ * A sequential read, through the page cache
+ */
+static int
+smb_read_cached(struct inode *inode, off_t pos, char *buf, int count)
+{
+	struct page *page;
+	unsigned long offset;
+	int hunk, result, done = 0;
+
+	while (done < count)
+	{
+		offset = pos & PAGE_MASK;
+		if ((page = find_page(inode, offset)) == NULL)
+		{
+			result = smb_readahead(inode, offset, pos + count - done);
+			if (result < 0)
+			{
+				return done ? done : result;
+			}
+			if ((page = find_page(inode, offset)) == NULL)
+			{
+				/* no memory, or the page went again */
+				result = smb_transfer(inode, pos, buf,
+						      count - done, 0);
+				if (result < 0)
+				{
+					return done ? done : result;
+				}
+				done += result;
+				break;
+			}
+		}
+		hunk = min(PAGE_SIZE - (pos & ~PAGE_MASK), count - done);
+		memcpy_tofs(buf, (char *) page_address(page)
+			    + (pos & ~PAGE_MASK), hunk);
+		__free_page(page);
+		pos += hunk;
+		buf += hunk;
+		done += hunk;
+	}
+	return done;
+}
+
 static int
 smb_file_read(struct inode *inode, struct file *file, char *buf, int count)
 {
-	int result, bufsize, to_read, already_read;
+	struct smb_inode_info *info;
+	int result, want, already_read;
 	off_t pos;
 	int errno;
 
@@ -98,31 +323,46 @@ smb_file_read(struct inode *inode, struct file *file, char *buf, int count)
 	{
 		return 0;
 	}
-	bufsize = SMB_SERVER(inode)->max_xmit - SMB_HEADER_LEN - 5 * 2 - 5;
+	info = SMB_INOP(inode);
 
-	already_read = 0;
-
-	/* First read in as much as possible for each bufsize. */
-	while (already_read < count)
+	if (pos == info->ra_next)
 	{
-		to_read = min(bufsize, count - already_read);
-		result = smb_proc_read(SMB_SERVER(inode), SMB_FINFO(inode),
-				       pos, to_read, buf, 1);
-		if (result < 0)
-		{
-			return result;
-		}
-		pos += result;
-		buf += result;
-		already_read += result;
+		already_read = smb_read_cached(inode, pos, buf, count);
+	} else
+	{
+		/* After a seek, what was read ahead may be stale */
+		invalidate_inode_pages(inode);
+		info->ra_window = 0;
 
-		if (result < to_read)
+		already_read = 0;
+		while (already_read < count)
 		{
-			break;
+			want = min(count - already_read,
+				   SMB_PIPE_BATCH * smb_bufsize(inode));
+			result = smb_transfer(inode, pos + already_read,
+					      buf + already_read, want, 0);
+			if (result <= 0)
+			{
+				if (already_read == 0)
+				{
+					already_read = result;
+				}
+				break;
+			}
+			already_read += result;
+			if (result < want)
+			{
+				break;
+			}
 		}
 	}
-
+	if (already_read < 0)
+	{
+		return already_read;
+	}
+	pos += already_read;
 	file->f_pos = pos;
+	info->ra_next = pos;
 
 	if (!IS_RDONLY(inode))
 		inode->i_atime = CURRENT_TIME;
@@ -137,7 +377,7 @@ static int
 smb_file_write(struct inode *inode, struct file *file, const char *buf,
 	       int count)
 {
-	int result, bufsize, to_write, already_written;
+	int result, want, already_written;
 	off_t pos;
 	int errno;
 
@@ -167,8 +407,6 @@ smb_file_write(struct inode *inode, struct file *file, const char *buf,
 	if (file->f_flags & O_APPEND)
 		pos = inode->i_size;
 
-	bufsize = SMB_SERVER(inode)->max_xmit - SMB_HEADER_LEN - 5 * 2 - 5;
-
 	already_written = 0;
 
 	DPRINTK("smb_write_file: blkmode = %d, blkmode & 2 = %d\n",
@@ -177,24 +415,34 @@ smb_file_write(struct inode *inode, struct file *file, const char *buf,
 
 	while (already_written < count)
 	{
-		to_write = min(bufsize, count - already_written);
-		result = smb_proc_write(SMB_SERVER(inode), SMB_FINFO(inode),
-					pos, to_write, buf);
-
+		want = min(count - already_written,
+			   SMB_PIPE_BATCH * smb_bufsize(inode));
+		result = smb_transfer(inode, pos, (char *) buf, want, 1);
 		if (result < 0)
 		{
-			return result;
+			if (already_written == 0)
+			{
+				return result;
+			}
+			break;
 		}
 		pos += result;
 		buf += result;
 		already_written += result;
 
-		if (result < to_write)
+		if (result < want)
 		{
 			break;
 		}
 	}
 
+	/* Pages read ahead do not see what we wrote */
+	if (inode->i_nrpages != 0)
+	{
+		invalidate_inode_pages(inode);
+	}
+	SMB_INOP(inode)->ra_window = 0;
+
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 	inode->i_dirt = 1;
 
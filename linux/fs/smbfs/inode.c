@@ -77,6 +77,8 @@ smb_read_inode(struct inode *inode)
 	inode->i_atime = inode_info->finfo.f_atime;
 	inode->i_blksize = inode_info->finfo.f_blksize;
 	inode->i_blocks = inode_info->finfo.f_blocks;
+	inode_info->ra_next = 0;
+	inode_info->ra_window = 0;
 
 	if (S_ISREG(inode->i_mode))
 	{
@@ -152,6 +154,11 @@ smb_put_super(struct super_block *sb)
 
 	smb_vfree(server->packet);
 	server->packet = NULL;
+	if (server->pipe_packet != NULL)
+	{
+		smb_vfree(server->pipe_packet);
+		server->pipe_packet = NULL;
+	}
 
 	sb->s_dev = 0;
 	smb_kfree_s(SMB_SBP(sb), sizeof(struct smb_sb_info));
@@ -289,6 +296,8 @@ smb_read_super(struct super_block *sb, void *raw_data, int silent)
 	server->lock = 0;
 	server->wait = NULL;
 	server->packet = NULL;
+	server->pipe_packet = NULL;
+	server->pipe_size = 0;
 	server->max_xmit = data.max_xmit;
 	if (server->max_xmit <= 0)
 	{
@@ -434,6 +443,8 @@ smb_notify_change(struct inode *inode, struct iattr *attr)
 					    SMB_FINFO(inode)->fileid,
 					    attr->ia_size)) < 0)
 			goto fail;
+		/* pages read ahead past the new end are stale */
+		invalidate_inode_pages(inode);
 
 	}
 
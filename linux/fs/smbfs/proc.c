@@ -461,12 +461,12 @@ smb_request_ok_unlock(struct smb_server *s, int command, int wct, int bcc)
 /* smb_setup_header: We completely set up the packet. You only have to
    insert the command-specific fields */
 
-__u8 *
-smb_setup_header(struct smb_server * server, byte command, word wct, word bcc)
+static __u8 *
+smb_setup_header_buf(struct smb_server *server, byte * buf,
+		     byte command, word wct, word bcc)
 {
 	dword xmit_len = SMB_HEADER_LEN + wct * sizeof(word) + bcc + 2;
-	byte *p = server->packet;
-	byte *buf = server->packet;
+	byte *p = buf;
 
 	p = smb_encode_smb_length(p, xmit_len - 4);
 
@@ -497,6 +497,12 @@ smb_setup_header(struct smb_server * server, byte command, word wct, word bcc)
 	return p + 2;
 }
 
+__u8 *
+smb_setup_header(struct smb_server * server, byte command, word wct, word bcc)
+{
+	return smb_setup_header_buf(server, server->packet, command, wct, bcc);
+}
+
 /* smb_setup_header_exclusive waits on server->lock and locks the
    server, when it's free. You have to unlock it manually when you're
    finished with server->packet! */
@@ -693,6 +699,211 @@ smb_proc_write(struct smb_server *server, struct smb_dirent *finfo,
 	return res;
 }
 
+/* smb_proc_read_pipe and smb_proc_write_pipe: Like smb_proc_read and
+   smb_proc_write, for n pieces at once. The result of each piece is
+   left in io->result. Without maxmux > 1 the pieces go one by one. */
+
+struct smb_pipe_args
+{
+	struct smb_dirent *finfo;
+	struct smb_io *io;
+	int fs;
+};
+
+static int
+smb_pipe_alloc(struct smb_server *server)
+{
+	if ((server->pipe_packet != NULL)
+	    && (server->pipe_size >= server->max_xmit))
+	{
+		return 0;
+	}
+	if (server->pipe_packet != NULL)
+	{
+		smb_vfree(server->pipe_packet);
+	}
+	server->pipe_size = 0;
+	if ((server->pipe_packet = smb_vmalloc(server->max_xmit)) == NULL)
+	{
+		return -ENOMEM;
+	}
+	server->pipe_size = server->max_xmit;
+	return 0;
+}
+
+static int
+smb_pipe_depth(struct smb_server *server)
+{
+	if (server->maxmux <= 1)
+	{
+		return 1;
+	}
+	return min(server->maxmux, SMB_MAX_PIPE);
+}
+
+static int
+smb_pipe_check(struct smb_server *server, int command, int wct)
+{
+	if (smb_valid_packet(server->packet) != 0)
+	{
+		DPRINTK("not a valid packet!\n");
+		return -EIO;
+	}
+	if (server->rcls != 0)
+	{
+		return -smb_errno(server->rcls, server->err);
+	}
+	if (smb_verify(server->packet, command, wct, -1) != 0)
+	{
+		DPRINTK("smb_verify failed\n");
+		return -EIO;
+	}
+	return 0;
+}
+
+static int
+smb_read_setup(struct smb_server *server, int i, void *arg)
+{
+	struct smb_pipe_args *a = arg;
+	struct smb_io *io = &(a->io[i]);
+	byte *buf = server->pipe_packet;
+
+	smb_setup_header_buf(server, buf, SMBread, 5, 0);
+	WSET(buf, smb_vwv0, a->finfo->fileid);
+	WSET(buf, smb_vwv1, io->count);
+	DSET(buf, smb_vwv2, io->offset);
+	WSET(buf, smb_vwv4, 0);
+	return 0;
+}
+
+static int
+smb_read_reply(struct smb_server *server, int i, void *arg)
+{
+	struct smb_pipe_args *a = arg;
+	struct smb_io *io = &(a->io[i]);
+	byte *p = SMB_BUF(server->packet);
+	word data_len;
+
+	if ((io->result = smb_pipe_check(server, SMBread, 5)) < 0)
+	{
+		return 0;
+	}
+	if (WVAL(p, 1) > io->count)
+	{
+		printk("smb_read_reply: got %d bytes for %d\n",
+		       WVAL(p, 1), io->count);
+		io->result = -EIO;
+		return 0;
+	}
+	smb_decode_data(p, io->data, &data_len, a->fs);
+	io->result = data_len;
+	return 0;
+}
+
+int
+smb_proc_read_pipe(struct smb_server *server, struct smb_dirent *finfo,
+		   struct smb_io *io, int n, int fs)
+{
+	struct smb_pipe_args a;
+	int i, result;
+
+	if ((n == 1) || (smb_pipe_depth(server) == 1))
+	{
+		for (i = 0; i < n; i++)
+		{
+			io[i].result = smb_proc_read(server, finfo,
+						     io[i].offset, io[i].count,
+						     io[i].data, fs);
+		}
+		return 0;
+	}
+	a.finfo = finfo;
+	a.io = io;
+	a.fs = fs;
+
+	smb_lock_server(server);
+	if ((result = smb_pipe_alloc(server)) == 0)
+	{
+		result = smb_request_pipe(server, n, smb_pipe_depth(server),
+					  smb_read_setup, smb_read_reply, &a);
+	}
+	smb_unlock_server(server);
+	return result;
+}
+
+static int
+smb_write_setup(struct smb_server *server, int i, void *arg)
+{
+	struct smb_pipe_args *a = arg;
+	struct smb_io *io = &(a->io[i]);
+	byte *buf = server->pipe_packet;
+	byte *p;
+
+	p = smb_setup_header_buf(server, buf, SMBwrite, 5, io->count + 3);
+	WSET(buf, smb_vwv0, a->finfo->fileid);
+	WSET(buf, smb_vwv1, io->count);
+	DSET(buf, smb_vwv2, io->offset);
+	WSET(buf, smb_vwv4, 0);
+
+	*p++ = 1;
+	WSET(p, 0, io->count);
+	memcpy_fromfs(p + 2, io->data, io->count);
+	return 0;
+}
+
+static int
+smb_write_reply(struct smb_server *server, int i, void *arg)
+{
+	struct smb_pipe_args *a = arg;
+	struct smb_io *io = &(a->io[i]);
+
+	if ((io->result = smb_pipe_check(server, SMBwrite, 1)) == 0)
+	{
+		io->result = WVAL(server->packet, smb_vwv0);
+	}
+	return 0;
+}
+
+int
+smb_proc_write_pipe(struct smb_server *server, struct smb_dirent *finfo,
+		    struct smb_io *io, int n)
+{
+	struct smb_pipe_args a;
+	int i, result;
+
+	if ((n == 1) || (smb_pipe_depth(server) == 1))
+	{
+		for (i = 0; i < n; i++)
+		{
+			io[i].result = smb_proc_write(server, finfo,
+						      io[i].offset, io[i].count,
+						      io[i].data);
+			if (io[i].result < io[i].count)
+			{
+				/* what follows would leave a hole */
+				break;
+			}
+		}
+		while (++i < n)
+		{
+			io[i].result = 0;
+		}
+		return 0;
+	}
+	a.finfo = finfo;
+	a.io = io;
+	a.fs = 1;
+
+	smb_lock_server(server);
+	if ((result = smb_pipe_alloc(server)) == 0)
+	{
+		result = smb_request_pipe(server, n, smb_pipe_depth(server),
+					  smb_write_setup, smb_write_reply, &a);
+	}
+	smb_unlock_server(server);
+	return result;
+}
+
 int
 smb_proc_create(struct inode *dir, const char *name, int len,
 		word attr, time_t ctime)
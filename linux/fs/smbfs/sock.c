@@ -590,6 +590,117 @@ smb_request(struct smb_server *server)
 	return result;
 }
 
+/*
+ * smb_request_pipe: Do n requests with up to depth of them outstanding
+ * on the connection. setup(server, i, arg) builds request i in
+ * server->pipe_packet, which is sent with mid server->mid + 1 + i.
+ * The replies may come in any order; reply(server, i, arg) is called
+ * with each in server->packet. Both run in the caller's fs segment.
+ * A setup error stops sending, but the requests in flight are still
+ * collected. Returns the first error of a callback, or a transport
+ * error, after which the connection is invalid as with smb_request.
+ */
+int
+smb_request_pipe(struct smb_server *server, int n, int depth,
+		 int (*setup) (struct smb_server *, int, void *),
+		 int (*reply) (struct smb_server *, int, void *),
+		 void *arg)
+{
+	unsigned long old_mask;
+	unsigned short fs;
+	int sent = 0, received = 0;
+	int result, error = 0;
+	word i;
+
+	if (server->state != CONN_VALID)
+	{
+		return -EIO;
+	}
+	if ((result = smb_dont_catch_keepalive(server)) != 0)
+	{
+		server->state = CONN_INVALID;
+		smb_invalidate_all_inodes(server);
+		return result;
+	}
+	old_mask = current->blocked;
+	current->blocked |= ~(_S(SIGKILL) | _S(SIGSTOP));
+	fs = get_fs();
+	set_fs(get_ds());
+
+	result = 0;
+	while (received < n)
+	{
+		while ((sent < n) && (sent - received < depth))
+		{
+			set_fs(fs);
+			result = setup(server, sent, arg);
+			set_fs(get_ds());
+			if (result < 0)
+			{
+				error = result;
+				n = sent;
+				break;
+			}
+			WSET(server->pipe_packet, smb_mid,
+			     server->mid + 1 + sent);
+			result = smb_send_raw(server_sock(server),
+					      server->pipe_packet,
+					      smb_len(server->pipe_packet) + 4);
+			if (result < 0)
+			{
+				goto out;
+			}
+			sent += 1;
+		}
+		if (received >= n)
+		{
+			break;
+		}
+		if ((result = smb_receive(server)) < 0)
+		{
+			goto out;
+		}
+		i = WVAL(server->packet, smb_mid) - server->mid - 1;
+		if (i >= sent)
+		{
+			printk("smb_request_pipe: reply to unknown mid %d\n",
+			       WVAL(server->packet, smb_mid));
+			result = -EIO;
+			goto out;
+		}
+		received += 1;
+
+		set_fs(fs);
+		result = reply(server, i, arg);
+		set_fs(get_ds());
+		if ((result < 0) && (error == 0))
+		{
+			error = result;
+		}
+	}
+	result = 0;
+
+      out:
+	/* read/write errors are handled by errno */
+	current->signal &= ~_S(SIGPIPE);
+	current->blocked = old_mask;
+	set_fs(fs);
+
+	if (result >= 0)
+	{
+		result = smb_catch_keepalive(server);
+	}
+	if (result < 0)
+	{
+		server->state = CONN_INVALID;
+		smb_invalidate_all_inodes(server);
+		return result;
+	}
+	DDPRINTK("smb_request_pipe: %d requests, error = %d\n", n, error);
+
+	return error;
+}
+
 #define ROUND_UP(x) (((x)+3) & ~3)
 static int
 smb_send_trans2(struct smb_server *server, __u16 trans2_command,
@@ -24,15 +24,348 @@
 #include <linux/sysv_fs.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
+
+#include <asm/bitops.h>
 
 /* We don't trust the value of
    sb->sv_sbd2->s_tfree = *sb->sv_sb_total_free_blocks
    but we nevertheless keep it up to date. */
 
+/* The free list is a chain of chunks. The super-block holds the first
+ * one; blocks are taken from its top, and the last one taken (index 0)
+ * holds the next chunk. Used as is, it hands out whatever was freed
+ * last, which scatters files all over an aged volume.
+ *
+ * So for a read-write mount the chain is read once into a bitmap of the
+ * data zones (sv_fmap), and blocks are allocated from the bitmap: the
+ * block the caller asks for if it is free, else the start of a free
+ * run, and regular files preallocate a few more after it.
+ *
+ * The chain is kept on disk in a fixed ascending layout, rewritten in
+ * the buffer cache after every allocation and free so that it never
+ * lists a block that is in use (a crash must not leave blocks both free
+ * and allocated); it goes to disk with the other metadata. The
+ * data zones are cut into groups of flc_size-1 zones. Every group with
+ * free zones is one chunk, which gives them out in ascending order; its
+ * highest free zone comes last and holds the chunk of the next such
+ * group. The last chunk ends with a 0 entry (Coherent: its highest zone
+ * holds an empty chunk). A change in a group only touches its own chunk
+ * and the next one's, so only the chunks around dirty groups are
+ * rewritten.
+ */
+
+#define SYSV_PREALLOC	8	/* blocks preallocated for a regular file */
+#define SYSV_RUNSEARCH	64	/* free runs looked at before giving up */
+
+static void sysv_chunk(struct super_block * sb, char * bh_data,
+		       unsigned short ** flc_count, unsigned long ** flc_blocks)
+{
+	switch (sb->sv_type) {
+		case FSTYPE_XENIX:
+			*flc_count = &((struct xenix_freelist_chunk *) bh_data)->fl_nfree;
+			*flc_blocks = &((struct xenix_freelist_chunk *) bh_data)->fl_free[0];
+			break;
+		case FSTYPE_SYSV4:
+			*flc_count = &((struct sysv4_freelist_chunk *) bh_data)->fl_nfree;
+			*flc_blocks = &((struct sysv4_freelist_chunk *) bh_data)->fl_free[0];
+			break;
+		case FSTYPE_SYSV2:
+			*flc_count = &((struct sysv2_freelist_chunk *) bh_data)->fl_nfree;
+			*flc_blocks = &((struct sysv2_freelist_chunk *) bh_data)->fl_free[0];
+			break;
+		case FSTYPE_COH:
+			*flc_count = &((struct coh_freelist_chunk *) bh_data)->fl_nfree;
+			*flc_blocks = &((struct coh_freelist_chunk *) bh_data)->fl_free[0];
+			break;
+		default: panic("sysv_chunk: invalid fs type\n");
+	}
+}
+
+static void sysv_adjust_free(struct super_block * sb, int delta)
+{
+	if (sb->sv_convert)
+		*sb->sv_sb_total_free_blocks =
+		  to_coh_ulong(from_coh_ulong(*sb->sv_sb_total_free_blocks) + delta);
+	else
+		*sb->sv_sb_total_free_blocks = *sb->sv_sb_total_free_blocks + delta;
+	mark_buffer_dirty(sb->sv_bh1, 1); /* super-block has been modified */
+	if (sb->sv_bh1 != sb->sv_bh2) mark_buffer_dirty(sb->sv_bh2, 1);
+	sb->s_dirt = 1; /* and needs time stamp */
+}
+
+static inline unsigned long fmap_group(struct super_block * sb, unsigned long i)
+{
+	return i / (sb->sv_flc_size - 1);
+}
+
+/* Mark data zone i (counted from sv_firstdatazone) used or free. */
+static void fmap_set(struct super_block * sb, unsigned long i, int used)
+{
+	unsigned long g = fmap_group(sb, i);
+
+	if (used) {
+		set_bit(i, sb->sv_fmap);
+		sb->sv_fgroup[g]--;
+	} else {
+		clear_bit(i, sb->sv_fmap);
+		sb->sv_fgroup[g]++;
+	}
+	set_bit(g, sb->sv_fdirty);
+	sb->sv_fmap_dirty = 1;
+	sysv_adjust_free(sb, used ? -1 : 1);
+}
+
+/* Pick a free zone: the goal, else the start of a free run of
+   SYSV_PREALLOC zones at or after it, else the first free one. */
+static long fmap_find(struct super_block * sb, unsigned int goal)
+{
+	unsigned long nd = sb->sv_ndatazones;
+	long i, j, k, first = -1;
+	int wrapped = 0, tries = SYSV_RUNSEARCH;
+
+	if (goal < sb->sv_firstdatazone || goal >= sb->sv_nzones)
+		goal = sb->sv_frover;
+	i = goal - sb->sv_firstdatazone;
+	if (i >= nd)
+		i = 0;
+	if (!test_bit(i, sb->sv_fmap))
+		return i;
+
+	for (j = i ; ; ) {
+		j = find_next_zero_bit(sb->sv_fmap, nd, j);
+		if (j >= nd) {
+			if (wrapped)
+				break;
+			wrapped = 1;
+			j = 0;
+			continue;
+		}
+		if (wrapped && j >= i)
+			break;
+		if (first < 0)
+			first = j;
+		if (!tries--)
+			break;
+		for (k = j + 1; k < nd && k < j + SYSV_PREALLOC; k++)
+			if (test_bit(k, sb->sv_fmap))
+				break;
+		if (k == j + SYSV_PREALLOC)
+			return j;
+		j = k;
+	}
+	return first;
+}
+
+void sysv_init_fmap(struct super_block * sb)
+{
+	unsigned long nd = sb->sv_ndatazones;
+	unsigned long groups, mapsize, dirtysize, count = 0, old_count;
+	unsigned short * flc_count = sb->sv_sb_flc_count;
+	unsigned long * flc_blocks = sb->sv_sb_flc_blocks;
+	struct buffer_head * bh = NULL;
+	unsigned int block;
+	char * p;
+	int i;
+
+	sb->sv_fmap = NULL;
+	if (sb->sv_flc_size < 2 || nd == 0)
+		return;
+	groups = (nd + sb->sv_flc_size - 2) / (sb->sv_flc_size - 1);
+	mapsize = ((nd + 31) >> 5) << 2;
+	dirtysize = ((groups + 31) >> 5) << 2;
+	p = vmalloc(mapsize + dirtysize + groups * sizeof(unsigned short));
+	if (!p) {
+		printk("sysv_init_fmap: no memory for free block map\n");
+		return;
+	}
+	memset(p, 0xff, mapsize + dirtysize);	/* all used, all dirty */
+	memset(p + mapsize + dirtysize, 0, groups * sizeof(unsigned short));
+	sb->sv_fmap = p;
+	sb->sv_fdirty = p + mapsize;
+	sb->sv_fgroup = (unsigned short *) (p + mapsize + dirtysize);
+	sb->sv_fgroups = groups;
+	sb->sv_frover = sb->sv_firstdatazone;
+	sb->sv_fmap_dirty = 1;
+
+	lock_super(sb);
+	while (*flc_count > 0) {
+		if (*flc_count > sb->sv_flc_size)
+			goto bad;
+		for (i = *flc_count ; i > 0 ; ) {
+			block = flc_blocks[--i];
+			if (sb->sv_convert)
+				block = from_coh_ulong(block);
+			if (block == 0) /* block 0 terminates list */
+				goto done;
+			if (block < sb->sv_firstdatazone || block >= sb->sv_nzones)
+				goto bad;
+			block -= sb->sv_firstdatazone;
+			if (!test_bit(block, sb->sv_fmap))	/* listed twice */
+				goto bad;
+			clear_bit(block, sb->sv_fmap);
+			sb->sv_fgroup[fmap_group(sb, block)]++;
+			count++;
+		}
+		/* block = flc_blocks[0], the last block continues the free list */
+		brelse(bh);
+		if (!(bh = sv_bread(sb, sb->s_dev, block + sb->sv_firstdatazone)))
+			goto bad;
+		sysv_chunk(sb, bh->b_data, &flc_count, &flc_blocks);
+	}
+done:
+	brelse(bh);
+	old_count = *sb->sv_sb_total_free_blocks;
+	if (sb->sv_convert)
+		old_count = from_coh_ulong(old_count);
+	if (count != old_count) {
+		printk("sysv_init_fmap: free block count was %lu, correcting to %lu\n",
+		       old_count, count);
+		*sb->sv_sb_total_free_blocks = (sb->sv_convert ? to_coh_ulong(count) : count);
+		mark_buffer_dirty(sb->sv_bh2, 1);
+		sb->s_dirt = 1;
+	}
+	unlock_super(sb);
+	return;
+
+bad:
+	brelse(bh);
+	printk("sysv_init_fmap: free list is damaged, using it as it is\n");
+	vfree(sb->sv_fmap);
+	sb->sv_fmap = NULL;
+	unlock_super(sb);
+}
+
+void sysv_release_fmap(struct super_block * sb)
+{
+	if (sb->sv_fmap)
+		vfree(sb->sv_fmap);
+	sb->sv_fmap = NULL;
+}
+
+/* Highest free zone of group g. */
+static unsigned long fmap_highest(struct super_block * sb, unsigned long g)
+{
+	unsigned long i = (g + 1) * (sb->sv_flc_size - 1);
+
+	if (i > sb->sv_ndatazones)
+		i = sb->sv_ndatazones;
+	while (test_bit(--i, sb->sv_fmap))
+		;
+	return i;
+}
+
+/* Write the chunk of group g (g < 0: empty free list) into the highest
+   free zone of group pg, or into the super-block if pg < 0. */
+static void fmap_write_chunk(struct super_block * sb, long pg, long g, int last)
+{
+	struct buffer_head * bh = NULL;
+	unsigned short * flc_count;
+	unsigned long * flc_blocks;
+	unsigned long i, end, n;
+
+	if (pg < 0) {
+		flc_count = sb->sv_sb_flc_count;
+		flc_blocks = sb->sv_sb_flc_blocks;
+		mark_buffer_dirty(sb->sv_bh1, 1);
+		if (sb->sv_bh1 != sb->sv_bh2) mark_buffer_dirty(sb->sv_bh2, 1);
+	} else {
+		bh = sv_getblk(sb, sb->s_dev,
+			       fmap_highest(sb, pg) + sb->sv_firstdatazone);
+		if (!bh) {
+			printk("sysv_write_fmap: getblk() failed\n");
+			return;
+		}
+		memset(bh->b_data, 0, sb->sv_block_size);
+		sysv_chunk(sb, bh->b_data, &flc_count, &flc_blocks);
+	}
+
+	n = (g < 0) ? 0 : sb->sv_fgroup[g];
+	if (last && sb->sv_type != FSTYPE_COH) {
+		flc_blocks[0] = 0;
+		n++;
+	}
+	*flc_count = n;
+	if (g >= 0) {
+		i = g * (sb->sv_flc_size - 1);
+		end = i + sb->sv_flc_size - 1;
+		if (end > sb->sv_ndatazones)
+			end = sb->sv_ndatazones;
+		for ( ; i < end; i++)
+			if (!test_bit(i, sb->sv_fmap)) {
+				n--;
+				flc_blocks[n] = (sb->sv_convert ?
+				    to_coh_ulong(i + sb->sv_firstdatazone) :
+				    i + sb->sv_firstdatazone);
+			}
+	}
+
+	if (bh) {
+		mark_buffer_uptodate(bh, 1);
+		mark_buffer_dirty(bh, 1);
+		brelse(bh);
+	}
+
+	/* The Coherent list ends when a block with an empty chunk is taken. */
+	if (last && g >= 0 && sb->sv_type == FSTYPE_COH) {
+		bh = sv_getblk(sb, sb->s_dev,
+			       fmap_highest(sb, g) + sb->sv_firstdatazone);
+		if (!bh)
+			return;
+		memset(bh->b_data, 0, sb->sv_block_size);
+		mark_buffer_uptodate(bh, 1);
+		mark_buffer_dirty(bh, 1);
+		brelse(bh);
+	}
+}
+
+/* Called with the super-block locked, after every change to the bitmap
+   and from sysv_write_super(). */
+void sysv_write_fmap(struct super_block * sb)
+{
+	long g, prev = -1, pprev = -1;
+	int d, dprev = 0, need = 0, acc = 0;
+
+	if (!sb->sv_fmap || !sb->sv_fmap_dirty)
+		return;
+	for (g = 0; g < sb->sv_fgroups; g++) {
+		d = clear_bit(g, sb->sv_fdirty);
+		acc |= d;
+		if (!sb->sv_fgroup[g])
+			continue;
+		/* prev is not the last group, its chunk links to g: rewrite
+		   it too if anything in (prev,g] changed, or a former tail
+		   chunk keeps its terminator and the blocks after it leak */
+		if (prev >= 0 && (need || acc))
+			fmap_write_chunk(sb, pprev, prev, 0);
+		/* g's chunk moves or changes if anything in [prev,g] did */
+		need = dprev || acc;
+		pprev = prev;
+		prev = g;
+		dprev = d;
+		acc = 0;
+	}
+	if (prev >= 0) {
+		if (need || acc)
+			fmap_write_chunk(sb, pprev, prev, 1);
+	} else if (acc)
+		fmap_write_chunk(sb, -1, -1, 1);
+	sb->sv_fmap_dirty = 0;
+}
+
+void sysv_discard_prealloc(struct inode * inode)
+{
+	unsigned long count = inode->u.sysv_i.i_prealloc_count;
+	unsigned long block = inode->u.sysv_i.i_prealloc_block;
+
+	inode->u.sysv_i.i_prealloc_count = 0;
+	while (count--)
+		sysv_free_block(inode->i_sb, block++);
+}
+
 void sysv_free_block(struct super_block * sb, unsigned int block)
 {
 	struct buffer_head * bh;
-	char * bh_data;
 
 	if (!sb) {
 		printk("sysv_free_block: trying to free block on nonexistent device\n");
@@ -43,6 +376,22 @@ void sysv_free_block(struct super_block * sb, unsigned int block)
 		return;
 	}
 	lock_super(sb);
+	if (sb->sv_fmap) {
+		if (!test_bit(block - sb->sv_firstdatazone, sb->sv_fmap)) {
+			printk("sysv_free_block: block %d is already free\n", block);
+			unlock_super(sb);
+			return;
+		}
+		/* Throw away block's contents */
+		bh = sv_get_hash_table(sb, sb->s_dev, block);
+		if (bh)
+			mark_buffer_clean(bh);
+		brelse(bh);
+		fmap_set(sb, block - sb->sv_firstdatazone, 0);
+		sysv_write_fmap(sb);
+		unlock_super(sb);
+		return;
+	}
 	if (*sb->sv_sb_flc_count > sb->sv_flc_size) {
 		printk("sysv_free_block: flc_count > flc_size\n");
 		unlock_super(sb);
@@ -61,26 +410,7 @@ void sysv_free_block(struct super_block * sb, unsigned int block)
 			unlock_super(sb);
 			return;
 		}
-		bh_data = bh->b_data;
-		switch (sb->sv_type) {
-			case FSTYPE_XENIX:
-				flc_count = &((struct xenix_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct xenix_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_SYSV4:
-				flc_count = &((struct sysv4_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct sysv4_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_SYSV2:
-				flc_count = &((struct sysv2_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct sysv2_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_COH:
-				flc_count = &((struct coh_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct coh_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			default: panic("sysv_free_block: invalid fs type\n");
-		}
+		sysv_chunk(sb, bh->b_data, &flc_count, &flc_blocks);
 		*flc_count = *sb->sv_sb_flc_count; /* = sb->sv_flc_size */
 		memcpy(flc_blocks, sb->sv_sb_flc_blocks, *flc_count * sizeof(sysv_zone_t));
 		mark_buffer_dirty(bh, 1);
@@ -114,28 +444,47 @@ void sysv_free_block(struct super_block * sb, unsigned int block)
 	if (sb->sv_convert)
 		block = to_coh_ulong(block);
 	sb->sv_sb_flc_blocks[(*sb->sv_sb_flc_count)++] = block;
-	if (sb->sv_convert)
-		*sb->sv_sb_total_free_blocks =
-		  to_coh_ulong(from_coh_ulong(*sb->sv_sb_total_free_blocks) + 1);
-	else
-		*sb->sv_sb_total_free_blocks = *sb->sv_sb_total_free_blocks + 1;
-	mark_buffer_dirty(sb->sv_bh1, 1); /* super-block has been modified */
-	if (sb->sv_bh1 != sb->sv_bh2) mark_buffer_dirty(sb->sv_bh2, 1);
-	sb->s_dirt = 1; /* and needs time stamp */
+	sysv_adjust_free(sb, 1);
 	unlock_super(sb);
 }
 
-int sysv_new_block(struct super_block * sb)
+/* Get a zeroed block for the caller, preferably goal. If prealloc_count
+   is given, up to SYSV_PREALLOC-1 free blocks right after it are taken
+   too, and left for the caller in *prealloc_block, *prealloc_count. */
+int sysv_new_block(struct super_block * sb, unsigned int goal,
+		   unsigned long * prealloc_count, unsigned long * prealloc_block)
 {
 	unsigned int block;
 	struct buffer_head * bh;
-	char * bh_data;
+	long i;
 
 	if (!sb) {
 		printk("sysv_new_block: trying to get new block from nonexistent device\n");
 		return 0;
 	}
+	if (prealloc_count)
+		*prealloc_count = 0;
 	lock_super(sb);
+	if (sb->sv_fmap) {
+		if ((i = fmap_find(sb, goal)) < 0) {
+			unlock_super(sb);
+			return 0;	/* no blocks available */
+		}
+		fmap_set(sb, i, 1);
+		block = i + sb->sv_firstdatazone;
+		if (prealloc_count) {
+			*prealloc_block = block + 1;
+			while (++i < sb->sv_ndatazones &&
+			       *prealloc_count < SYSV_PREALLOC - 1 &&
+			       !test_bit(i, sb->sv_fmap)) {
+				fmap_set(sb, i, 1);
+				(*prealloc_count)++;
+			}
+		}
+		sb->sv_frover = block + 1 + (prealloc_count ? *prealloc_count : 0);
+		sysv_write_fmap(sb);
+		goto got_block;
+	}
 	if (*sb->sv_sb_flc_count == 0) { /* Applies only to Coherent FS */
 		unlock_super(sb);
 		return 0;		/* no blocks available */
@@ -164,26 +513,7 @@ int sysv_new_block(struct super_block * sb)
 			unlock_super(sb);
 			return 0;
 		}
-		bh_data = bh->b_data;
-		switch (sb->sv_type) {
-			case FSTYPE_XENIX:
-				flc_count = &((struct xenix_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct xenix_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_SYSV4:
-				flc_count = &((struct sysv4_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct sysv4_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_SYSV2:
-				flc_count = &((struct sysv2_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct sysv2_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			case FSTYPE_COH:
-				flc_count = &((struct coh_freelist_chunk *) bh_data)->fl_nfree;
-				flc_blocks = &((struct coh_freelist_chunk *) bh_data)->fl_free[0];
-				break;
-			default: panic("sysv_new_block: invalid fs type\n");
-		}
+		sysv_chunk(sb, bh->b_data, &flc_count, &flc_blocks);
 		if (*flc_count > sb->sv_flc_size) {
 			printk("sysv_new_block: free-list block with >flc_size entries\n");
 			brelse(bh);
@@ -195,6 +525,8 @@ int sysv_new_block(struct super_block * sb)
 		brelse(bh);
 	}
 	/* Now the free list head in the superblock is valid again. */
+	sysv_adjust_free(sb, -1);
+got_block:
 	bh = sv_getblk(sb, sb->s_dev, block);
 	if (!bh) {
 		printk("sysv_new_block: getblk() failed\n");
@@ -210,14 +542,6 @@ int sysv_new_block(struct super_block * sb)
 	mark_buffer_dirty(bh, 1);
 	mark_buffer_uptodate(bh, 1);
 	brelse(bh);
-	if (sb->sv_convert)
-		*sb->sv_sb_total_free_blocks =
-		  to_coh_ulong(from_coh_ulong(*sb->sv_sb_total_free_blocks) - 1);
-	else
-		*sb->sv_sb_total_free_blocks = *sb->sv_sb_total_free_blocks - 1;
-	mark_buffer_dirty(sb->sv_bh1, 1); /* super-block has been modified */
-	if (sb->sv_bh1 != sb->sv_bh2) mark_buffer_dirty(sb->sv_bh2, 1);
-	sb->s_dirt = 1; /* and needs time stamp */
 	unlock_super(sb);
 	return block;
 }
@@ -26,6 +26,7 @@
 #include <asm/segment.h>
 
 #define	NBUF	32
+#define	NREADA	16	/* read-ahead for a file contiguous on disk */
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -34,6 +35,7 @@
 #include <linux/sysv_fs.h>
 
 static int sysv_file_write(struct inode *, struct file *, const char *, int);
+static void sysv_release_file(struct inode *, struct file *);
 
 /*
  * We have mostly NULL's here: the current defaults are ok for
@@ -48,7 +50,7 @@ static struct file_operations sysv_file_operations = {
 	NULL,			/* ioctl - default */
 	generic_file_mmap,	/* mmap */
 	NULL,			/* no special open is needed */
-	NULL,			/* release */
+	sysv_release_file,	/* release */
 	sysv_sync_file		/* fsync */
 };
 
@@ -82,7 +84,8 @@ int sysv_file_read(struct inode * inode, struct file * filp, char * buf, int cou
 	struct buffer_head ** bhb, ** bhe;
 	struct buffer_head * bhreq[NBUF];
 	struct buffer_head * buflist[NBUF];
-	unsigned int size;
+	struct buffer_head * bh;
+	unsigned int size, reada, prev;
 
 	if (!inode) {
 		printk("sysv_file_read: inode = NULL\n");
@@ -108,8 +111,15 @@ int sysv_file_read(struct inode * inode, struct file * filp, char * buf, int cou
 	size = (size + sb->sv_block_size_1) >> sb->sv_block_size_bits;
 	blocks = (left + offset + sb->sv_block_size_1) >> sb->sv_block_size_bits;
 	bhb = bhe = buflist;
+	/* Read ahead at least NREADA blocks on sequential reads, but only
+	   as long as the file stays contiguous on disk: a whole run then
+	   goes out as one request, and scattered blocks are not read in
+	   on speculation. */
+	reada = block + blocks;
+	prev = 0;
 	if (filp->f_reada) {
-		blocks += read_ahead[MAJOR(inode->i_dev)] >> (sb->sv_block_size_bits - 9);
+		blocks += MAX(read_ahead[MAJOR(inode->i_dev)] >> (sb->sv_block_size_bits - 9),
+			      NREADA);
 		if (block + blocks > size)
 			blocks = size - block;
 	}
@@ -129,8 +139,19 @@ int sysv_file_read(struct inode * inode, struct file * filp, char * buf, int cou
 		bhrequest = 0;
 		uptodate = 1;
 		while (blocks) {
+			bh = sysv_getblk(inode, block, 0);
+			if (bh) {
+				if (block >= reada && prev &&
+				    bh->b_blocknr != prev + 1) {
+					brelse(bh);
+					blocks = 0;
+					break;
+				}
+				prev = bh->b_blocknr;
+			}
 			--blocks;
-			*bhb = sysv_getblk(inode, block++, 0);
+			block++;
+			*bhb = bh;
 			if (*bhb && !buffer_uptodate(*bhb)) {
 				uptodate = 0;
 				bhreq[bhrequest++] = *bhb;
@@ -267,3 +288,12 @@ static int sysv_file_write(struct inode * inode, struct file * filp, const char
 	inode->i_dirt = 1;
 	return written;
 }
+
+/*
+ * Give back the blocks preallocated for the last writer.
+ */
+static void sysv_release_file(struct inode * inode, struct file * filp)
+{
+	if (filp->f_mode & 2)
+		sysv_discard_prealloc(inode);
+}
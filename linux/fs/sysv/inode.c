@@ -34,6 +34,8 @@
 
 void sysv_put_inode(struct inode *inode)
 {
+	sysv_ind_forget(inode);
+	sysv_discard_prealloc(inode);
 	if (inode->i_nlink)
 		return;
 	inode->i_size = 0;
@@ -371,6 +373,7 @@ struct super_block *sysv_read_super(struct super_block *sb,void *data,
 	lock_super(sb);
 	set_blocksize(dev,BLOCK_SIZE);
 	sb->sv_block_base = 0;
+	sb->sv_fmap = NULL;	/* read-only, or until sysv_init_fmap() */
 
 	/* Try to read Xenix superblock */
 	if ((bh = bread(dev, 1, BLOCK_SIZE)) != NULL) {
@@ -504,6 +507,8 @@ struct super_block *sysv_read_super(struct super_block *sb,void *data,
 		sysv_put_super(sb);
 		return NULL;
 	}
+	if (!(sb->s_flags & MS_RDONLY))
+		sysv_init_fmap(sb);
 	sb->s_dirt = 1;
 	/* brelse(bh);  resp.  brelse(bh1); brelse(bh2);
 	   occurs when the disk is unmounted. */
@@ -514,6 +519,7 @@ struct super_block *sysv_read_super(struct super_block *sb,void *data,
 void sysv_write_super (struct super_block *sb)
 {
 	lock_super(sb);
+	sysv_write_fmap(sb);
 	if (buffer_dirty(sb->sv_bh1) || buffer_dirty(sb->sv_bh2)) {
 		/* If we are going to write out the super block,
 		   then attach current time stamp.
@@ -556,6 +562,7 @@ void sysv_put_super(struct super_block *sb)
 	    mark_buffer_dirty(sb->sv_bh1, 1);
 	}
 #endif
+	sysv_release_fmap(sb);
 	brelse(sb->sv_bh1);
 	if (sb->sv_bh1 != sb->sv_bh2) brelse(sb->sv_bh2);
 	/* switch back to default block size */
@@ -583,6 +590,49 @@ void sysv_statfs(struct super_block *sb, struct statfs *buf, int bufsiz)
 }
 
 
+/* The indirect block which mapped the last block looked up is kept in
+   the inode, with a reference held, so that a sequential walk through
+   the file does not go down the indirection tree for every block.
+   All file blocks mapped by one indirect block have the same
+   (block - 10) / ind_per_block, since the single, double and triple
+   indirect ranges start at multiples of ind_per_block past block 10. */
+
+static inline unsigned long ind_base(struct super_block * sb, unsigned int block)
+{
+	return block - ((block - 10) & sb->sv_ind_per_block_1);
+}
+
+static struct buffer_head * sysv_ind_get(struct inode * inode, unsigned int block)
+{
+	struct buffer_head * bh = inode->u.sysv_i.i_ind_bh;
+
+	if (!bh || block < 10 ||
+	    ind_base(inode->i_sb, block) != inode->u.sysv_i.i_ind_base)
+		return NULL;
+	bh->b_count++;
+	return bh;
+}
+
+static void sysv_ind_set(struct inode * inode, unsigned int block, struct buffer_head * bh)
+{
+	if (!bh)
+		return;
+	sysv_ind_forget(inode);
+	bh->b_count++;
+	inode->u.sysv_i.i_ind_bh = bh;
+	inode->u.sysv_i.i_ind_base = ind_base(inode->i_sb, block);
+}
+
+void sysv_ind_forget(struct inode * inode)
+{
+	struct buffer_head * bh = inode->u.sysv_i.i_ind_bh;
+
+	if (bh) {
+		inode->u.sysv_i.i_ind_bh = NULL;
+		brelse(bh);
+	}
+}
+
 /* bmap support for running executables and shared libraries. */
 
 static inline int inode_bmap(struct super_block * sb, struct inode * inode, int nr)
@@ -618,13 +668,19 @@ int sysv_bmap(struct inode * inode,int block_nr)
 
 	if (block < 10)
 		return inode_bmap(sb,inode,block);
-	block -= 10;
 	convert = sb->sv_convert;
+	if ((bh = sysv_ind_get(inode, block)) != NULL) {
+		if (buffer_uptodate(bh))
+			return block_bmap(sb, bh, (block - 10) & sb->sv_ind_per_block_1, convert);
+		brelse(bh);
+	}
+	block -= 10;
 	if (block < sb->sv_ind_per_block) {
 		i = inode_bmap(sb,inode,10);
 		if (!i)
 			return 0;
 		bh = bread(inode->i_dev,i,sb->sv_block_size);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_bmap(sb, bh, block, convert);
 	}
 	block -= sb->sv_ind_per_block;
@@ -637,6 +693,7 @@ int sysv_bmap(struct inode * inode,int block_nr)
 		if (!i)
 			return 0;
 		bh = bread(inode->i_dev,i,sb->sv_block_size);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_bmap(sb, bh, block & sb->sv_ind_per_block_1, convert);
 	}
 	block -= sb->sv_ind_per_block_2;
@@ -653,6 +710,7 @@ int sysv_bmap(struct inode * inode,int block_nr)
 		if (!i)
 			return 0;
 		bh = bread(inode->i_dev,i,sb->sv_block_size);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_bmap(sb, bh, block & sb->sv_ind_per_block_1, convert);
 	}
 	if ((int)block<0) {
@@ -668,12 +726,43 @@ int sysv_bmap(struct inode * inode,int block_nr)
 
 /* Access selected blocks of regular files (or directories) */
 
+/* goal is the block we would like: the one after the file's previous
+   block. Regular files take it from their preallocation if they can. */
+static int sysv_alloc_block(struct inode * inode, unsigned int goal)
+{
+	struct super_block * sb = inode->i_sb;
+	struct buffer_head * bh;
+	unsigned int result;
+
+	if (inode->u.sysv_i.i_prealloc_count &&
+	    goal == inode->u.sysv_i.i_prealloc_block) {
+		result = inode->u.sysv_i.i_prealloc_block++;
+		inode->u.sysv_i.i_prealloc_count--;
+		if (!(bh = sv_getblk(sb, inode->i_dev, result))) {
+			printk("sysv_alloc_block: getblk() failed\n");
+			return 0;
+		}
+		memset(bh->b_data, 0, sb->sv_block_size);
+		mark_buffer_uptodate(bh, 1);
+		mark_buffer_dirty(bh, 1);
+		brelse(bh);
+		return result;
+	}
+	sysv_discard_prealloc(inode);
+	if (S_ISREG(inode->i_mode))
+		return sysv_new_block(sb, goal,
+				      &inode->u.sysv_i.i_prealloc_count,
+				      &inode->u.sysv_i.i_prealloc_block);
+	return sysv_new_block(sb, goal, NULL, NULL);
+}
+
 static struct buffer_head * inode_getblk(struct inode * inode, int nr, int create)
 {
 	struct super_block *sb;
-	unsigned long tmp;
+	unsigned long tmp, goal;
 	unsigned long *p;
 	struct buffer_head * result;
+	int i;
 
 	sb = inode->i_sb;
 	p = inode->u.sysv_i.i_data + nr;
@@ -688,7 +777,13 @@ repeat:
 	}
 	if (!create)
 		return NULL;
-	tmp = sysv_new_block(sb);
+	goal = 0;
+	for (i = nr - 1; i >= 0; i--)
+		if (inode->u.sysv_i.i_data[i]) {
+			goal = inode->u.sysv_i.i_data[i] + 1;
+			break;
+		}
+	tmp = sysv_alloc_block(inode, goal);
 	if (!tmp)
 		return NULL;
 	result = sv_getblk(sb, inode->i_dev, tmp);
@@ -707,9 +802,10 @@ static struct buffer_head * block_getblk(struct inode * inode,
 	struct buffer_head * bh, int nr, int create)
 {
 	struct super_block *sb;
-	unsigned long tmp, block;
+	unsigned long tmp, block, goal;
 	sysv_zone_t *p;
 	struct buffer_head * result;
+	int i;
 
 	if (!bh)
 		return NULL;
@@ -740,7 +836,14 @@ repeat:
 		brelse(bh);
 		return NULL;
 	}
-	block = sysv_new_block(sb);
+	/* after the previous block mapped here, else after this block */
+	goal = bh->b_blocknr - sb->sv_block_base + 1;
+	for (i = nr - 1; i >= 0; i--)
+		if ((tmp = ((sysv_zone_t *) bh->b_data)[i]) != 0) {
+			goal = (sb->sv_convert ? from_coh_ulong(tmp) : tmp) + 1;
+			break;
+		}
+	block = sysv_alloc_block(inode, goal);
 	if (!block) {
 		brelse(bh);
 		return NULL;
@@ -761,18 +864,23 @@ struct buffer_head * sysv_getblk(struct inode * inode, unsigned int block, int c
 {
 	struct super_block * sb = inode->i_sb;
 	struct buffer_head * bh;
+	unsigned int block_nr = block;
 
 	if (block < 10)
 		return inode_getblk(inode,block,create);
+	if ((bh = sysv_ind_get(inode, block)) != NULL)
+		return block_getblk(inode, bh, (block - 10) & sb->sv_ind_per_block_1, create);
 	block -= 10;
 	if (block < sb->sv_ind_per_block) {
 		bh = inode_getblk(inode,10,create);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_getblk(inode, bh, block, create);
 	}
 	block -= sb->sv_ind_per_block;
 	if (block < sb->sv_ind_per_block_2) {
 		bh = inode_getblk(inode,11,create);
 		bh = block_getblk(inode, bh, block >> sb->sv_ind_per_block_bits, create);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_getblk(inode, bh, block & sb->sv_ind_per_block_1, create);
 	}
 	block -= sb->sv_ind_per_block_2;
@@ -780,6 +888,7 @@ struct buffer_head * sysv_getblk(struct inode * inode, unsigned int block, int c
 		bh = inode_getblk(inode,12,create);
 		bh = block_getblk(inode, bh, block >> sb->sv_ind_per_block_2_bits, create);
 		bh = block_getblk(inode, bh, (block >> sb->sv_ind_per_block_bits) & sb->sv_ind_per_block_1, create);
+		sysv_ind_set(inode, block_nr, bh);
 		return block_getblk(inode, bh, block & sb->sv_ind_per_block_1, create);
 	}
 	if ((int)block<0) {
@@ -280,10 +280,15 @@ void sysv_truncate(struct inode * inode)
 		printk("sysv_truncate: truncating symbolic link\n");
 	else if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	sysv_ind_forget(inode);
+	sysv_discard_prealloc(inode);
 	while (trunc_all(inode)) {
 		current->counter = 0;
 		schedule();
 	}
+	/* a reader may have cached an indirect block we have just freed
+	   while trunc_all() slept */
+	sysv_ind_forget(inode);
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
 	inode->i_dirt = 1;
 }
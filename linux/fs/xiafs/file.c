@@ -25,6 +25,8 @@
 #include "xiafs_mac.h"
 
 #define	NBUF	32
+#define	NRUN	8	/* runs mapped by one xiafs_bmap_runs() */
+#define	NREADA	16	/* read-ahead for a file contiguous on disk */
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -62,7 +64,7 @@ struct inode_operations xiafs_file_inode_operations = {
     NULL,			/* rename */
     NULL,			/* readlink */
     NULL,			/* follow_link */
-    generic_readpage,		/* readpage */
+    xiafs_readpage,		/* readpage */
     NULL,			/* writepage */
     xiafs_bmap,			/* bmap */
     xiafs_truncate,		/* truncate */
@@ -75,9 +77,11 @@ xiafs_file_read(struct inode * inode, struct file * filp, char * buf, int count)
     int read, left, chars;
     int zone_nr, zones, f_zones, offset;
     int bhrequest, uptodate;
+    int reada, run, nrun, roff, phys, prev;
     struct buffer_head ** bhb, ** bhe;
     struct buffer_head * bhreq[NBUF];
     struct buffer_head * buflist[NBUF];
+    struct bmap_run runs[NRUN];
 
     if (!inode) {
         printk("XIA-FS: inode = NULL (%s %d)\n", WHERE_ERR);
@@ -99,12 +103,19 @@ xiafs_file_read(struct inode * inode, struct file * filp, char * buf, int count)
     f_zones =(inode->i_size+XIAFS_ZSIZE(inode->i_sb)-1)>>XIAFS_ZSIZE_BITS(inode->i_sb);
     zones = (left+offset+XIAFS_ZSIZE(inode->i_sb)-1) >> XIAFS_ZSIZE_BITS(inode->i_sb);
     bhb = bhe = buflist;
+    /* Zones past reada are read ahead only as long as the file stays
+       contiguous on disk: a whole run then goes out as one request,
+       and scattered zones are not read in on speculation. */
+    reada = zone_nr + zones;
     if (filp->f_reada) {
         if(zones < read_ahead[MAJOR(inode->i_dev)] >> (1+XIAFS_ZSHIFT(inode->i_sb)))
 	  zones = read_ahead[MAJOR(inode->i_dev)] >> (1+XIAFS_ZSHIFT(inode->i_sb));
+	if (zones < NREADA)
+	    zones = NREADA;
 	if (zone_nr + zones > f_zones)
 	    zones = f_zones - zone_nr;
     }
+    run = nrun = roff = prev = 0;
 
     /* We do this in a two stage process.  We first try to request
        as many blocks as we can, then we wait for the first one to
@@ -120,7 +131,27 @@ xiafs_file_read(struct inode * inode, struct file * filp, char * buf, int count)
         bhrequest = 0;
 	uptodate = 1;
 	while (zones--) {
-	    *bhb = xiafs_getblk(inode, zone_nr++, 0);
+	    /* map the rest of the range in one walk of the zone tree */
+	    if (run == nrun) {
+	        nrun = xiafs_bmap_runs(inode, zone_nr, zones + 1, runs, NRUN);
+		run = roff = 0;
+	    }
+	    phys = 0;
+	    if (run < nrun) {
+	        if (runs[run].br_block)
+		    phys = runs[run].br_block + roff;
+		if (++roff == runs[run].br_count) {
+		    run++;
+		    roff = 0;
+		}
+	    }
+	    if (zone_nr >= reada && phys != prev + 1) {
+	        zones = 0;
+		break;
+	    }
+	    prev = phys;
+	    zone_nr++;
+	    *bhb = phys ? getblk(inode->i_dev, phys, XIAFS_ZSIZE(inode->i_sb)) : NULL;
 	    if (*bhb && !buffer_uptodate(*bhb)) {
 	        uptodate = 0;
 		bhreq[bhrequest++] = *bhb;
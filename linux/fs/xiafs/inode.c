@@ -228,6 +228,44 @@ int xiafs_bmap(struct inode * inode,int zone)
     return i;
 }
 
+/*
+ * The zone pointers in the inode, 8 direct ones, the single and the
+ * double indirect one, as a tree and its roots for bmap_runs().
+ */
+static inline void xiafs_tree(struct inode * inode, struct bmap_tree * t,
+			      unsigned long * roots)
+{
+    struct super_block * sb = inode->i_sb;
+
+    roots[0] = inode->u.xiafs_i.i_ind_zone;
+    roots[1] = inode->u.xiafs_i.i_dind_zone;
+    t->bt_direct = 8;
+    t->bt_depth = 2;
+    t->bt_bits = XIAFS_ADDRS_PER_Z_BITS(sb);
+    t->bt_ptrsize = sizeof(u_long);
+    t->bt_size = XIAFS_ZSIZE(sb);
+}
+
+int xiafs_bmap_runs(struct inode * inode, int zone, int count,
+		    struct bmap_run * run, int nrun)
+{
+    struct bmap_tree t;
+    unsigned long roots[2];
+
+    xiafs_tree(inode, &t, roots);
+    return bmap_runs(inode, &t, inode->u.xiafs_i.i_zone, roots, zone, count,
+		     run, nrun);
+}
+
+int xiafs_readpage(struct inode * inode, struct page * page)
+{
+    struct bmap_tree t;
+    unsigned long roots[2];
+
+    xiafs_tree(inode, &t, roots);
+    return bmap_readpage(inode, page, &t, inode->u.xiafs_i.i_zone, roots);
+}
+
 static u_long get_prev_addr(struct inode * inode, int zone)
 {
     u_long tmp;
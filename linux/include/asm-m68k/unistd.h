@@ -169,6 +169,7 @@
 #define __NR_sched_rr_get_interval	161
 #define __NR_nanosleep		162
 #define __NR_mremap		163
+#define __NR_sendfile		164
 
 /* user-visible error numbers are in the range -1 - -122: see
    <asm-m68k/errno.h> */
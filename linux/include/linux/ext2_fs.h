@@ -298,6 +298,7 @@ struct ext2_inode {
 #define EXT2_MOUNT_ERRORS_PANIC		0x0040	/* Panic on errors */
 #define EXT2_MOUNT_MINIX_DF		0x0080	/* Mimics the Minix statfs */
 #define EXT2_MOUNT_NO_ATIME		0x0100  /* Don't update the atime */
+#define EXT2_MOUNT_DIR_INDEX		0x0200	/* Hash index of large directories */
 
 #define clear_opt(o, opt)		o &= ~EXT2_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT2_MOUNT_##opt
@@ -446,6 +447,8 @@ extern void ext2_free_blocks (const struct inode *, unsigned long,
 			      unsigned long);
 extern unsigned long ext2_count_free_blocks (struct super_block *);
 extern void ext2_check_blocks_bitmap (struct super_block *);
+extern int ext2_setup_block_bitmaps (struct super_block *, unsigned long);
+extern void ext2_release_block_bitmaps (struct super_block *);
 
 /* bitmap.c */
 extern unsigned long ext2_count_free (struct buffer_head *, unsigned);
@@ -455,6 +458,17 @@ extern int ext2_check_dir_entry (const char *, struct inode *,
 				 struct ext2_dir_entry *, struct buffer_head *,
 				 unsigned long, int);
 
+/* dirindex.c */
+extern int ext2_dindex_lookup (struct inode *, const char *, int,
+			       struct buffer_head **, struct ext2_dir_entry **);
+extern long ext2_dindex_space (struct inode *, int);
+extern void ext2_dindex_add (struct inode *, struct ext2_dir_entry *,
+			     struct buffer_head *, unsigned long);
+extern void ext2_dindex_remove (struct inode *, struct ext2_dir_entry *,
+				struct buffer_head *);
+extern void ext2_dindex_drop (struct inode *);
+extern void ext2_dindex_release (struct super_block *);
+
 /* file.c */
 extern int ext2_read (struct inode *, struct file *, char *, int);
 extern int ext2_write (struct inode *, struct file *, char *, int);
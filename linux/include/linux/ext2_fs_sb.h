@@ -25,6 +25,11 @@
 /* #define EXT2_MAX_GROUP_DESC	8 */
 
 #define EXT2_MAX_GROUP_LOADED	8
+#define EXT2_MAX_BITMAPS_LOADED	1024	/* limit of the block bitmap cache */
+#define EXT2_MAX_DIR_INDEXES	16	/* directories indexed at once */
+#define EXT2_DIR_INDEX_BLOCKS	4	/* smallest directory worth indexing */
+
+struct ext2_dir_index;
 
 /*
  * second extended-fs super-block data in memory
@@ -47,8 +52,12 @@ struct ext2_sb_info {
 	unsigned short s_loaded_block_bitmaps;
 	unsigned long s_inode_bitmap_number[EXT2_MAX_GROUP_LOADED];
 	struct buffer_head * s_inode_bitmap[EXT2_MAX_GROUP_LOADED];
-	unsigned long s_block_bitmap_number[EXT2_MAX_GROUP_LOADED];
-	struct buffer_head * s_block_bitmap[EXT2_MAX_GROUP_LOADED];
+	unsigned long * s_block_bitmap_number;
+	struct buffer_head ** s_block_bitmap;
+	unsigned long s_block_bitmap_slots;	/* size of the block bitmap cache */
+	unsigned long * s_max_free_run;	/* per group, bound on longest free run */
+	struct ext2_dir_index * s_dir_index;	/* see dirindex.c */
+	int s_dir_indexes;
 	int s_rename_lock;
 	struct wait_queue * s_rename_wait;
 	unsigned long  s_mount_opt;
@@ -191,6 +191,9 @@ struct buffer_head {
 	struct buffer_head * b_prev;		/* doubly linked list of hash-queue */
 	struct buffer_head * b_prev_free;	/* doubly linked list of buffers */
 	struct buffer_head * b_reqnext;		/* request queue */
+	struct inode * b_inode;			/* whose dirty list we are on */
+	struct buffer_head * b_inode_next;	/* circular list of the */
+	struct buffer_head * b_inode_prev;	/* inode's dirty buffers */
 
 /*
  * Some MD stuff like RAID5 needs special event handlers and
@@ -309,6 +312,7 @@ struct inode {
 	struct file_lock *i_flock;
 	struct vm_area_struct *i_mmap;
 	struct page *i_pages;
+	struct buffer_head *i_dirty_buffers;
 	struct dquot *i_dquot[MAXQUOTAS];
 	struct inode *i_next, *i_prev;
 	struct inode *i_hash_next, *i_hash_prev;
@@ -498,6 +502,8 @@ struct file_operations {
 	int (*fasync) (struct inode *, struct file *, int);
 	int (*check_media_change) (kdev_t dev);
 	int (*revalidate) (kdev_t dev);
+	int (*flush) (struct inode *, struct file *);
+	int (*prepare_read) (struct inode *, struct file *, unsigned long, int);
 };
 
 struct inode_operations {
@@ -627,6 +633,19 @@ extern inline void mark_buffer_dirty(struct buffer_head * bh, int flag)
 	}
 }
 
+/*
+ * Mark a buffer dirty and put it on the dirty list of the inode it
+ * belongs to, for fsync_inode_buffers().
+ */
+extern void buffer_insert_inode(struct buffer_head *, struct inode *);
+extern inline void mark_buffer_dirty_inode(struct buffer_head * bh, int flag,
+					   struct inode * inode)
+{
+	mark_buffer_dirty(bh, flag);
+	if (bh->b_inode != inode)
+		buffer_insert_inode(bh, inode);
+}
+
 extern int check_disk_change(kdev_t dev);
 extern void invalidate_inodes(kdev_t dev);
 extern void invalidate_inode_pages(struct inode *);
@@ -686,6 +705,30 @@ extern int generic_file_read(struct inode *, struct file *, char *, int);
 extern int generic_file_mmap(struct inode *, struct file *, struct vm_area_struct *);
 extern int brw_page(int, struct page *, kdev_t, int [], int, int);
 
+/*
+ * The shape of a minix-style block pointer tree, for bmap_runs().
+ */
+#define BMAP_MAX_DEPTH	3
+
+struct bmap_tree {
+	int bt_direct;		/* direct pointers in the inode */
+	int bt_depth;		/* indirect trees, single up to triple */
+	int bt_bits;		/* log2 of the pointers in an indirect block */
+	int bt_ptrsize;		/* 2 or 4 bytes */
+	int bt_size;		/* of an indirect block */
+};
+
+struct bmap_run {
+	int br_block;		/* first device block, 0 for a hole */
+	int br_count;
+};
+
+extern int bmap_runs(struct inode *, const struct bmap_tree *, const void *,
+		     const unsigned long *, int, int, struct bmap_run *, int);
+extern int bmap_readpage(struct inode *, struct page *,
+			 const struct bmap_tree *, const void *,
+			 const unsigned long *);
+
 extern void put_super(kdev_t dev);
 unsigned long generate_cluster(kdev_t dev, int b[], int size);
 unsigned long generate_cluster_swab(kdev_t dev, int b[], int size);
@@ -708,6 +751,9 @@ extern int block_write(struct inode *, struct file *, const char *, int);
 
 extern int block_fsync(struct inode *, struct file *);
 extern int file_fsync(struct inode *, struct file *);
+extern int fsync_inode_buffers(struct inode *);
+extern void forget_inode_buffers(struct inode *);
+extern int inode_has_dirty_buffers(struct inode *);
 
 extern void dcache_add(struct inode *, const char *, int, unsigned long);
 extern int dcache_lookup(struct inode *, const char *, int, unsigned long *);
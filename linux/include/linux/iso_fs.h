@@ -209,6 +209,13 @@ extern void isofs_statfs(struct super_block *, struct statfs *, int);
 extern int isofs_lseek(struct inode *, struct file *, off_t, int);
 extern int isofs_read(struct inode *, struct file *, char *, int);
 extern int isofs_lookup_grandparent(struct inode *, int);
+extern int isofs_entry_name(struct inode *, struct iso_directory_record *,
+			    char *, char **, int *);
+
+extern int isofs_dircache_find(struct inode *, const char *, int,
+			       unsigned long *);
+extern char * isofs_get_symlink(struct inode *);
+extern void isofs_cache_release(struct super_block *);
 
 extern struct inode_operations isofs_file_inode_operations;
 extern struct inode_operations isofs_dir_inode_operations;
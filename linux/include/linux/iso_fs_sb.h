@@ -1,6 +1,11 @@
 #ifndef _ISOFS_FS_SB
 #define _ISOFS_FS_SB
 
+#define ISOFS_MAX_DIR_CACHES	8	/* directories with a name cache */
+#define ISOFS_DIR_CACHE_MAXSIZE	(256*1024)	/* larger ones get none */
+#define ISOFS_MAX_LINK_CACHES	32	/* symbolic link targets kept */
+#define ISOFS_DIR_RA_BLOCKS	8	/* directory blocks read at once */
+
 /*
  * iso9660 super-block data in memory
  */
@@ -28,6 +33,10 @@ struct isofs_sb_info {
 	gid_t s_gid;
 	uid_t s_uid;
 	struct nls_table *s_nls_iocharset; /* Native language support table */
+	struct isofs_dir_cache *s_dir_cache; /* see cache.c */
+	int s_dir_caches;
+	struct isofs_link_cache *s_link_cache;
+	int s_link_caches;
 };
 
 #endif
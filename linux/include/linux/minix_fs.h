@@ -109,6 +109,7 @@ extern void minix_free_block(struct super_block * sb, int block);
 extern unsigned long minix_count_free_blocks(struct super_block *sb);
 
 extern int minix_bmap(struct inode *,int);
+extern int minix_readpage(struct inode *, struct page *);
 
 extern struct buffer_head * minix_getblk(struct inode *, int, int);
 extern struct buffer_head * minix_bread(struct inode *, int, int);
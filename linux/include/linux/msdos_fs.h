@@ -20,7 +20,8 @@
 
 #define MSDOS_SUPER_MAGIC 0x4d44 /* MD */
 
-#define FAT_CACHE    8 /* FAT cache size */
+#define FAT_EXT_MIN  16  /* initial per-inode cluster extent cache size */
+#define FAT_EXT_MAX  256 /* limit of the per-inode cluster extent cache */
 
 #define MSDOS_MAX_EXTRA	3 /* tolerate up to that number of clusters which are
 			     inaccessible because the FAT is too short */
@@ -195,12 +196,17 @@ struct slot_info {
 typedef int (*fat_filldir_t)(filldir_t filldir, void *, const char *,
 			     int, int, off_t, off_t, int, ino_t);
 
-struct fat_cache {
-	kdev_t device; /* device number. 0 means unused. */
-	int ino; /* inode number. */
-	int file_cluster; /* cluster number in the file. */
-	int disk_cluster; /* cluster number on disk. */
-	struct fat_cache *next; /* next cache entry */
+struct fat_extent {
+	int file_cluster; /* first cluster number in the file. */
+	int disk_cluster; /* first cluster number on disk. */
+	int len; /* number of consecutive clusters. */
+};
+
+struct fat_extent_cache {
+	int count; /* extents in use, sorted by file_cluster */
+	int size; /* extents allocated */
+	int hint; /* last extent hit */
+	struct fat_extent ext[0];
 };
 
 /* misc.c */
@@ -226,8 +232,7 @@ extern int fat_access(struct super_block *sb,int nr,int new_value);
 extern int fat_smap(struct inode *inode,int sector);
 extern int fat_free(struct inode *inode,int skip);
 void fat_cache_inval_inode(struct inode *inode);
-void fat_cache_inval_dev(kdev_t device);
-extern void cache_init(void);
+void fat_cache_free_inode(struct inode *inode);
 void cache_lookup(struct inode *inode,int cluster,int *f_clu,int *d_clu);
 void cache_add(struct inode *inode,int f_clu,int d_clu);
 int get_cluster(struct inode *inode,int cluster);
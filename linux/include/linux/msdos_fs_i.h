@@ -39,6 +39,7 @@ struct msdos_inode_info {
 	struct inode *i_oldlink;/* pointer to open inode that references
 				   the same file */
 	int i_binary;	/* file contains non-text data */
+	struct fat_extent_cache *i_ext;	/* cluster runs, NULL until needed */
 };
 
 #endif
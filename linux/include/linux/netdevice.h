@@ -86,6 +86,17 @@ struct hh_cache
 	char		hh_data[16];    /* cached hardware header */
 };
 
+/*
+ *	Receive queue statistics, shown in /proc/net/dev_rx.
+ */
+
+struct net_rx_stats
+{
+  unsigned long		queued;		/* frames accepted by netif_rx	*/
+  unsigned long		dropped;	/* dropped, queue was full	*/
+  unsigned long		max_depth;	/* deepest the queue has been	*/
+};
+
 /*
  * The DEVICE structure.
  * Actually, this whole structure is a big mistake.  It mixes I/O
@@ -200,6 +211,13 @@ struct device
   int			  (*change_mtu)(struct device *dev, int new_mtu);
 
   struct iw_statistics*	  (*get_wireless_stats)(struct device *dev);
+
+  /* Received frames waiting for net_bh(), see netif_rx(). */
+  struct sk_buff_head	  rx_queue;
+  struct device		  *rx_next;	/* next device with frames queued */
+  int			  rx_scheduled;	/* on the receive poll list	*/
+  int			  rx_dropping;	/* queue overran, dropping	*/
+  struct net_rx_stats	  rx_stats;
 };
 
 
@@ -247,6 +265,7 @@ extern void		netif_rx(struct sk_buff *skb);
 extern void		net_bh(void);
 extern void		dev_tint(struct device *dev);
 extern int		dev_get_info(char *buffer, char **start, off_t offset, int length, int dummy);
+extern int		dev_get_rx_info(char *buffer, char **start, off_t offset, int length, int dummy);
 extern int		dev_ioctl(unsigned int cmd, void *);
 
 extern void		dev_init(void);
@@ -255,6 +274,11 @@ extern void		dev_init(void);
 
 extern int		dev_lockct;
 
+/* Receive queue tunables, /proc/sys/net/core */
+extern int		netdev_max_backlog;
+extern int		netdev_rx_budget;
+extern int		netdev_rx_weight;
+
 /*
  *	These two don't currently need to be interrupt-safe
  *	but they may do soon. Do it properly anyway.
@@ -22,9 +22,38 @@
 
 #define NFS_READDIR_CACHE_SIZE		64
 
+/*
+ * Chunks of NFS_READDIR_CACHE_SIZE entries kept from earlier READDIR
+ * calls, of any directories. Each is valid as long as the mtime of its
+ * directory is unchanged.
+ */
+
+#define NFS_READDIR_CACHES		8
+
 #define NFS_MAX_FILE_IO_BUFFER_SIZE	16384
 #define NFS_DEF_FILE_IO_BUFFER_SIZE	1024
 
+/*
+ * The number of WRITE calls one file may have in flight at a time.
+ * They are carried by the nfsiod daemons, so more than there are of
+ * those would not help.
+ */
+
+#define NFS_MAX_WRITEBACK		4
+
+/*
+ * Read-ahead window of a sequentially read file, in pages (= READ
+ * calls, as read-ahead needs rsize >= PAGE_SIZE). The window moves
+ * between NFS_MIN_READAHEAD and nfs_readahead_max, which can be set
+ * in /proc/sys/fs/nfs up to NFS_MAX_READAHEAD. Reads ahead and
+ * write-behind share the NFS_NFSIODS daemons.
+ */
+
+#define NFS_MIN_READAHEAD		2
+#define NFS_DEF_READAHEAD		6
+#define NFS_MAX_READAHEAD		16
+#define NFS_NFSIODS			8
+
 /*
  * The upper limit on timeouts for the exponential backoff algorithm.
  */
@@ -32,12 +61,14 @@
 #define NFS_MAX_RPC_TIMEOUT		(6*HZ)
 
 /*
- * Size of the lookup cache in units of number of entries cached.
- * It is better not to make this too large although the optimum
- * depends on a usage and environment.
+ * Size of the lookup cache in units of number of entries cached, and
+ * the longest name it caches. Entries are hashed, so the size costs
+ * memory only.
  */
 
-#define NFS_LOOKUP_CACHE_SIZE		64
+#define NFS_LOOKUP_CACHE_SIZE		256
+#define NFS_LOOKUP_HASH_SIZE		64
+#define NFS_LOOKUP_NAMELEN		39
 
 #define NFS_SUPER_MAGIC			0x6969
 
@@ -47,6 +78,16 @@
 #define NFS_READTIME(inode)		((inode)->u.nfs_i.read_cache_jiffies)
 #define NFS_OLDMTIME(inode)		((inode)->u.nfs_i.read_cache_mtime)
 #define NFS_ATTRTIMEO(inode)		((inode)->u.nfs_i.attrtimeo)
+#define NFS_WBGATHER(inode)		((inode)->u.nfs_i.wb_gather)
+#define NFS_WBLIST(inode)		((inode)->u.nfs_i.wb_list)
+#define NFS_WBPENDING(inode)		((inode)->u.nfs_i.wb_pending)
+#define NFS_WBERROR(inode)		((inode)->u.nfs_i.wb_error)
+#define NFS_WBWAIT(inode)		((inode)->u.nfs_i.wb_wait)
+#define NFS_WRITEBACK(inode)		(NFS_WBGATHER(inode) || NFS_WBPENDING(inode))
+#define NFS_RANEXT(inode)		((inode)->u.nfs_i.ra_next)
+#define NFS_RAEND(inode)		((inode)->u.nfs_i.ra_end)
+#define NFS_RAWINDOW(inode)		((inode)->u.nfs_i.ra_window)
+#define NFS_RALAST(inode)		((inode)->u.nfs_i.ra_last)
 #define NFS_MINATTRTIMEO(inode)		(S_ISREG((inode)->i_mode)?	\
 						NFS_SERVER(inode)->acregmin : \
 						NFS_SERVER(inode)->acdirmin)
@@ -102,6 +143,11 @@ extern int nfs_proc_read_request(struct rpc_ioreq *, struct nfs_server *,
 				 struct nfs_fh *, unsigned long offset,
 				 unsigned long count, __u32 *buf);
 extern int nfs_proc_read_reply(struct rpc_ioreq *, struct nfs_fattr *);
+extern int nfs_proc_write_request(struct rpc_ioreq *, struct nfs_server *,
+				  struct nfs_fh *, unsigned long offset,
+				  unsigned long count, const char *data,
+				  int ruid);
+extern int nfs_proc_write_reply(struct rpc_ioreq *, struct nfs_fattr *);
 extern int *rpc_header(int *p, int procedure, int program, int version,
 				int uid, int gid, int *groups);
 extern int *rpc_verify(int *p);
@@ -112,6 +158,7 @@ extern int nfs_rpc_call(struct nfs_server *server, int *start,
 				int *end, int size);
 extern int nfs_rpc_doio(struct nfs_server *server, struct rpc_ioreq *,
 				int async);
+extern int nfs_rpc_timer(__u32 *);
 
 /* linux/fs/nfs/inode.c */
 
@@ -131,6 +178,7 @@ extern struct inode_operations nfs_file_inode_operations;
 extern struct inode_operations nfs_dir_inode_operations;
 extern void nfs_sillyrename_cleanup(struct inode *);
 extern void nfs_kfree_cache(void);
+extern void nfs_dircache_flush(kdev_t);
 
 /* linux/fs/nfs/symlink.c */
 
@@ -143,6 +191,20 @@ extern int nfs_mmap(struct inode * inode, struct file * file, struct vm_area_str
 /* linux/fs/nfs/bio.c */
 
 extern int nfs_readpage(struct inode *, struct page *);
+extern void nfs_readahead(struct inode *, unsigned long, int);
+
+/* linux/fs/nfs/write.c */
+
+extern int nfs_writeback(struct inode *, unsigned long, const char *, int);
+extern void nfs_flush_writes(struct inode *);
+extern int nfs_write_error(struct inode *);
+
+/* linux/fs/nfs/stats.c */
+
+extern int nfs_readahead_max;
+extern void nfs_read_account(struct nfs_server *, int);
+extern void nfs_stats_init(void);
+extern void nfs_stats_cleanup(void);
 
 /* NFS root */
 
@@ -4,6 +4,8 @@
 #include <linux/nfs.h>
 #include <linux/pipe_fs_i.h>
 
+struct nfs_wreq;
+
 /*
  * nfs fs inode data in memory
  */
@@ -32,6 +34,24 @@ struct nfs_inode_info {
 	 * attrtimeo defines for how long the cached attributes are valid
 	 */
 	unsigned long attrtimeo;
+	/*
+	 * Write-behind (see write.c): the request being filled, the
+	 * WRITE calls in flight and the first error none has reported yet.
+	 */
+	struct nfs_wreq *wb_gather;
+	struct nfs_wreq *wb_list;
+	int wb_pending;
+	int wb_error;
+	struct wait_queue *wb_wait;
+	/*
+	 * Read-ahead (see bio.c): where the next sequential read would
+	 * start, how far READs have been issued, the window in pages and
+	 * when the last read came in.
+	 */
+	unsigned long ra_next;
+	unsigned long ra_end;
+	int ra_window;
+	unsigned long ra_last;
 };
 
 #endif
@@ -20,6 +20,27 @@ struct nfs_server {
 	int acdirmin;
 	int acdirmax;
 	char hostname[256];
+	/*
+	 * Read-ahead state and statistics (bio.c, stats.c): READs queued
+	 * to the nfsiods and not yet answered, the smoothed round trip
+	 * time of a READ in jiffies << 3, and what has been read, for
+	 * the rate shown in /proc/nfsstat.
+	 */
+	int rd_inflight;
+	int rd_srtt;
+	unsigned long rd_bytes;
+	unsigned long rd_mark;		/* rd_bytes at rd_stamp */
+	unsigned long rd_stamp;
+	unsigned long rd_rate;		/* bytes/s */
+	/*
+	 * Calls the caches in dir.c and file.c saved, and those they
+	 * had to make.
+	 */
+	unsigned long lookup_hits;
+	unsigned long lookup_calls;
+	unsigned long readdir_hits;
+	unsigned long readdir_calls;
+	unsigned long getattr_saved;
 };
 
 /*
@@ -32,6 +32,7 @@ struct nfsiod_req {
 	struct nfs_server *	rq_server;
 	struct inode *		rq_inode;
 	struct page *		rq_page;
+	struct nfs_wreq *	rq_wreq;
 
 	/* user creds */
 	uid_t			rq_fsuid;
@@ -40,6 +41,7 @@ struct nfsiod_req {
 
 	/* retry handling */
 	int			rq_retries;
+	unsigned long		rq_stamp;	/* jiffies when (re)sent */
 };
 
 struct nfsiod_req *	nfsiod_reserve(struct nfs_server *);
@@ -45,7 +45,8 @@ enum root_directory_inos {
 	PROC_RTC,
 	PROC_LOCKS,
 	PROC_HARDWARE,
-	PROC_ZORRO
+	PROC_ZORRO,
+	PROC_FSYNC
 };
 
 enum pid_directory_inos {
@@ -112,6 +113,8 @@ enum net_directory_inos {
 	PROC_NET_RS_ROUTES,
 	PROC_NET_RS,
 	PROC_NET_Z8530,
+	PROC_NET_DEV_RX,
+	PROC_NET_SKB_POOL,
 	PROC_NET_LAST
 };
 
@@ -22,8 +22,12 @@
  * Note: on machines with low memory we should probably use a smaller
  * MAXREQS value: At 32 outstanding reqs with 8 megs of RAM, fragment
  * reassembly will frequently run out of memory.
+ *
+ * Request slots are allocated as the congestion window opens up, from
+ * RPC_INITREQS to at most RPC_MAXREQS.
  */
-#define RPC_MAXREQS		32
+#define RPC_INITREQS		8
+#define RPC_MAXREQS		64
 #define RPC_CWNDSCALE		256
 #define RPC_MAXCWND		(RPC_MAXREQS * RPC_CWNDSCALE)
 /* #define RPC_INITCWND		(RPC_MAXCWND / 2) */
@@ -35,6 +39,48 @@
  */
 #define RPC_HDRSIZE		(4 * 4)
 
+/*
+ * Round trip timers. The caller puts one of these into rq_timer, and
+ * replies to calls that were not retransmitted update a smoothed RTT
+ * and mean deviation for it, as in TCP (Jacobson/Karels). rpc_rto()
+ * then gives the timeout for the next call of the class. Calls with
+ * RPC_TIMER_NONE (procedures that vary too much in how long the server
+ * takes) always use the timeout they are given.
+ */
+#define RPC_TIMER_NONE		0
+#define RPC_TIMER_SMALL		1	/* quick lookups */
+#define RPC_TIMER_READ		2
+#define RPC_TIMER_WRITE		3
+#define RPC_NTIMERS		4
+
+#define RPC_MINRTO		(HZ/50 ? HZ/50 : 1)
+
+/* TCP record marking */
+#define RPC_LASTFRAG		0x80000000
+
+/*
+ * The reply record a TCP socket is in the middle of receiving. It lives
+ * in the rpc_sock rather than on the receiver's stack, so that the
+ * next receiver can finish a record the last one was interrupted in.
+ */
+#define RPC_REC_MARK		0	/* reading a fragment header */
+#define RPC_REC_XID		1
+#define RPC_REC_DATA		2
+
+struct rpc_wait;
+
+struct rpc_record {
+	int			state;		/* RPC_REC_* */
+	int			pos;		/* bytes of mark or xid read */
+	__u32			mark;
+	__u32			xid;
+	int			frag;		/* bytes left in the fragment */
+	int			last;		/* it is the last one */
+	int			started;	/* the first mark is in */
+	struct rpc_wait *	slot;		/* whose reply, NULL to drop */
+	int			got;		/* bytes stored for the slot */
+};
+
 /*
  * This describes a timeout strategy
  */
@@ -59,6 +105,7 @@ struct rpc_ioreq {
 	struct iovec		rq_rvec[UIO_MAXIOV];
 	unsigned int		rq_rnr;
 	unsigned long		rq_rlen;
+	int			rq_timer;	/* RPC_TIMER_* */
 };
 
 /*
@@ -82,14 +129,17 @@ struct rpc_wait {
 	void *			w_cdata;
 	char			w_queued;
 	char			w_gotit;
+	char			w_resent;	/* no RTT sample then */
 	__u32			w_xid;
+	unsigned long		w_sent;		/* jiffies */
 };
 
 struct rpc_sock {
 	struct file *		file;
 	struct socket *		sock;
 	struct sock *		inet;
-	struct rpc_wait		waiting[RPC_MAXREQS];
+	int			stream;		/* TCP, with record marks */
+	int			nslots;
 	unsigned long		cong;
 	unsigned long		cwnd;
 	struct rpc_wait *	pending;
@@ -97,6 +147,13 @@ struct rpc_sock {
 	struct wait_queue *	backlog;
 	struct wait_queue *	shutwait;
 	int			shutdown;
+	int			sending;	/* TCP: a record is going out */
+	struct wait_queue *	sendwait;
+	struct rpc_record	rec;		/* TCP: reply being received */
+	long			srtt[RPC_NTIMERS];	/* jiffies << 3 */
+	long			rttvar[RPC_NTIMERS];	/* jiffies << 2 */
+	unsigned long		calls;
+	unsigned long		retrans;
 };
 
 #ifdef __KERNEL__
@@ -115,6 +172,7 @@ int			rpc_doio(struct rpc_sock *, struct rpc_ioreq *,
 					 struct rpc_timeout *, int);
 struct rpc_sock	*	rpc_makesock(struct file *);
 int			rpc_closesock(struct rpc_sock *);
+unsigned long		rpc_rto(struct rpc_sock *, int, unsigned long);
 
 #endif /* __KERNEL__*/
 
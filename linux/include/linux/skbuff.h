@@ -95,7 +95,8 @@ struct sk_buff
   			localroute,		/* Local routing asserted for this frame	*/
   			pkt_type,		/* Packet class					*/
   			pkt_bridged,		/* Tracker for bridging 			*/
-  			ip_summed;		/* Driver fed us an IP checksum			*/
+  			ip_summed,		/* Driver fed us an IP checksum			*/
+  			sacked;			/* TCP retransmit queue scoreboard state	*/
 #define PACKET_HOST		0		/* To us					*/
 #define PACKET_BROADCAST	1		/* To all					*/
 #define PACKET_MULTICAST	2		/* To group					*/
@@ -176,6 +177,8 @@ extern int			skb_headroom(struct sk_buff *skb);
 extern int			skb_tailroom(struct sk_buff *skb);
 extern void			skb_reserve(struct sk_buff *skb, int len);
 extern void 			skb_trim(struct sk_buff *skb, int len);
+extern int			skb_pool_depth;
+extern int			skb_pool_get_info(char *buffer, char **start, off_t offset, int length, int dummy);
 
 extern __inline__ int skb_queue_empty(struct sk_buff_head *list)
 {
@@ -37,6 +37,16 @@
 
 #define SMB_SUPER_MAGIC               0x517B
 
+/*
+ * Reads and writes send up to SMB_MAX_PIPE requests before waiting for
+ * a reply, if the server's maxmux allows. Sequential reads go through
+ * the page cache, up to SMB_MAX_READAHEAD pages ahead.
+ */
+#define SMB_MAX_PIPE                  8
+#define SMB_PIPE_BATCH                16   /* pieces per smb_proc_*_pipe */
+#define SMB_MIN_READAHEAD             2
+#define SMB_MAX_READAHEAD             16
+
 
 
 #define SMB_SBP(sb)          ((struct smb_sb_info *)(sb->u.generic_sbp))
@@ -124,6 +134,16 @@ smb_info_ino(struct smb_inode_info *info)
 #endif
 }
 
+/*
+ * One piece of a pipelined read or write, of at most one packet
+ */
+struct smb_io {
+	off_t offset;
+	int count;
+	char *data;
+	int result;		/* bytes transferred, or an error */
+};
+
 /* linux/fs/smbfs/file.c */
 extern struct inode_operations smb_file_inode_operations;
 int smb_make_open(struct inode *i, int right);
@@ -171,6 +191,10 @@ int smb_proc_write(struct smb_server *server, struct smb_dirent *finfo,
 		   off_t offset, int count, const char *data);
 int smb_proc_write_raw(struct smb_server *server, struct smb_dirent *finfo, 
                        off_t offset, long count, const char *data);
+int smb_proc_read_pipe(struct smb_server *server, struct smb_dirent *finfo,
+		       struct smb_io *io, int n, int fs);
+int smb_proc_write_pipe(struct smb_server *server, struct smb_dirent *finfo,
+			struct smb_io *io, int n);
 int smb_proc_create(struct inode *dir, const char *name, int len,
 		    word attr, time_t ctime);
 int smb_proc_mv(struct inode *odir, const char *oname, const int olen,
@@ -198,6 +222,10 @@ int smb_proc_trunc(struct smb_server *server, word fid, dword length);
 int smb_release(struct smb_server *server);
 int smb_connect(struct smb_server *server);
 int smb_request(struct smb_server *server);
+int smb_request_pipe(struct smb_server *server, int n, int depth,
+		     int (*setup) (struct smb_server *, int, void *),
+		     int (*reply) (struct smb_server *, int, void *),
+		     void *arg);
 int smb_request_read_raw(struct smb_server *server,
                          unsigned char *target, int max_len);
 int smb_request_write_raw(struct smb_server *server,
@@ -28,6 +28,8 @@ struct smb_inode_info {
         struct smb_inode_info *dir;
         struct smb_inode_info *next, *prev;
         struct smb_dirent finfo;
+        off_t ra_next;          /* where a sequential read goes on */
+        int ra_window;          /* pages read ahead of it */
 };
 
 #endif
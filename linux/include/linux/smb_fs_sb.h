@@ -42,6 +42,9 @@ struct smb_server {
 	__u32              packet_size;
 	unsigned char *    packet;
 
+	__u32              pipe_size;
+	unsigned char *    pipe_packet; /* requests of smb_request_pipe */
+
         enum smb_conn_state state;
         unsigned long reconnect_time; /* The time of the last attempt */
 
@@ -84,6 +84,10 @@ struct __sysctl_args {
 
 /* /proc/sys/net/core */
 #define NET_CORE_NET_ALIAS_MAX 1
+#define NET_CORE_MAX_BACKLOG	2
+#define NET_CORE_RX_BUDGET	3
+#define NET_CORE_RX_WEIGHT	4
+#define NET_CORE_SKB_POOL_DEPTH	5
 
 /* /proc/sys/net/ethernet */
 
@@ -101,6 +105,9 @@ struct __sysctl_args {
 #define NET_IPV4_ARP_CONFIRM_TIMEOUT	7
 #define NET_IPV4_FORWARD                8
 #define NET_IPV4_DYNADDR		9
+#define NET_IPV4_TCP_ACK_SEGS		10
+#define NET_IPV4_TCP_QUICKACK_SEGS	11
+#define NET_IPV4_TCP_SACK		12
 
 /* /proc/sys/net/ipx */
 
@@ -146,6 +153,10 @@ struct __sysctl_args {
 /* CTL_PROC names: */
 
 /* CTL_FS names: */
+#define FS_NFS		1	/* NFS client */
+
+/* /proc/sys/fs/nfs */
+#define NFS_READAHEAD_MAX	1
 
 /* CTL_DEBUG names: */
 
@@ -395,11 +395,18 @@ extern int sysv_rename(struct inode * old_dir, const char * old_name, int old_le
 extern struct inode * sysv_new_inode(const struct inode * dir);
 extern void sysv_free_inode(struct inode * inode);
 extern unsigned long sysv_count_free_inodes(struct super_block *sb);
-extern int sysv_new_block(struct super_block * sb);
+extern int sysv_new_block(struct super_block * sb, unsigned int goal,
+			  unsigned long * prealloc_count,
+			  unsigned long * prealloc_block);
 extern void sysv_free_block(struct super_block * sb, unsigned int block);
+extern void sysv_discard_prealloc(struct inode * inode);
 extern unsigned long sysv_count_free_blocks(struct super_block *sb);
+extern void sysv_init_fmap(struct super_block *sb);
+extern void sysv_write_fmap(struct super_block *sb);
+extern void sysv_release_fmap(struct super_block *sb);
 
 extern int sysv_bmap(struct inode *,int);
+extern void sysv_ind_forget(struct inode *);
 
 extern struct buffer_head * sysv_getblk(struct inode *, unsigned int, int);
 extern struct buffer_head * sysv_file_bread(struct inode *, int, int);
@@ -10,6 +10,10 @@ struct sysv_inode_info {
 					 * then 1 double indirection block,
 					 * then 1 triple indirection block.
 					 */
+	unsigned long i_prealloc_block;	/* next preallocated zone */
+	unsigned long i_prealloc_count;	/* number of them left */
+	struct buffer_head *i_ind_bh;	/* last indirect block used, held */
+	unsigned long i_ind_base;	/* first file block it maps */
 };
 
 #endif
@@ -65,6 +65,13 @@ struct sysv_sb_info {
 	unsigned long  s_ninodes;	/* total number of inodes */
 	unsigned long  s_ndatazones;	/* total number of data zones */
 	unsigned long  s_nzones;	/* same as s_sbd->s_fsize */
+	/* In-memory free block map, see balloc.c. NULL if not in use. */
+	unsigned char *s_fmap;		/* bit per data zone, set = in use */
+	unsigned short *s_fgroup;	/* free zones per group */
+	unsigned char *s_fdirty;	/* bit per group, chunk must be rewritten */
+	unsigned long  s_fgroups;	/* number of groups */
+	unsigned long  s_frover;	/* zone after the last allocation */
+	char	       s_fmap_dirty;	/* some group is dirty */
 };
 /* The fields s_block_size_ratio, s_ind_per_block_2_1, s_toobig_block are currently unused. */
 
@@ -117,6 +124,12 @@ struct sysv_sb_info {
 #define sv_ninodes				u.sysv_sb.s_ninodes
 #define sv_ndatazones				u.sysv_sb.s_ndatazones
 #define sv_nzones				u.sysv_sb.s_nzones
+#define sv_fmap					u.sysv_sb.s_fmap
+#define sv_fgroup				u.sysv_sb.s_fgroup
+#define sv_fdirty				u.sysv_sb.s_fdirty
+#define sv_fgroups				u.sysv_sb.s_fgroups
+#define sv_frover				u.sysv_sb.s_frover
+#define sv_fmap_dirty				u.sysv_sb.s_fmap_dirty
 
 #endif
 
@@ -56,6 +56,7 @@
 #define IP_MASQ_F_FTP_PASV	    	0x400	/* ftp PASV command just issued */
 #define IP_MASQ_F_NO_REPLY		0x800 	/* no reply yet from outside */
 #define IP_MASQ_F_AFW_PORT	       0x1000
+#define IP_MASQ_F_POOL_PORT	       0x2000	/* mport taken from port pool */
 
 #ifdef __KERNEL__
 
@@ -75,7 +76,8 @@ struct ip_masq_seq {
  */
 struct ip_masq {
         struct ip_masq  *m_link, *s_link; /* hashed link ptrs */
-	struct timer_list timer;	/* Expiration timer */
+	struct ip_masq	*w_next, **w_pprev; /* expire wheel slot links */
+	unsigned long	expires;	/* Expiration time (jiffies) */
 	__u16 		protocol;	/* Which protocol are we talking? */
 	__u16		sport, dport, mport;	/* src, dst & masq ports */
 	__u32 		saddr, daddr, maddr;	/* src, dst & masq addresses */
@@ -95,6 +95,30 @@ struct tcp_mib
  	unsigned long	TcpRetransSegs;
 };
  
+/*
+ *	Not in any MIB: how we acknowledge received data.
+ */
+
+struct tcp_ack_mib
+{
+	unsigned long	TcpAckDataSegsIn;	/* in-order data segments	*/
+	unsigned long	TcpAckOut;		/* pure ACKs sent		*/
+	unsigned long	TcpAckDelayed;		/* from the delayed ACK timer	*/
+	unsigned long	TcpAckQuick;		/* at once, in quick-ACK mode	*/
+	unsigned long	TcpAckPiggybacked;	/* owed ACKs carried on data	*/
+};
+
+struct tcp_sack_mib
+{
+	unsigned long	TcpSackBlocksIn;	/* SACK blocks received		*/
+	unsigned long	TcpSackSegs;		/* segments newly marked SACKed	*/
+	unsigned long	TcpSackSkipped;		/* retransmits avoided		*/
+	unsigned long	TcpSackHoles;		/* holes resent in recovery	*/
+	unsigned long	TcpFastRecovery;	/* fast recovery episodes	*/
+	unsigned long	TcpPartialAcks;		/* NewReno partial ACKs		*/
+	unsigned long	TcpSackRenege;		/* scoreboards discarded on RTO	*/
+};
+
 struct udp_mib
 {
  	unsigned long	UdpInDatagrams;
@@ -229,6 +229,7 @@ struct sock
 	unsigned short		window;
 	__u32                   lastwin_seq;    /* sequence number when we last updated the window we offer */
 	__u32			high_seq;	/* sequence number when we did current fast retransmit */
+	__u32			sack_recent;	/* start of the last out of order segment queued */
 	volatile unsigned long  ato;            /* ack timeout */
 	volatile unsigned long  lrcvtime;       /* jiffies at last data rcv */
 	volatile unsigned long  idletime;       /* jiffies at last rcv */
@@ -264,6 +265,9 @@ struct sock
 	unsigned char		protocol;
 	volatile unsigned char	state;
 	unsigned short		ack_backlog;
+	unsigned short		ack_segs;	/* full sized segments not yet acked */
+	unsigned short		ack_quick;	/* segments left to ack at once */
+	unsigned char		sack_ok;	/* peer agreed to selective acks */
 	unsigned char		priority;
 	unsigned char		debug;
 	int			rcvbuf;
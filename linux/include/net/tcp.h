@@ -120,11 +120,12 @@ static __inline__ void tcp_sk_unbindify(struct sock *sk)
 
 /*
  * 40 is maximal IP options size
- * 4  is TCP option size (MSS)
+ * 8  is TCP option size (MSS, SACK permitted)
+ * 36 is TCP option size of an ACK carrying TCP_MAX_SACKS blocks
  */
-#define MAX_SYN_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + 4 + MAX_HEADER + 15)
+#define MAX_SYN_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + 8 + MAX_HEADER + 15)
 #define MAX_FIN_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + MAX_HEADER + 15)
-#define MAX_ACK_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + MAX_HEADER + 15)
+#define MAX_ACK_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + 36 + MAX_HEADER + 15)
 #define MAX_RESET_SIZE	(sizeof(struct iphdr) + 40 + sizeof(struct tcphdr) + MAX_HEADER + 15)
 
 #define MAX_WINDOW	32767		/* Never offer a window over 32767 without using
@@ -179,6 +180,20 @@ static __inline__ void tcp_sk_unbindify(struct sock *sk)
 #define TCPOPT_NOP		1	/* Padding */
 #define TCPOPT_EOL		0	/* End of options */
 #define TCPOPT_MSS		2	/* Segment size negotiating */
+#define TCPOPT_SACK_PERM	4	/* SACK permitted, SYN only (RFC2018) */
+#define TCPOPT_SACK		5	/* Selective acknowledgement blocks */
+
+#define TCPOLEN_SACK_PERM	2
+#define TCPOLEN_SACK_BASE	2
+#define TCPOLEN_SACK_PERBLOCK	8
+#define TCP_MAX_SACKS		4	/* 2 NOPs + 2 + 4*8 = 36 bytes */
+
+/*
+ *	skb->sacked bits for segments on the retransmit queue
+ */
+
+#define TCPCB_SACKED_ACKED	0x01	/* Peer holds this segment */
+#define TCPCB_SACKED_RETRANS	0x02	/* Resent during this recovery */
 /*
  *	We don't use these yet, but they are for PAWS and big windows
  */
@@ -271,6 +286,15 @@ extern int tcp_chkaddr(struct sk_buff *);
 #define     tcp_reset_msl_timer(x,y,z)	reset_timer(x,y,z)
 extern void tcp_reset_xmit_timer(struct sock *, int, unsigned long);
 extern void tcp_delack_timer(unsigned long);
+extern void tcp_send_pending_ack(struct sock *sk);
+extern void tcp_ack_data(struct sock *sk, struct sk_buff *skb, struct tcphdr *th);
+
+extern int sysctl_tcp_ack_segs;
+extern int sysctl_tcp_quickack_segs;
+extern struct tcp_ack_mib tcp_ack_statistics;
+extern int sysctl_tcp_sack;
+extern struct tcp_sack_mib tcp_sack_statistics;
+extern void tcp_sack_clear(struct sock *sk, int mask);
 extern void tcp_retransmit_timer(unsigned long);
 
 static __inline__ int tcp_old_window(struct sock * sk)
@@ -26,11 +26,28 @@
 
 #define UDP_HTABLE_SIZE		128
 
+/* This is for connected sockets, with local and remote address and
+ * remote port all set.  They are on both tables.
+ */
+#define UDP_CHTABLE_SIZE	128
+
 /* udp.c: This needs to be shared by v4 and v6 because the lookup
  *        and hashing code needs to work with different AF's yet
  *        the port space is shared.
  */
 extern struct sock *udp_hash[UDP_HTABLE_SIZE];
+extern struct sock *udp_conn_hash[UDP_CHTABLE_SIZE];
+
+/* This is IPv4 specific. */
+static __inline__ int udp_conn_hashfn(__u32 laddr, __u16 lport,
+				      __u32 faddr, __u16 fport)
+{
+	__u32 h = (laddr ^ lport) ^ (faddr ^ fport);
+
+	return (h ^ (h >> 16)) & (UDP_CHTABLE_SIZE - 1);
+}
+
+extern void udp_cache_flush(void);
 
 extern unsigned short udp_good_socknum(void);
 
@@ -180,6 +180,8 @@ struct symbol_table symbol_table = {
 	X(generic_file_read),
 	X(generic_file_mmap),
 	X(generic_readpage),
+	X(bmap_runs),
+	X(bmap_readpage),
 	X(__fput),
 	X(make_bad_inode),
 
@@ -342,6 +344,8 @@ struct symbol_table symbol_table = {
 	X(sys_tz),
 	X(__wait_on_super),
 	X(file_fsync),
+	X(buffer_insert_inode),
+	X(fsync_inode_buffers),
 	X(clear_inode),
 	X(refile_buffer),
 	X(nr_async_pages),
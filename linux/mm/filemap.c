@@ -23,6 +23,7 @@
 #include <linux/locks.h>
 #include <linux/pagemap.h>
 #include <linux/swap.h>
+#include <linux/file.h>
 
 #include <asm/segment.h>
 #include <asm/system.h>
@@ -551,6 +552,22 @@ static inline unsigned long generic_file_readahead(int reada_ok, struct file * f
 }
 
 
+/*
+ * The page cache walk below hands the data to an "actor", which either
+ * copies it to user space (read) or passes it on to another file
+ * (sendfile). The actor returns how much it consumed; a short count
+ * stops the walk, with the reason left in desc->error.
+ */
+
+typedef struct {
+	int written;
+	int count;
+	char * buf;
+	int error;
+} read_descriptor_t;
+
+typedef int (*read_actor_t)(read_descriptor_t *, const char *, unsigned long);
+
 /*
  * This is a generic file read routine, and uses the
  * inode->i_op->readpage() function for the actual low-level
@@ -560,18 +577,18 @@ static inline unsigned long generic_file_readahead(int reada_ok, struct file * f
  * of the logic when it comes to error handling etc.
  */
 
-int generic_file_read(struct inode * inode, struct file * filp, char * buf, int count)
+static void do_generic_file_read(struct inode * inode, struct file * filp,
+	unsigned long * ppos, read_descriptor_t * desc, read_actor_t actor)
 {
-	int error, read;
-	unsigned long pos, ppos, page_cache;
+	int error;
+	unsigned long pos, pgpos, page_cache;
 	int reada_ok;
 
 	error = 0;
-	read = 0;
 	page_cache = 0;
 
-	pos = filp->f_pos;
-	ppos = pos & PAGE_MASK;
+	pos = *ppos;
+	pgpos = pos & PAGE_MASK;
 /*
  * If the current position is outside the previous read-ahead window, 
  * we reset the current read-ahead context and set read ahead max to zero
@@ -579,7 +596,7 @@ int generic_file_read(struct inode * inode, struct file * filp, char * buf, int
  * otherwise, we assume that the file accesses are sequential enough to
  * continue read-ahead.
  */
-	if (ppos > filp->f_raend || ppos + filp->f_rawin < filp->f_raend) {
+	if (pgpos > filp->f_raend || pgpos + filp->f_rawin < filp->f_raend) {
 		reada_ok = 0;
 		filp->f_raend = 0;
 		filp->f_ralen = 0;
@@ -595,12 +612,12 @@ int generic_file_read(struct inode * inode, struct file * filp, char * buf, int
  * Then, at least MIN_READAHEAD if read ahead is ok,
  * and at most MAX_READAHEAD in all cases.
  */
-	if (pos + count <= (PAGE_SIZE >> 1)) {
+	if (pos + desc->count <= (PAGE_SIZE >> 1)) {
 		filp->f_ramax = 0;
 	} else {
 		unsigned long needed;
 
-		needed = ((pos + count) & PAGE_MASK) - ppos;
+		needed = ((pos + desc->count) & PAGE_MASK) - pgpos;
 
 		if (filp->f_ramax < needed)
 			filp->f_ramax = needed;
@@ -646,24 +663,21 @@ found_page:
 success:
 		/*
 		 * Ok, we have the page, it's up-to-date and ok,
-		 * so now we can finally copy it to user space...
+		 * so now we can finally hand it to the actor...
 		 */
 	{
-		unsigned long offset, nr;
+		unsigned long offset, nr, done;
 		offset = pos & ~PAGE_MASK;
 		nr = PAGE_SIZE - offset;
-		if (nr > count)
-			nr = count;
+		if (nr > desc->count)
+			nr = desc->count;
 
 		if (nr > inode->i_size - pos)
 			nr = inode->i_size - pos;
-		memcpy_tofs(buf, (void *) (page_address(page) + offset), nr);
+		done = actor(desc, (const char *) (page_address(page) + offset), nr);
 		release_page(page);
-		buf += nr;
-		pos += nr;
-		read += nr;
-		count -= nr;
-		if (count) {
+		pos += done;
+		if (done == nr && desc->count) {
 			/*
 			 * to prevent hogging the CPU on well-cached systems,
 			 * schedule if needed, it's safe to do it here:
@@ -740,14 +754,147 @@ page_read_error:
 		break;
 	}
 
-	filp->f_pos = pos;
+	*ppos = pos;
 	filp->f_reada = 1;
 	if (page_cache)
 		free_page(page_cache);
 	UPDATE_ATIME(inode)
-	if (!read)
-		read = error;
-	return read;
+	if (error)
+		desc->error = error;
+}
+
+static int file_read_actor(read_descriptor_t * desc, const char *area, unsigned long size)
+{
+	memcpy_tofs(desc->buf, area, size);
+	desc->buf += size;
+	desc->written += size;
+	desc->count -= size;
+	return size;
+}
+
+int generic_file_read(struct inode * inode, struct file * filp, char * buf, int count)
+{
+	read_descriptor_t desc;
+	unsigned long pos = filp->f_pos;
+
+	desc.written = 0;
+	desc.count = count;
+	desc.buf = buf;
+	desc.error = 0;
+	do_generic_file_read(inode, filp, &pos, &desc, file_read_actor);
+	filp->f_pos = pos;
+	if (desc.written)
+		return desc.written;
+	return desc.error;
+}
+
+/*
+ * Write a piece of a cached page to the output file of a sendfile().
+ * For a TCP socket this is the only copy the data sees: tcp_sendmsg()
+ * folds the checksum into the copy from the page into the skb, so
+ * the bytes never pass through a user buffer.
+ */
+
+static int file_send_actor(read_descriptor_t * desc, const char *area, unsigned long size)
+{
+	struct file *file = (struct file *) desc->buf;
+	struct inode *inode = file->f_inode;
+	unsigned long fs;
+	int written;
+
+	fs = get_fs();
+	set_fs(KERNEL_DS);
+	down(&inode->i_sem);
+	written = file->f_op->write(inode, file, area, size);
+	up(&inode->i_sem);
+	set_fs(fs);
+	if (written < 0) {
+		desc->error = written;
+		written = 0;
+	}
+	desc->written += written;
+	desc->count -= written;
+	return written;
+}
+
+/*
+ * Copy count bytes of in_fd, starting at *offset (or the file position
+ * if offset is NULL), to out_fd straight from the page cache.
+ */
+
+asmlinkage int sys_sendfile(int out_fd, int in_fd, off_t *offset, int count)
+{
+	struct file * in_file, * out_file;
+	struct inode * in_inode, * out_inode;
+	read_descriptor_t desc;
+	unsigned long pos;
+	int error;
+
+	error = -EBADF;
+	in_file = fget(in_fd);
+	if (!in_file)
+		goto bad_in;
+	in_inode = in_file->f_inode;
+	if (!in_inode || !(in_file->f_mode & 1))
+		goto out_in;
+	error = -EINVAL;
+	if (!in_inode->i_op || !in_inode->i_op->readpage)
+		goto out_in;
+
+	error = -EBADF;
+	out_file = fget(out_fd);
+	if (!out_file)
+		goto out_in;
+	out_inode = out_file->f_inode;
+	if (!out_inode || !(out_file->f_mode & 2))
+		goto out_out;
+	error = -EINVAL;
+	if (!out_file->f_op || !out_file->f_op->write)
+		goto out_out;
+
+	pos = in_file->f_pos;
+	if (offset) {
+		error = verify_area(VERIFY_WRITE, offset, sizeof(off_t));
+		if (error)
+			goto out_out;
+		pos = get_user(offset);
+	}
+
+	error = 0;
+	if (count <= 0)
+		goto out_out;
+	error = locks_verify_area(FLOCK_VERIFY_READ, in_inode, in_file, pos, count);
+	if (error)
+		goto out_out;
+	error = locks_verify_area(FLOCK_VERIFY_WRITE, out_inode, out_file, out_file->f_pos, count);
+	if (error)
+		goto out_out;
+	/* what the filesystem's read() does before using the page cache */
+	if (in_file->f_op && in_file->f_op->prepare_read) {
+		error = in_file->f_op->prepare_read(in_inode, in_file, pos, count);
+		if (error)
+			goto out_out;
+	}
+
+	desc.written = 0;
+	desc.count = count;
+	desc.buf = (char *) out_file;
+	desc.error = 0;
+	do_generic_file_read(in_inode, in_file, &pos, &desc, file_send_actor);
+
+	error = desc.written;
+	if (!error)
+		error = desc.error;
+	if (offset)
+		put_user(pos, offset);
+	else
+		in_file->f_pos = pos;
+out_out:
+	fput(out_file, out_inode);
+out_in:
+	fput(in_file, in_inode);
+bad_in:
+	return error;
 }
 
 /*
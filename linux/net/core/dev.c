@@ -50,6 +50,8 @@
  *	    Lawrence V. Stefani	:	Changed set MTU ioctl to not assume
  *					min MTU of 68 bytes for devices
  *					that have change MTU functions.
+ *		    		:	Per device receive queues, net_bh budget
+ *					and protocol grouped delivery.
  *
  */
 
@@ -112,17 +114,32 @@ int dev_lockct=0;
 struct notifier_block *netdev_chain=NULL;
 
 /*
- *	Device drivers call our routines to queue packets here. We empty the
- *	queue in the bottom half handler.
+ *	Device drivers call our routines to queue packets on the device's
+ *	rx_queue. Devices with frames waiting are kept on a round robin
+ *	poll list which we empty in the bottom half handler.
  */
 
-static struct sk_buff_head backlog;
+static struct device *rx_poll_head = NULL;
+static struct device *rx_poll_tail = NULL;
 
 /* 
  *	We don't overdo the queue or we will thrash memory badly.
+ *	netdev_rx_budget frames are handled per net_bh run, at most
+ *	netdev_rx_weight of them from one device before moving on.
  */
  
-static int backlog_size = 0;
+int netdev_max_backlog = 300;
+int netdev_rx_budget = 300;
+int netdev_rx_weight = 64;
+
+/*
+ *	Bottom half statistics for /proc/net/dev_rx
+ */
+
+static unsigned long rx_bh_runs = 0;		/* net_bh passes */
+static unsigned long rx_bh_frames = 0;		/* frames handled */
+static unsigned long rx_bh_groups = 0;		/* protocol groups delivered */
+static unsigned long rx_bh_squeezed = 0;	/* ran out of budget */
 
 /*
  *	Return the lesser of the two values. 
@@ -311,6 +328,33 @@ int dev_close(struct device *dev)
 				kfree_skb(skb,FREE_WRITE);
 		ct++;
 	}
+
+	/*
+	 *	And any received ones net_bh has not got to yet.
+	 */
+	if (dev->rx_queue.next != NULL)
+	{
+		struct sk_buff *skb;
+		struct device **dp;
+		unsigned long flags;
+
+		save_flags(flags);
+		cli();
+		while((skb=__skb_dequeue(&dev->rx_queue))!=NULL)
+			kfree_skb(skb,FREE_READ);
+		if (dev->rx_scheduled)
+		{
+			for (dp = &rx_poll_head; *dp != dev; dp = &(*dp)->rx_next)
+				;
+			*dp = dev->rx_next;
+			for (rx_poll_tail = rx_poll_head; rx_poll_tail && rx_poll_tail->rx_next;
+			     rx_poll_tail = rx_poll_tail->rx_next)
+				;
+			dev->rx_next = NULL;
+			dev->rx_scheduled = 0;
+		}
+		restore_flags(flags);
+	}
 	return(0);
 }
 
@@ -487,6 +531,24 @@ void dev_queue_xmit(struct sk_buff *skb, struct device *dev, int pri)
 	end_bh_atomic();
 }
 
+/*
+ *	Put a device on the tail of the receive poll list.
+ *	Must be called with interrupts off.
+ */
+
+static __inline__ void net_rx_schedule(struct device *dev)
+{
+	if (dev->rx_scheduled)
+		return;
+	dev->rx_next = NULL;
+	if (rx_poll_tail)
+		rx_poll_tail->rx_next = dev;
+	else
+		rx_poll_head = dev;
+	rx_poll_tail = dev;
+	dev->rx_scheduled = 1;
+}
+
 /*
  *	Receive a packet from a device driver and queue it for the upper
  *	(protocol) levels.  It always succeeds. This is the recommended 
@@ -495,7 +557,9 @@ void dev_queue_xmit(struct sk_buff *skb, struct device *dev, int pri)
 
 void netif_rx(struct sk_buff *skb)
 {
-	static int dropping = 0;
+	struct device *dev = skb->dev;
+	unsigned long flags;
+	__u32 qlen;
 
 	/*
 	 *	Any received buffers are un-owned and should be discarded
@@ -508,29 +572,47 @@ void netif_rx(struct sk_buff *skb)
 	if(skb->stamp.tv_sec==0)
 		skb->stamp = xtime;
 
+	save_flags(flags);
+	cli();
+
+	/*
+	 *	Devices are not required to set up their receive queue,
+	 *	so do it on the first frame.
+	 */
+
+	if (dev->rx_queue.next == NULL)
+		skb_queue_head_init(&dev->rx_queue);
+
 	/*
 	 *	Check that we aren't overdoing things.
 	 */
 
-	if (!backlog_size)
-  		dropping = 0;
-	else if (backlog_size > 300)
-		dropping = 1;
+	qlen = dev->rx_queue.qlen;
+	if (!qlen)
+  		dev->rx_dropping = 0;
+	else if (qlen > netdev_max_backlog)
+		dev->rx_dropping = 1;
 
-	if (dropping) 
+	if (dev->rx_dropping) 
 	{
+		dev->rx_stats.dropped++;
+		restore_flags(flags);
 		kfree_skb(skb, FREE_READ);
 		return;
 	}
 
 	/*
-	 *	Add it to the "backlog" queue. 
+	 *	Add it to the device's receive queue. 
 	 */
 #if CONFIG_SKB_CHECK
 	IS_SKB(skb);
 #endif	
-	skb_queue_tail(&backlog,skb);
-	backlog_size++;
+	__skb_queue_tail(&dev->rx_queue,skb);
+	dev->rx_stats.queued++;
+	if (++qlen > dev->rx_stats.max_depth)
+		dev->rx_stats.max_depth = qlen;
+	net_rx_schedule(dev);
+	restore_flags(flags);
   
 	/*
 	 *	If any packet arrived, mark it for processing after the
@@ -568,8 +650,145 @@ static void dev_transmit(void)
 ***********************************************************************************/
 
 /*
- *	When we are called the queue is ready to grab, the interrupts are
- *	on and hardware can interrupt and queue to the receive queue as we
+ *	Most frames match only a handful of handlers. If more than this
+ *	match, the group is delivered one frame at a time instead.
+ */
+
+#define NET_RX_MAX_HANDLERS	8
+
+/*
+ *	Deliver a group of frames of one protocol ID that arrived on one
+ *	device. The handler lists are walked once for the whole group:
+ *	the ptype_all list of taps (normally empty) and the main protocol
+ *	list which is hashed perfectly for normal protocols.
+ */
+
+static void net_rx_deliver_group(struct sk_buff_head *group, unsigned short type,
+				 struct device *dev)
+{
+	struct packet_type *handlers[NET_RX_MAX_HANDLERS];
+	struct packet_type *ptype;
+	struct sk_buff *skb;
+	int n = 0, i;
+
+	for (ptype = ptype_all; ptype!=NULL; ptype=ptype->next)
+	{
+		if(!ptype->dev || ptype->dev == dev) {
+			if (n == NET_RX_MAX_HANDLERS)
+				goto slow;
+			handlers[n++] = ptype;
+		}
+	}
+	for (ptype = ptype_base[ntohs(type)&15]; ptype != NULL; ptype = ptype->next) 
+	{
+		if (ptype->type == type && (!ptype->dev || ptype->dev==dev))
+		{
+			if (n == NET_RX_MAX_HANDLERS)
+				goto slow;
+			handlers[n++] = ptype;
+		}
+	}
+
+	rx_bh_groups++;
+	while ((skb = __skb_dequeue(group)) != NULL)
+	{
+		/*
+		 *	Has an unknown packet has been received ?
+		 */
+		if (n == 0)
+		{
+			kfree_skb(skb, FREE_WRITE);
+			continue;
+		}
+
+		/*
+		 *	Every handler but the last gets a clone. Kick the
+		 *	protocol handler. This should be fast and efficient
+		 *	code.
+		 */
+		for (i = 0; i < n - 1; i++)
+		{
+			struct sk_buff *skb2=skb_clone(skb, GFP_ATOMIC);
+			if(skb2)
+				handlers[i]->func(skb2, dev, handlers[i]);
+		}
+		handlers[n-1]->func(skb, dev, handlers[n-1]);
+	}
+	return;
+
+	/*
+	 *	Too many handlers to remember, walk the lists for each frame.
+	 */
+slow:
+	while ((skb = __skb_dequeue(group)) != NULL)
+	{
+		struct packet_type *pt_prev = NULL;
+
+		rx_bh_groups++;
+		for (ptype = ptype_all; ptype!=NULL; ptype=ptype->next)
+		{
+			if(!ptype->dev || ptype->dev == dev) {
+				if(pt_prev) {
+					struct sk_buff *skb2=skb_clone(skb, GFP_ATOMIC);
+					if(skb2)
+						pt_prev->func(skb2, dev, pt_prev);
+				}
+				pt_prev=ptype;
+			}
+		}
+		for (ptype = ptype_base[ntohs(type)&15]; ptype != NULL; ptype = ptype->next) 
+		{
+			if (ptype->type == type && (!ptype->dev || ptype->dev==dev))
+			{
+				if(pt_prev)
+				{
+					struct sk_buff *skb2=skb_clone(skb, GFP_ATOMIC);
+					if(skb2)
+						pt_prev->func(skb2, dev, pt_prev);
+				}
+				pt_prev=ptype;
+			}
+		}
+		if(pt_prev)
+			pt_prev->func(skb, dev, pt_prev);
+		else
+			kfree_skb(skb, FREE_WRITE);
+	}
+}
+
+/*
+ *	Split a batch from one device into groups by protocol ID and
+ *	deliver them. Frames of one protocol stay in arrival order.
+ *	The batch is private to net_bh so needs no locking.
+ */
+
+static void net_rx_deliver(struct sk_buff_head *batch)
+{
+	struct sk_buff_head group;
+	struct sk_buff *skb, *next;
+	unsigned short type;
+
+	skb_queue_head_init(&group);
+	while ((skb = __skb_dequeue(batch)) != NULL)
+	{
+		type = skb->protocol;
+		__skb_queue_tail(&group, skb);
+		for (skb = batch->next; skb != (struct sk_buff *) batch; skb = next)
+		{
+			next = skb->next;
+			if (skb->protocol == type)
+			{
+				__skb_unlink(skb, batch);
+				__skb_queue_tail(&group, skb);
+			}
+		}
+		net_rx_deliver_group(&group, type, group.next->dev);
+	}
+}
+
+/*
+ *	When we are called the queues are ready to grab, the interrupts are
+ *	on and hardware can interrupt and queue to the receive queues as we
  *	run with no problems.
  *	This is run as a bottom half after an interrupt handler that does
  *	mark_bh(NET_BH);
@@ -577,9 +796,11 @@ static void dev_transmit(void)
  
 void net_bh(void)
 {
-	struct packet_type *ptype;
-	struct packet_type *pt_prev;
-	unsigned short type;
+	struct sk_buff_head batch;
+	struct sk_buff *skb;
+	struct device *dev;
+	int budget = netdev_rx_budget;
+	int quota;
 
 	/*
 	 *	Can we send anything now? We want to clear the
@@ -589,137 +810,93 @@ void net_bh(void)
 	 */
 
 	dev_transmit();
-  
-	/*
-	 *	Any data left to process. This may occur because a
-	 *	mark_bh() is done after we empty the queue including
-	 *	that from the device which does a mark_bh() just after
-	 */
+
+	rx_bh_runs++;
+	skb_queue_head_init(&batch);
 
 	/*
-	 *	While the queue is not empty..
-	 *
-	 *	Note that the queue never shrinks due to
-	 *	an interrupt, so we can do this test without
-	 *	disabling interrupts.
+	 *	While some device has frames queued and we have budget left,
+	 *	take up to netdev_rx_weight frames off the device at the head
+	 *	of the poll list and hand them up as one batch.
 	 */
 
-	while (!skb_queue_empty(&backlog)) {
-		struct sk_buff * skb = backlog.next;
-
-		/*
-		 *	We have a packet. Therefore the queue has shrunk
-		 */
+	while (budget > 0) {
 		cli();
-		__skb_unlink(skb, &backlog);
-  		backlog_size--;
+		dev = rx_poll_head;
+		if (dev == NULL) {
+			sti();
+			break;
+		}
+		rx_poll_head = dev->rx_next;
+		if (rx_poll_head == NULL)
+			rx_poll_tail = NULL;
+		dev->rx_next = NULL;
+		dev->rx_scheduled = 0;
 		sti();
-		
+
+		quota = netdev_rx_weight;
+		if (quota > budget)
+			quota = budget;
+
+		while (quota > 0 && (skb = skb_dequeue(&dev->rx_queue)) != NULL) {
+			quota--;
+			budget--;
+			rx_bh_frames++;
 
 #ifdef CONFIG_BRIDGE
 
-		/*
-		 *	If we are bridging then pass the frame up to the
-		 *	bridging code. If it is bridged then move on
-		 */
-		 
-		if (br_stats.flags & BR_UP)
-		{
 			/*
-			 *	We pass the bridge a complete frame. This means
-			 *	recovering the MAC header first.
+			 *	If we are bridging then pass the frame up to the
+			 *	bridging code. If it is bridged then move on
 			 */
 			 
-			int offset=skb->data-skb->mac.raw;
-			cli();
-			skb_push(skb,offset);	/* Put header back on for bridge */
-			if(br_receive_frame(skb))
+			if (br_stats.flags & BR_UP)
 			{
+				/*
+				 *	We pass the bridge a complete frame. This means
+				 *	recovering the MAC header first.
+				 */
+				 
+				int offset=skb->data-skb->mac.raw;
+				cli();
+				skb_push(skb,offset);	/* Put header back on for bridge */
+				if(br_receive_frame(skb))
+				{
+					sti();
+					continue;
+				}
+				/*
+				 *	Pull the MAC header off for the copy going to
+				 *	the upper layers.
+				 */
+				skb_pull(skb,offset);
 				sti();
-				continue;
 			}
-			/*
-			 *	Pull the MAC header off for the copy going to
-			 *	the upper layers.
-			 */
-			skb_pull(skb,offset);
-			sti();
-		}
 #endif
 		
-		/*
-	 	 *	Bump the pointer to the next structure.
-		 * 
-		 *	On entry to the protocol layer. skb->data and
-		 *	skb->h.raw point to the MAC and encapsulated data
-		 */
-
-		skb->h.raw = skb->data;
+			/*
+		 	 *	Bump the pointer to the next structure.
+			 * 
+			 *	On entry to the protocol layer. skb->data and
+			 *	skb->h.raw point to the MAC and encapsulated data
+			 */
 
-		/*
-		 * 	Fetch the packet protocol ID. 
-		 */
-		
-		type = skb->protocol;
+			skb->h.raw = skb->data;
+			__skb_queue_tail(&batch, skb);
+		}
 
 		/*
-		 *	We got a packet ID.  Now loop over the "known protocols"
-		 * 	list. There are two lists. The ptype_all list of taps (normally empty)
-		 *	and the main protocol list which is hashed perfectly for normal protocols.
+		 *	Still more on this device, put it back at the end
+		 *	of the list so the others get their turn.
 		 */
-		
-		pt_prev = NULL;
-		for (ptype = ptype_all; ptype!=NULL; ptype=ptype->next)
-		{
-			if(!ptype->dev || ptype->dev == skb->dev) {
-				if(pt_prev) {
-					struct sk_buff *skb2=skb_clone(skb, GFP_ATOMIC);
-					if(skb2)
-						pt_prev->func(skb2,skb->dev, pt_prev);
-				}
-				pt_prev=ptype;
-			}
-		}
-		
-		for (ptype = ptype_base[ntohs(type)&15]; ptype != NULL; ptype = ptype->next) 
-		{
-			if (ptype->type == type && (!ptype->dev || ptype->dev==skb->dev))
-			{
-				/*
-				 *	We already have a match queued. Deliver
-				 *	to it and then remember the new match
-				 */
-				if(pt_prev)
-				{
-					struct sk_buff *skb2;
 
-					skb2=skb_clone(skb, GFP_ATOMIC);
-
-					/*
-					 *	Kick the protocol handler. This should be fast
-					 *	and efficient code.
-					 */
+		cli();
+		if (!skb_queue_empty(&dev->rx_queue))
+			net_rx_schedule(dev);
+		sti();
 
-					if(skb2)
-						pt_prev->func(skb2, skb->dev, pt_prev);
-				}
-				/* Remember the current last to do */
-				pt_prev=ptype;
-			}
-		} /* End of protocol list loop */
-		
-		/*
-		 *	Is there a last item to send to ?
-		 */
+		net_rx_deliver(&batch);
 
-		if(pt_prev)
-			pt_prev->func(skb, skb->dev, pt_prev);
-		/*
-		 * 	Has an unknown packet has been received ?
-		 */
-	 
-		else
-			kfree_skb(skb, FREE_WRITE);
 		/*
 		 *	Again, see if we can transmit anything now. 
 		 *	[Ought to take this out judging by tests it slows
@@ -730,9 +907,15 @@ void net_bh(void)
 #endif		
   	}	/* End of queue loop */
   	
-  	/*
-  	 *	We have emptied the queue
-  	 */
+	/*
+	 *	Out of budget with frames still queued: let the rest of the
+	 *	system run and come back for them.
+	 */
+
+	if (rx_poll_head != NULL) {
+		rx_bh_squeezed++;
+		mark_bh(NET_BH);
+	}
 	
 	/*
 	 *	One last output flush.
@@ -952,6 +1135,54 @@ int dev_get_info(char *buffer, char **start, off_t offset, int length, int dummy
 		len=length;		/* Ending slop */
 	return len;
 }
+
+/*
+ *	/proc/net/dev_rx: receive queue depth and drops per device, and
+ *	how the bottom half has been coping.
+ */
+
+int dev_get_rx_info(char *buffer, char **start, off_t offset, int length, int dummy)
+{
+	int len=0;
+	off_t begin=0;
+	off_t pos=0;
+	int size;
+	
+	struct device *dev;
+
+	size = sprintf(buffer, "bh runs %lu frames %lu groups %lu squeezed %lu\n"
+			    "  face  qlen  maxq   queued  dropped\n",
+			    rx_bh_runs, rx_bh_frames, rx_bh_groups, rx_bh_squeezed);
+	
+	pos+=size;
+	len+=size;
+
+	for (dev = dev_base; dev != NULL; dev = dev->next) 
+	{
+		size = sprintf(buffer+len, "%6s: %5u %5lu %8lu %8lu\n",
+			       dev->name,
+			       dev->rx_queue.next ? skb_queue_len(&dev->rx_queue) : 0,
+			       dev->rx_stats.max_depth,
+			       dev->rx_stats.queued,
+			       dev->rx_stats.dropped);
+		len+=size;
+		pos=begin+len;
+				
+		if(pos<offset)
+		{
+			len=0;
+			begin=pos;
+		}
+		if(pos>offset+length)
+			break;
+	}
+	
+	*start=buffer+(offset-begin);	/* Start of wanted data */
+	len-=(offset-begin);		/* Start slop */
+	if(len>length)
+		len=length;		/* Ending slop */
+	return len;
+}
 #endif	/* CONFIG_PROC_FS */
 
 
@@ -1515,10 +1746,10 @@ int net_dev_init(void)
 	struct device *dev, **dp;
 
 	/*
-	 *	Initialise the packet receive queue.
+	 *	Initialise the packet receive queues.
 	 */
 	 
-	skb_queue_head_init(&backlog);
+	rx_poll_head = rx_poll_tail = NULL;
 	
 	/*
 	 *	The bridge has to be up before the devices
@@ -1578,6 +1809,7 @@ int net_dev_init(void)
 		for (i = 0; i < DEV_NUMBUFFS; i++)  {
 			skb_queue_head_init(dev->buffs + i);
 		}
+		skb_queue_head_init(&dev->rx_queue);
 
 		if (dev->init && dev->init(dev)) 
 		{
@@ -1599,6 +1831,18 @@ int net_dev_init(void)
 		0, &proc_net_inode_operations,
 		dev_get_info
 	});
+	proc_net_register(&(struct proc_dir_entry) {
+		PROC_NET_DEV_RX, 6, "dev_rx",
+		S_IFREG | S_IRUGO, 1, 0, 0,
+		0, &proc_net_inode_operations,
+		dev_get_rx_info
+	});
+	proc_net_register(&(struct proc_dir_entry) {
+		PROC_NET_SKB_POOL, 8, "skb_pool",
+		S_IFREG | S_IRUGO, 1, 0, 0,
+		0, &proc_net_inode_operations,
+		skb_pool_get_info
+	});
 #endif
 
 #ifdef CONFIG_NET_RADIO
@@ -15,6 +15,7 @@
  *		Alan Cox	:	Added all the changed routines Linus
  *					only put in the headers
  *		Ray VanTassle	:	Fixed --skb->lock in free
+ *					Recycle pools for the common sizes.
  *
  *	TO FIX:
  *		The __skb_ routines ought to check interrupts are disabled
@@ -67,6 +68,38 @@ atomic_t net_free_locked = 0;
 
 extern atomic_t ip_frag_mem;
 
+/*
+ *	Recycle pools. Most buffers come in a few sizes (a full ethernet
+ *	frame, a TCP segment, a bare ACK), so instead of handing them back
+ *	to kmalloc we keep up to skb_pool_depth free blocks of each size
+ *	class and give them to the next alloc_skb() that fits. The sizes
+ *	are just below the 512..4096 byte kmalloc buckets, leaving room
+ *	for its block header, so a pooled block wastes nothing kmalloc
+ *	would not have wasted anyway.
+ *
+ *	A block is recognised on free by the distance between skb->head
+ *	and the end of the sk_buff, which alloc_skb() puts at the very end.
+ */
+
+#define SKB_POOLS	4
+
+struct skb_pool
+{
+	unsigned int size;		/* Block size, sk_buff included */
+	unsigned char *list;		/* Free blocks, linked through the first word */
+	int count;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long recycled;
+	unsigned long released;		/* Freed to kmalloc, pool full */
+};
+
+static struct skb_pool skb_pool[SKB_POOLS] = {
+	{ 512-24 }, { 1024-24 }, { 2048-24 }, { 4096-24 }
+};
+
+int skb_pool_depth = 16;
+
 void show_net_buffers(void)
 {
 	printk(KERN_INFO "Networking buffers in use          : %u\n",net_skbcount);
@@ -637,6 +670,61 @@ void kfree_skb(struct sk_buff *skb, int rw)
 		kfree_skbmem(skb);
 }
 
+static inline struct skb_pool *skb_pool_find(unsigned int size)
+{
+	struct skb_pool *p;
+
+	for (p = skb_pool; p < skb_pool + SKB_POOLS; p++)
+		if (size <= p->size)
+			return p;
+	return NULL;
+}
+
+/*
+ *	Hand a data block back to its pool, or to kmalloc if there is no
+ *	pool of that size or it is full. A lowered depth is caught up with
+ *	one block per free.
+ */
+
+static void skb_pool_free(unsigned char *head, struct sk_buff *skb)
+{
+	unsigned int size = (unsigned char *)(skb + 1) - head;
+	struct skb_pool *p = skb_pool_find(size);
+	unsigned char *extra = NULL;
+	unsigned long flags;
+
+	if (p == NULL || p->size != size)
+	{
+		kfree(head);
+		return;
+	}
+
+	save_flags(flags);
+	cli();
+	if (p->count > skb_pool_depth && p->list)
+	{
+		extra = p->list;
+		p->list = *(unsigned char **)extra;
+		p->count--;
+	}
+	if (p->count < skb_pool_depth)
+	{
+		*(unsigned char **)head = p->list;
+		p->list = head;
+		p->count++;
+		p->recycled++;
+		head = NULL;
+	}
+	else
+		p->released++;
+	restore_flags(flags);
+
+	if (head)
+		kfree(head);
+	if (extra)
+		kfree(extra);
+}
+
 /*
  *	Allocate a new skbuff. We do this ourselves so we can fill in a few 'private'
  *	fields and also do memory statistics to find all the [BEEP] leaks.
@@ -646,6 +734,7 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 	struct sk_buff *skb;
 	int len=size;
 	unsigned char *bptr;
+	struct skb_pool *pool;
 
 	if (intr_count && priority!=GFP_ATOMIC) 
 	{
@@ -661,10 +750,33 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 	size+=sizeof(struct sk_buff);	/* And stick the control itself on the end */
 	
 	/*
-	 *	Allocate some space
+	 *	Allocate some space. A pooled block keeps its old data, only
+	 *	the header below is set up again. Pooled blocks are not known
+	 *	to be DMA-able, so DMA requests always go to kmalloc.
 	 */
+	
+	bptr = NULL;
+	pool = (priority & GFP_DMA) ? NULL : skb_pool_find(size);
+	if (pool != NULL)
+	{
+		unsigned long flags;
+
+		size = pool->size;
+		save_flags(flags);
+		cli();
+		if ((bptr = pool->list) != NULL)
+		{
+			pool->list = *(unsigned char **)bptr;
+			pool->count--;
+			pool->hits++;
+		}
+		else
+			pool->misses++;
+		restore_flags(flags);
+	}
 	 
-	bptr=(unsigned char *)kmalloc(size,priority);
+	if (bptr == NULL)
+		bptr=(unsigned char *)kmalloc(size,priority);
 	if (bptr == NULL)
 	{
 		net_fails++;
@@ -700,6 +812,7 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 	skb->stamp.tv_sec=0;	/* No idea about time */
 	skb->localroute = 0;
 	skb->ip_summed = 0;
+	skb->sacked = 0;
 	memset(skb->proto_priv, 0, sizeof(skb->proto_priv));
 	net_skbcount++;
 #if CONFIG_SKB_CHECK
@@ -724,23 +837,22 @@ static inline void __kfree_skbmem(struct sk_buff *skb)
 {
 	/* don't do anything if somebody still uses us */
 	if (atomic_dec_and_test(&skb->count)) {
-		kfree(skb->head);
+		skb_pool_free(skb->head, skb);
 		atomic_dec(&net_skbcount);
 	}
 }
 
 void kfree_skbmem(struct sk_buff *skb)
 {
-	void * addr = skb->head;
-
 	/* don't do anything if somebody still uses us */
 	if (atomic_dec_and_test(&skb->count)) {
 		/* free the skb that contains the actual data if we've clone()'d */
 		if (skb->data_skb) {
-			addr = skb;
 			__kfree_skbmem(skb->data_skb);
+			kfree(skb);
 		}
-		kfree(addr);
+		else
+			skb_pool_free(skb->head, skb);
 		atomic_dec(&net_skbcount);
 	}
 }
@@ -822,6 +934,7 @@ struct sk_buff *skb_copy(struct sk_buff *skb, int priority)
 	n->end_seq=skb->end_seq;
 	n->ack_seq=skb->ack_seq;
 	n->acked=skb->acked;
+	n->sacked=0;
 	memcpy(n->proto_priv, skb->proto_priv, sizeof(skb->proto_priv));
 	n->used=skb->used;
 	n->free=1;
@@ -906,3 +1019,37 @@ int skb_device_locked(struct sk_buff *skb)
 {
 	return skb->lock? 1 : 0;
 }
+
+#ifdef CONFIG_PROC_FS
+/*
+ *	/proc/net/skb_pool: how the recycle pools are doing, and how much
+ *	memory they hold.
+ */
+
+int skb_pool_get_info(char *buffer, char **start, off_t offset, int length, int dummy)
+{
+	struct skb_pool *p;
+	unsigned long held = 0;
+	int len;
+
+	len = sprintf(buffer, "depth %d\n"
+			      " size count     hits   misses recycled released\n",
+			      skb_pool_depth);
+	for (p = skb_pool; p < skb_pool + SKB_POOLS; p++)
+	{
+		len += sprintf(buffer+len, "%5u %5d %8lu %8lu %8lu %8lu\n",
+			       p->size, p->count, p->hits, p->misses,
+			       p->recycled, p->released);
+		held += p->count * p->size;
+	}
+	len += sprintf(buffer+len, "held %lu\n", held);
+
+	*start = buffer + offset;
+	len -= offset;
+	if (len > length)
+		len = length;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+#endif
@@ -267,6 +267,11 @@ int sock_setsockopt(struct sock *sk, int level, int optname,
  						return -EINVAL;
  				}
  			}
+#ifdef CONFIG_INET
+			/* Cached UDP lookups may now resolve differently. */
+			if (sk->prot == &udp_prot)
+				udp_cache_flush();
+#endif
   			return 0;
 #endif
 
@@ -8,16 +8,30 @@
 #include <linux/mm.h>
 #include <linux/sysctl.h>
 #include <linux/config.h>
+#include <linux/netdevice.h>
 
 #ifdef CONFIG_NET_ALIAS
 extern int sysctl_net_alias_max;
 extern int proc_do_net_alias_max(ctl_table *, int, struct file *, void *, size_t *);
 #endif
 
+/* a zero budget or weight would leave net_bh rescheduling itself forever */
+static int min_rx[] = {1};
+
 ctl_table core_table[] = {
 #ifdef CONFIG_NET_ALIAS
 	{NET_CORE_NET_ALIAS_MAX, "net_alias_max", &sysctl_net_alias_max, sizeof(int),
 	 0644, NULL, &proc_do_net_alias_max },
 #endif  
+	{NET_CORE_MAX_BACKLOG, "netdev_max_backlog", &netdev_max_backlog,
+	 sizeof(int), 0644, NULL, &proc_dointvec},
+	{NET_CORE_RX_BUDGET, "netdev_rx_budget", &netdev_rx_budget,
+	 sizeof(int), 0644, NULL, &proc_dointvec_minmax, &sysctl_intvec, NULL,
+	 &min_rx, NULL},
+	{NET_CORE_RX_WEIGHT, "netdev_rx_weight", &netdev_rx_weight,
+	 sizeof(int), 0644, NULL, &proc_dointvec_minmax, &sysctl_intvec, NULL,
+	 &min_rx, NULL},
+	{NET_CORE_SKB_POOL_DEPTH, "skb_pool_depth", &skb_pool_depth,
+	 sizeof(int), 0644, NULL, &proc_dointvec},
 	{0}
 };
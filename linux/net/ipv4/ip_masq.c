@@ -20,6 +20,8 @@
  *	Delian Delchev		:	Added support for ICMP requests and replys
  *	Nigel Metheringham	:	ICMP in ICMP handling, tidy ups, bug fixes, made ICMP optional
  *	Juan Jose Ciarlante	:	re-assign maddr if no packet received from outside
+ *					Resizable hash tables, expire wheel in place of
+ *					per-entry timers, per-protocol mport pools.
  *	
  */
 
@@ -29,7 +31,10 @@
 #include <linux/kernel.h>
 #include <linux/errno.h>
 #include <linux/skbuff.h>
+#include <linux/mm.h>
+#include <linux/timer.h>
 #include <asm/system.h>
+#include <asm/bitops.h>
 #include <linux/stat.h>
 #include <linux/proc_fs.h>
 #include <linux/in.h>
@@ -43,7 +48,23 @@
 #include <net/ip_masq.h>
 #include <linux/ip_fw.h>
 
-#define IP_MASQ_TAB_SIZE 256    /* must be power of 2 */
+/*
+ *	The hash tables start at IP_MASQ_TAB_MIN buckets and double
+ *	whenever the average chain grows past IP_MASQ_TAB_LOAD entries.
+ */
+#define IP_MASQ_TAB_MIN		256	/* must be power of 2 */
+#define IP_MASQ_TAB_MAX		8192	/* must be power of 2 */
+#define IP_MASQ_TAB_LOAD	2
+
+/*
+ *	Expire wheel: IP_MASQ_WHEEL_SIZE slots of IP_MASQ_WHEEL_TICK
+ *	jiffies each.  Entries further away than one turn of the wheel
+ *	simply stay in their slot until their time comes round.
+ */
+#define IP_MASQ_WHEEL_SIZE	256	/* must be power of 2 */
+#define IP_MASQ_WHEEL_TICK	HZ
+
+#define PORT_MASQ_POOL_SIZE	(PORT_MASQ_END - PORT_MASQ_BEGIN)
 
 /*
  *	Implement IP packet masquerading
@@ -100,10 +121,12 @@ static __inline__ const char *masq_proto_name(unsigned proto)
 }
 
 /*
- *	Last masq_port number in use.
- *	Will cycle in MASQ_PORT boundaries.
+ *	Per protocol mport pools: a bitmap of the ports in
+ *	MASQ_PORT boundaries handed out by ip_masq_port_get(), and the
+ *	place to resume searching from.  Will cycle in MASQ_PORT boundaries.
  */
-static __u16 masq_port = PORT_MASQ_BEGIN;
+static unsigned long ip_masq_port_map[3][PORT_MASQ_POOL_SIZE/(8*sizeof(unsigned long))];
+static int ip_masq_port_next[3];
 
 /*
  *	free ports counters (UDP & TCP)
@@ -137,8 +160,24 @@ static struct symbol_table ip_masq_syms = {
  *	2 ip_masq hash tables: for input and output pkts lookups.
  */
 
-struct ip_masq *ip_masq_m_tab[IP_MASQ_TAB_SIZE];
-struct ip_masq *ip_masq_s_tab[IP_MASQ_TAB_SIZE];
+static struct ip_masq *ip_masq_m_tab_min[IP_MASQ_TAB_MIN];
+static struct ip_masq *ip_masq_s_tab_min[IP_MASQ_TAB_MIN];
+
+struct ip_masq **ip_masq_m_tab = ip_masq_m_tab_min;
+struct ip_masq **ip_masq_s_tab = ip_masq_s_tab_min;
+
+static unsigned ip_masq_tab_size = IP_MASQ_TAB_MIN;
+static unsigned ip_masq_entries = 0;
+
+/*
+ *	Expire wheel
+ */
+
+static struct ip_masq *ip_masq_wheel[IP_MASQ_WHEEL_SIZE];
+static unsigned long ip_masq_wheel_clock;	/* next tick to run */
+static unsigned ip_masq_wheel_count = 0;	/* entries on the wheel */
+static int ip_masq_wheel_running = 0;
+static struct timer_list ip_masq_wheel_timer;
 
 /*
  * timeouts
@@ -256,7 +295,69 @@ void ip_autofw_update_in (__u32 where, __u16 port, __u16 protocol)
 static __inline__ unsigned
 ip_masq_hash_key(unsigned proto, __u32 addr, __u16 port)
 {
-        return (proto^ntohl(addr)^ntohs(port)) & (IP_MASQ_TAB_SIZE-1);
+        __u32 a = ntohl(addr);
+
+        return (proto^a^(a>>16)^ntohs(port)) & (ip_masq_tab_size-1);
+}
+
+static int ip_masq_tab_order(unsigned size)
+{
+        int order = 0;
+
+        while ((PAGE_SIZE << order) < size * sizeof(struct ip_masq *))
+                order++;
+        return order;
+}
+
+/*
+ *	Moves every entry to tables of new_size buckets.
+ *	should be called with masked interrupts.
+ *	If memory is short the old tables are simply kept.
+ */
+
+static void ip_masq_rehash(unsigned new_size)
+{
+        struct ip_masq **m_tab, **s_tab, *ms, *ms_next;
+        struct ip_masq **old_m_tab = ip_masq_m_tab;
+        struct ip_masq **old_s_tab = ip_masq_s_tab;
+        unsigned old_size = ip_masq_tab_size;
+        unsigned idx, hash;
+        int order = ip_masq_tab_order(new_size);
+
+        m_tab = (struct ip_masq **) __get_free_pages(GFP_ATOMIC, order, 0);
+        if (m_tab == NULL)
+                return;
+        s_tab = (struct ip_masq **) __get_free_pages(GFP_ATOMIC, order, 0);
+        if (s_tab == NULL) {
+                free_pages((unsigned long) m_tab, order);
+                return;
+        }
+        memset(m_tab, 0, new_size * sizeof(struct ip_masq *));
+        memset(s_tab, 0, new_size * sizeof(struct ip_masq *));
+
+        ip_masq_tab_size = new_size;
+        for (idx = 0; idx < old_size; idx++) {
+                for (ms = old_m_tab[idx]; ms ; ms = ms_next) {
+                        ms_next = ms->m_link;
+                        hash = ip_masq_hash_key(ms->protocol, ms->maddr, ms->mport);
+                        ms->m_link = m_tab[hash];
+                        m_tab[hash] = ms;
+                }
+                for (ms = old_s_tab[idx]; ms ; ms = ms_next) {
+                        ms_next = ms->s_link;
+                        hash = ip_masq_hash_key(ms->protocol, ms->saddr, ms->sport);
+                        ms->s_link = s_tab[hash];
+                        s_tab[hash] = ms;
+                }
+        }
+        ip_masq_m_tab = m_tab;
+        ip_masq_s_tab = s_tab;
+
+        if (old_m_tab != ip_masq_m_tab_min) {
+                order = ip_masq_tab_order(old_size);
+                free_pages((unsigned long) old_m_tab, order);
+                free_pages((unsigned long) old_s_tab, order);
+        }
 }
 
 /*
@@ -274,6 +375,10 @@ ip_masq_hash(struct ip_masq *ms)
                 printk("ip_masq_hash(): request for already hashed\n");
                 return 0;
         }
+        if (ip_masq_entries >= ip_masq_tab_size * IP_MASQ_TAB_LOAD &&
+            ip_masq_tab_size < IP_MASQ_TAB_MAX)
+                ip_masq_rehash(ip_masq_tab_size * 2);
+
         /*
          *	Hash by proto,m{addr,port}
          */
@@ -290,6 +395,7 @@ ip_masq_hash(struct ip_masq *ms)
 
 
         ms->flags |= IP_MASQ_F_HASHED;
+        ip_masq_entries++;
         return 1;
 }
 
@@ -327,6 +433,7 @@ static __inline__ int ip_masq_unhash(struct ip_masq *ms)
                 }
 
         ms->flags &= ~IP_MASQ_F_HASHED;
+        ip_masq_entries--;
         return 1;
 }
 
@@ -519,6 +626,79 @@ ip_masq_getbym(int protocol, __u32 m_addr, __u16 m_port)
         return NULL;
 }
 
+/*
+ *	Grabs a free mport from the protocol's pool, searching on from
+ *	the last one handed out.  Returns 0 if the pool is exhausted.
+ *	should be called with masked interrupts.
+ */
+
+static __u16 ip_masq_port_get(int proto_num)
+{
+        unsigned long *map = ip_masq_port_map[proto_num];
+        int bit;
+
+        bit = find_next_zero_bit(map, PORT_MASQ_POOL_SIZE, ip_masq_port_next[proto_num]);
+        if (bit >= PORT_MASQ_POOL_SIZE)
+                bit = find_first_zero_bit(map, PORT_MASQ_POOL_SIZE);
+        if (bit >= PORT_MASQ_POOL_SIZE)
+                return 0;
+        set_bit(bit, map);
+        ip_masq_port_next[proto_num] = bit + 1;
+        return htons(PORT_MASQ_BEGIN + bit);
+}
+
+static __inline__ void ip_masq_port_put(int proto_num, __u16 mport)
+{
+        clear_bit(ntohs(mport) - PORT_MASQ_BEGIN, ip_masq_port_map[proto_num]);
+}
+
+/*
+ *	Expire wheel handling.
+ *	should be called with masked interrupts.
+ */
+
+static void ip_masq_wheel_run(unsigned long);
+
+static void ip_masq_wheel_link(struct ip_masq *ms)
+{
+        unsigned long tick = ms->expires / IP_MASQ_WHEEL_TICK;
+        struct ip_masq **slot;
+
+        if (!ip_masq_wheel_running) {
+                if (!ip_masq_wheel_count)
+                        ip_masq_wheel_clock = jiffies / IP_MASQ_WHEEL_TICK;
+                init_timer(&ip_masq_wheel_timer);
+                ip_masq_wheel_timer.function = ip_masq_wheel_run;
+                ip_masq_wheel_timer.expires = (ip_masq_wheel_clock+1) * IP_MASQ_WHEEL_TICK;
+                add_timer(&ip_masq_wheel_timer);
+                ip_masq_wheel_running = 1;
+        }
+
+        /*
+         *	Never file behind the hand, or the entry would wait a
+         *	whole turn of the wheel.
+         */
+        if (tick < ip_masq_wheel_clock)
+                tick = ip_masq_wheel_clock;
+        slot = &ip_masq_wheel[tick & (IP_MASQ_WHEEL_SIZE-1)];
+
+        if ((ms->w_next = *slot) != NULL)
+                ms->w_next->w_pprev = &ms->w_next;
+        ms->w_pprev = slot;
+        *slot = ms;
+        ip_masq_wheel_count++;
+}
+
+static __inline__ void ip_masq_wheel_unlink(struct ip_masq *ms)
+{
+        if (ms->w_next)
+                ms->w_next->w_pprev = ms->w_pprev;
+        *ms->w_pprev = ms->w_next;
+        ms->w_next = NULL;
+        ms->w_pprev = NULL;
+        ip_masq_wheel_count--;
+}
+
 static void masq_expire(unsigned long data)
 {
 	struct ip_masq *ms = (struct ip_masq *)data, *ms_data;
@@ -542,7 +722,7 @@ static void masq_expire(unsigned long data)
 		 * links which we don't want to lose, e.g. ftp.
 		 * Assumption: loops such as a->b->a or a->a will never occur.
 		 */
-		for (idx = 0; idx < IP_MASQ_TAB_SIZE && !reprieve; idx++) {
+		for (idx = 0; idx < ip_masq_tab_size && !reprieve; idx++) {
 			for (ms_data = ip_masq_m_tab[idx]; ms_data ; ms_data = ms_data->m_link) {
 				if (ms_data->control == ms) {
 					reprieve = 1;	/* this control connection can live a bit longer */
@@ -570,6 +750,8 @@ static void masq_expire(unsigned long data)
 
         if (ip_masq_unhash(ms)) {
                 ip_masq_free_ports[masq_proto_num(ms->protocol)]++;
+                if (ms->flags & IP_MASQ_F_POOL_PORT)
+                        ip_masq_port_put(masq_proto_num(ms->protocol), ms->mport);
                 if (ms->protocol != IPPROTO_ICMP)
                              ip_masq_unbind_app(ms);
                 kfree_s(ms,sizeof(*ms));
@@ -578,6 +760,53 @@ static void masq_expire(unsigned long data)
 	restore_flags(flags);
 }
 
+/*
+ *	Runs every IP_MASQ_WHEEL_TICK while there are entries on the
+ *	wheel, catching up on any slots missed in between.  Entries due
+ *	are unlinked first and only then expired, as masq_expire() may
+ *	put a control entry back on the wheel.
+ */
+
+static void ip_masq_wheel_run(unsigned long dummy)
+{
+	struct ip_masq *ms, *ms_next, *expired = NULL;
+	unsigned long flags, now = jiffies / IP_MASQ_WHEEL_TICK;
+
+	save_flags(flags);
+	cli();
+	ip_masq_wheel_running = 0;
+	if (now - ip_masq_wheel_clock > IP_MASQ_WHEEL_SIZE)
+		ip_masq_wheel_clock = now - IP_MASQ_WHEEL_SIZE;
+	while (ip_masq_wheel_clock < now) {
+		ms = ip_masq_wheel[ip_masq_wheel_clock & (IP_MASQ_WHEEL_SIZE-1)];
+		for (; ms ; ms = ms_next) {
+			ms_next = ms->w_next;
+			if (ms->expires <= jiffies) {
+				ip_masq_wheel_unlink(ms);
+				ms->w_next = expired;
+				expired = ms;
+			}
+		}
+		ip_masq_wheel_clock++;
+	}
+	restore_flags(flags);
+
+	while ((ms = expired) != NULL) {
+		expired = ms->w_next;
+		ms->w_next = NULL;
+		masq_expire((unsigned long)ms);
+	}
+
+	save_flags(flags);
+	cli();
+	if (ip_masq_wheel_count && !ip_masq_wheel_running) {
+		ip_masq_wheel_timer.expires = (ip_masq_wheel_clock+1) * IP_MASQ_WHEEL_TICK;
+		add_timer(&ip_masq_wheel_timer);
+		ip_masq_wheel_running = 1;
+	}
+	restore_flags(flags);
+}
+
 #ifdef CONFIG_IP_MASQUERADE_IPAUTOFW
 void ip_autofw_expire(unsigned long data)
 {
@@ -600,11 +829,12 @@ void ip_autofw_expire(unsigned long data)
 struct ip_masq * ip_masq_new_enh(struct device *dev, int proto, __u32 saddr, __u16 sport, __u32 daddr, __u16 dport, unsigned mflags, __u16 matchport)
 {
         struct ip_masq *ms, *mst;
-        int ports_tried, *free_ports_p;
+        int ports_tried, *free_ports_p, proto_num;
 	unsigned long flags;
         static int n_fails = 0;
 
-        free_ports_p = &ip_masq_free_ports[masq_proto_num(proto)];
+        proto_num = masq_proto_num(proto);
+        free_ports_p = &ip_masq_free_ports[proto_num];
 
         if (*free_ports_p == 0) {
                 if (++n_fails < 5)
@@ -620,9 +850,6 @@ struct ip_masq * ip_masq_new_enh(struct device *dev, int proto, __u32 saddr, __u
                 return NULL;
         }
         memset(ms, 0, sizeof(*ms));
-	init_timer(&ms->timer);
-	ms->timer.data     = (unsigned long)ms;
-	ms->timer.function = masq_expire;
         ms->protocol	   = proto;
         ms->saddr    	   = saddr;
         ms->sport	   = sport;
@@ -651,27 +878,28 @@ struct ip_masq * ip_masq_new_enh(struct device *dev, int proto, __u32 saddr, __u
                 cli();
                 
 		/*
-                 *	Try the next available port number
+                 *	Try the next available port number from the pool
                  */
-                if (!matchport || ports_tried)
-			ms->mport = htons(masq_port++);
-		else
+                if (!matchport || ports_tried) {
+			ms->mport = ip_masq_port_get(proto_num);
+			if (ms->mport == 0) {
+				restore_flags(flags);
+				break;
+			}
+			ms->flags |= IP_MASQ_F_POOL_PORT;
+		} else
 			ms->mport = matchport;
-			
-		if (masq_port==PORT_MASQ_END) masq_port = PORT_MASQ_BEGIN;
-                
-                restore_flags(flags);
                 
                 /*
-                 *	lookup to find out if this port is used.
+                 *	lookup to find out if this port is used
+                 *	(an auto-forwarded matchport may sit in the pool range).
                  */
                 
                 mst = ip_masq_getbym(proto, ms->maddr, ms->mport);
                 if (mst == NULL || matchport) {
-                        save_flags(flags);
-                        cli();
-                
                         if (*free_ports_p == 0) {
+                                if (ms->flags & IP_MASQ_F_POOL_PORT)
+                                        ip_masq_port_put(proto_num, ms->mport);
                                 restore_flags(flags);
                                 break;
                         }
@@ -685,6 +913,11 @@ struct ip_masq * ip_masq_new_enh(struct device *dev, int proto, __u32 saddr, __u
                         n_fails = 0;
                         return ms;
                 }
+                if (ms->flags & IP_MASQ_F_POOL_PORT) {
+                        ip_masq_port_put(proto_num, ms->mport);
+                        ms->flags &= ~IP_MASQ_F_POOL_PORT;
+                }
+                restore_flags(flags);
         }
         
         if (++n_fails < 5)
@@ -700,19 +933,24 @@ struct ip_masq * ip_masq_new(struct device *dev, int proto, __u32 saddr, __u16 s
 }
 
 /*
- * 	Set masq expiration (deletion) and adds timer,
+ * 	Set masq expiration (deletion) and puts it on the expire wheel,
  *	if timeout==0 cancel expiration.
- *	Warning: it does not check/delete previous timer!
+ *	An entry already on the wheel is moved to its new slot.
  */
 
 void ip_masq_set_expire(struct ip_masq *ms, unsigned long tout)
 {
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (ms->w_pprev)
+		ip_masq_wheel_unlink(ms);
         if (tout) {
-                ms->timer.expires = jiffies+tout;
-                add_timer(&ms->timer);
-        } else {
-                del_timer(&ms->timer);
+                ms->expires = jiffies+tout;
+                ip_masq_wheel_link(ms);
         }
+	restore_flags(flags);
 }
 
 static void recalc_check(struct udphdr *uh, __u32 saddr,
@@ -1632,17 +1870,17 @@ static int ip_msqhst_procinfo(char *buffer, char **start, off_t offset,
 	save_flags(flags);
 	cli();
         
-        for(idx = 0; idx < IP_MASQ_TAB_SIZE; idx++)
+        for(idx = 0; idx < ip_masq_tab_size; idx++)
         for(ms = ip_masq_m_tab[idx]; ms ; ms = ms->m_link)
 	{
-		int timer_active;
+		unsigned long expires;
 		pos += 128;
 		if (pos <= offset)
 			continue;
 
-		timer_active = del_timer(&ms->timer);
-		if (!timer_active)
-			ms->timer.expires = jiffies;
+		expires = ms->w_pprev ? ms->expires : jiffies;
+		if (expires < jiffies)
+			expires = jiffies;
 		sprintf(temp,"%s %08lX:%04X %08lX:%04X %04X %08X %6d %6d %7lu",
 			masq_proto_name(ms->protocol),
 			ntohl(ms->saddr), ntohs(ms->sport),
@@ -1651,9 +1889,7 @@ static int ip_msqhst_procinfo(char *buffer, char **start, off_t offset,
 			ms->out_seq.init_seq,
 			ms->out_seq.delta,
 			ms->out_seq.previous_delta,
-			ms->timer.expires-jiffies);
-		if (timer_active)
-			add_timer(&ms->timer);
+			expires-jiffies);
 		len += sprintf(buffer+len, "%-127s\n", temp);
 
 		if(len >= length)
@@ -258,6 +258,23 @@ int snmp_get_info(char *buffer, char **start, off_t offset, int length, int dumm
 		"Udp: InDatagrams NoPorts InErrors OutDatagrams\nUdp: %lu %lu %lu %lu\n",
 		    udp_statistics.UdpInDatagrams, udp_statistics.UdpNoPorts,
 		    udp_statistics.UdpInErrors, udp_statistics.UdpOutDatagrams);	    
+
+	len += sprintf (buffer + len,
+		"TcpAck: DataSegsIn AcksOut Delayed Quick Piggybacked AcksPer100Segs\n"
+		"TcpAck: %lu %lu %lu %lu %lu %lu\n",
+		    tcp_ack_statistics.TcpAckDataSegsIn, tcp_ack_statistics.TcpAckOut,
+		    tcp_ack_statistics.TcpAckDelayed, tcp_ack_statistics.TcpAckQuick,
+		    tcp_ack_statistics.TcpAckPiggybacked,
+		    tcp_ack_statistics.TcpAckDataSegsIn ?
+		    	tcp_ack_statistics.TcpAckOut * 100 / tcp_ack_statistics.TcpAckDataSegsIn : 0);
+
+	len += sprintf (buffer + len,
+		"TcpSack: BlocksIn SegsSacked RetransSkipped HolesResent FastRecovery PartialAcks Renege\n"
+		"TcpSack: %lu %lu %lu %lu %lu %lu %lu\n",
+		    tcp_sack_statistics.TcpSackBlocksIn, tcp_sack_statistics.TcpSackSegs,
+		    tcp_sack_statistics.TcpSackSkipped, tcp_sack_statistics.TcpSackHoles,
+		    tcp_sack_statistics.TcpFastRecovery, tcp_sack_statistics.TcpPartialAcks,
+		    tcp_sack_statistics.TcpSackRenege);
 /*	
 	  len += sprintf( buffer + len,
 	  	"TCP fast path RX:  H2: %ul H1: %ul L: %ul\n",
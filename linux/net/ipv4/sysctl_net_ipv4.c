@@ -8,6 +8,7 @@
 #include <linux/mm.h>
 #include <linux/sysctl.h>
 #include <net/ip.h>
+#include <net/tcp.h>
 
 /* From arp.c */
 extern int sysctl_arp_res_time;
@@ -40,6 +41,10 @@ static int proc_doipforward(ctl_table *ctl, int write, struct file *filp,
     return retv; 
 }
 
+/* both end up in the socket's unsigned short counters */
+static int tcp_ack_segs_min[] = {1}, tcp_ack_segs_max[] = {64};
+static int tcp_quickack_min[] = {0}, tcp_quickack_max[] = {65535};
+
 ctl_table ipv4_table[] = {
         {NET_IPV4_ARP_RES_TIME, "arp_res_time",
          &sysctl_arp_res_time, sizeof(int), 0644, NULL, &proc_dointvec},
@@ -61,5 +66,15 @@ ctl_table ipv4_table[] = {
 	 0644, NULL, &proc_doipforward },
         {NET_IPV4_DYNADDR, "ip_dynaddr",
          &sysctl_ip_dynaddr, sizeof(int), 0644, NULL, &proc_dointvec},
+        {NET_IPV4_TCP_ACK_SEGS, "tcp_ack_segs",
+         &sysctl_tcp_ack_segs, sizeof(int), 0644, NULL,
+         &proc_dointvec_minmax, &sysctl_intvec, NULL,
+         &tcp_ack_segs_min, &tcp_ack_segs_max},
+        {NET_IPV4_TCP_QUICKACK_SEGS, "tcp_quickack_segs",
+         &sysctl_tcp_quickack_segs, sizeof(int), 0644, NULL,
+         &proc_dointvec_minmax, &sysctl_intvec, NULL,
+         &tcp_quickack_min, &tcp_quickack_max},
+        {NET_IPV4_TCP_SACK, "tcp_sack",
+         &sysctl_tcp_sack, sizeof(int), 0644, NULL, &proc_dointvec},
 	{0}
 };
@@ -2177,6 +2177,7 @@ static int tcp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 	struct device *dev=NULL;
 	unsigned char *ptr;
 	int tmp;
+	int optlen;
 	int atype;
 	struct tcphdr *t1;
 	struct rtable *rt;
@@ -2269,7 +2270,8 @@ static int tcp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 	t1->ack = 0;
 	t1->window = 2;
 	t1->syn = 1;
-	t1->doff = 6;
+	optlen = sysctl_tcp_sack ? 8 : 4;
+	t1->doff = (sizeof(struct tcphdr)+optlen)/4;
 	/* use 512 or whatever user asked for */
 
 	if(rt!=NULL && (rt->rt_flags&RTF_WINDOW))
@@ -2298,17 +2300,24 @@ static int tcp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 		sk->mtu = 32;	/* Sanity limit */
 
 	/*
-	 *	Put in the TCP options to say MTU.
+	 *	Put in the TCP options to say MTU, and offer SACK.
 	 */
 
-	ptr = skb_put(buff,4);
+	ptr = skb_put(buff,optlen);
 	ptr[0] = 2;
 	ptr[1] = 4;
 	ptr[2] = (sk->mtu) >> 8;
 	ptr[3] = (sk->mtu) & 0xff;
-	buff->csum = csum_partial(ptr, 4, 0);
+	if (optlen > 4)
+	{
+		ptr[4] = TCPOPT_NOP;
+		ptr[5] = TCPOPT_NOP;
+		ptr[6] = TCPOPT_SACK_PERM;
+		ptr[7] = TCPOLEN_SACK_PERM;
+	}
+	buff->csum = csum_partial(ptr, optlen, 0);
 	tcp_send_check(t1, sk->saddr, sk->daddr,
-		  sizeof(struct tcphdr) + 4, buff);
+		  sizeof(struct tcphdr) + optlen, buff);
 
 	tcp_set_state(sk,TCP_SYN_SENT);
 
@@ -52,6 +52,7 @@
 #include <linux/types.h>
 #include <linux/random.h>
 #include <net/tcp.h>
+#include <asm/unaligned.h>
 
 /*
  *	Do we assume the IP ToS is entirely for its intended purpose
@@ -460,7 +461,18 @@ static int tcp_reset(struct sock *sk, struct sk_buff *skb)
 
 
 /*
- *	Look for tcp options. Parses everything but only knows about MSS.
+ *	Selective acknowledgement (RFC2018) is offered on every SYN and
+ *	accepted from any peer that offers it, unless switched off through
+ *	/proc/sys/net/ipv4/tcp_sack.
+ */
+
+int sysctl_tcp_sack = 1;
+
+struct tcp_sack_mib tcp_sack_statistics;
+
+/*
+ *	Look for tcp options. Parses everything but only knows about MSS
+ *	and SACK permitted.
  *	This routine is always called with the packet containing the SYN.
  *	However it may also be called with the ack to the SYN.  So you
  *	can't assume this is always the SYN.  It's always called after
@@ -477,6 +489,8 @@ static void tcp_options(struct sock *sk, struct tcphdr *th)
 	int mss_seen = 0;
     
 	ptr = (unsigned char *)(th + 1);
+	if (th->syn)
+		sk->sack_ok = 0;
   
 	while(length>0)
 	{
@@ -503,6 +517,10 @@ static void tcp_options(struct sock *sk, struct tcphdr *th)
 							mss_seen = 1;
 	  					}
 	  					break;
+					case TCPOPT_SACK_PERM:
+						if(opsize==TCPOLEN_SACK_PERM && th->syn && sysctl_tcp_sack)
+							sk->sack_ok = 1;
+						break;
 		  				/* Add other options here as people feel the urge to implement stuff like large windows */
 	  			}
 	  			ptr+=opsize-2;
@@ -1151,6 +1169,93 @@ void tcp_window_shrunk(struct sock * sk, u32 window_seq)
 }
 
 
+/*
+ *	Update the retransmit queue scoreboard from the SACK blocks of an
+ *	incoming ack. Blocks are only advisory: a segment is marked when
+ *	it lies wholly inside a block and is freed only by the cumulative
+ *	ack, so a peer that reneges costs us a timeout, not data.
+ */
+
+static void tcp_sack_update(struct sock *sk, struct tcphdr *th, u32 ack)
+{
+	unsigned char *ptr = (unsigned char *)(th + 1);
+	int length = (th->doff*4)-sizeof(struct tcphdr);
+
+	while (length > 0)
+	{
+		int opcode = *ptr++;
+		int opsize;
+
+		if (opcode == TCPOPT_EOL)
+			return;
+		if (opcode == TCPOPT_NOP)
+		{
+			length--;
+			continue;
+		}
+		opsize = *ptr++;
+		if (opsize < 2 || opsize > length)
+			return;
+		if (opcode == TCPOPT_SACK &&
+		    opsize >= TCPOLEN_SACK_BASE+TCPOLEN_SACK_PERBLOCK &&
+		    !((opsize-TCPOLEN_SACK_BASE) % TCPOLEN_SACK_PERBLOCK))
+		{
+			unsigned char *blk = ptr;
+			int nblk = (opsize-TCPOLEN_SACK_BASE) / TCPOLEN_SACK_PERBLOCK;
+
+			while (nblk--)
+			{
+				u32 start = ntohl(get_unaligned((__u32 *) blk));
+				u32 end = ntohl(get_unaligned((__u32 *) (blk+4)));
+				struct sk_buff *skb;
+
+				blk += TCPOLEN_SACK_PERBLOCK;
+
+				/* Ignore stale or impossible blocks */
+				if (!after(end, ack) || after(end, sk->sent_seq) ||
+				    !before(start, end))
+					continue;
+				tcp_sack_statistics.TcpSackBlocksIn++;
+
+				for (skb = sk->send_head; skb != NULL; skb = skb->link3)
+				{
+					if (!after(skb->end_seq, start))
+						continue;
+					if (after(skb->end_seq, end))
+						break;
+					if (before(skb->seq, start))
+						continue;
+					if (!(skb->sacked & TCPCB_SACKED_ACKED))
+					{
+						skb->sacked |= TCPCB_SACKED_ACKED;
+						tcp_sack_statistics.TcpSackSegs++;
+					}
+				}
+			}
+		}
+		ptr += opsize-2;
+		length -= opsize;
+	}
+}
+
+/*
+ *	Resend one segment from the scoreboard while in fast recovery.
+ *	The retransmission does not count against packets_out, which
+ *	tracks segments on the queue rather than copies in flight.
+ *	Returns non zero if something was sent.
+ */
+
+static int tcp_sack_fill_hole(struct sock *sk)
+{
+	int tmp = sk->packets_out;
+	int sent;
+
+	tcp_do_retransmit(sk, 0);
+	sent = sk->packets_out;
+	sk->packets_out = tmp;
+	return sent;
+}
+
 /*
  *	This routine deals with incoming acks, but not outgoing ones.
  *
@@ -1161,6 +1266,7 @@ void tcp_window_shrunk(struct sock * sk, u32 window_seq)
 static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 {
 	int flag = 0;
+	int partial = 0;
 	u32 window_seq;
 
 	/* 
@@ -1189,6 +1295,13 @@ static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 	if (after(ack, sk->sent_seq) || before(ack, sk->rcv_ack_seq)) 
 		goto uninteresting_ack;
 
+	/*
+	 *	Note which queued segments the peer already holds.
+	 */
+
+	if (sk->sack_ok && th->doff > sizeof(struct tcphdr)/4 && sk->send_head)
+		tcp_sack_update(sk, th, ack);
+
 	/*
 	 *	Have we discovered a larger window
 	 */
@@ -1277,7 +1390,8 @@ static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 	 * (3) we have outstanding data that has not been ACKed
 	 * (4) The packet was not carrying any data.
 	 * (5) [From Floyd's paper on fast retransmit wars]
-	 *     The packet acked data after high_seq;
+	 *     The packet acked data after high_seq, unless we are
+	 *     already in fast recovery;
 	 * I've tried to order these in occurrence of most likely to fail
 	 * to least likely to fail.
 	 * [These are an extension of the rules BSD stacks use to
@@ -1288,7 +1402,7 @@ static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 		&& sk->window_seq == window_seq
 		&& len == th->doff*4
 		&& before(ack, sk->sent_seq)
-		&& after(ack, sk->high_seq))
+		&& (after(ack, sk->high_seq) || sk->rcv_ack_cnt > MAX_DUP_ACKS))
 	{
 		/* Prevent counting of duplicate ACKs if the congestion
 		 * window is smaller than 3. Note that since we reduce
@@ -1316,30 +1430,57 @@ static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 				 >> 1, 2);
 			sk->cong_window = sk->ssthresh+MAX_DUP_ACKS+1;
 			sk->cong_count = 0;
+			/*
+			 * Everything sent so far must be acked before
+			 * we leave recovery (NewReno, RFC2582).
+			 */
+			sk->high_seq = sk->sent_seq;
+			tcp_sack_clear(sk, TCPCB_SACKED_RETRANS);
+			tcp_sack_statistics.TcpFastRecovery++;
 			tmp = sk->packets_out;
 			tcp_do_retransmit(sk,0);
 			sk->packets_out = tmp;
 		} else if (sk->rcv_ack_cnt > MAX_DUP_ACKS+1) {
-			sk->cong_window++;
 			/*
-			* At this point we are suppose to transmit a NEW
-			* packet (not retransmit the missing packet,
-			* this would only get us into a retransmit war.)
-			* I think that having just adjusted cong_window
-			* we will transmit the new packet below.
-			*/
+			 * If the scoreboard shows another hole the peer
+			 * is known to be missing, resend that in place
+			 * of new data: this is still one packet for the
+			 * one that left the network.
+			 */
+			if (sk->sack_ok && tcp_sack_fill_hole(sk)) {
+				tcp_sack_statistics.TcpSackHoles++;
+			} else {
+				sk->cong_window++;
+				/*
+				* At this point we are suppose to transmit a NEW
+				* packet (not retransmit the missing packet,
+				* this would only get us into a retransmit war.)
+				* I think that having just adjusted cong_window
+				* we will transmit the new packet below.
+				*/
+			}
 		}
 	}
 	else
 	{
 		if (sk->rcv_ack_cnt > MAX_DUP_ACKS) {
+			if (before(ack, sk->high_seq) && !sk->retransmits) {
+				/*
+				 * A partial ack: the segment after it was
+				 * lost as well. Stay in recovery and resend
+				 * it below, rather than waiting for three
+				 * more duplicates or a timeout.
+				 */
+				partial = 1;
+				tcp_sack_statistics.TcpPartialAcks++;
+			}
 			/* Don't allow congestion window to drop to zero. */
 			sk->cong_window = max(sk->ssthresh, 1);
 			sk->cong_count = 0;
 		}
 		sk->window_seq = window_seq;
 		sk->rcv_ack_seq = ack;
-		sk->rcv_ack_cnt = 1;
+		sk->rcv_ack_cnt = partial ? MAX_DUP_ACKS+1 : 1;
 	}
 	
 	/*
@@ -1504,6 +1645,16 @@ static int tcp_ack(struct sock *sk, struct tcphdr *th, u32 ack, int len)
 			sk->write_space(sk);
 	}
 
+	/*
+	 * NewReno: resend the segment the partial ack points at.
+	 */
+
+	if (partial && sk->send_head != NULL)
+	{
+		sk->send_head->sacked &= ~TCPCB_SACKED_RETRANS;
+		tcp_sack_fill_hole(sk);
+	}
+
 	/*
 	 * Maybe we can take some stuff off of the write queue,
 	 * and put it onto the xmit queue.
@@ -1960,23 +2111,9 @@ static void tcp_queue(struct sk_buff * skb, struct sock * sk, struct tcphdr *th)
 
 
 		/*
-		 * Delay the ack if possible.  Send ack's to
-		 * fin frames immediately as there shouldn't be
-		 * anything more to come.
+		 * Delay the ack if the policy allows.
 		 */
-		if (!sk->delay_acks || th->fin) {
-			tcp_send_ack(sk);
-		} else {
-			/*
-			 * If psh is set we assume it's an
-			 * interactive session that wants quick
-			 * acks to avoid nagling too much. 
-			 */
-			int delay = HZ/2;
-			if (th->psh)
-				delay = HZ/50;
-			tcp_send_delayed_ack(sk, delay, sk->ato);
-		}
+		tcp_ack_data(sk, skb, th);
 
 		/*
 		 *	Tell the user we have some more data.
@@ -2009,6 +2146,12 @@ static void tcp_queue(struct sk_buff * skb, struct sock * sk, struct tcphdr *th)
 	    {
 		    if(sk->debug)
 			    printk("Ack past end of seq packet.\n");
+		    sk->sack_recent = skb->seq;
+		    /*
+		     * Something was lost: ack the next segments
+		     * at once until the sender has recovered.
+		     */
+		    sk->ack_quick = sysctl_tcp_quickack_segs;
 		    tcp_send_ack(sk);
 		    /*
 		     * We need to be very careful here. We must
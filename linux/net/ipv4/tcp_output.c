@@ -43,6 +43,7 @@
 #include <linux/ip_fw.h>
 #include <linux/firewall.h>
 #include <linux/interrupt.h>
+#include <asm/unaligned.h>
 #ifdef CONFIG_RST_COOKIES
 #include <linux/random.h>
 #endif
@@ -112,6 +113,7 @@ static __inline__ void clear_delayed_acks(struct sock * sk)
 {
 	sk->ack_timed = 0;
 	sk->ack_backlog = 0;
+	sk->ack_segs = 0;
 	sk->bytes_rcv = 0;
 	del_timer(&sk->delack_timer);
 }
@@ -415,9 +417,64 @@ void tcp_write_xmit(struct sock *sk)
 }
 
 
+/*
+ *	Drop scoreboard marks from every segment on the retransmit queue.
+ */
+
+void tcp_sack_clear(struct sock *sk, int mask)
+{
+	struct sk_buff *skb;
+
+	for (skb = sk->send_head; skb != NULL; skb = skb->link3)
+		skb->sacked &= ~mask;
+}
+
+/*
+ *	Pick the segment a single retransmit should resend. Without SACK
+ *	that is always the head of the queue. With SACK it is the head
+ *	unless the peer holds it or we already resent it in this
+ *	recovery, else the first such segment that has SACKed data
+ *	above it: a hole the peer is known to be missing. Segments past
+ *	the highest SACKed one may simply still be in flight.
+ *
+ *	Returns NULL only for an empty queue: a NULL send_next would stop
+ *	retransmission in the middle of recovery. With no known hole we
+ *	fall back to the first segment the peer does not hold, preferring
+ *	one not resent yet, and to the head if the peer holds them all.
+ */
+
+static struct sk_buff * tcp_sack_next_hole(struct sock *sk)
+{
+	struct sk_buff *skb = sk->send_head;
+	struct sk_buff *hole = NULL, *first = NULL;
+
+	if (!sk->sack_ok || skb == NULL || !skb->sacked)
+		return skb;
+
+	for (; skb != NULL; skb = skb->link3)
+	{
+		if (skb->sacked & TCPCB_SACKED_ACKED)
+		{
+			if (hole)
+				return hole;
+			continue;
+		}
+		if (!first && skb != sk->send_head)
+			first = skb;
+		if (!(skb->sacked & TCPCB_SACKED_RETRANS) && !hole)
+			hole = skb;
+	}
+	if (hole)
+		return hole;
+	return first ? first : sk->send_head;
+}
+
 /*
  *	A socket has timed out on its send queue and wants to do a
  *	little retransmitting. Currently this means TCP.
+ *
+ *	Segments the peer has selectively acknowledged are stepped over;
+ *	the head of the queue is always resent in case the peer reneged.
  */
 
 void tcp_do_retransmit(struct sock *sk, int all)
@@ -431,9 +488,10 @@ void tcp_do_retransmit(struct sock *sk, int all)
 	if (!all) {
 		/*
 		 * If we are just retransmitting one packet reset
-		 * to the start of the queue.
+		 * to the start of the queue, or to the first hole
+		 * in the SACK scoreboard.
 		 */
-		sk->send_next = sk->send_head;
+		sk->send_next = tcp_sack_next_hole(sk);
 		sk->packets_out = 0;
 	}
 	skb = sk->send_next;
@@ -445,6 +503,14 @@ void tcp_do_retransmit(struct sock *sk, int all)
 		int size;
 		unsigned long flags;
 
+		if ((skb->sacked & TCPCB_SACKED_ACKED) && skb != sk->send_head)
+		{
+			tcp_sack_statistics.TcpSackSkipped++;
+			sk->send_next = skb->link3;
+			skb = skb->link3;
+			continue;
+		}
+
 		dev = skb->dev;
 		IS_SKB(skb);
 		skb->when = jiffies;
@@ -670,6 +736,7 @@ void tcp_do_retransmit(struct sock *sk, int all)
 		 
 		sk->prot->retransmits++;
 		tcp_statistics.TcpRetransSegs++;
+		skb->sacked |= TCPCB_SACKED_RETRANS;
 
 		/*
 		 * Record the high sequence number to help avoid doing
@@ -964,6 +1031,7 @@ void tcp_send_synack(struct sock * newsk, struct sock * sk, struct sk_buff * skb
 	struct sk_buff * buff;
 	struct device *ndev=newsk->bound_device;
 	int tmp;
+	int optlen;
 
 	buff = sock_wmalloc(newsk, MAX_SYN_SIZE, 1, GFP_ATOMIC);
 	if (buff == NULL) 
@@ -1020,15 +1088,23 @@ void tcp_send_synack(struct sock * newsk, struct sock * sk, struct sk_buff * skb
 	t1->rst = 0;
 	t1->psh = 0;
 	t1->ack_seq = htonl(newsk->acked_seq);
-	t1->doff = sizeof(*t1)/4+1;
+	optlen = newsk->sack_ok ? 8 : 4;
+	t1->doff = (sizeof(*t1)+optlen)/4;
 	t1->res1 = 0;
 	t1->res2 = 0;
-	ptr = skb_put(buff,4);
+	ptr = skb_put(buff,optlen);
 	ptr[0] = 2;
 	ptr[1] = 4;
 	ptr[2] = ((newsk->mtu) >> 8) & 0xff;
 	ptr[3] =(newsk->mtu) & 0xff;
-	buff->csum = csum_partial(ptr, 4, 0);
+	if (newsk->sack_ok)
+	{
+		ptr[4] = TCPOPT_NOP;
+		ptr[5] = TCPOPT_NOP;
+		ptr[6] = TCPOPT_SACK_PERM;
+		ptr[7] = TCPOLEN_SACK_PERM;
+	}
+	buff->csum = csum_partial(ptr, optlen, 0);
 #ifdef CONFIG_SYN_COOKIES
 	/* Don't save buff on the newsk chain if we are going to destroy
 	 * newsk anyway in a second, it just delays getting rid of newsk.
@@ -1043,7 +1119,7 @@ void tcp_send_synack(struct sock * newsk, struct sock * sk, struct sk_buff * skb
 		atomic_sub(buff->truesize, &newsk->wmem_alloc);
 	}
 #endif
-	tcp_send_check(t1, newsk->saddr, newsk->daddr, sizeof(*t1)+4, buff);
+	tcp_send_check(t1, newsk->saddr, newsk->daddr, sizeof(*t1)+optlen, buff);
 	if (destroy)
 		newsk->prot->queue_xmit(NULL, ndev, buff, 1);
 	else
@@ -1082,7 +1158,8 @@ void tcp_send_synack(struct sock * newsk, struct sock * sk, struct sk_buff * skb
  *
  *      rules for delaying an ack:
  *      - delay time <= 0.5 HZ
- *      - must send at least every 2 full sized packets
+ *      - must send at least every tcp_ack_segs full sized packets
+ *        (RFC1122's 2 by default, see below)
  *      - we don't have a window update to send
  *
  * 	additional thoughts:
@@ -1099,7 +1176,7 @@ void tcp_send_delayed_ack(struct sock * sk, int max_timeout, unsigned long timeo
 	/* Calculate new timeout */
 	if (timeout > max_timeout)
 		timeout = max_timeout;
-	if (sk->bytes_rcv >= sk->max_unacked)
+	if (sk->bytes_rcv >= (unsigned long) sysctl_tcp_ack_segs * sk->mss)
 		timeout = 0;
 	timeout += jiffies;
 
@@ -1111,7 +1188,157 @@ void tcp_send_delayed_ack(struct sock * sk, int max_timeout, unsigned long timeo
 	add_timer(&sk->delack_timer);
 }
 
+/*
+ *	ACK policy for received data, tunable through /proc/sys/net/ipv4:
+ *
+ *	tcp_ack_segs		ACK at once every this many full sized
+ *				segments (RFC1122 says at least every 2)
+ *	tcp_quickack_segs	after we saw a hole in the sequence space,
+ *				ACK this many segments at once so the
+ *				sender's recovery is clocked quickly
+ */
+
+int sysctl_tcp_ack_segs = 2;
+int sysctl_tcp_quickack_segs = 8;
 
+struct tcp_ack_mib tcp_ack_statistics;
+
+/*
+ *	An ACK is owed and should go out now. If the window lets us send
+ *	data that is waiting on the write queue, that carries the ACK for
+ *	free; otherwise send a pure ACK.
+ */
+
+void tcp_send_pending_ack(struct sock *sk)
+{
+	if (sk->ack_backlog && !skb_queue_empty(&sk->write_queue))
+	{
+		tcp_write_xmit(sk);
+		if (!sk->ack_backlog)
+		{
+			tcp_ack_statistics.TcpAckPiggybacked++;
+			return;
+		}
+	}
+	tcp_send_ack(sk);
+}
+
+/*
+ *	Acknowledge new in-order data that has just been queued.
+ *	Send ack's to fin frames immediately as there shouldn't be
+ *	anything more to come. Otherwise follow the policy above,
+ *	and failing that delay the ack; if psh is set we assume it's
+ *	an interactive session that wants quick acks to avoid nagling
+ *	too much.
+ */
+
+void tcp_ack_data(struct sock *sk, struct sk_buff *skb, struct tcphdr *th)
+{
+	int delay;
+
+	tcp_ack_statistics.TcpAckDataSegsIn++;
+	if (skb->len >= sk->mss)
+		sk->ack_segs++;
+
+	if (!sk->delay_acks || th->fin)
+		goto ack_now;
+
+	if (sk->ack_quick)
+	{
+		sk->ack_quick--;
+		tcp_ack_statistics.TcpAckQuick++;
+		goto ack_now;
+	}
+
+	if (sk->ack_segs >= sysctl_tcp_ack_segs)
+		goto ack_now;
+
+	delay = HZ/2;
+	if (th->psh)
+		delay = HZ/50;
+	tcp_send_delayed_ack(sk, delay, sk->ato);
+	return;
+
+ack_now:
+	sk->ack_backlog++;
+	tcp_send_pending_ack(sk);
+}
+
+
+
+/*
+ *	Describe the out of order data sitting in the receive queue as
+ *	SACK blocks (RFC2018). The block holding the most recently
+ *	received segment goes first, the rest follow in sequence order.
+ *	Returns the option length appended to the buffer.
+ */
+
+static int tcp_build_sack(struct sock *sk, struct sk_buff *buff)
+{
+	struct sk_buff_head *list = &sk->receive_queue;
+	struct sk_buff *skb;
+	__u32 start[TCP_MAX_SACKS], end[TCP_MAX_SACKS];
+	unsigned char *ptr;
+	unsigned long flags;
+	int n = 0, first = 0, i;
+
+	save_flags(flags);
+	cli();
+	skb = list->next;
+	while (skb != (struct sk_buff *) list)
+	{
+		__u32 s, e;
+		int idx;
+
+		if (skb->acked || !after(skb->seq, sk->acked_seq))
+		{
+			skb = skb->next;
+			continue;
+		}
+
+		/* Merge the run of adjacent segments into one block */
+		s = skb->seq;
+		e = skb->end_seq;
+		for (skb = skb->next; skb != (struct sk_buff *) list; skb = skb->next)
+		{
+			if (after(skb->seq, e))
+				break;
+			if (after(skb->end_seq, e))
+				e = skb->end_seq;
+		}
+
+		if (n < TCP_MAX_SACKS)
+			idx = n++;
+		else if (!before(sk->sack_recent, s) && before(sk->sack_recent, e))
+			idx = n-1;
+		else
+			continue;
+		start[idx] = s;
+		end[idx] = e;
+		if (!before(sk->sack_recent, s) && before(sk->sack_recent, e))
+			first = idx;
+	}
+	restore_flags(flags);
+
+	if (!n)
+		return 0;
+
+	ptr = skb_put(buff, 4 + n*TCPOLEN_SACK_PERBLOCK);
+	ptr[0] = TCPOPT_NOP;
+	ptr[1] = TCPOPT_NOP;
+	ptr[2] = TCPOPT_SACK;
+	ptr[3] = TCPOLEN_SACK_BASE + n*TCPOLEN_SACK_PERBLOCK;
+	ptr += 4;
+	for (i = 0; i < n; i++)
+	{
+		int idx = (i == 0) ? first : (i <= first ? i-1 : i);
+
+		put_unaligned(htonl(start[idx]), (__u32 *) ptr);
+		put_unaligned(htonl(end[idx]), (__u32 *) (ptr+4));
+		ptr += TCPOLEN_SACK_PERBLOCK;
+	}
+	return 4 + n*TCPOLEN_SACK_PERBLOCK;
+}
 
 /*
  *	This routine sends an ack and also updates the window. 
@@ -1123,6 +1350,7 @@ void tcp_send_ack(struct sock *sk)
 	struct tcphdr *t1;
 	struct device *dev = sk->bound_device;
 	int tmp;
+	int optlen = 0;
 
 	if(sk->zapped)
 		return;		/* We have been reset, we may not send again */
@@ -1200,11 +1428,26 @@ void tcp_send_ack(struct sock *sk)
   	t1->ack_seq = htonl(sk->acked_seq);
 	t1->window  = htons(tcp_select_window(sk));
 
-  	tcp_send_check(t1, sk->saddr, sk->daddr, sizeof(*t1), buff);
+	/*
+	 *	Tell a SACK capable peer about any holes we have.
+	 */
+
+	if (sk->sack_ok)
+	{
+		optlen = tcp_build_sack(sk, buff);
+		if (optlen)
+		{
+			t1->doff = (sizeof(*t1)+optlen)/4;
+			buff->csum = csum_partial((char *)(t1+1), optlen, 0);
+		}
+	}
+
+  	tcp_send_check(t1, sk->saddr, sk->daddr, sizeof(*t1)+optlen, buff);
   	if (sk->debug)
   		 printk(KERN_ERR "\rtcp_ack: seq %x ack %x\n", sk->sent_seq, sk->acked_seq);
   	sk->prot->queue_xmit(sk, dev, buff, 1);
   	tcp_statistics.TcpOutSegs++;
+	tcp_ack_statistics.TcpAckOut++;
 }
 
 /*
@@ -28,7 +28,17 @@
 
 void tcp_delack_timer(unsigned long data)
 {
-	tcp_send_ack((struct sock *) data);
+	struct sock *sk = (struct sock *) data;
+
+	tcp_ack_statistics.TcpAckDelayed++;
+
+	/*
+	 *	Don't go through the write queue under the user's feet.
+	 */
+	if (sk->users)
+		tcp_send_ack(sk);
+	else
+		tcp_send_pending_ack(sk);
 }
 
 /*
@@ -90,6 +100,19 @@ static void tcp_retransmit_time(struct sock *sk, int all)
 	 */
 	sk->retransmits++;
 
+	/*
+	 * A timeout ends any fast recovery in progress. Whatever we
+	 * resent during it may be lost again, and if the peer SACKed
+	 * data yet keeps timing us out it has probably thrown that
+	 * data away, so stop trusting the scoreboard.
+	 */
+	sk->rcv_ack_cnt = 1;
+	if (sk->retransmits > 1 && sk->sack_ok) {
+		tcp_sack_clear(sk, TCPCB_SACKED_ACKED|TCPCB_SACKED_RETRANS);
+		tcp_sack_statistics.TcpSackRenege++;
+	} else
+		tcp_sack_clear(sk, TCPCB_SACKED_RETRANS);
+
 	tcp_do_retransmit(sk, all);
 
 	/*
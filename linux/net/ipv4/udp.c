@@ -123,6 +123,69 @@
 struct udp_mib		udp_statistics;
 
 struct sock *udp_hash[UDP_HTABLE_SIZE];
+struct sock *udp_conn_hash[UDP_CHTABLE_SIZE];
+
+/*
+ *	One entry last-hit cache per udp_hash chain, so back to back
+ *	datagrams for the same wildcard socket skip the scoring loop.
+ *	Any change to the chain clears it.
+ */
+
+struct udp_lookup_cache {
+	struct sock	*sk;
+	struct device	*dev;
+	u32		saddr, daddr;
+	u16		sport, dport;
+};
+
+static struct udp_lookup_cache udp_lookup_cache[UDP_HTABLE_SIZE];
+
+static __inline__ void udp_cache_clear(int hashent)
+{
+	udp_lookup_cache[hashent].sk = NULL;
+}
+
+/* A socket changed in a way the hash functions do not see
+ * (SO_BINDTODEVICE), so forget every cached lookup.
+ */
+void udp_cache_flush(void)
+{
+	int i;
+
+	SOCKHASH_LOCK();
+	for (i = 0; i < UDP_HTABLE_SIZE; i++)
+		udp_cache_clear(i);
+	SOCKHASH_UNLOCK();
+}
+
+/* Only those holding the sockhash lock call these.  UDP has no
+ * bound hash, so the connected hash borrows the bind links just
+ * like TCP borrows sk->prev.
+ */
+static __inline__ void udp_sk_connify(struct sock *sk)
+{
+	struct sock **htable;
+
+	if (!sk->rcv_saddr || !sk->daddr || !sk->dummy_th.dest)
+		return;
+	htable = &udp_conn_hash[udp_conn_hashfn(sk->rcv_saddr, sk->num,
+						 sk->daddr, sk->dummy_th.dest)];
+	if((sk->bind_next = *htable) != NULL)
+		(*htable)->bind_pprev = &sk->bind_next;
+	*htable = sk;
+	sk->bind_pprev = htable;
+}
+
+static __inline__ void udp_sk_unconnify(struct sock *sk)
+{
+	if (!sk->bind_pprev)
+		return;
+	if(sk->bind_next)
+		sk->bind_next->bind_pprev = sk->bind_pprev;
+	*(sk->bind_pprev) = sk->bind_next;
+	sk->bind_next = NULL;
+	sk->bind_pprev = NULL;
+}
 
 static int udp_v4_verify_bind(struct sock *sk, unsigned short snum)
 {
@@ -222,6 +285,8 @@ static void udp_v4_hash(struct sock *sk)
 	sk->next = *skp;
 	*skp = sk;
 	sk->hashent = num;
+	udp_sk_connify(sk);
+	udp_cache_clear(num);
 	SOCKHASH_UNLOCK();
 }
 
@@ -241,6 +306,8 @@ static void udp_v4_unhash(struct sock *sk)
 		}
 		skp = &((*skp)->next);
 	}
+	udp_sk_unconnify(sk);
+	udp_cache_clear(num);
 	SOCKHASH_UNLOCK();
 }
 
@@ -264,20 +331,55 @@ static void udp_v4_rehash(struct sock *sk)
 	sk->next = udp_hash[num];
 	udp_hash[num] = sk;
 	sk->hashent = num;
+	udp_sk_unconnify(sk);
+	udp_sk_connify(sk);
+	udp_cache_clear(oldnum);
+	udp_cache_clear(num);
 	SOCKHASH_UNLOCK();
 }
 
 /* UDP is nearly always wildcards out the wazoo, it makes no sense to try
  * harder than this. -DaveM
+ *
+ * Connected sockets are tried first, they beat any wildcard match.
+ * Failing that the port chain is scored, skipping the connected
+ * sockets on it, unless the chain's last hit matches.
  */
 __inline__ struct sock *udp_v4_lookup(u32 saddr, u16 sport, u32 daddr, u16 dport,
 				      struct device *dev)
 {
 	struct sock *sk, *result = NULL;
 	unsigned short hnum = ntohs(dport);
+	struct udp_lookup_cache *uc;
 	int badness = -1;
 
+	sk = udp_conn_hash[udp_conn_hashfn(daddr, hnum, saddr, sport)];
+	for(; sk != NULL; sk = sk->bind_next) {
+		if((sk->num == hnum) && (sk->rcv_saddr == daddr) &&
+		   (sk->daddr == saddr) && (sk->dummy_th.dest == sport) &&
+		   !(sk->dead && (sk->state == TCP_CLOSE))) {
+			if (sk->bound_device) {
+				if (dev == sk->bound_device)
+					return sk;
+				continue;
+			}
+			if (!result)
+				result = sk;
+		}
+	}
+	if (result)
+		return result;
+
+	uc = &udp_lookup_cache[hnum & (UDP_HTABLE_SIZE - 1)];
+	sk = uc->sk;
+	if(sk && uc->dport == dport && uc->sport == sport &&
+	   uc->saddr == saddr && uc->daddr == daddr && uc->dev == dev &&
+	   !(sk->dead && (sk->state == TCP_CLOSE)))
+		return sk;
+
 	for(sk = udp_hash[hnum & (UDP_HTABLE_SIZE - 1)]; sk != NULL; sk = sk->next) {
+		if(sk->bind_pprev)
+			continue;	/* connected, tried above */
 		if((sk->num == hnum) && !(sk->dead && (sk->state == TCP_CLOSE))) {
 			int score = 0;
 			if(sk->rcv_saddr) {
@@ -312,6 +414,14 @@ __inline__ struct sock *udp_v4_lookup(u32 saddr, u16 sport, u32 daddr, u16 dport
 			}
 		}
 	}
+	if (result) {
+		uc->sk = result;
+		uc->dev = dev;
+		uc->saddr = saddr;
+		uc->sport = sport;
+		uc->daddr = daddr;
+		uc->dport = dport;
+	}
 	return result;
 }
 
@@ -878,6 +988,7 @@ int udp_connect(struct sock *sk, struct sockaddr_in *usin, int addr_len)
 	if (sk->ip_route_cache)
 	        ip_rt_put(sk->ip_route_cache);
 	sk->ip_route_cache = rt;
+	sk->prot->rehash(sk);		/* onto the connected hash */
 	return(0);
 }
 